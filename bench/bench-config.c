@@ -0,0 +1,244 @@
+/**
+ * @file bench-config.c
+ * @copyright Violin Memory, Inc, 2014
+ *
+ * @brief Benchmark of the config parser on large generated config files.
+ *
+ * Writes a config of LINES lines, 50000 by default, of the kinds a big
+ * generated config has: entries with and without wildcards on root buses
+ * and mux channels of a synthetic sysfs tree, comments, blank lines,
+ * trailing comments and malformed lines. Then it times i2cdev_init() with
+ * it, matching and discovery included, against i2cdev_init() without a
+ * config.
+ *
+ * usage: bench-config [LINES [RUNS]]
+ */
+
+#define _GNU_SOURCE 1
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <libi2cdev.h>
+
+#include "data.h"
+#include "fakesys.h"
+
+#define BENCH_ROOTS     8
+#define BENCH_LEVELS    2
+#define BENCH_CHANNELS  4
+
+static const char *const bench_chips[] = {
+    "at24", "lm75", "tmp102", "ina219", "pca9541", "pca9547", "*",
+};
+
+static const char *const bench_indent[] = { "", "", "  ", "\t" };
+
+static const char *const bench_trailer[] = { "", "", " # c", "\t trailing", "#x" };
+
+static uint32_t bench_seed = 1;
+
+/* the same config on every run and every machine */
+static uint32_t bench_rand(uint32_t n)
+{
+    bench_seed = bench_seed * 1103515245 + 12345;
+    return ((bench_seed >> 16) & 0x7fff) % n;
+}
+
+#define bench_pick(array) ((array)[bench_rand(sizeof(array) / sizeof((array)[0]))])
+
+static void bench_bus(char *bus, size_t size)
+{
+    int root = (int) bench_rand(BENCH_ROOTS);
+
+    switch (bench_rand(8)) {
+    case 0:
+        snprintf(bus, size, "*");
+        break;
+    case 1:
+        snprintf(bus, size, "x1"); /* no such bus */
+        break;
+    case 2:
+    case 3:
+        snprintf(bus, size, "%d", root);
+        break;
+    case 4:
+    case 5:
+        snprintf(bus, size, "%d:0.%d", root, (int) bench_rand(BENCH_CHANNELS));
+        break;
+    default:
+        snprintf(bus, size, "%d:0.%d:1.%d", root, (int) bench_rand(BENCH_CHANNELS),
+                (int) bench_rand(BENCH_CHANNELS));
+        break;
+    }
+}
+
+static void bench_addr(char *addr, size_t size)
+{
+    switch (bench_rand(8)) {
+    case 0:
+        snprintf(addr, size, "*");
+        break;
+    case 1:
+        addr[0] = '\0'; /* missing */
+        break;
+    case 2:
+        snprintf(addr, size, "0x50junk");
+        break;
+    default:
+        snprintf(addr, size, "0x%02x", 0x03 + bench_rand(0x75));
+        break;
+    }
+}
+
+static int bench_write_config(FILE *file, int lines)
+{
+    int entries = 0;
+
+    for (int i = 0; i < lines; ++i) {
+        char bus[32];
+        char addr[16];
+
+        switch (bench_rand(20)) {
+        case 0:
+            fprintf(file, "# comment line %d\n", i + 1);
+            continue;
+        case 1:
+            fprintf(file, "\n");
+            continue;
+        case 2:
+            fprintf(file, "%s\n", bench_rand(2) ? "x-i2c" : "bogus");
+            continue;
+        default:
+            break;
+        }
+        bench_bus(bus, sizeof(bus));
+        bench_addr(addr, sizeof(addr));
+        fprintf(file, "%s%s-i2c-%s-%s%s\n", bench_pick(bench_indent), bench_pick(bench_chips),
+                bus, addr, bench_pick(bench_trailer));
+        entries++;
+    }
+    return (fflush(file) == 0) ? entries : -errno;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * Time i2cdev_init() runs times
+ * @param config path of the config, NULL for none
+ * @param runs
+ * @param ns one time per run, sorted
+ * @param entries config entries loaded
+ * @return negative errno on failure else zero
+ */
+static int bench_init(const char *config, int runs, uint64_t *ns, int *entries)
+{
+    for (int i = 0; i < runs; ++i) {
+        const dev_config_chip *chip = NULL;
+        FILE *file = NULL;
+        uint64_t start = 0;
+        int err = 0;
+
+        if (config != NULL) {
+            file = fopen(config, "r");
+            if (file == NULL) {
+                return -errno;
+            }
+        }
+        start = bench_clock();
+        err = i2cdev_init(file);
+        ns[i] = bench_clock() - start;
+        if (file != NULL) {
+            fclose(file);
+        }
+        if (err != 0) {
+            return (err < 0) ? err : -EINVAL;
+        }
+        *entries = 0;
+        SLIST_FOREACH(chip, p_dev_config_list_head, node) {
+            (*entries)++;
+        }
+        i2cdev_cleanup();
+    }
+    qsort(ns, runs, sizeof(*ns), compare_u64);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    char config[] = "/tmp/libi2cdev-bench-XXXXXX.cfg";
+    int lines = (argc > 1) ? atoi(argv[1]) : 50000;
+    int runs = (argc > 2) ? atoi(argv[2]) : 5;
+    uint64_t *with_ns = NULL;
+    uint64_t *without_ns = NULL;
+    FILE *file = NULL;
+    int written = 0;
+    int entries = 0;
+    int adapters = 0;
+    int fd = -1;
+    int err = 0;
+
+    if ((lines < 0) || (runs < 1)) {
+        fprintf(stderr, "usage: %s [LINES [RUNS]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    with_ns = calloc(runs, sizeof(*with_ns));
+    without_ns = calloc(runs, sizeof(*without_ns));
+    if ((with_ns == NULL) || (without_ns == NULL)) {
+        return EXIT_FAILURE;
+    }
+
+    adapters = bench_fakesys_create(BENCH_SYSFS, BENCH_ROOTS, BENCH_LEVELS, BENCH_CHANNELS, 2);
+    if (adapters < 0) {
+        fprintf(stderr, "Failed to build %s: %s\n", BENCH_SYSFS, strerror(-adapters));
+        return EXIT_FAILURE;
+    }
+    fd = mkstemps(config, 4);
+    file = (fd >= 0) ? fdopen(fd, "w") : NULL;
+    if (file == NULL) {
+        fprintf(stderr, "Failed to create %s: %s\n", config, strerror(errno));
+        bench_fakesys_remove(BENCH_SYSFS);
+        return EXIT_FAILURE;
+    }
+    written = bench_write_config(file, lines);
+    fclose(file);
+    if (written < 0) {
+        fprintf(stderr, "Failed to write %s: %s\n", config, strerror(-written));
+        err = written;
+        goto exit_remove;
+    }
+    printf("%d lines, %d entries written to %s, %d adapters in %s\n", lines, written, config,
+            adapters, BENCH_SYSFS);
+
+    i2cdev_set_snapshot_file(NULL);
+    err = bench_init(NULL, runs, without_ns, &entries);
+    if (err == 0) {
+        err = bench_init(config, runs, with_ns, &entries);
+    }
+    if (err < 0) {
+        fprintf(stderr, "i2cdev_init() failed: %s\n", strerror(-err));
+        goto exit_remove;
+    }
+    printf("%d entries loaded\n", entries);
+    printf("init without config  min %8.2f ms  median %8.2f ms\n",
+            without_ns[0] / 1e6, without_ns[runs / 2] / 1e6);
+    printf("init with config     min %8.2f ms  median %8.2f ms\n",
+            with_ns[0] / 1e6, with_ns[runs / 2] / 1e6);
+
+exit_remove:
+    unlink(config);
+    bench_fakesys_remove(BENCH_SYSFS);
+    free(with_ns);
+    free(without_ns);
+    return (err < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
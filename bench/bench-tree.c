@@ -0,0 +1,98 @@
+/**
+ * @file bench-tree.c
+ * @copyright Violin Memory, Inc, 2014
+ *
+ * @brief Benchmark of the bus scan and tree build on large synthetic trees.
+ *
+ * Builds a sysfs tree of ROOTS controllers with LEVELS levels of muxes of
+ * CHANNELS channels below each, 10 x (1 + 31 + 31^2) = 9930 adapters by
+ * default, and times i2cdev_init() without a topology snapshot, then
+ * i2cdev_rescan() with nothing changed.
+ *
+ * usage: bench-tree [ROOTS [LEVELS [CHANNELS [RUNS]]]]
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libi2cdev.h>
+
+#include "fakesys.h"
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+static void print_times(const char *what, uint64_t *ns, int runs)
+{
+    qsort(ns, runs, sizeof(*ns), compare_u64);
+    printf("%-8s min %8.2f ms  median %8.2f ms  max %8.2f ms\n", what,
+            ns[0] / 1e6, ns[runs / 2] / 1e6, ns[runs - 1] / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+    int roots = (argc > 1) ? atoi(argv[1]) : 10;
+    int levels = (argc > 2) ? atoi(argv[2]) : 2;
+    int channels = (argc > 3) ? atoi(argv[3]) : 31;
+    int runs = (argc > 4) ? atoi(argv[4]) : 5;
+    uint64_t *init_ns = NULL;
+    uint64_t *rescan_ns = NULL;
+    uint64_t start = 0;
+    int adapters = 0;
+    int err = 0;
+
+    if ((roots < 1) || (levels < 0) || (channels < 1) || (runs < 1)) {
+        fprintf(stderr, "usage: %s [ROOTS [LEVELS [CHANNELS [RUNS]]]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    init_ns = calloc(runs, sizeof(*init_ns));
+    rescan_ns = calloc(runs, sizeof(*rescan_ns));
+    if ((init_ns == NULL) || (rescan_ns == NULL)) {
+        return EXIT_FAILURE;
+    }
+
+    start = bench_clock();
+    adapters = bench_fakesys_create(BENCH_SYSFS, roots, levels, channels, 2);
+    if (adapters < 0) {
+        fprintf(stderr, "Failed to build %s: %s\n", BENCH_SYSFS, strerror(-adapters));
+        return EXIT_FAILURE;
+    }
+    printf("%d adapters in %s, built in %.0f ms\n", adapters, BENCH_SYSFS,
+            (bench_clock() - start) / 1e6);
+
+    i2cdev_set_snapshot_file(NULL);
+    for (int i = 0; i < runs; ++i) {
+        start = bench_clock();
+        err = i2cdev_init(NULL);
+        init_ns[i] = bench_clock() - start;
+        if (err != 0) {
+            fprintf(stderr, "i2cdev_init() failed: %d\n", err);
+            break;
+        }
+        start = bench_clock();
+        err = i2cdev_rescan();
+        rescan_ns[i] = bench_clock() - start;
+        i2cdev_cleanup();
+        if (err < 0) {
+            fprintf(stderr, "i2cdev_rescan() failed: %s\n", strerror(-err));
+            break;
+        }
+    }
+    bench_fakesys_remove(BENCH_SYSFS);
+    if (err < 0) {
+        return EXIT_FAILURE;
+    }
+
+    print_times("init", init_ns, runs);
+    print_times("rescan", rescan_ns, runs);
+    free(init_ns);
+    free(rescan_ns);
+    return EXIT_SUCCESS;
+}
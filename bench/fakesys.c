@@ -0,0 +1,252 @@
+/**
+ * @file fakesys.c
+ * @copyright Violin Memory, Inc, 2014
+ *
+ * @brief Synthetic sysfs i2c trees for the benchmarks.
+ *
+ * The tree has what the bus scan reads and nothing more: the adapters
+ * under devices/platform linked from bus/i2c/devices, their name and
+ * subsystem, and their clients with a name and a driver linked to its
+ * module. Mux channels are named the way i2c-mux names them.
+ */
+
+#define _GNU_SOURCE 1
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "fakesys.h"
+
+static const char *const fakesys_drivers[] = { "at24", "lm75", "pca954x" };
+
+/* the tree being built */
+static struct {
+    const char *root;
+    int channels;
+    int chips;
+    int next_nr;
+} fakesys;
+
+static int fakesys_mkdir(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static int fakesys_mkdir(const char *fmt, ...)
+{
+    char path[PATH_MAX];
+    va_list ap;
+    int len = 0;
+
+    va_start(ap, fmt);
+    len = vsnprintf(path, sizeof(path), fmt, ap);
+    va_end(ap);
+    if (len >= (int) sizeof(path)) {
+        return -ENAMETOOLONG;
+    }
+    if ((mkdir(path, 0755) < 0) && (errno != EEXIST)) {
+        return -errno;
+    }
+    return 0;
+}
+
+static int fakesys_write(const char *dir, const char *attr, const char *value)
+{
+    char path[PATH_MAX];
+    int fd = -1;
+    ssize_t len = 0;
+
+    if (snprintf(path, sizeof(path), "%s/%s", dir, attr) >= (int) sizeof(path)) {
+        return -ENAMETOOLONG;
+    }
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return -errno;
+    }
+    len = (value != NULL) ? write(fd, value, strlen(value)) : 0;
+    close(fd);
+    return (len < 0) ? -EIO : 0;
+}
+
+static int fakesys_link(const char *target, const char *dir, const char *name)
+{
+    char path[PATH_MAX];
+
+    if (snprintf(path, sizeof(path), "%s/%s", dir, name) >= (int) sizeof(path)) {
+        return -ENAMETOOLONG;
+    }
+    return (symlink(target, path) < 0) ? -errno : 0;
+}
+
+static int fakesys_client(const char *adir, int nr, int addr, const char *driver)
+{
+    char dir[PATH_MAX];
+    char target[PATH_MAX];
+    char name[32];
+    int err = 0;
+
+    snprintf(dir, sizeof(dir), "%s/%d-%04x", adir, nr, addr);
+    err = fakesys_mkdir("%s", dir);
+    if (err < 0) {
+        return err;
+    }
+    snprintf(name, sizeof(name), "%s\n", driver);
+    err = fakesys_write(dir, "name", name);
+    if (err < 0) {
+        return err;
+    }
+    snprintf(target, sizeof(target), "%s/bus/i2c/drivers/%s", fakesys.root, driver);
+    err = fakesys_link(target, dir, "driver");
+    if (err < 0) {
+        return err;
+    }
+    snprintf(target, sizeof(target), "%s/bus/i2c", fakesys.root);
+    return fakesys_link(target, dir, "subsystem");
+}
+
+/**
+ * Make an adapter and everything below it
+ * @param parent directory to make it in
+ * @param parent_nr number of the adapter the mux is on, -1 for a controller
+ * @param chan mux channel
+ * @param levels mux levels still to make below it
+ * @return negative errno on failure else zero
+ */
+static int fakesys_adapter(const char *parent, int parent_nr, int chan, int levels)
+{
+    char dir[PATH_MAX];
+    char target[PATH_MAX];
+    char link[PATH_MAX];
+    char name[64];
+    int nr = fakesys.next_nr++;
+    int err = 0;
+
+    snprintf(dir, sizeof(dir), "%s/i2c-%d", parent, nr);
+    err = fakesys_mkdir("%s", dir);
+    if (err < 0) {
+        return err;
+    }
+    if (parent_nr < 0) {
+        snprintf(name, sizeof(name), "SMBus adapter %d\n", nr);
+    } else {
+        snprintf(name, sizeof(name), "i2c-%d-mux (chan_id %d)\n", parent_nr, chan);
+    }
+    err = fakesys_write(dir, "name", name);
+    if (!err) {
+        err = fakesys_write(dir, "new_device", NULL);
+    }
+    if (!err) {
+        err = fakesys_write(dir, "delete_device", NULL);
+    }
+    if (!err) {
+        snprintf(target, sizeof(target), "%s/bus/i2c", fakesys.root);
+        err = fakesys_link(target, dir, "subsystem");
+    }
+    if (!err) {
+        snprintf(link, sizeof(link), "%s/bus/i2c/devices", fakesys.root);
+        snprintf(name, sizeof(name), "i2c-%d", nr);
+        err = fakesys_link(dir, link, name);
+    }
+
+    for (int i = 0; (i < fakesys.chips) && !err; ++i) {
+        err = fakesys_client(dir, nr, 0x50 + i, fakesys_drivers[i % 2]);
+    }
+    if (err || (levels == 0)) {
+        return err;
+    }
+    err = fakesys_client(dir, nr, 0x70, "pca954x");
+    for (int i = 0; (i < fakesys.channels) && !err; ++i) {
+        err = fakesys_adapter(dir, nr, i, levels - 1);
+    }
+    return err;
+}
+
+static int fakesys_unlink(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+    (void) st;
+    (void) ftw;
+
+    if (flag == FTW_DP) {
+        rmdir(path);
+    } else {
+        unlink(path);
+    }
+    return 0;
+}
+
+void bench_fakesys_remove(const char *root)
+{
+    nftw(root, fakesys_unlink, 64, FTW_DEPTH | FTW_PHYS);
+}
+
+int bench_fakesys_create(const char *root, int roots, int levels, int channels, int chips)
+{
+    char dir[PATH_MAX];
+    char target[PATH_MAX];
+    int err = 0;
+
+    bench_fakesys_remove(root);
+    fakesys.root = root;
+    fakesys.channels = channels;
+    fakesys.chips = chips;
+    fakesys.next_nr = 0;
+
+    err = fakesys_mkdir("%s", root);
+    if (!err) {
+        err = fakesys_mkdir("%s/bus", root);
+    }
+    if (!err) {
+        err = fakesys_mkdir("%s/bus/i2c", root);
+    }
+    if (!err) {
+        err = fakesys_mkdir("%s/bus/i2c/devices", root);
+    }
+    if (!err) {
+        err = fakesys_mkdir("%s/bus/i2c/drivers", root);
+    }
+    if (!err) {
+        err = fakesys_mkdir("%s/module", root);
+    }
+    if (!err) {
+        err = fakesys_mkdir("%s/devices", root);
+    }
+    if (!err) {
+        err = fakesys_mkdir("%s/devices/platform", root);
+    }
+    for (size_t i = 0; (i < sizeof(fakesys_drivers) / sizeof(fakesys_drivers[0])) && !err; ++i) {
+        err = fakesys_mkdir("%s/module/%s", root, fakesys_drivers[i]);
+        if (!err) {
+            err = fakesys_mkdir("%s/bus/i2c/drivers/%s", root, fakesys_drivers[i]);
+        }
+        if (!err) {
+            snprintf(dir, sizeof(dir), "%s/bus/i2c/drivers/%s", root, fakesys_drivers[i]);
+            snprintf(target, sizeof(target), "%s/module/%s", root, fakesys_drivers[i]);
+            err = fakesys_link(target, dir, "module");
+        }
+    }
+
+    for (int i = 0; (i < roots) && !err; ++i) {
+        snprintf(dir, sizeof(dir), "%s/devices/platform/ctrl%d", root, i);
+        err = fakesys_mkdir("%s", dir);
+        if (!err) {
+            err = fakesys_adapter(dir, -1, 0, levels);
+        }
+    }
+    return (err < 0) ? err : fakesys.next_nr;
+}
+
+uint64_t bench_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
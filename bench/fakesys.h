@@ -0,0 +1,45 @@
+/**
+ * @file fakesys.h
+ * @copyright Violin Memory, Inc, 2014
+ * @brief Synthetic sysfs i2c trees for the benchmarks
+ */
+
+#ifndef BENCH_FAKESYS_H
+#define BENCH_FAKESYS_H
+
+#include <stdint.h>
+
+/*
+ * Where the benchmarks build their sysfs tree. Their copy of sysfs.c is
+ * compiled with SYSFS_OVERRIDE_STRING set to the same path.
+ */
+#ifndef BENCH_SYSFS
+#define BENCH_SYSFS "/tmp/libi2cdev-bench-sysfs"
+#endif /* !BENCH_SYSFS */
+
+/**
+ * Build a sysfs i2c tree at root, removing whatever was there: roots
+ * controller adapters, each with a pca954x mux of channels channels per
+ * level down to levels levels, and chips at24 and lm75 clients from 0x50
+ * on every adapter
+ * @param root
+ * @param roots
+ * @param levels
+ * @param channels
+ * @param chips
+ * @return negative errno on failure else the number of adapters made
+ */
+extern int bench_fakesys_create(const char *root, int roots, int levels, int channels, int chips);
+
+/**
+ * Remove a tree made by bench_fakesys_create()
+ * @param root
+ */
+extern void bench_fakesys_remove(const char *root);
+
+/**
+ * @return the monotonic clock in nanoseconds
+ */
+extern uint64_t bench_clock(void);
+
+#endif /* !BENCH_FAKESYS_H */
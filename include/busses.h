@@ -16,6 +16,7 @@
 #include <sys/stat.h>
 #include <sys/queue.h>
 #include <sys/types.h>
+#include <libi2cdev.h>
 
 #define BUS_PATH_ANY            NULL
 #define CHIP_NAME_PREFIX_ANY    NULL
@@ -102,6 +103,10 @@ typedef struct smbus_i2c_adapter {
 
     int prev_addr; /* previous chip address */
     unsigned long funcs;
+
+    struct dev_i2c_stats stats; /* all the clients on this adapter */
+    struct dev_i2c_latency_hist *latency;
+    uint64_t slow_ns; /* latency threshold of its clients, 0 if none */
 } SMBusAdapter;
 
 typedef struct dev_chip_list {
@@ -112,6 +117,13 @@ typedef struct {
     struct dev_chip *sle_next; /* next element */
 } dev_chip_node;
 
+/* Chip attributes which are read from sysfs on first use */
+typedef enum dev_chip_attr {
+    DEV_CHIP_ATTR_DRIVER = 0x1,
+    DEV_CHIP_ATTR_MODULE = 0x2,
+    DEV_CHIP_ATTR_SUBSYSTEM = 0x4,
+} dev_chip_attr;
+
 /* A chip name is encoded in this structure */
 typedef struct dev_chip {
     int addr;
@@ -125,6 +137,7 @@ typedef struct dev_chip {
     char *driver;
     char *module;
     char *subsystem;
+    unsigned int attr_read; /* dev_chip_attr values already read, use the dev_chip_get_* accessors */
 
     struct dev_bus_adapter *adapter; /* the adapter the device sits on */
 
@@ -186,6 +199,15 @@ typedef struct dev_bus_adapter {
 
     dev_bus_adapter_head children;
     dev_bus_adapter_node node;
+
+    /* mux children indexed by [bus_id * child_index_chans + chan_id] */
+    struct dev_bus_adapter **child_index;
+    int child_index_buses;
+    int child_index_chans;
+
+    /* sysfs directory when its chips were last read, 0 if never */
+    ino_t sysfs_ino;
+    nlink_t sysfs_nlink;
 } dev_bus_adapter;
 
 #ifdef __cplusplus
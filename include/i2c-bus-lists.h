@@ -146,6 +146,37 @@ static inline int compare_bus_list_insert(dev_bus_adapter *new_entry,
     return pos;
 }
 
+/**
+ * sorted_bus_list_insert - add a new entry keeping the list ordered by nr
+ * @param head: list head to add it to
+ * @param new_entry: new entry to be added
+ *
+ * Insert a new entry before the first entry with a greater bus nr,
+ * or at the tail of the list.
+ */
+static inline void sorted_bus_list_insert(dev_bus_adapter_head *head,
+        dev_bus_adapter *new_entry)
+{
+    dev_bus_adapter *entry = NULL;
+    dev_bus_adapter *last = NULL;
+
+    if ((new_entry == NULL) || (head == NULL)) {
+        return;
+    }
+    LIST_FOREACH(entry, head, node) {
+        if (entry->nr > new_entry->nr) {
+            LIST_INSERT_BEFORE(entry, new_entry, node);
+            return;
+        }
+        last = entry;
+    }
+    if (last != NULL) {
+        LIST_INSERT_AFTER(last, new_entry, node);
+    } else {
+        LIST_INSERT_HEAD(head, new_entry, node);
+    }
+}
+
 /**
  * Get the Parent Device
  * @param child
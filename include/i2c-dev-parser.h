@@ -18,4 +18,127 @@
  */
 extern int gather_i2c_dev_busses(void);
 
+/**
+ * (Re)build the index of an adapter's mux children by bus id and channel,
+ * used to resolve bus paths without walking the child list.
+ * @param adapter
+ * @return negative errno on failure else zero on success
+ */
+extern int dev_bus_build_child_index(dev_bus_adapter *adapter);
+
+/**
+ * Get the driver bound to a chip, read from sysfs on first use
+ * @param chip
+ * @return driver name or NULL if there is none
+ */
+extern const char *dev_chip_get_driver(const dev_chip *chip);
+
+/**
+ * Get the kernel module of a chip's driver, read from sysfs on first use
+ * @param chip
+ * @return module name or NULL if there is none
+ */
+extern const char *dev_chip_get_module(const dev_chip *chip);
+
+/**
+ * Get the subsystem of a chip, read from sysfs on first use
+ * @param chip
+ * @return subsystem name or NULL if there is none
+ */
+extern const char *dev_chip_get_subsystem(const dev_chip *chip);
+
+/**
+ * Keys of the chip indexes, names are matched regardless of case
+ */
+typedef enum dev_chip_key {
+    DEV_CHIP_KEY_NAME,
+    DEV_CHIP_KEY_DRIVER,
+    DEV_CHIP_KEY_MODULE,
+    DEV_CHIP_KEY_ADDR,
+    DEV_CHIP_KEY_MAX,
+} dev_chip_key;
+
+/**
+ * Iterator over the chips matching an index query, in bus tree order.
+ * It ends early once the bus tree changed.
+ */
+typedef struct dev_chip_iter {
+    dev_chip * const *chips;
+    int pos;
+    int count;
+    unsigned long serial;
+} dev_chip_iter;
+
+/**
+ * Find all chips with a name, driver or module.
+ * The index for the key is built on the first query after the bus tree
+ * changed, the driver and module indexes read those attributes of every chip.
+ * @param[out] iter iterator over the matching chips
+ * @param key DEV_CHIP_KEY_NAME, DEV_CHIP_KEY_DRIVER or DEV_CHIP_KEY_MODULE
+ * @param value
+ * @return negative errno on failure else the number of matching chips
+ */
+extern int dev_chip_query(dev_chip_iter *iter, dev_chip_key key, const char *value);
+
+/**
+ * Find all chips at an address, on any adapter
+ * @param[out] iter iterator over the matching chips
+ * @param addr
+ * @return negative errno on failure else the number of matching chips
+ */
+extern int dev_chip_query_addr(dev_chip_iter *iter, int addr);
+
+/**
+ * @param iter
+ * @return the next matching chip, or NULL at the end of the matches
+ * or if the bus tree changed since the query
+ */
+extern const dev_chip *dev_chip_iter_next(dev_chip_iter *iter);
+
+/**
+ * Read a single i2c adapter from sysfs and link it into the bus tree.
+ * The parent adapter (if any) must already be present.
+ * @param name adapter device name (e.g. "i2c-3")
+ * @return negative errno on failure else zero on success
+ */
+extern int i2c_dev_bus_add_adapter(const char *name);
+
+/**
+ * Add every adapter listed in sysfs which isn't part of the bus tree yet,
+ * e.g. the channels of a mux that was just created
+ * @return negative errno on failure else number of adapters added
+ */
+extern int i2c_dev_bus_add_new_adapters(void);
+
+/**
+ * Unlink and free an adapter along with all of its children and chips
+ * @param nr adapter bus nr
+ * @return negative errno on failure else zero on success
+ */
+extern int i2c_dev_bus_remove_adapter(int nr);
+
+/**
+ * Read a single i2c client from sysfs and add it to its adapter
+ * @param nr adapter bus nr
+ * @param name client device name (e.g. "3-0050")
+ * @return negative errno on failure else zero on success
+ */
+extern int i2c_dev_bus_add_chip(int nr, const char *name);
+
+/**
+ * Remove a single i2c client from its adapter
+ * @param nr adapter bus nr
+ * @param addr client address
+ * @return negative errno on failure else zero on success
+ */
+extern int i2c_dev_bus_remove_chip(int nr, int addr);
+
+/**
+ * Bring the bus tree in line with sysfs, reading again only the adapters
+ * and chips that appeared, disappeared or changed. Unchanged adapters keep
+ * their open file descriptors, functionality and registered clients.
+ * @return negative errno on failure else number of changes applied
+ */
+extern int i2c_dev_bus_reconcile(void);
+
 #endif /* I2C_DEV_PARSER_H_ */
@@ -92,6 +92,191 @@ struct dev_i2c_board_info {
 #define DEV_I2C_BOARD_INFO_PATH(dev_name, dev_addr, dev_path) \
     .name = dev_name, .flags = 0, .addr = (dev_addr),  .path = dev_path
 
+/* SMBus protocols and plain I2C transfers, counted apart in dev_i2c_stats */
+enum dev_i2c_op {
+    DEV_I2C_OP_QUICK = 0,
+    DEV_I2C_OP_BYTE,             /* send and receive byte */
+    DEV_I2C_OP_BYTE_DATA,
+    DEV_I2C_OP_WORD_DATA,
+    DEV_I2C_OP_PROC_CALL,
+    DEV_I2C_OP_BLOCK_DATA,
+    DEV_I2C_OP_I2C_BLOCK_DATA,
+    DEV_I2C_OP_BLOCK_PROC_CALL,
+    DEV_I2C_OP_TRANSFER,         /* I2C_RDWR messages */
+    DEV_I2C_OP_MAX,
+};
+
+/* Failed transactions, classed by the errno the adapter driver returned */
+enum dev_i2c_error_class {
+    DEV_I2C_ERR_NOACK = 0,       /* ENXIO, EREMOTEIO: no acknowledge */
+    DEV_I2C_ERR_TIMEOUT,         /* ETIMEDOUT */
+    DEV_I2C_ERR_BUS,             /* EAGAIN, EBUSY, EIO: arbitration lost, bus busy */
+    DEV_I2C_ERR_PROTOCOL,        /* EBADMSG, EPROTO, EOVERFLOW, EMSGSIZE: PEC, bad length */
+    DEV_I2C_ERR_UNSUPPORTED,     /* EOPNOTSUPP, EINVAL */
+    DEV_I2C_ERR_OTHER,
+    DEV_I2C_ERR_MAX,
+};
+
+/**
+ * Transaction counters kept for every client and every adapter.
+ * Bytes written include the command byte, bytes read include the count
+ * byte of block reads; neither counts failed transactions. Latencies are
+ * the time spent in the transaction ioctl, in nanoseconds.
+ */
+struct dev_i2c_stats {
+    uint64_t ops[DEV_I2C_OP_MAX];
+    uint64_t errors[DEV_I2C_ERR_MAX];
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    uint64_t latency_ns;     /**< sum over all transactions */
+    uint64_t latency_max_ns;
+    uint64_t wire_bits;      /**< bit times on the wire, see dev_i2c_get_bus_utilisation() */
+    uint64_t first_ns;       /**< CLOCK_MONOTONIC start of the first transaction, 0 if none */
+};
+
+/**
+ * How busy a bus was since its counters were first used or last reset,
+ * from the time the transactions would take on the wire at the bus clock
+ * frequency. Covers an adapter and all the mux channels below it.
+ */
+struct dev_i2c_bus_utilisation {
+    uint32_t bus_freq_hz;    /**< clock-frequency of the physical bus */
+    int bus_freq_known;      /**< 0 if the firmware doesn't say and 100 kHz is assumed */
+    uint64_t transactions;
+    uint64_t wire_ns;        /**< estimated time on the wire */
+    uint64_t wall_ns;        /**< time spent in the transaction ioctls */
+    uint64_t window_ns;      /**< from the first transaction to now */
+    double utilisation;      /**< wire_ns over window_ns, in percent */
+    double busy;             /**< wall_ns over window_ns, in percent */
+    double wall_to_wire;     /**< wall_ns over wire_ns, how much slower than the wire */
+};
+
+/* latency histogram of a client or adapter, allocated on first use */
+struct dev_i2c_latency_hist;
+
+/**
+ * A transaction as seen by the tracing hooks, see dev_i2c_set_trace_hooks().
+ * The pre hook gets it before the transaction, with result and end_ns zero.
+ */
+struct dev_i2c_trace_event {
+    int adapter_nr;          /**< the N of /dev/i2c-N, -1 if unknown */
+    unsigned short addr;
+    enum dev_i2c_op op;
+    int read_write;          /**< I2C_SMBUS_READ or I2C_SMBUS_WRITE, as the kernel has it */
+    int command;             /**< command byte, -1 if the protocol has none */
+    uint32_t length;         /**< data bytes requested, the command byte excluded */
+    const char *path;        /**< path of the client's adapter */
+    const uint8_t *write_data; /**< data written after the command byte, NULL for the pre hook */
+    uint32_t write_len;
+    const uint8_t *read_data; /**< data read, NULL for the pre hook or on failure */
+    uint32_t read_len;
+    int32_t result;          /**< negative errno on failure */
+    uint64_t start_ns;       /**< CLOCK_MONOTONIC */
+    uint64_t end_ns;
+};
+
+typedef void (*dev_i2c_trace_func)(const struct dev_i2c_trace_event *event, void *arg);
+
+/**
+ * Where dev_i2c_trace_replay() sends the recorded transactions. xfer gets
+ * the transaction as recorded, start_ns and end_ns counted from the start
+ * of the trace, and puts the bytes it reads in read_data, which has room
+ * for event->read_len of them; it returns the result of the transaction.
+ */
+struct dev_i2c_replay_backend {
+    int32_t (*xfer)(const struct dev_i2c_trace_event *event, uint8_t *read_data, void *arg);
+    void *arg;
+};
+
+/* flags of dev_i2c_trace_replay() */
+#define DEV_I2C_REPLAY_REALTIME  0x1 /**< keep the recorded gaps and, for the mock, durations */
+
+struct dev_i2c_replay_stats {
+    uint64_t transactions;
+    uint64_t errors;         /**< transactions that failed in the replay */
+    uint64_t mismatches;     /**< results or data read that differ from the recording */
+    uint64_t recorded_ns;    /**< from the first transaction recorded to the end of the last */
+    uint64_t elapsed_ns;     /**< the same for the replay */
+    uint64_t recorded_latency_ns; /**< sum over all transactions */
+    uint64_t latency_ns;
+};
+
+/**
+ * A transaction slower than its threshold, see dev_i2c_set_slow_threshold()
+ */
+struct dev_i2c_slow_event {
+    uint64_t seq;            /**< counts slow transactions, a gap means events were overwritten */
+    char name[I2C_NAME_SIZE]; /**< of the client */
+    char path[I2C_ADAPT_PATH_SIZE]; /**< of the client's adapter, mux channels included */
+    int adapter_nr;          /**< the N of /dev/i2c-N, -1 if unknown */
+    unsigned short addr;
+    enum dev_i2c_op op;
+    int read_write;          /**< I2C_SMBUS_READ or I2C_SMBUS_WRITE */
+    int command;             /**< command byte, -1 if the protocol has none */
+    int32_t result;          /**< negative errno on failure */
+    uint64_t start_ns;       /**< CLOCK_MONOTONIC */
+    uint64_t latency_ns;
+    uint64_t threshold_ns;   /**< the threshold it went over */
+};
+
+/* Public calls the syscalls of the library are counted against */
+enum dev_i2c_api {
+    DEV_I2C_API_OTHER = 0,       /* none of the below, or a thread of the application's own */
+    DEV_I2C_API_INIT,            /* i2cdev_init() */
+    DEV_I2C_API_RESCAN,          /* i2cdev_rescan() */
+    DEV_I2C_API_CLEANUP,         /* i2cdev_cleanup() */
+    DEV_I2C_API_COMPILE_CONFIG,  /* i2cdev_compile_config() */
+    DEV_I2C_API_INSTANTIATE,     /* initialize_all_config_chips(), remove_all_config_chips() and the like */
+    DEV_I2C_API_UEVENT,          /* i2cdev_uevent_monitor_*() */
+    DEV_I2C_API_CONFIG_MONITOR,  /* i2cdev_config_monitor_*() */
+    DEV_I2C_API_LOOKUP,          /* dev_i2c_lookup_i2c_bus() */
+    DEV_I2C_API_NEW_DEVICE,      /* dev_i2c_new_device() */
+    DEV_I2C_API_DELETE,          /* dev_i2c_delete() */
+    DEV_I2C_API_OPEN,            /* dev_i2c_open() */
+    DEV_I2C_API_CLOSE,           /* dev_i2c_close() */
+    DEV_I2C_API_PROBE,           /* dev_i2c_smbus_probe() */
+    DEV_I2C_API_SMBUS,           /* the other dev_i2c_smbus_*() */
+    DEV_I2C_API_TRANSFER,        /* dev_i2c_transfer_data(), dev_i2c_read_data(), dev_i2c_write_data() */
+    DEV_I2C_API_MAX,
+};
+
+/* Syscalls the library makes, ioctls by request */
+enum dev_i2c_syscall {
+    DEV_I2C_SYS_OPEN = 0,        /* open(), fopen(), mkostemp() */
+    DEV_I2C_SYS_CLOSE,           /* close(), fclose(), closedir() */
+    DEV_I2C_SYS_STAT,            /* stat(), fstat() */
+    DEV_I2C_SYS_READ,            /* read(), recvmsg(), per getline() and fread() of stdio */
+    DEV_I2C_SYS_WRITE,           /* write(), pwrite(), per fprintf() to a sysfs file */
+    DEV_I2C_SYS_READLINK,
+    DEV_I2C_SYS_REALPATH,        /* an lstat() and maybe a readlink() per path component */
+    DEV_I2C_SYS_OPENDIR,         /* opendir(), scandir() */
+    DEV_I2C_SYS_READDIR,         /* per entry, the getdents() behind it read many */
+    DEV_I2C_SYS_MMAP,            /* mmap(), munmap() */
+    DEV_I2C_SYS_RENAME,
+    DEV_I2C_SYS_UNLINK,
+    DEV_I2C_SYS_SOCKET,          /* socket(), bind(), setsockopt() */
+    DEV_I2C_SYS_INOTIFY,         /* inotify_init1(), inotify_add_watch() */
+    DEV_I2C_SYS_IOCTL_SMBUS,     /* I2C_SMBUS */
+    DEV_I2C_SYS_IOCTL_RDWR,      /* I2C_RDWR */
+    DEV_I2C_SYS_IOCTL_SLAVE,     /* I2C_SLAVE, I2C_SLAVE_FORCE */
+    DEV_I2C_SYS_IOCTL_FUNCS,     /* I2C_FUNCS */
+    DEV_I2C_SYS_IOCTL_OTHER,     /* I2C_TIMEOUT, I2C_RETRIES */
+    DEV_I2C_SYS_CHMOD,           /* fchmod() */
+    DEV_I2C_SYS_CLOCK,           /* clock_gettime(), but for the timing of transactions */
+    DEV_I2C_SYS_MAX,
+};
+
+/**
+ * Syscalls made by the library, while counting is turned on with
+ * dev_i2c_set_syscall_counting(). A call is counted against the public
+ * call the thread entered first, so the syscalls of dev_i2c_open() made
+ * by dev_i2c_smbus_read_byte() are counted against DEV_I2C_API_SMBUS.
+ */
+struct dev_i2c_syscall_stats {
+    uint64_t calls[DEV_I2C_API_MAX];     /**< public calls made */
+    uint64_t syscalls[DEV_I2C_API_MAX][DEV_I2C_SYS_MAX];
+};
+
 /* flags for the client struct: */
 #define I2C_CLIENT_PEC  0x04        /* Use Packet Error Checking */
 #define I2C_CLIENT_TEN  0x10        /* we have a ten bit chip address */
@@ -122,6 +307,9 @@ typedef struct smbus_i2c_client {
     struct smbus_i2c_adapter *adapter; /**< the adapter we sit on */
     struct dev_client_list *client_node; /**< a pointer to allocated data pointing to itself */
     void *dev; /**< A void pointer that can be used to store device specific information */
+    struct dev_i2c_stats stats; /**< read with dev_i2c_get_stats() */
+    struct dev_i2c_latency_hist *latency; /**< freed by dev_i2c_delete() */
+    uint64_t slow_ns; /**< set with dev_i2c_set_slow_threshold() */
 } SMBusDevice;
 
 #define to_devi2c_client(d) container_of(d, struct smbus_i2c_client, dev)
@@ -153,11 +341,67 @@ static inline void devi2c_set_clientdata(SMBusDevice *client,
 extern int i2cdev_init(FILE *input);
 
 /**
- * Used to rescan the i2c device tree and update internal data structures
+ * Used to rescan the i2c device tree and update internal data structures.
+ * Only adapters and chips that appeared, disappeared or changed since the
+ * last scan are read again; unchanged adapters keep their open file
+ * descriptors, cached functionality and registered clients. A tree whose
+ * adapters all kept their device node and sysfs directory link count is
+ * left alone without reading the chips.
  * @return negative errno on failure else zero on success
  */
 extern int i2cdev_rescan(void);
 
+/**
+ * Set the topology snapshot file. i2cdev_init() loads the bus tree from it
+ * instead of walking sysfs when it was written during the current boot and
+ * no adapter has changed since, and writes it after a full discovery.
+ * Call before i2cdev_init().
+ * @param path snapshot file to use, or NULL to disable the snapshot
+ * @return negative errno on failure else zero on success
+ */
+extern int i2cdev_set_snapshot_file(const char *path);
+
+/**
+ * Write the topology snapshot now if the bus tree or the functionality of
+ * an adapter learned since differs from the file, e.g. before a long
+ * running process exits. i2cdev_cleanup() doesn't write it.
+ * @return negative errno on failure else zero on success
+ */
+extern int i2cdev_save_snapshot(void);
+
+/**
+ * Set the compiled config file. When i2cdev_init() reads the default
+ * config file and directory, it maps the compiled config instead as long
+ * as none of the config files was added, removed or modified since it was
+ * compiled. Call before i2cdev_init().
+ * @param path compiled config file to use, or NULL to always parse the text
+ * @return negative errno on failure else zero on success
+ */
+extern int i2cdev_set_compiled_config_file(const char *path);
+
+/**
+ * Write the config read by i2cdev_init() from the default config file and
+ * directory to a compiled config file
+ * @param path file to write or NULL for the one set by
+ * i2cdev_set_compiled_config_file()
+ * @return negative errno on failure, -EINVAL if the config wasn't read
+ * from the default files, else zero on success
+ */
+extern int i2cdev_compile_config(const char *path);
+
+/**
+ * Set how many threads create and remove the config file chips. Chips on
+ * different root buses are then written to sysfs in parallel, so their
+ * driver probes overlap; the chips of one root bus are always written in
+ * order by a single thread. The calling thread writes too; the others, at
+ * most 32, are started by the first batch needing them and kept for the
+ * following ones until i2cdev_cleanup().
+ * @param threads maximum number of threads, 0 for one per root bus,
+ * 1 (the default) to write everything from the calling thread
+ * @return negative errno on failure else zero on success
+ */
+extern int i2cdev_set_instantiate_threads(int threads);
+
 /**
  * Clean-up function to free libraries resources
  * @note You can't access anything after
@@ -165,6 +409,59 @@ extern int i2cdev_rescan(void);
  */
 extern void i2cdev_cleanup(void);
 
+/**
+ * Get the bus tree generation counter. It is incremented every time the
+ * in-memory adapter tree changes (rescan finding a change or applied uevent), so callers
+ * can tell whether cached adapter lookups are still current.
+ * @return the current generation
+ */
+extern unsigned long i2cdev_get_generation(void);
+
+/**
+ * Open a kernel uevent (NETLINK_KOBJECT_UEVENT) monitor used to apply
+ * i2c adapter and client hot-plug events to the bus tree incrementally.
+ * The returned descriptor is non-blocking and can be added to an event
+ * loop (poll/epoll); call i2cdev_uevent_monitor_process() when it becomes
+ * readable. Events that happened before the monitor was opened are not
+ * seen, call i2cdev_rescan() after opening it if that matters.
+ * @return negative errno on failure else the pollable file descriptor
+ */
+extern int i2cdev_uevent_monitor_open(void);
+
+/**
+ * Drain pending uevents and apply i2c adapter/client add and remove
+ * events to the bus tree. Falls back to i2cdev_rescan() if the kernel
+ * reports that events were dropped.
+ * @return negative errno on failure else the number of applied events
+ */
+extern int i2cdev_uevent_monitor_process(void);
+
+/**
+ * Close the uevent monitor (also done by i2cdev_cleanup())
+ */
+extern void i2cdev_uevent_monitor_close(void);
+
+/**
+ * Watch the default config file and config directory for changes. When
+ * the returned non-blocking descriptor becomes readable,
+ * i2cdev_config_monitor_process() parses the changed files again and
+ * creates or removes only the chips whose entries were added or removed.
+ * Only available when the config was read from the default locations.
+ * @return negative errno on failure else the pollable file descriptor
+ */
+extern int i2cdev_config_monitor_open(void);
+
+/**
+ * Reload the config files that changed and apply the difference
+ * @return negative errno on failure else the number of entries added or removed
+ */
+extern int i2cdev_config_monitor_process(void);
+
+/**
+ * Close the config monitor (also done by i2cdev_cleanup())
+ */
+extern void i2cdev_config_monitor_close(void);
+
 /*---------------------------------------------------------------------------*/
 
 /**
@@ -278,6 +575,213 @@ extern SMBusDevice *dev_i2c_new_device(struct dev_i2c_board_info const *info);
  */
 extern void dev_i2c_delete(SMBusDevice *client);
 
+/**
+ * Get the transaction counters of a client
+ * The counters are updated without a lock, each one is read atomically
+ * but a transaction finishing meanwhile may be only partly counted.
+ * @param[in] client
+ * @param[out] stats
+ * @return negative errno on failure else zero on success
+ */
+extern int dev_i2c_get_stats(const SMBusDevice *client, struct dev_i2c_stats *stats);
+
+/**
+ * Zero the transaction counters and the latency histogram of a client
+ * @param[in] client
+ * @return negative errno on failure else zero on success
+ */
+extern int dev_i2c_reset_stats(SMBusDevice *client);
+
+/**
+ * Get the transaction counters of an adapter, all the clients on it together.
+ * They are kept for as long as the adapter stays in the bus tree.
+ * @param[in] path path of the adapter, as in dev_i2c_board_info
+ * @param[out] stats
+ * @return negative errno on failure, -ENODEV if there is no such adapter,
+ * else zero on success
+ */
+extern int dev_i2c_get_adapter_stats(const char *path, struct dev_i2c_stats *stats);
+
+/**
+ * Zero the transaction counters and the latency histogram of an adapter
+ * @param[in] path path of the adapter
+ * @return negative errno on failure else zero on success
+ */
+extern int dev_i2c_reset_adapter_stats(const char *path);
+
+/**
+ * Estimate how busy the bus of an adapter was. The clock frequency is the
+ * clock-frequency firmware property of the bus controller, the one of the
+ * physical bus for a mux channel. Transactions on different channels of a
+ * bus wait for each other, so busy can go over 100 for a physical bus.
+ * @param[in] path path of the adapter, its mux channels are counted too
+ * @param[out] util
+ * @return negative errno on failure else zero on success
+ */
+extern int dev_i2c_get_bus_utilisation(const char *path, struct dev_i2c_bus_utilisation *util);
+
+/**
+ * Get latency percentiles of a client's transactions. Latencies are kept
+ * in a log-linear histogram with 8 buckets per power of two from 1 us, so
+ * a percentile is exact to within 12.5% (128 ns below 1 us); the value
+ * returned is the upper end of its bucket, never more than the maximum
+ * latency seen. The histogram is zeroed by dev_i2c_reset_stats().
+ * @param[in] client
+ * @param[in] percentiles between 0 and 100, e.g. 50, 99, 99.9
+ * @param[out] values_ns latency of each percentile, 0 if nothing was recorded
+ * @param[in] count number of percentiles
+ * @return negative errno on failure else zero on success
+ */
+extern int dev_i2c_get_latency_percentiles(const SMBusDevice *client,
+        const double *percentiles, uint64_t *values_ns, int count);
+
+/**
+ * dev_i2c_get_latency_percentiles() for an adapter, all the clients on it together
+ * @param[in] path path of the adapter
+ * @param[in] percentiles
+ * @param[out] values_ns
+ * @param[in] count
+ * @return negative errno on failure, -ENODEV if there is no such adapter,
+ * else zero on success
+ */
+extern int dev_i2c_get_adapter_latency_percentiles(const char *path,
+        const double *percentiles, uint64_t *values_ns, int count);
+
+/**
+ * Set the latency threshold of a client. A transaction that takes longer
+ * than the threshold of its client, else of its adapter, else the default
+ * one, is kept for dev_i2c_get_slow_events().
+ * @param[in] client
+ * @param[in] threshold_ns 0 for none, the adapter's then applies
+ * @return negative errno on failure else zero on success
+ */
+extern int dev_i2c_set_slow_threshold(SMBusDevice *client, uint64_t threshold_ns);
+
+/**
+ * Set the latency threshold of the clients on an adapter that have none of
+ * their own. It is kept for as long as the adapter stays in the bus tree.
+ * @param[in] path path of the adapter, mux channels below it aren't covered
+ * @param[in] threshold_ns 0 for none, the default then applies
+ * @return negative errno on failure, -ENODEV if there is no such adapter,
+ * else zero on success
+ */
+extern int dev_i2c_set_adapter_slow_threshold(const char *path, uint64_t threshold_ns);
+
+/**
+ * Set the latency threshold of the clients and adapters that have none
+ * @param[in] threshold_ns 0 for none, the default
+ */
+extern void dev_i2c_set_default_slow_threshold(uint64_t threshold_ns);
+
+/**
+ * Take the slow transactions kept, oldest first. Only the latest 256 are
+ * kept; older ones are overwritten.
+ * @param[out] events
+ * @param[in] count room in events
+ * @return negative errno on failure else the number of events taken
+ */
+extern int dev_i2c_get_slow_events(struct dev_i2c_slow_event *events, int count);
+
+/**
+ * @param[in] op enum dev_i2c_op
+ * @return short name of the protocol, e.g. "byte_data"
+ */
+extern const char *dev_i2c_op_name(int op);
+
+/**
+ * @param[in] err enum dev_i2c_error_class
+ * @return short name of the error class, e.g. "noack"
+ */
+extern const char *dev_i2c_error_class_name(int err);
+
+/**
+ * Install hooks called around every transaction the library makes, from
+ * the thread making it. Either hook may be NULL; with both NULL tracing
+ * is turned off. Transactions already under way may still call the hooks
+ * installed before, so their arg must stay valid a while after replacing.
+ * @param[in] pre called just before the transaction
+ * @param[in] post called just after it, with its result
+ * @param[in] arg passed to the hooks
+ * @return negative errno on failure else zero on success
+ */
+extern int dev_i2c_set_trace_hooks(dev_i2c_trace_func pre, dev_i2c_trace_func post, void *arg);
+
+/**
+ * Record every transaction the library makes to a binary trace file, until
+ * dev_i2c_trace_record_stop(). The tracing hooks keep working alongside.
+ * @param[in] file created or truncated
+ * @return negative errno on failure else zero on success
+ */
+extern int dev_i2c_trace_record_start(const char *file);
+
+/**
+ * Stop recording and close the trace file
+ * @return negative errno on failure, e.g. -ENOSPC if records were lost,
+ * else the number of transactions recorded
+ */
+extern int dev_i2c_trace_record_stop(void);
+
+/**
+ * Write every transaction the library makes to a file in the Chrome trace
+ * event format, until dev_i2c_trace_export_stop(), for chrome://tracing or
+ * ui.perfetto.dev. Each physical bus is a process and each of its adapters,
+ * the bus itself and every mux channel below it, a thread with a slice per
+ * transaction.
+ * @param[in] file created or truncated
+ * @return negative errno on failure else zero on success
+ */
+extern int dev_i2c_trace_export_start(const char *file);
+
+/**
+ * Stop exporting and close the file
+ * @return negative errno on failure else the number of transactions written
+ */
+extern int dev_i2c_trace_export_stop(void);
+
+/**
+ * Replay a trace file written by dev_i2c_trace_record_start(). Each
+ * transaction goes through the counters, histograms, tracing hooks and
+ * probes of the library like a real one, on stand-in clients that open
+ * no device, and is answered by the backend.
+ * @param[in] file
+ * @param[in] backend NULL for a mock answering what was recorded
+ * @param[in] flags DEV_I2C_REPLAY_*
+ * @param[out] stats may be NULL
+ * @return negative errno on failure else zero on success
+ */
+extern int dev_i2c_trace_replay(const char *file, const struct dev_i2c_replay_backend *backend,
+        int flags, struct dev_i2c_replay_stats *stats);
+
+/**
+ * Turn the counting of the library's syscalls on or off, it's off at first
+ * @param[in] enable
+ */
+extern void dev_i2c_set_syscall_counting(int enable);
+
+/**
+ * Get the syscalls counted since counting was first turned on or last reset
+ * @param[out] stats
+ * @return negative errno on failure else zero on success
+ */
+extern int dev_i2c_get_syscall_stats(struct dev_i2c_syscall_stats *stats);
+
+/**
+ * Zero the syscall counters
+ */
+extern void dev_i2c_reset_syscall_stats(void);
+
+/**
+ * @param[in] api enum dev_i2c_api
+ * @return short name of the public call, e.g. "smbus"
+ */
+extern const char *dev_i2c_api_name(int api);
+
+/**
+ * @param[in] sys enum dev_i2c_syscall
+ * @return short name of the syscall, e.g. "ioctl_slave"
+ */
+extern const char *dev_i2c_syscall_name(int sys);
+
 /*---------------------------------------------------------------------------*/
 /* usually are only used internally within each library call */
 extern int dev_i2c_open(SMBusDevice *client);
@@ -11,6 +11,8 @@
 #include <string.h>
 #include <math.h>
 #include <strings.h>
+#include <stdint.h>
+#include <errno.h>
 
 #include "access.h"
 
@@ -18,6 +20,9 @@
 #include "data.h"
 #include "error.h"
 #include "sysfs.h"
+#include "intern.h"
+#include "topology.h"
+#include "probes.h"
 
 #include "i2cdiscov.h"
 #include "i2c-error.h"
@@ -50,7 +55,7 @@ int dev_match_chip(const dev_chip *chip1,
 
     if ((chip1->name != CHIP_NAME_PREFIX_ANY)
             && (chip2->name != CHIP_NAME_PREFIX_ANY)
-            && strcasecmp(chip1->name, chip2->name)) {
+            && !dev_intern_caseeq(chip1->name, chip2->name)) {
         return 0;
     }
 
@@ -73,7 +78,7 @@ int dev_match_chip_config(const dev_chip *chip1,
     }
     if ((chip1->name != CHIP_NAME_PREFIX_ANY)
             && (chip2->prefix != CHIP_NAME_PREFIX_ANY)
-            && strcasecmp(chip1->name, chip2->prefix)) {
+            && !dev_intern_caseeq(chip1->name, chip2->prefix)) {
         return 0;
     }
 
@@ -82,7 +87,9 @@ int dev_match_chip_config(const dev_chip *chip1,
         return 0;
     }
 
-    if (strcasecmp(chip1->bus_id->path, chip2->bus.path)) {
+    /* a wildcard bus matches the chips of every adapter */
+    if ((chip2->bus.path != BUS_PATH_ANY) && ((chip1->bus_id->path == NULL)
+            || strcasecmp(chip1->bus_id->path, chip2->bus.path))) {
         return 0;
     }
 
@@ -104,143 +111,428 @@ int dev_chip_name_has_wildcards(const dev_chip *chip)
     }
 }
 
-/* Returns, one by one, a pointer to all sensor_chip structs of the
- config file which match with the given chip name. Last should be
- the value returned by the last call, or NULL if this is the first
- call. Returns NULL if no more matches are found. Do not modify
- the struct the return value points to!
- Note that this visits the list of chips from last to first. Usually,
- you want the match that was latest in the config file. */
-dev_chip *dev_match_all_adapter_configured_chips(dev_bus_adapter *adapter,
-        dev_config_chip_head *head)
+/* Check whether a config entry names a single chip or has wildcards.
+ Returns 0 if it is absolute, 1 if there are wildcards. */
+int dev_config_chip_has_wildcards(const dev_config_chip *chip)
+{
+    if ((chip->prefix == CHIP_NAME_PREFIX_ANY)
+            || (chip->bus.nr == BUS_NR_ANY)
+            || (chip->address == CHIP_NAME_ADDR_ANY)) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+/**
+ * Find the first chip of an adapter matching a config entry.
+ * The chip addresses of the adapter are contiguous in the flattened
+ * topology, only chips at a matching address are looked at.
+ * @param topo flattened topology or NULL to walk the clients list
+ * @param adapter
+ * @param config
+ * @param[out] has_chips set if the adapter has any chips
+ * @return the matching chip or NULL
+ */
+static dev_chip *adapter_match_config_chip(const dev_topology *topo,
+        const dev_bus_adapter *adapter, const dev_config_chip *config, bool *has_chips)
 {
-    int ret = 0;
     dev_chip *chip = NULL;
+    int i = dev_topology_adapter_index(topo, adapter);
 
-    if (adapter == NULL) {
+    if (i == TOPOLOGY_NONE) {
+        *has_chips = !SLIST_EMPTY(&adapter->clients);
+        SLIST_FOREACH(chip, &adapter->clients, node) {
+            if (dev_match_chip_config(chip, config)) {
+                return chip;
+            }
+        }
         return NULL;
     }
 
-    if ((head == NULL) || (SLIST_FIRST(head) == NULL)) {
-        return NULL;
+    *has_chips = (topo->first_chip[i] != topo->first_chip[i + 1]);
+    for (int c = topo->first_chip[i]; c < topo->first_chip[i + 1]; ++c) {
+        if ((config->address != CHIP_NAME_ADDR_ANY) && (topo->chip_addr[c] != config->address)
+                && (topo->chip_addr[c] != CHIP_NAME_ADDR_ANY)) {
+            continue;
+        }
+        if (dev_match_chip_config(topo->chip[c], config)) {
+            return topo->chip[c];
+        }
     }
+    return NULL;
+}
 
-    SLIST_FOREACH(chip, &adapter->clients, node) {
+/*
+ * The config list compiled for matching against the flattened topology.
+ * Entries are hashed by (adapter index, address), where either half may be
+ * a wildcard, so a chip only has to probe the key forms which are in use:
+ * its own adapter and address, its adapter with any address, any bus at
+ * its address and any bus with any address. Entries whose bus couldn't be
+ * resolved or isn't part of the topology are not hashed.
+ */
+#define CONFIG_ADAPTER_ANY      (-2)
+
+#define CONFIG_FORM_EXACT       (1 << 0)
+#define CONFIG_FORM_ADDR_ANY    (1 << 1)
+#define CONFIG_FORM_BUS_ANY     (1 << 2)
+#define CONFIG_FORM_ANY         (1 << 3)
+
+typedef struct config_match_entry {
+    dev_config_chip *config;
+    const dev_bus_adapter *adapter; /* resolved bus or NULL */
+    int index; /* topology index, CONFIG_ADAPTER_ANY or TOPOLOGY_NONE */
+    int next; /* next entry in the same bucket or -1 */
+    bool hashed;
+    bool hit;
+} config_match_entry;
+
+typedef struct config_match {
+    const dev_config_chip_head *head;
+    unsigned long serial; /* topology the bus paths were resolved in */
+    const dev_topology *topo;
+    config_match_entry *entry; /* in config list order */
+    int count;
+    int *bucket;
+    unsigned int mask;
+    unsigned int forms; /* CONFIG_FORM_* in use */
+} config_match;
+
+static config_match config_index;
+
+static unsigned int config_match_hash(int index, int address)
+{
+    uint32_t h = ((uint32_t) index * 0x9e3779b1u) ^ ((uint32_t) address * 0x85ebca77u);
 
-        dev_config_chip *p_config_chip = NULL;
+    return h ^ (h >> 15);
+}
 
-        SLIST_FOREACH(p_config_chip, head, node) {
+static void config_match_release(config_match *cm)
+{
+    free(cm->entry);
+    free(cm->bucket);
+    memset(cm, 0, sizeof(*cm));
+}
 
-            ret = dev_match_chip_config(chip, p_config_chip);
+/**
+ * Resolve the bus of every config entry and hash the entries
+ * @param cm
+ * @param head
+ * @param topo
+ * @return negative errno on failure else zero on success
+ */
+static int config_match_compile(config_match *cm, dev_config_chip_head *head,
+        const dev_topology *topo)
+{
+    dev_config_chip *p_config_chip = NULL;
+    unsigned int buckets = 16;
+    int count = 0;
+    int k = 0;
 
-            if (ret == 1) {
-                p_config_chip->matched = true;
-                return chip;
+    memset(cm, 0, sizeof(*cm));
+    SLIST_FOREACH(p_config_chip, head, node) {
+        count++;
+    }
+    while (buckets < (unsigned int) count * 2) {
+        buckets <<= 1;
+    }
+    cm->entry = calloc(count, sizeof(*cm->entry));
+    cm->bucket = malloc(buckets * sizeof(*cm->bucket));
+    if ((cm->entry == NULL) || (cm->bucket == NULL)) {
+        config_match_release(cm);
+        return -ENOMEM;
+    }
+    memset(cm->bucket, 0xff, buckets * sizeof(*cm->bucket));
+    cm->mask = buckets - 1;
+    cm->count = count;
+    cm->topo = topo;
+
+    SLIST_FOREACH(p_config_chip, head, node) {
+        config_match_entry *entry = &cm->entry[k];
+        unsigned int form = 0;
+        unsigned int b = 0;
+
+        entry->config = p_config_chip;
+        entry->index = TOPOLOGY_NONE;
+        entry->next = -1;
+
+        if ((p_config_chip->bus.path == BUS_PATH_ANY) && (p_config_chip->bus.nr == BUS_NR_ANY)) {
+            entry->index = CONFIG_ADAPTER_ANY;
+            form = (p_config_chip->address == CHIP_NAME_ADDR_ANY) ?
+                    CONFIG_FORM_ANY : CONFIG_FORM_BUS_ANY;
+        } else {
+            if (p_config_chip->bus.path != NULL) {
+                entry->adapter = dev_i2c_lookup_i2c_bus(p_config_chip->bus.path);
             } else {
-                continue;
+                entry->adapter = lookup_dev_bus_by_nr(p_config_chip->bus.nr);
             }
+            if (entry->adapter != NULL) {
+                entry->index = dev_topology_adapter_index(topo, entry->adapter);
+            }
+            form = (p_config_chip->address == CHIP_NAME_ADDR_ANY) ?
+                    CONFIG_FORM_ADDR_ANY : CONFIG_FORM_EXACT;
+        }
+        if (entry->index != TOPOLOGY_NONE) {
+            b = config_match_hash(entry->index, p_config_chip->address) & cm->mask;
+            entry->next = cm->bucket[b];
+            entry->hashed = true;
+            cm->bucket[b] = k;
+            cm->forms |= form;
         }
+        k++;
     }
-    return NULL;
+    return 0;
 }
 
-/* Returns, one by one, a pointer to all sensor_chip structs of the
- config file which match with the given chip name. Last should be
- the value returned by the last call, or NULL if this is the first
- call. Returns NULL if no more matches are found. Do not modify
- the struct the return value points to!
- Note that this visits the list of chips from last to first. Usually,
- you want the match that was latest in the config file. */
-void dev_for_all_chips_match_config(dev_config_chip_head *head)
+void dev_config_match_invalidate(void)
 {
-    int ret = 0;
-    dev_chip *chip = NULL;
-    dev_config_chip *p_config_chip = NULL;
-    const dev_bus_adapter *adapter = NULL;
+    config_match_release(&config_index);
+}
 
-    if (head == NULL || SLIST_FIRST(head) == NULL) {
-        return;
+/**
+ * Get the compiled config list, it is compiled again when the list
+ * or the bus tree changed
+ * @param head
+ * @param topo
+ * @return the compiled list with no entries hit, or NULL if out of memory
+ */
+static config_match *config_match_get(dev_config_chip_head *head, const dev_topology *topo)
+{
+    if ((config_index.entry != NULL) && (config_index.head == head)
+            && (config_index.serial == topo->serial)) {
+        for (int k = 0; k < config_index.count; ++k) {
+            config_index.entry[k].hit = false;
+        }
+        return &config_index;
     }
+    config_match_release(&config_index);
+    if (config_match_compile(&config_index, head, topo) < 0) {
+        return NULL;
+    }
+    config_index.head = head;
+    config_index.serial = topo->serial;
+    return &config_index;
+}
 
-    SLIST_FOREACH(p_config_chip, head, node) {
+/**
+ * Look up the entries of a chip for one key form
+ * @param cm
+ * @param index topology index of the chip's adapter or CONFIG_ADAPTER_ANY
+ * @param address chip address or CHIP_NAME_ADDR_ANY
+ * @return the first entry of the bucket or -1, walk on with entry->next
+ * and skip entries with another key
+ */
+static int config_match_first(const config_match *cm, int index, int address)
+{
+    return cm->bucket[config_match_hash(index, address) & cm->mask];
+}
 
-        if (p_config_chip->bus.path != NULL) {
-            adapter = dev_i2c_lookup_i2c_bus(p_config_chip->bus.path);
-        } else {
-            adapter = lookup_dev_bus_by_nr(p_config_chip->bus.nr);
-        }
+static bool config_match_key_equal(const config_match *cm, int k, int index, int address)
+{
+    return (cm->entry[k].index == index) && (cm->entry[k].config->address == address);
+}
 
-        if (adapter == NULL) {
-            p_config_chip->adapter_available = false;
-            p_config_chip->matched = false;
-            p_config_chip->adapter = NULL;
+/**
+ * Find the config entries matching a chip
+ * @param cm
+ * @param c topology chip index
+ * @param mark_all set every matching entry's hit flag,
+ * else only return the matching entry which comes first in the config list
+ * @return the first matching entry in config list order or -1
+ */
+static int config_match_chip(config_match *cm, int c, bool mark_all)
+{
+    const dev_topology *topo = cm->topo;
+    const dev_chip *chip = topo->chip[c];
+    int keys[4][2] = {
+        { topo->chip_adapter[c], topo->chip_addr[c] },
+        { topo->chip_adapter[c], CHIP_NAME_ADDR_ANY },
+        { CONFIG_ADAPTER_ANY, topo->chip_addr[c] },
+        { CONFIG_ADAPTER_ANY, CHIP_NAME_ADDR_ANY },
+    };
+    int first = -1;
+
+    for (int form = 0; form < 4; ++form) {
+        if (!(cm->forms & (1 << form))) {
             continue;
-        } else {
-            p_config_chip->adapter_available = true;
-            p_config_chip->adapter = adapter;
         }
+        for (int k = config_match_first(cm, keys[form][0], keys[form][1]); k >= 0;
+                k = cm->entry[k].next) {
+            if (!config_match_key_equal(cm, k, keys[form][0], keys[form][1])
+                    || (mark_all && cm->entry[k].hit)
+                    || (!mark_all && (first >= 0) && (k > first))) {
+                continue;
+            }
+            if (dev_match_chip_config(chip, cm->entry[k].config)) {
+                cm->entry[k].hit = true;
+                if ((first < 0) || (k < first)) {
+                    first = k;
+                }
+            }
+        }
+    }
+    return first;
+}
 
-        SLIST_FOREACH(chip, &adapter->clients, node) {
+/**
+ * Match every config entry against the chips of the bus tree,
+ * in time linear in the number of chips plus config entries.
+ * @param head
+ * @param[out] unmatched last config entry on an adapter with chips
+ * which matched none of them, or NULL
+ */
+static void config_match_all(dev_config_chip_head *head, dev_config_chip **unmatched)
+{
+    const dev_topology *topo = NULL;
+    dev_config_chip *p_config_chip = NULL;
+    config_match *cm = NULL;
 
-            ret = dev_match_chip_config(chip, p_config_chip);
+    *unmatched = NULL;
+    topo = dev_topology_get();
+    if ((topo == NULL) || ((cm = config_match_get(head, topo)) == NULL)) {
+        /* no memory for the index, match entry by entry */
+        SLIST_FOREACH(p_config_chip, head, node) {
+            const dev_bus_adapter *adapter = NULL;
+            bool has_chips = false;
+            dev_chip *chip = NULL;
 
-            if (ret == 1) {
-                p_config_chip->matched = true;
-                break;
+            if (p_config_chip->bus.path != NULL) {
+                adapter = dev_i2c_lookup_i2c_bus(p_config_chip->bus.path);
             } else {
+                adapter = lookup_dev_bus_by_nr(p_config_chip->bus.nr);
+            }
+            p_config_chip->adapter = adapter;
+            p_config_chip->adapter_available = (adapter != NULL);
+            if (adapter == NULL) {
                 p_config_chip->matched = false;
                 continue;
             }
+            chip = adapter_match_config_chip(NULL, adapter, p_config_chip, &has_chips);
+            p_config_chip->matched = (chip != NULL);
+            I2CDEV_PROBE4(config__match, p_config_chip->prefix, adapter->nr,
+                    p_config_chip->address, p_config_chip->matched);
+            if (has_chips && (chip == NULL)) {
+                *unmatched = p_config_chip;
+            }
         }
+        return;
     }
-}
 
-/* Returns, one by one, a pointer to all sensor_chip structs of the
- config file which match with the given chip name. Last should be
- the value returned by the last call, or NULL if this is the first
- call. Returns NULL if no more matches are found. Do not modify
- the struct the return value points to!
- Note that this visits the list of chips from last to first. Usually,
- you want the match that was latest in the config file. */
-dev_config_chip *dev_config_chip_not_matched_chips(dev_config_chip_head *head)
-{
-    dev_config_chip *p_config_chip = NULL;
-    dev_config_chip *unconfigured_chip = NULL;
-    const dev_bus_adapter *adapter = NULL;
-
-    if (head == NULL || SLIST_FIRST(head) == NULL) {
-        return NULL;
+    for (int c = 0; c < topo->chip_count; ++c) {
+        config_match_chip(cm, c, true);
     }
 
-    SLIST_FOREACH(p_config_chip, head, node) {
-        dev_chip *chip = NULL;
-        if (p_config_chip->bus.path != NULL) {
-            adapter = dev_i2c_lookup_i2c_bus(p_config_chip->bus.path);
-        } else {
-            adapter = lookup_dev_bus_by_nr(p_config_chip->bus.nr);
-        }
+    for (int k = 0; k < cm->count; ++k) {
+        config_match_entry *entry = &cm->entry[k];
+        bool has_chips = false;
+        bool found = false;
 
-        if (adapter == NULL) {
+        p_config_chip = entry->config;
+        if (entry->index == CONFIG_ADAPTER_ANY) {
+            /* a wildcard bus names no adapter to create the chip on */
+            p_config_chip->adapter_available = (topo->adapter_count > 0);
+            p_config_chip->adapter = NULL;
+            has_chips = (topo->chip_count > 0);
+            found = entry->hit;
+        } else if (entry->adapter == NULL) {
             p_config_chip->adapter_available = false;
             p_config_chip->matched = false;
             p_config_chip->adapter = NULL;
             continue;
         } else {
             p_config_chip->adapter_available = true;
-            p_config_chip->adapter = adapter;
+            p_config_chip->adapter = entry->adapter;
+            if (entry->hashed) {
+                has_chips = (topo->first_chip[entry->index] != topo->first_chip[entry->index + 1]);
+                found = entry->hit;
+            } else {
+                /* adapters left out of the topology */
+                found = (adapter_match_config_chip(topo, entry->adapter, p_config_chip,
+                        &has_chips) != NULL);
+            }
         }
 
+        /* the chip may have been removed since the last match, don't keep a stale result */
+        p_config_chip->matched = found;
+        I2CDEV_PROBE4(config__match, p_config_chip->prefix,
+                (entry->adapter != NULL) ? entry->adapter->nr : -1,
+                p_config_chip->address, found);
+        if (has_chips && !found) {
+            *unmatched = p_config_chip;
+        }
+    }
+}
+
+/* Returns the first chip of an adapter which matches any config entry
+ and marks the first such entry in the config list as matched.
+ Returns NULL if none of the adapter's chips is configured. */
+dev_chip *dev_match_all_adapter_configured_chips(dev_bus_adapter *adapter,
+        dev_config_chip_head *head)
+{
+    const dev_topology *topo = NULL;
+    dev_chip *chip = NULL;
+    config_match *cm = NULL;
+    int i = TOPOLOGY_NONE;
+
+    if (adapter == NULL) {
+        return NULL;
+    }
+
+    if ((head == NULL) || (SLIST_FIRST(head) == NULL)) {
+        return NULL;
+    }
+
+    topo = dev_topology_get();
+    i = dev_topology_adapter_index(topo, adapter);
+    if ((i == TOPOLOGY_NONE) || ((cm = config_match_get(head, topo)) == NULL)) {
         SLIST_FOREACH(chip, &adapter->clients, node) {
-            if (dev_match_chip_config(chip, p_config_chip)) {
-                p_config_chip->matched = true;
-                break;
-            } else {
-                p_config_chip->matched = false;
-                unconfigured_chip = p_config_chip;
-                continue;
+            dev_config_chip *p_config_chip = NULL;
+
+            SLIST_FOREACH(p_config_chip, head, node) {
+                if (dev_match_chip_config(chip, p_config_chip)) {
+                    p_config_chip->matched = true;
+                    return chip;
+                }
             }
         }
+        return NULL;
+    }
+
+    chip = NULL;
+    for (int c = topo->first_chip[i]; c < topo->first_chip[i + 1]; ++c) {
+        int k = config_match_chip(cm, c, false);
+
+        if (k >= 0) {
+            cm->entry[k].config->matched = true;
+            chip = topo->chip[c];
+            break;
+        }
+    }
+    return chip;
+}
+
+/* Match every config entry against the chips of its adapter, setting
+ its matched, adapter_available and adapter fields. */
+void dev_for_all_chips_match_config(dev_config_chip_head *head)
+{
+    dev_config_chip *unmatched = NULL;
+
+    if (head == NULL || SLIST_FIRST(head) == NULL) {
+        return;
     }
-    return unconfigured_chip;
+    config_match_all(head, &unmatched);
 }
 
+/* Match every config entry like dev_for_all_chips_match_config() and
+ return the last one which sits on an adapter with chips but matches
+ none of them, or NULL if there is none. */
+dev_config_chip *dev_config_chip_not_matched_chips(dev_config_chip_head *head)
+{
+    dev_config_chip *unmatched = NULL;
+
+    if (head == NULL || SLIST_FIRST(head) == NULL) {
+        return NULL;
+    }
+    config_match_all(head, &unmatched);
+    return unmatched;
+}
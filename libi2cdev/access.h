@@ -12,6 +12,7 @@
    one chip, or whether it has wildcards. Returns 0 if it is absolute, 1
    if there are wildcards. */
 int dev_chip_name_has_wildcards(const dev_chip *chip);
+int dev_config_chip_has_wildcards(const dev_config_chip *chip);
 
 /* Compare two chips name descriptions, to see whether they could match.
  Return 0 if it does not match, return 1 if it does match. */
@@ -20,4 +21,6 @@ int dev_match_chip_config(const dev_chip *chip1, const dev_config_chip *chip2);
 void dev_for_all_chips_match_config(dev_config_chip_head *head);
 dev_chip *dev_match_all_adapter_configured_chips(dev_bus_adapter *adapter, dev_config_chip_head *head);
 dev_config_chip *dev_config_chip_not_matched_chips(dev_config_chip_head *head);
+/* Drop the compiled config list, call when config entries are added or freed */
+void dev_config_match_invalidate(void);
 #endif /* def LIB_SENSORS_ACCESS_H */
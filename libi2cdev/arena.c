@@ -0,0 +1,137 @@
+/**
+ * @file arena.c
+ * @copyright Violin Memory, Inc, 2014
+ *
+ * @brief Bump allocator backing the bus tree of one topology generation.
+ *
+ * A full discovery allocates every adapter, chip and string of the bus tree
+ * from one reserved address range, so building it costs no malloc() calls
+ * and tearing it down is a single munmap(). Objects the tree drops while the
+ * generation is alive are not reused, so incremental updates done after
+ * dev_arena_end() go back to the heap and only the initial tree is held here.
+ */
+
+#define _GNU_SOURCE 1
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include <sys/mman.h>
+
+#include "common.h"
+#include "arena.h"
+#include "syscalls.h"
+
+#include "i2c-error.h"
+#include "i2cdiscov.h"
+
+/* address space only, pages are committed as the tree grows */
+#define ARENA_RESERVE_SIZE  (64UL << 20)
+#define ARENA_ALIGN         (sizeof(long double))
+
+static char *arena_base = NULL;
+static size_t arena_used = 0;
+static bool arena_active = false;
+
+void dev_arena_release(void)
+{
+    if (arena_base != NULL) {
+        dev_sys_munmap(arena_base, ARENA_RESERVE_SIZE);
+    }
+    arena_base = NULL;
+    arena_used = 0;
+    arena_active = false;
+}
+
+void dev_arena_begin(void)
+{
+    void *base = NULL;
+
+    dev_arena_release();
+
+    base = dev_sys_mmap(NULL, ARENA_RESERVE_SIZE, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        /* not fatal, the tree is simply built on the heap */
+        devi2c_info(NULL, "failed to reserve topology arena - %s", strerror(errno));
+        return;
+    }
+    arena_base = base;
+    arena_active = true;
+}
+
+void dev_arena_end(void)
+{
+    if (arena_active && (i2c_dev_verbose > 2)) {
+        devi2c_debug(NULL, "topology arena holds %zu bytes", arena_used);
+    }
+    arena_active = false;
+}
+
+bool dev_arena_owns(const void *ptr)
+{
+    const char *p = ptr;
+
+    return (arena_base != NULL) && (p >= arena_base) && (p < arena_base + arena_used);
+}
+
+/**
+ * Carve size bytes off the arena
+ * @param size
+ * @param align power of two alignment of the returned memory
+ * @return zeroed memory or NULL if the arena can't hold it
+ */
+static void *arena_alloc(size_t size, size_t align)
+{
+    size_t offset = (arena_used + align - 1) & ~(align - 1);
+
+    if (!arena_active || (size == 0) || (offset > ARENA_RESERVE_SIZE)
+            || (size > ARENA_RESERVE_SIZE - offset)) {
+        return NULL;
+    }
+    /* fresh anonymous pages are zero filled and never handed out twice */
+    arena_used = offset + size;
+    return arena_base + offset;
+}
+
+void *dev_arena_calloc(size_t nmemb, size_t size)
+{
+    void *ptr = NULL;
+
+    if ((size != 0) && (nmemb > SIZE_MAX / size)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    ptr = arena_alloc(nmemb * size, ARENA_ALIGN);
+    if (ptr == NULL) {
+        ptr = calloc(nmemb, size);
+    }
+    return ptr;
+}
+
+char *dev_arena_strndup(const char *str, size_t len)
+{
+    char *copy = NULL;
+
+    len = strnlen(str, len);
+    copy = arena_alloc(len + 1, 1);
+    if (copy == NULL) {
+        return strndup(str, len);
+    }
+    memcpy(copy, str, len);
+    return copy;
+}
+
+char *dev_arena_strdup(const char *str)
+{
+    return dev_arena_strndup(str, SIZE_MAX);
+}
+
+void dev_arena_free(void *ptr)
+{
+    if (!dev_arena_owns(ptr)) {
+        free(ptr);
+    }
+}
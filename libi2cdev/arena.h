@@ -0,0 +1,68 @@
+/**
+ * @file arena.h
+ * @copyright Violin Memory, Inc, 2014
+ * @brief Bump allocator backing the bus tree of one topology generation
+ */
+
+#ifndef LIB_ARENA_H
+#define LIB_ARENA_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * Start allocating a topology generation from the arena.
+ * Anything left over from the previous generation is released,
+ * nothing may reference it any more.
+ */
+extern void dev_arena_begin(void);
+
+/**
+ * Stop allocating from the arena, later allocations come from the heap.
+ * The generation stays valid until dev_arena_release().
+ */
+extern void dev_arena_end(void);
+
+/**
+ * Release the whole generation in one go
+ */
+extern void dev_arena_release(void);
+
+/**
+ * Allocate zeroed memory from the arena while a generation is being built,
+ * else from the heap
+ * @param nmemb
+ * @param size
+ * @return pointer to the memory or NULL if out of memory
+ */
+extern void *dev_arena_calloc(size_t nmemb, size_t size);
+
+/**
+ * Duplicate a string with dev_arena_calloc()
+ * @param str
+ * @return the copy or NULL if out of memory
+ */
+extern char *dev_arena_strdup(const char *str);
+
+/**
+ * Duplicate at most len bytes of a string with dev_arena_calloc()
+ * @param str
+ * @param len
+ * @return the NUL terminated copy or NULL if out of memory
+ */
+extern char *dev_arena_strndup(const char *str, size_t len);
+
+/**
+ * Free memory returned by the dev_arena_*() allocators.
+ * Arena memory is only given back by dev_arena_release().
+ * @param ptr
+ */
+extern void dev_arena_free(void *ptr);
+
+/**
+ * @param ptr
+ * @return true if ptr points into the current arena
+ */
+extern bool dev_arena_owns(const void *ptr);
+
+#endif /* !LIB_ARENA_H */
@@ -0,0 +1,255 @@
+/**
+ * @file chip-index.c
+ * @copyright Violin Memory, Inc, 2014
+ *
+ * @brief Secondary indexes over the chips of the bus tree.
+ *
+ * Each index is a copy of the topology's chip array sorted by its key and
+ * then by bus tree order, so a query is a pair of binary searches and its
+ * matches are a contiguous slice. An index is built on the first query for
+ * its key after the topology changed, keys that are never asked for cost
+ * nothing and the driver and module stay unread until they are.
+ */
+
+#define _GNU_SOURCE 1
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+
+#include "common.h"
+#include "data.h"
+#include "topology.h"
+#include "chip-index.h"
+
+#include "i2c-error.h"
+#include "i2c-dev-parser.h"
+#include "i2cdiscov.h"
+
+typedef struct chip_index_entry {
+    const char *key;
+    int addr;
+    int order; /* index into the topology chip array */
+} chip_index_entry;
+
+typedef struct chip_index {
+    unsigned long serial; /* topology the index was built from */
+    int count;
+    chip_index_entry *entry;
+    dev_chip **chip; /* same order as entry */
+} chip_index;
+
+static chip_index chip_indexes[DEV_CHIP_KEY_MAX];
+
+void dev_chip_index_release(void)
+{
+    for (int key = 0; key < DEV_CHIP_KEY_MAX; ++key) {
+        free(chip_indexes[key].entry);
+    }
+    memset(chip_indexes, 0, sizeof(chip_indexes));
+}
+
+static int chip_index_compare_key(const void *p1, const void *p2)
+{
+    const chip_index_entry *e1 = p1;
+    const chip_index_entry *e2 = p2;
+    int ret = strcasecmp(e1->key, e2->key);
+
+    if (ret == 0) {
+        ret = (e1->order > e2->order) - (e1->order < e2->order);
+    }
+    return ret;
+}
+
+static int chip_index_compare_addr(const void *p1, const void *p2)
+{
+    const chip_index_entry *e1 = p1;
+    const chip_index_entry *e2 = p2;
+
+    if (e1->addr != e2->addr) {
+        return (e1->addr > e2->addr) - (e1->addr < e2->addr);
+    }
+    return (e1->order > e2->order) - (e1->order < e2->order);
+}
+
+/**
+ * @param chip
+ * @param key
+ * @return the value of a chip's string key or NULL if it has none
+ */
+static const char *chip_index_key(const dev_chip *chip, dev_chip_key key)
+{
+    switch (key) {
+    case DEV_CHIP_KEY_NAME:
+        return chip->name;
+    case DEV_CHIP_KEY_DRIVER:
+        return dev_chip_get_driver(chip);
+    case DEV_CHIP_KEY_MODULE:
+        return dev_chip_get_module(chip);
+    default:
+        return NULL;
+    }
+}
+
+/**
+ * Get the index for a key, (re)building it if the topology changed
+ * @param key
+ * @return the index or NULL if it couldn't be built
+ */
+static const chip_index *chip_index_get(dev_chip_key key)
+{
+    chip_index *index = &chip_indexes[key];
+    const dev_topology *topo = NULL;
+    chip_index_entry *entry = NULL;
+    int count = 0;
+
+    topo = dev_topology_get();
+    if (topo == NULL) {
+        return NULL;
+    }
+    if ((index->entry != NULL) && (index->serial == topo->serial)) {
+        return index;
+    }
+
+    free(index->entry);
+    memset(index, 0, sizeof(*index));
+
+    /* one block holds the entries followed by the sorted chip pointers */
+    entry = malloc((size_t) (topo->chip_count + 1) * (sizeof(*entry) + sizeof(dev_chip *)));
+    if (entry == NULL) {
+        return NULL;
+    }
+    for (int c = 0; c < topo->chip_count; ++c) {
+        const char *value = NULL;
+
+        if (key != DEV_CHIP_KEY_ADDR) {
+            value = chip_index_key(topo->chip[c], key);
+            if (value == NULL) {
+                continue;
+            }
+        }
+        entry[count].key = value;
+        entry[count].addr = topo->chip_addr[c];
+        entry[count].order = c;
+        count++;
+    }
+    qsort(entry, count, sizeof(*entry),
+            (key == DEV_CHIP_KEY_ADDR) ? chip_index_compare_addr : chip_index_compare_key);
+
+    index->entry = entry;
+    index->chip = (dev_chip **) (entry + topo->chip_count + 1);
+    for (int i = 0; i < count; ++i) {
+        index->chip[i] = topo->chip[entry[i].order];
+    }
+    index->count = count;
+    index->serial = topo->serial;
+
+    if (i2c_dev_verbose > 2) {
+        devi2c_debug(NULL, "built chip index %d: %d of %d chips",
+                key, count, topo->chip_count);
+    }
+    return index;
+}
+
+/**
+ * Compare an index entry against a query
+ * @param entry
+ * @param key
+ * @param value
+ * @param addr
+ * @return <0, 0 or >0 like strcmp
+ */
+static int chip_index_entry_compare(const chip_index_entry *entry, dev_chip_key key,
+        const char *value, int addr)
+{
+    if (key == DEV_CHIP_KEY_ADDR) {
+        return (entry->addr > addr) - (entry->addr < addr);
+    }
+    return strcasecmp(entry->key, value);
+}
+
+/**
+ * Point an iterator at the slice of an index matching a query
+ * @param iter
+ * @param key
+ * @param value
+ * @param addr
+ * @return negative errno on failure else the number of matches
+ */
+static int chip_index_query(dev_chip_iter *iter, dev_chip_key key, const char *value, int addr)
+{
+    const chip_index *index = NULL;
+    int lo = 0;
+    int hi = 0;
+    int end = 0;
+
+    memset(iter, 0, sizeof(*iter));
+    if (!check_libi2cdev_ready()) {
+        return -ENODEV;
+    }
+    index = chip_index_get(key);
+    if (index == NULL) {
+        return -ENOMEM;
+    }
+
+    /* first entry not below the query */
+    hi = index->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+
+        if (chip_index_entry_compare(&index->entry[mid], key, value, addr) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    /* first entry above the query */
+    end = lo;
+    hi = index->count;
+    while (end < hi) {
+        int mid = end + (hi - end) / 2;
+
+        if (chip_index_entry_compare(&index->entry[mid], key, value, addr) <= 0) {
+            end = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    iter->chips = index->chip + lo;
+    iter->count = end - lo;
+    iter->serial = index->serial;
+    return iter->count;
+}
+
+int dev_chip_query(dev_chip_iter *iter, dev_chip_key key, const char *value)
+{
+    if ((iter == NULL) || (value == NULL)
+            || ((key != DEV_CHIP_KEY_NAME) && (key != DEV_CHIP_KEY_DRIVER)
+                    && (key != DEV_CHIP_KEY_MODULE))) {
+        return -EINVAL;
+    }
+    return chip_index_query(iter, key, value, 0);
+}
+
+int dev_chip_query_addr(dev_chip_iter *iter, int addr)
+{
+    if (iter == NULL) {
+        return -EINVAL;
+    }
+    return chip_index_query(iter, DEV_CHIP_KEY_ADDR, NULL, addr);
+}
+
+const dev_chip *dev_chip_iter_next(dev_chip_iter *iter)
+{
+    if ((iter == NULL) || (iter->pos >= iter->count)) {
+        return NULL;
+    }
+    /* the chips may have been freed along with the old topology */
+    if (iter->serial != dev_topology_serial()) {
+        iter->pos = iter->count;
+        return NULL;
+    }
+    return iter->chips[iter->pos++];
+}
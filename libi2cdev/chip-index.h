@@ -0,0 +1,15 @@
+/**
+ * @file chip-index.h
+ * @copyright Violin Memory, Inc, 2014
+ * @brief Secondary indexes over the chips of the bus tree
+ */
+
+#ifndef LIB_CHIP_INDEX_H
+#define LIB_CHIP_INDEX_H
+
+/**
+ * Free the chip indexes
+ */
+extern void dev_chip_index_release(void);
+
+#endif /* !LIB_CHIP_INDEX_H */
@@ -0,0 +1,676 @@
+/**
+ * @file compiled-config.c
+ * @copyright Violin Memory, Inc, 2014
+ *
+ * @brief Pre-parsed binary copy of the chip configuration files.
+ *
+ * i2cdev_compile_config() writes the entries read from the config file and
+ * directory to a flat file together with the size and modification time
+ * of every source. i2cdev_init() maps that file instead of parsing the text
+ * as long as no source was added, removed or changed since; the bus paths
+ * and file names of the entries point into the mapping and every chip name
+ * is interned once.
+ */
+
+#define _GNU_SOURCE 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <linux/limits.h> /* for PATH_MAX */
+
+#include "common.h"
+#include "data.h"
+#include "access.h"
+#include "intern.h"
+#include "config-parser.h"
+#include "compiled-config.h"
+#include "syscalls.h"
+
+#include "i2c-error.h"
+#include "i2c-dev-parser.h"
+#include "i2cdiscov.h"
+
+#define DEFAULT_COMPILED_CONFIG_FILE	ETCDIR"/i2cdiscov.cache"
+
+#define COMPILED_CONFIG_MAGIC   0x43433249 /* "I2CC" */
+#define COMPILED_CONFIG_VERSION 1
+
+#define COMPILED_NONE           UINT32_MAX
+
+/*
+ * File layout:
+ *  compiled_header
+ *  compiled_source[source_count]   config file, config directory, files in it
+ *  uint32_t names[name_count]      string offsets of the chip names
+ *  compiled_entry[entry_count]     in config list order
+ *  string table[strings_size]      string offsets of zero stand for NULL
+ */
+typedef struct compiled_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;
+    uint32_t source_count;
+    uint32_t name_count;
+    uint32_t entry_count;
+    uint32_t strings_size;
+} compiled_header;
+
+typedef struct compiled_source {
+    uint32_t path;
+    uint32_t kind;
+    int64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+} compiled_source;
+
+typedef struct compiled_entry {
+    uint32_t name; /* index into names or COMPILED_NONE for any chip */
+    int32_t address;
+    int32_t bus_type;
+    int32_t bus_nr;
+    uint32_t bus_path;
+    uint32_t source;
+    int32_t lineno;
+    uint32_t reserved;
+} compiled_entry;
+
+/* string table being written, equal strings are stored once */
+typedef struct compiled_strings {
+    char *buf;
+    size_t len;
+    size_t max;
+    uint32_t *hash; /* string offsets, zero for a free slot */
+    size_t hash_size;
+    size_t hash_count;
+    bool failed;
+} compiled_strings;
+
+static char *compiled_file = NULL;
+static bool compiled_disabled = false;
+
+static void *compiled_map = NULL;
+static size_t compiled_map_size = 0;
+
+int i2cdev_set_compiled_config_file(const char *path)
+{
+    char *file = NULL;
+
+    if (path != NULL) {
+        file = strdup(path);
+        if (file == NULL) {
+            return -ENOMEM;
+        }
+    }
+    free(compiled_file);
+    compiled_file = file;
+    compiled_disabled = (path == NULL);
+    return 0;
+}
+
+static const char *compiled_file_name(void)
+{
+    if (compiled_disabled) {
+        return NULL;
+    }
+    return (compiled_file != NULL) ? compiled_file : DEFAULT_COMPILED_CONFIG_FILE;
+}
+
+void dev_compiled_config_release(void)
+{
+    if (compiled_map != NULL) {
+        dev_sys_munmap(compiled_map, compiled_map_size);
+    }
+    compiled_map = NULL;
+    compiled_map_size = 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void dev_config_sources_free(dev_config_sources *sources)
+{
+    for (int i = 0; i < sources->count; ++i) {
+        free(sources->source[i].path);
+    }
+    free(sources->source);
+    sources->source = NULL;
+    sources->count = 0;
+}
+
+static int config_sources_add(dev_config_sources *sources, const char *path, int max)
+{
+    dev_config_source *source = NULL;
+    struct stat st;
+
+    if (sources->count == max) {
+        return -EOVERFLOW;
+    }
+    source = &sources->source[sources->count];
+    memset(source, 0, sizeof(*source));
+    source->path = strdup(path);
+    if (source->path == NULL) {
+        return -ENOMEM;
+    }
+    sources->count++;
+
+    if (dev_sys_stat(path, &st) < 0) {
+        if (errno != ENOENT) {
+            return -errno;
+        }
+        source->kind = CONFIG_SOURCE_MISSING;
+        return 0;
+    }
+    source->kind = S_ISDIR(st.st_mode) ? CONFIG_SOURCE_DIR : CONFIG_SOURCE_FILE;
+    source->size = st.st_size;
+    source->mtime_sec = st.st_mtim.tv_sec;
+    source->mtime_nsec = st.st_mtim.tv_nsec;
+    return 0;
+}
+
+static int config_sources_filter(const struct dirent *entry)
+{
+    return entry->d_name[0] != '.'; /* Skip hidden files */
+}
+
+int dev_config_sources_scan(const char *file, const char *dir, dev_config_sources *sources)
+{
+    struct dirent **namelist = NULL;
+    int count = 0;
+    int max = 2;
+    int err = 0;
+
+    memset(sources, 0, sizeof(*sources));
+
+    /* the directory's time changes whenever a file is added or removed */
+    count = dev_sys_scandir(dir, &namelist, config_sources_filter, alphasort);
+    if (count < 0) {
+        if (errno != ENOENT) {
+            return -errno;
+        }
+        count = 0;
+    }
+    max += count;
+    sources->source = calloc(max, sizeof(*sources->source));
+    if (sources->source == NULL) {
+        err = -ENOMEM;
+        goto exit_free;
+    }
+    if (((err = config_sources_add(sources, file, max)) < 0)
+            || ((err = config_sources_add(sources, dir, max)) < 0)) {
+        goto exit_free;
+    }
+    for (int i = 0; i < count; ++i) {
+        char path[PATH_MAX];
+        int len = snprintf(path, sizeof(path), "%s/%s", dir, namelist[i]->d_name);
+
+        if (len < 0 || len >= (int) sizeof(path)) {
+            err = -ENAMETOOLONG;
+            goto exit_free;
+        }
+        err = config_sources_add(sources, path, max);
+        if (err < 0) {
+            goto exit_free;
+        }
+        /* only regular files are read */
+        if (sources->source[sources->count - 1].kind != CONFIG_SOURCE_FILE) {
+            free(sources->source[--sources->count].path);
+        }
+    }
+
+exit_free:
+    for (int i = 0; i < count; ++i) {
+        free(namelist[i]);
+    }
+    free(namelist);
+    if (err < 0) {
+        dev_config_sources_free(sources);
+    }
+    return err;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static uint32_t compiled_hash(const char *str)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*str != '\0') {
+        hash = (hash ^ (unsigned char) *str++) * 16777619u;
+    }
+    return hash;
+}
+
+static bool compiled_strings_grow_hash(compiled_strings *strings)
+{
+    size_t size = strings->hash_size ? strings->hash_size * 2 : 1024;
+    uint32_t *hash = calloc(size, sizeof(*hash));
+
+    if (hash == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < strings->hash_size; ++i) {
+        uint32_t offset = strings->hash[i];
+
+        if (offset != 0) {
+            size_t slot = compiled_hash(strings->buf + offset) & (size - 1);
+
+            while (hash[slot] != 0) {
+                slot = (slot + 1) & (size - 1);
+            }
+            hash[slot] = offset;
+        }
+    }
+    free(strings->hash);
+    strings->hash = hash;
+    strings->hash_size = size;
+    return true;
+}
+
+static uint32_t compiled_add_string(compiled_strings *strings, const char *str)
+{
+    size_t len = 0;
+    size_t slot = 0;
+    uint32_t offset = 0;
+
+    if ((str == NULL) || strings->failed) {
+        return 0;
+    }
+    if ((strings->hash_count + 1) * 2 > strings->hash_size) {
+        if (!compiled_strings_grow_hash(strings)) {
+            strings->failed = true;
+            return 0;
+        }
+    }
+    slot = compiled_hash(str) & (strings->hash_size - 1);
+    while (strings->hash[slot] != 0) {
+        if (!strcmp(strings->buf + strings->hash[slot], str)) {
+            return strings->hash[slot];
+        }
+        slot = (slot + 1) & (strings->hash_size - 1);
+    }
+
+    len = strlen(str) + 1;
+    if (strings->len + len > strings->max) {
+        size_t max = (strings->max != 0) ? strings->max * 2 : 4096;
+        char *buf = NULL;
+
+        while (strings->len + len > max) {
+            max *= 2;
+        }
+        buf = (max <= UINT32_MAX) ? realloc(strings->buf, max) : NULL;
+        if (buf == NULL) {
+            strings->failed = true;
+            return 0;
+        }
+        strings->buf = buf;
+        strings->max = max;
+    }
+    offset = (uint32_t) strings->len;
+    memcpy(strings->buf + strings->len, str, len);
+    strings->len += len;
+    strings->hash[slot] = offset;
+    strings->hash_count++;
+    return offset;
+}
+
+/**
+ * @param sources
+ * @param filename
+ * @param hint index to try first
+ * @return index of the source a file name belongs to or COMPILED_NONE
+ */
+static uint32_t compiled_source_index(const dev_config_sources *sources, const char *filename,
+        uint32_t hint)
+{
+    if (filename == NULL) {
+        return COMPILED_NONE;
+    }
+    if ((hint < (uint32_t) sources->count) && !strcmp(sources->source[hint].path, filename)) {
+        return hint;
+    }
+    for (int i = 0; i < sources->count; ++i) {
+        if ((sources->source[i].kind == CONFIG_SOURCE_FILE)
+                && !strcmp(sources->source[i].path, filename)) {
+            return (uint32_t) i;
+        }
+    }
+    return COMPILED_NONE;
+}
+
+int dev_config_compile(const char *path, const dev_config_sources *sources,
+        const dev_config_chip_head *head)
+{
+    const char *file = (path != NULL) ? path : compiled_file_name();
+    char tmp_name[PATH_MAX];
+    compiled_header header;
+    compiled_strings strings;
+    compiled_source *srcs = NULL;
+    compiled_entry *entries = NULL;
+    uint32_t *names = NULL;
+    const char **name_ptr = NULL; /* hash of the interned names seen */
+    uint32_t *name_slot = NULL;
+    size_t name_hash_size = 16;
+    const dev_config_chip *chip = NULL;
+    uint32_t name_count = 0;
+    uint32_t entry_count = 0;
+    uint32_t source = 0;
+    size_t e = 0;
+    int fd = -1;
+    int err = 0;
+
+    if ((file == NULL) || (sources == NULL) || (head == NULL)) {
+        return -EINVAL;
+    }
+    memset(&header, 0, sizeof(header));
+    memset(&strings, 0, sizeof(strings));
+
+    SLIST_FOREACH(chip, head, node) {
+        entry_count++;
+    }
+    while (name_hash_size < (size_t) entry_count * 2) {
+        name_hash_size *= 2;
+    }
+    srcs = calloc(sources->count ? sources->count : 1, sizeof(*srcs));
+    entries = calloc(entry_count ? entry_count : 1, sizeof(*entries));
+    names = calloc(entry_count ? entry_count : 1, sizeof(*names));
+    name_ptr = calloc(name_hash_size, sizeof(*name_ptr));
+    name_slot = calloc(name_hash_size, sizeof(*name_slot));
+    strings.buf = calloc(1, strings.max = 4096);
+    if ((srcs == NULL) || (entries == NULL) || (names == NULL) || (name_ptr == NULL)
+            || (name_slot == NULL) || (strings.buf == NULL)) {
+        err = -ENOMEM;
+        goto exit_free;
+    }
+    /* offset zero is reserved for NULL */
+    strings.len = 1;
+
+    for (int i = 0; i < sources->count; ++i) {
+        srcs[i].path = compiled_add_string(&strings, sources->source[i].path);
+        srcs[i].kind = sources->source[i].kind;
+        srcs[i].size = sources->source[i].size;
+        srcs[i].mtime_sec = sources->source[i].mtime_sec;
+        srcs[i].mtime_nsec = sources->source[i].mtime_nsec;
+    }
+
+    SLIST_FOREACH(chip, head, node) {
+        compiled_entry *rec = &entries[e++];
+
+        rec->name = COMPILED_NONE;
+        if (chip->prefix != CHIP_NAME_PREFIX_ANY) {
+            /* chip names are interned, equal names share a pointer */
+            size_t slot = ((uintptr_t) chip->prefix >> 3) & (name_hash_size - 1);
+
+            while ((name_ptr[slot] != NULL) && (name_ptr[slot] != chip->prefix)) {
+                slot = (slot + 1) & (name_hash_size - 1);
+            }
+            if (name_ptr[slot] == NULL) {
+                name_ptr[slot] = chip->prefix;
+                name_slot[slot] = name_count;
+                names[name_count++] = compiled_add_string(&strings, chip->prefix);
+            }
+            rec->name = name_slot[slot];
+        }
+        rec->address = chip->address;
+        rec->bus_type = chip->bus.type;
+        rec->bus_nr = chip->bus.nr;
+        rec->bus_path = compiled_add_string(&strings, chip->bus.path);
+        rec->lineno = chip->line.lineno;
+
+        source = compiled_source_index(sources, chip->line.filename, source);
+        if (source == COMPILED_NONE) {
+            /* not read from the config files, e.g. from stdin */
+            err = -EINVAL;
+            goto exit_free;
+        }
+        rec->source = source;
+    }
+
+    if (strings.failed) {
+        err = -ENOMEM;
+        goto exit_free;
+    }
+
+    header.magic = COMPILED_CONFIG_MAGIC;
+    header.version = COMPILED_CONFIG_VERSION;
+    header.source_count = (uint32_t) sources->count;
+    header.name_count = name_count;
+    header.entry_count = entry_count;
+    header.strings_size = (uint32_t) strings.len;
+    header.size = sizeof(header) + (sources->count * sizeof(*srcs))
+            + (name_count * sizeof(*names)) + (entry_count * sizeof(*entries)) + strings.len;
+
+    /* write a new file and rename it over the old one so readers never see a partial file */
+    if (snprintf(tmp_name, sizeof(tmp_name), "%s.XXXXXX", file) >= (int) sizeof(tmp_name)) {
+        err = -ENAMETOOLONG;
+        goto exit_free;
+    }
+    fd = dev_sys_mkostemp(tmp_name, O_CLOEXEC);
+    if (fd < 0) {
+        err = -errno;
+        goto exit_free;
+    }
+    dev_sys_fchmod(fd, 0644);
+
+    if (((err = dev_sys_write_all(fd, &header, sizeof(header))) < 0)
+            || ((err = dev_sys_write_all(fd, srcs, sources->count * sizeof(*srcs))) < 0)
+            || ((err = dev_sys_write_all(fd, names, name_count * sizeof(*names))) < 0)
+            || ((err = dev_sys_write_all(fd, entries, entry_count * sizeof(*entries))) < 0)
+            || ((err = dev_sys_write_all(fd, strings.buf, strings.len)) < 0)) {
+        dev_sys_close(fd);
+        dev_sys_unlink(tmp_name);
+        goto exit_free;
+    }
+    dev_sys_close(fd);
+    if (dev_sys_rename(tmp_name, file) < 0) {
+        err = -errno;
+        dev_sys_unlink(tmp_name);
+        goto exit_free;
+    }
+    err = 0;
+
+    if (i2c_dev_verbose > 1) {
+        devi2c_debug(NULL, "compiled %u config entries from %d sources to %s",
+                entry_count, sources->count, file);
+    }
+
+exit_free:
+    if (err < 0) {
+        devi2c_debug(NULL, "failed to write compiled config %s - %s", file, strerror(-err));
+    }
+    free(name_slot);
+    free(name_ptr);
+    free(strings.hash);
+    free(strings.buf);
+    free(names);
+    free(entries);
+    free(srcs);
+    return err;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Check that a mapped compiled config is intact and was compiled from the
+ * sources as they are now
+ * @param map
+ * @param size
+ * @param sources
+ * @return negative errno if it can't be used else zero
+ */
+static int compiled_validate(const void *map, size_t size, const dev_config_sources *sources)
+{
+    const compiled_header *header = map;
+    const compiled_source *srcs = NULL;
+    const uint32_t *names = NULL;
+    const compiled_entry *entries = NULL;
+    const char *strings = NULL;
+    uint64_t expected = 0;
+
+    if ((header->magic != COMPILED_CONFIG_MAGIC) || (header->version != COMPILED_CONFIG_VERSION)
+            || (header->size != size)) {
+        return -EINVAL;
+    }
+    expected = sizeof(*header) + ((uint64_t) header->source_count * sizeof(*srcs))
+            + ((uint64_t) header->name_count * sizeof(*names))
+            + ((uint64_t) header->entry_count * sizeof(*entries)) + header->strings_size;
+    if ((expected != size) || (header->strings_size == 0)) {
+        return -EINVAL;
+    }
+    srcs = (const compiled_source *) (header + 1);
+    names = (const uint32_t *) (srcs + header->source_count);
+    entries = (const compiled_entry *) (names + header->name_count);
+    strings = (const char *) (entries + header->entry_count);
+    if (strings[header->strings_size - 1] != '\0') {
+        return -EINVAL;
+    }
+
+    /* every source must be exactly as it was */
+    if (header->source_count != (uint32_t) sources->count) {
+        return -ESTALE;
+    }
+    for (uint32_t i = 0; i < header->source_count; ++i) {
+        const dev_config_source *source = &sources->source[i];
+
+        if ((srcs[i].path == 0) || (srcs[i].path >= header->strings_size)) {
+            return -EINVAL;
+        }
+        if (strcmp(strings + srcs[i].path, source->path) || (srcs[i].kind != source->kind)
+                || (srcs[i].size != source->size) || (srcs[i].mtime_sec != source->mtime_sec)
+                || (srcs[i].mtime_nsec != source->mtime_nsec)) {
+            return -ESTALE;
+        }
+    }
+
+    for (uint32_t i = 0; i < header->name_count; ++i) {
+        if ((names[i] == 0) || (names[i] >= header->strings_size)) {
+            return -EINVAL;
+        }
+    }
+    for (uint32_t i = 0; i < header->entry_count; ++i) {
+        const compiled_entry *rec = &entries[i];
+
+        if (((rec->name != COMPILED_NONE) && (rec->name >= header->name_count))
+                || (rec->bus_path >= header->strings_size)
+                || (rec->source >= header->source_count)
+                || (srcs[rec->source].kind != CONFIG_SOURCE_FILE)
+                || (rec->bus_type < 0) || (rec->bus_type > DEV_BUS_TYPE_UNKNOWN)) {
+            return -EINVAL;
+        }
+    }
+    return 0;
+}
+
+int dev_config_load_compiled(const dev_config_sources *sources, dev_config_chip_head *head)
+{
+    const char *file = compiled_file_name();
+    const compiled_header *header = NULL;
+    const compiled_source *srcs = NULL;
+    const uint32_t *names = NULL;
+    const compiled_entry *entries = NULL;
+    const char *strings = NULL;
+    dev_config_chip *chips = NULL;
+    char **interned = NULL;
+    void *map = MAP_FAILED;
+    size_t size = 0;
+    struct stat st;
+    int fd = -1;
+    int err = 0;
+
+    if (file == NULL) {
+        return -ENOENT;
+    }
+    if ((sources == NULL) || (head == NULL) || (compiled_map != NULL)) {
+        return -EINVAL;
+    }
+
+    fd = dev_sys_open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+    if (dev_sys_fstat(fd, &st) < 0) {
+        err = -errno;
+        dev_sys_close(fd);
+        return err;
+    }
+    size = (size_t) st.st_size;
+    if (size < sizeof(*header)) {
+        dev_sys_close(fd);
+        return -EINVAL;
+    }
+    map = dev_sys_mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    dev_sys_close(fd);
+    if (map == MAP_FAILED) {
+        return -errno;
+    }
+
+    err = compiled_validate(map, size, sources);
+    if (err < 0) {
+        goto exit_unmap;
+    }
+
+    header = map;
+    srcs = (const compiled_source *) (header + 1);
+    names = (const uint32_t *) (srcs + header->source_count);
+    entries = (const compiled_entry *) (names + header->name_count);
+    strings = (const char *) (entries + header->entry_count);
+
+    interned = calloc(header->name_count ? header->name_count : 1, sizeof(*interned));
+    chips = dev_config_alloc((header->entry_count ? header->entry_count : 1) * sizeof(*chips));
+    if ((interned == NULL) || (chips == NULL)) {
+        err = -ENOMEM;
+        goto exit_unmap;
+    }
+    for (uint32_t i = 0; i < header->name_count; ++i) {
+        interned[i] = dev_intern(strings + names[i]);
+        if (interned[i] == NULL) {
+            err = -ENOMEM;
+            goto exit_unmap;
+        }
+    }
+
+    /* nothing can fail from here on, link the entries */
+    for (uint32_t i = 0; i < header->entry_count; ++i) {
+        const compiled_entry *rec = &entries[i];
+        dev_config_chip *chip = &chips[i];
+
+        chip->prefix = (rec->name != COMPILED_NONE) ? interned[rec->name] : CHIP_NAME_PREFIX_ANY;
+        chip->address = rec->address;
+        chip->bus.type = rec->bus_type;
+        chip->bus.nr = rec->bus_nr;
+        chip->bus.path = (rec->bus_path != 0) ? (char *) strings + rec->bus_path : NULL;
+        chip->line.filename = strings + srcs[rec->source].path;
+        chip->line.lineno = rec->lineno;
+        dev_config_append(head, chip);
+    }
+    if (header->entry_count > 0) {
+        dev_config_match_invalidate();
+    }
+    compiled_map = map;
+    compiled_map_size = size;
+    free(interned);
+
+    if (i2c_dev_verbose > 1) {
+        devi2c_debug(NULL, "loaded %u config entries from compiled config %s",
+                header->entry_count, file);
+    }
+    return (int) header->entry_count;
+
+exit_unmap:
+    if (i2c_dev_verbose > 1) {
+        devi2c_debug(NULL, "not using compiled config %s - %s", file, strerror(-err));
+    }
+    free(interned);
+    dev_sys_munmap(map, size);
+    return err;
+}
@@ -0,0 +1,69 @@
+/**
+ * @file compiled-config.h
+ * @copyright Violin Memory, Inc, 2014
+ * @brief Pre-parsed binary copy of the chip configuration files
+ */
+
+#ifndef LIB_COMPILED_CONFIG_H
+#define LIB_COMPILED_CONFIG_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "busses.h"
+
+/* a config file or directory and the state it was read in */
+typedef struct dev_config_source {
+    char *path;
+    uint32_t kind; /* CONFIG_SOURCE_* */
+    int64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+} dev_config_source;
+
+#define CONFIG_SOURCE_MISSING   0
+#define CONFIG_SOURCE_FILE      1
+#define CONFIG_SOURCE_DIR       2
+
+typedef struct dev_config_sources {
+    dev_config_source *source;
+    int count;
+} dev_config_sources;
+
+/**
+ * Record the state of a config file, a config directory and the files in it
+ * @param file
+ * @param dir
+ * @param sources
+ * @return negative errno on failure else zero on success
+ */
+extern int dev_config_sources_scan(const char *file, const char *dir, dev_config_sources *sources);
+
+/**
+ * @param sources
+ */
+extern void dev_config_sources_free(dev_config_sources *sources);
+
+/**
+ * Load the compiled config if it was compiled from the sources as they are now
+ * @param sources
+ * @param head config list to append to
+ * @return negative errno if it can't be used else the number of entries added
+ */
+extern int dev_config_load_compiled(const dev_config_sources *sources, dev_config_chip_head *head);
+
+/**
+ * Write a config list read from sources to a compiled config file
+ * @param path file to write, NULL for the current compiled config file
+ * @param sources
+ * @param head
+ * @return negative errno on failure else zero on success
+ */
+extern int dev_config_compile(const char *path, const dev_config_sources *sources,
+        const dev_config_chip_head *head);
+
+/**
+ * Unmap the compiled config, the config list must have been emptied before
+ */
+extern void dev_compiled_config_release(void);
+
+#endif /* !LIB_COMPILED_CONFIG_H */
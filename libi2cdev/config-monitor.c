@@ -0,0 +1,521 @@
+/**
+ * @file config-monitor.c
+ * @copyright Violin Memory, Inc, 2014
+ *
+ * @brief Reload the config files when they change.
+ *
+ * An inotify watch on the config directory and on the directory holding
+ * the config file reports which files were written, moved or deleted.
+ * Only those are parsed again, their new entries are compared with the
+ * ones they had and only the difference is applied: chips of entries that
+ * went away are removed, chips of entries that were added are created and
+ * entries that stayed keep their state. Adapters and clients that no
+ * changed entry refers to are left alone.
+ */
+
+#define _GNU_SOURCE 1
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include <linux/limits.h> /* for PATH_MAX */
+
+#include "common.h"
+#include "data.h"
+#include "access.h"
+#include "config-parser.h"
+#include "instantiate.h"
+#include "syscalls.h"
+
+#include "i2c-error.h"
+#include "i2c-dev-parser.h"
+#include "i2cdiscov.h"
+
+#define CONFIG_MONITOR_EVENTS   (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM \
+        | IN_CREATE | IN_DELETE)
+
+static int config_monitor_fd = -1;
+static int config_file_wd = -1; /* directory holding the config file */
+static int config_dir_wd = -1;
+
+/* files to reload */
+typedef struct config_changes {
+    char **path;
+    int count;
+    int max;
+} config_changes;
+
+/* a set of entries sorted by address, for dev_config_move_if() */
+typedef struct config_entry_set {
+    dev_config_chip **chip;
+    int count;
+} config_entry_set;
+
+int i2cdev_config_monitor_open(void)
+{
+    DEV_SYS_API(DEV_I2C_API_CONFIG_MONITOR);
+    int fd = -1;
+
+    if (config_monitor_fd >= 0) {
+        return config_monitor_fd;
+    }
+    if (!check_libi2cdev_ready()) {
+        return -ENODEV;
+    }
+    /* entries read from elsewhere have no file to watch */
+    if (!dev_config_read_from_defaults()) {
+        return -EINVAL;
+    }
+
+    fd = dev_sys_inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+    /* editors replace files by renaming, watch the directory instead of the file */
+    config_file_wd = dev_sys_inotify_add_watch(fd, ETCDIR, CONFIG_MONITOR_EVENTS);
+    if (config_file_wd < 0) {
+        int err = -errno;
+        dev_sys_close(fd);
+        return err;
+    }
+    /* the config directory may only be created later */
+    config_dir_wd = dev_sys_inotify_add_watch(fd, DEFAULT_CONFIG_DIR, CONFIG_MONITOR_EVENTS);
+    config_monitor_fd = fd;
+    return config_monitor_fd;
+}
+
+void i2cdev_config_monitor_close(void)
+{
+    DEV_SYS_API(DEV_I2C_API_CONFIG_MONITOR);
+
+    if (config_monitor_fd >= 0) {
+        dev_sys_close(config_monitor_fd);
+    }
+    config_monitor_fd = -1;
+    config_file_wd = -1;
+    config_dir_wd = -1;
+}
+
+static void config_changes_free(config_changes *changes)
+{
+    for (int i = 0; i < changes->count; ++i) {
+        free(changes->path[i]);
+    }
+    free(changes->path);
+    memset(changes, 0, sizeof(*changes));
+}
+
+static int config_changes_add(config_changes *changes, const char *path)
+{
+    for (int i = 0; i < changes->count; ++i) {
+        if (!strcmp(changes->path[i], path)) {
+            return 0;
+        }
+    }
+    if (changes->count == changes->max) {
+        int max = changes->max ? changes->max * 2 : 8;
+        char **grown = realloc(changes->path, max * sizeof(*grown));
+
+        if (grown == NULL) {
+            return -ENOMEM;
+        }
+        changes->path = grown;
+        changes->max = max;
+    }
+    changes->path[changes->count] = strdup(path);
+    if (changes->path[changes->count] == NULL) {
+        return -ENOMEM;
+    }
+    changes->count++;
+    return 0;
+}
+
+static int config_dir_filter(const struct dirent *entry)
+{
+    return entry->d_name[0] != '.'; /* Skip hidden files */
+}
+
+/**
+ * Mark every config file as changed, those with entries and those on disk
+ * @param changes
+ * @return negative errno on failure else zero on success
+ */
+static int config_changes_add_all(config_changes *changes)
+{
+    const dev_config_chip *chip = NULL;
+    const char *last = NULL;
+    struct dirent **namelist = NULL;
+    int count = 0;
+    int err = 0;
+
+    err = config_changes_add(changes, DEFAULT_CONFIG_FILE);
+    SLIST_FOREACH(chip, p_dev_config_list_head, node) {
+        if ((err == 0) && (chip->line.filename != NULL) && (chip->line.filename != last)) {
+            last = chip->line.filename;
+            err = config_changes_add(changes, last);
+        }
+    }
+    count = dev_sys_scandir(DEFAULT_CONFIG_DIR, &namelist, config_dir_filter, alphasort);
+    for (int i = 0; i < count; ++i) {
+        char path[PATH_MAX];
+
+        if ((err == 0) && (snprintf(path, sizeof(path), "%s/%s", DEFAULT_CONFIG_DIR,
+                namelist[i]->d_name) < (int) sizeof(path))) {
+            err = config_changes_add(changes, path);
+        }
+        free(namelist[i]);
+    }
+    if (count >= 0) {
+        free(namelist);
+    }
+    return err;
+}
+
+/**
+ * Read the pending inotify events
+ * @param changes
+ * @return negative errno on failure else zero on success
+ */
+static int config_monitor_read(config_changes *changes)
+{
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    const char *file_name = strrchr(DEFAULT_CONFIG_FILE, '/') + 1;
+    const char *dir_name = strrchr(DEFAULT_CONFIG_DIR, '/') + 1;
+    bool all = false;
+    int err = 0;
+
+    while (1) {
+        ssize_t len = TEMP_FAILURE_RETRY(dev_sys_read(config_monitor_fd, buf, sizeof(buf)));
+        const char *pos = buf;
+
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return -errno;
+        }
+        while ((err == 0) && (pos < buf + len)) {
+            const struct inotify_event *event = (const struct inotify_event *) pos;
+            char path[PATH_MAX];
+
+            pos += sizeof(*event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                /* events were lost, only reading everything is safe */
+                all = true;
+            } else if ((event->wd == config_dir_wd) && (event->mask & IN_IGNORED)) {
+                config_dir_wd = -1;
+                all = true;
+            } else if (event->len == 0) {
+                continue;
+            } else if (event->wd == config_file_wd) {
+                if (!strcmp(event->name, file_name)) {
+                    err = config_changes_add(changes, DEFAULT_CONFIG_FILE);
+                } else if (!strcmp(event->name, dir_name)) {
+                    /* the directory was created, replaced or removed */
+                    config_dir_wd = dev_sys_inotify_add_watch(config_monitor_fd, DEFAULT_CONFIG_DIR,
+                            CONFIG_MONITOR_EVENTS);
+                    all = true;
+                }
+            } else if ((event->wd == config_dir_wd) && (event->name[0] != '.')) {
+                if (snprintf(path, sizeof(path), "%s/%s", DEFAULT_CONFIG_DIR,
+                        event->name) < (int) sizeof(path)) {
+                    err = config_changes_add(changes, path);
+                }
+            }
+        }
+        if (err < 0) {
+            return err;
+        }
+    }
+    return all ? config_changes_add_all(changes) : 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* entries describing the same chip */
+static int config_key_compare(const dev_config_chip *c1, const dev_config_chip *c2)
+{
+    /* prefixes are interned, equal names are the same pointer */
+    if (c1->prefix != c2->prefix) {
+        return ((uintptr_t) c1->prefix > (uintptr_t) c2->prefix) ? 1 : -1;
+    }
+    if (c1->address != c2->address) {
+        return (c1->address > c2->address) - (c1->address < c2->address);
+    }
+    if (c1->bus.type != c2->bus.type) {
+        return (c1->bus.type > c2->bus.type) - (c1->bus.type < c2->bus.type);
+    }
+    if (c1->bus.nr != c2->bus.nr) {
+        return (c1->bus.nr > c2->bus.nr) - (c1->bus.nr < c2->bus.nr);
+    }
+    if ((c1->bus.path == NULL) || (c2->bus.path == NULL)) {
+        return (c1->bus.path != NULL) - (c2->bus.path != NULL);
+    }
+    return strcmp(c1->bus.path, c2->bus.path);
+}
+
+static int config_key_qsort(const void *p1, const void *p2)
+{
+    return config_key_compare(*(dev_config_chip * const *) p1, *(dev_config_chip * const *) p2);
+}
+
+static int config_ptr_qsort(const void *p1, const void *p2)
+{
+    uintptr_t c1 = (uintptr_t) *(dev_config_chip * const *) p1;
+    uintptr_t c2 = (uintptr_t) *(dev_config_chip * const *) p2;
+
+    return (c1 > c2) - (c1 < c2);
+}
+
+static bool config_pick_set(const dev_config_chip *chip, void *arg)
+{
+    const config_entry_set *set = arg;
+    dev_config_chip *key = (dev_config_chip *) chip;
+
+    return bsearch(&key, set->chip, set->count, sizeof(*set->chip), config_ptr_qsort) != NULL;
+}
+
+static bool config_pick_all(const dev_config_chip *chip, void *arg)
+{
+    (void) chip;
+    (void) arg;
+
+    return true;
+}
+
+/**
+ * Collect the entries of a list, optionally only those of one file
+ * @param head
+ * @param filename or NULL
+ * @param set
+ * @return negative errno on failure else zero on success
+ */
+static int config_entry_set_get(const dev_config_chip_head *head, const char *filename,
+        config_entry_set *set)
+{
+    dev_config_chip *chip = NULL;
+    int max = 0;
+
+    memset(set, 0, sizeof(*set));
+    SLIST_FOREACH(chip, head, node) {
+        if ((filename != NULL) && ((chip->line.filename == NULL)
+                || strcmp(chip->line.filename, filename))) {
+            continue;
+        }
+        if (set->count == max) {
+            dev_config_chip **grown = NULL;
+
+            max = max ? max * 2 : 64;
+            grown = realloc(set->chip, max * sizeof(*grown));
+            if (grown == NULL) {
+                free(set->chip);
+                set->chip = NULL;
+                return -ENOMEM;
+            }
+            set->chip = grown;
+        }
+        set->chip[set->count++] = chip;
+    }
+    return 0;
+}
+
+/**
+ * Drop the entries of removed that another entry of the config list still
+ * describes, their chips stay
+ * @param removed sorted by key
+ * @return the number of entries left
+ */
+static int config_keep_wanted(config_entry_set *removed)
+{
+    dev_config_chip *chip = NULL;
+    bool *wanted = NULL;
+    int count = 0;
+
+    wanted = calloc(removed->count ? removed->count : 1, sizeof(*wanted));
+    if (wanted == NULL) {
+        /* removing nothing is the safe choice */
+        removed->count = 0;
+        return 0;
+    }
+    SLIST_FOREACH(chip, p_dev_config_list_head, node) {
+        int lo = 0;
+        int hi = removed->count;
+
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+
+            if (config_key_compare(removed->chip[mid], chip) < 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        while ((lo < removed->count) && !config_key_compare(removed->chip[lo], chip)) {
+            wanted[lo++] = true;
+        }
+    }
+    for (int i = 0; i < removed->count; ++i) {
+        if (!wanted[i]) {
+            removed->chip[count++] = removed->chip[i];
+        }
+    }
+    removed->count = count;
+    free(wanted);
+    return count;
+}
+
+/**
+ * Parse a config file again and apply what changed in it
+ * @param path
+ * @return negative errno on failure else the number of entries added or removed
+ */
+static int config_reload_file(const char *path)
+{
+    dev_config_chip_head fresh = SLIST_HEAD_INITIALIZER(fresh);
+    dev_config_chip_head moved = SLIST_HEAD_INITIALIZER(moved);
+    config_entry_set old;
+    config_entry_set new;
+    config_entry_set removed;
+    config_entry_set added;
+    const char *name = NULL;
+    struct stat st;
+    FILE *input = NULL;
+    int o = 0;
+    int n = 0;
+    int ret = 0;
+
+    memset(&old, 0, sizeof(old));
+    memset(&new, 0, sizeof(new));
+    memset(&removed, 0, sizeof(removed));
+    memset(&added, 0, sizeof(added));
+
+    /* a file that is gone or no longer a regular file has no entries */
+    if ((dev_sys_stat(path, &st) == 0) && S_ISREG(st.st_mode)) {
+        input = dev_sys_fopen(path, "r");
+    }
+    if (input != NULL) {
+        name = dev_config_file_name(path);
+        ret = (name != NULL) ? dev_config_parse(input, name, &fresh) : -ENOMEM;
+        dev_sys_fclose(input);
+        if (ret < 0) {
+            goto exit_free;
+        }
+    }
+
+    if (((ret = config_entry_set_get(p_dev_config_list_head, path, &old)) < 0)
+            || ((ret = config_entry_set_get(&fresh, NULL, &new)) < 0)) {
+        goto exit_free;
+    }
+    removed.chip = malloc((old.count ? old.count : 1) * sizeof(*removed.chip));
+    added.chip = malloc((new.count ? new.count : 1) * sizeof(*added.chip));
+    if ((removed.chip == NULL) || (added.chip == NULL)) {
+        ret = -ENOMEM;
+        goto exit_free;
+    }
+
+    /* pair up the entries that stayed, what's left over was removed or added */
+    qsort(old.chip, old.count, sizeof(*old.chip), config_key_qsort);
+    qsort(new.chip, new.count, sizeof(*new.chip), config_key_qsort);
+    while ((o < old.count) || (n < new.count)) {
+        int cmp = (o == old.count) ? 1 : (n == new.count) ? -1
+                : config_key_compare(old.chip[o], new.chip[n]);
+
+        if (cmp == 0) {
+            old.chip[o++]->line.lineno = new.chip[n++]->line.lineno;
+        } else if (cmp < 0) {
+            removed.chip[removed.count++] = old.chip[o++];
+        } else {
+            added.chip[added.count++] = new.chip[n++];
+        }
+    }
+    ret = removed.count + added.count;
+    if (ret == 0) {
+        goto exit_free;
+    }
+
+    if (i2c_dev_verbose) {
+        devi2c_debug(NULL, "config file %s changed: %d entries removed, %d added",
+                path, removed.count, added.count);
+    }
+
+    if (removed.count > 0) {
+        qsort(removed.chip, removed.count, sizeof(*removed.chip), config_ptr_qsort);
+        dev_config_move_if(p_dev_config_list_head, &moved, config_pick_set, &removed);
+        dev_config_match_invalidate();
+
+        /* remove the chips nothing else in the config lists */
+        qsort(removed.chip, removed.count, sizeof(*removed.chip), config_key_qsort);
+        if (config_keep_wanted(&removed) > 0) {
+            dev_config_chip_head gone = SLIST_HEAD_INITIALIZER(gone);
+
+            qsort(removed.chip, removed.count, sizeof(*removed.chip), config_ptr_qsort);
+            dev_config_move_if(&moved, &gone, config_pick_set, &removed);
+            dev_remove_config_chips(&gone);
+            dev_config_free_list(&gone);
+        }
+        dev_config_free_list(&moved);
+    }
+
+    if (added.count > 0) {
+        dev_config_chip_head create = SLIST_HEAD_INITIALIZER(create);
+
+        qsort(added.chip, added.count, sizeof(*added.chip), config_ptr_qsort);
+        dev_config_move_if(&fresh, &create, config_pick_set, &added);
+        dev_instantiate_config_chips(&create);
+        dev_config_move_if(&create, p_dev_config_list_head, config_pick_all, NULL);
+        dev_config_match_invalidate();
+    }
+
+exit_free:
+    /* the entries of the file that were already in the config list */
+    dev_config_free_list(&fresh);
+    free(added.chip);
+    free(removed.chip);
+    free(new.chip);
+    free(old.chip);
+    return ret;
+}
+
+int i2cdev_config_monitor_process(void)
+{
+    DEV_SYS_API(DEV_I2C_API_CONFIG_MONITOR);
+    config_changes changes;
+    int count = 0;
+    int err = 0;
+
+    if (config_monitor_fd < 0) {
+        return -EBADF;
+    }
+    if (get_libi2cdev_state() != LIB_SMB_READY) {
+        return -EBUSY;
+    }
+
+    memset(&changes, 0, sizeof(changes));
+    err = config_monitor_read(&changes);
+    for (int i = 0; (err == 0) && (i < changes.count); ++i) {
+        int ret = config_reload_file(changes.path[i]);
+
+        if (ret < 0) {
+            devi2c_warn(NULL, "Failed to reload config file %s - %s",
+                    changes.path[i], strerror(-ret));
+            err = ret;
+        } else {
+            count += ret;
+        }
+    }
+    if (changes.count > 0) {
+        /* a compiled config is only used while the files are as they were read */
+        dev_config_update_sources();
+        dev_for_all_chips_match_config(p_dev_config_list_head);
+    }
+    config_changes_free(&changes);
+    return (err < 0) ? err : count;
+}
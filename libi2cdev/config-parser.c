@@ -0,0 +1,402 @@
+/**
+ * @file config-parser.c
+ * @copyright Violin Memory, Inc, 2014
+ *
+ * @brief Single pass parser for the chip configuration files.
+ *
+ * A config file is mapped, or read into one buffer when it is a pipe,
+ * and its lines are split and parsed in place. Entries are carved out of
+ * large blocks that are only freed all together by dev_config_release(),
+ * their bus paths are interned, and new entries are linked after a
+ * remembered tail, so parsing costs a few allocations per file instead of
+ * several per line. Entries a config reload drops are kept on a free list
+ * for the next parse.
+ */
+
+#define _GNU_SOURCE 1
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "data.h"
+#include "access.h"
+#include "intern.h"
+#include "config-parser.h"
+#include "syscalls.h"
+
+#include "i2c-error.h"
+#include "i2c-dev-parser.h"
+#include "i2cdiscov.h"
+
+/* only the first CONFIG_LINE_MAX - 1 bytes of a line are looked at */
+#define CONFIG_LINE_MAX     1024
+#define CONFIG_BLOCK_SIZE   (64UL << 10)
+#define CONFIG_ALIGN        sizeof(void *)
+
+typedef struct config_block {
+    struct config_block *next;
+    size_t used;
+    size_t size;
+    char data[];
+} config_block;
+
+/* the contents of one config file */
+typedef struct config_text {
+    const char *data;
+    size_t len;
+    void *map; /* mapping of the file, or NULL */
+    size_t map_len;
+    char *buf; /* or the file read into memory */
+} config_text;
+
+static config_block *config_blocks = NULL;
+static dev_config_chip *config_tail = NULL;
+static dev_config_chip_head *config_tail_head = NULL; /* list config_tail is in */
+static dev_config_chip *config_free_chips = NULL; /* linked through their node */
+
+void dev_config_release(void)
+{
+    while (config_blocks != NULL) {
+        config_block *next = config_blocks->next;
+
+        free(config_blocks);
+        config_blocks = next;
+    }
+    config_tail = NULL;
+    config_tail_head = NULL;
+    config_free_chips = NULL;
+}
+
+void *dev_config_alloc(size_t size)
+{
+    config_block *block = config_blocks;
+    size_t offset = 0;
+
+    size = (size + CONFIG_ALIGN - 1) & ~(CONFIG_ALIGN - 1);
+    if ((block == NULL) || (size > block->size - block->used)) {
+        size_t block_size = (size > CONFIG_BLOCK_SIZE) ? size : CONFIG_BLOCK_SIZE;
+
+        block = calloc(1, sizeof(*block) + block_size);
+        if (block == NULL) {
+            return NULL;
+        }
+        block->size = block_size;
+        block->next = config_blocks;
+        config_blocks = block;
+    }
+    offset = block->used;
+    block->used += size;
+    return block->data + offset;
+}
+
+void dev_config_append(dev_config_chip_head *head, dev_config_chip *chip)
+{
+    /* an empty list may be a new one at the address of an old one */
+    if ((config_tail_head != head) || SLIST_EMPTY(head)) {
+        config_tail = NULL;
+        config_tail_head = head;
+    }
+    if ((config_tail == NULL) && !SLIST_EMPTY(head)) {
+        /* entries linked by someone else, find the end once */
+        config_tail = SLIST_FIRST(head);
+        while (SLIST_NEXT(config_tail, node) != NULL) {
+            config_tail = SLIST_NEXT(config_tail, node);
+        }
+    }
+    if (config_tail == NULL) {
+        SLIST_INSERT_HEAD(head, chip, node);
+    } else {
+        SLIST_INSERT_AFTER(config_tail, chip, node);
+    }
+    config_tail = chip;
+}
+
+int dev_config_move_if(dev_config_chip_head *head, dev_config_chip_head *removed,
+        bool (*pick)(const dev_config_chip *chip, void *arg), void *arg)
+{
+    dev_config_chip *chip = NULL;
+    dev_config_chip *prev = NULL;
+    int count = 0;
+
+    chip = SLIST_FIRST(head);
+    while (chip != NULL) {
+        dev_config_chip *next = SLIST_NEXT(chip, node);
+
+        if (pick(chip, arg)) {
+            if (prev == NULL) {
+                SLIST_REMOVE_HEAD(head, node);
+            } else {
+                SLIST_NEXT(prev, node) = next;
+            }
+            dev_config_append(removed, chip);
+            count++;
+        } else {
+            prev = chip;
+        }
+        chip = next;
+    }
+    if (count > 0) {
+        /* the tail of head may have been moved, find it again next time */
+        config_tail = NULL;
+        config_tail_head = NULL;
+    }
+    return count;
+}
+
+dev_config_chip *dev_config_chip_alloc(void)
+{
+    dev_config_chip *chip = config_free_chips;
+
+    if (chip == NULL) {
+        return dev_config_alloc(sizeof(*chip));
+    }
+    config_free_chips = SLIST_NEXT(chip, node);
+    memset(chip, 0, sizeof(*chip));
+    return chip;
+}
+
+/* put an entry that is in no list on the free list */
+static void config_chip_free(dev_config_chip *chip)
+{
+    dev_intern_free(chip->prefix);
+    chip->prefix = NULL;
+    SLIST_NEXT(chip, node) = config_free_chips;
+    config_free_chips = chip;
+}
+
+void dev_config_free_list(dev_config_chip_head *head)
+{
+    dev_config_chip *chip = NULL;
+
+    if (SLIST_EMPTY(head)) {
+        return;
+    }
+    /* the match index may point into the list */
+    dev_config_match_invalidate();
+    if (config_tail_head == head) {
+        config_tail = NULL;
+        config_tail_head = NULL;
+    }
+    while ((chip = SLIST_FIRST(head)) != NULL) {
+        SLIST_REMOVE_HEAD(head, node);
+        config_chip_free(chip);
+    }
+}
+
+static void config_text_release(config_text *text)
+{
+    if (text->map != NULL) {
+        dev_sys_munmap(text->map, text->map_len);
+    }
+    free(text->buf);
+    memset(text, 0, sizeof(*text));
+}
+
+/**
+ * Get the remaining contents of a config file, mapped if it's a regular file
+ * @param input
+ * @param text
+ * @return negative errno on failure else zero on success
+ */
+static int config_text_get(FILE *input, config_text *text)
+{
+    struct stat st;
+    off_t pos = 0;
+    size_t max = 0;
+
+    memset(text, 0, sizeof(*text));
+
+    pos = ftello(input);
+    if ((pos >= 0) && (dev_sys_fstat(fileno(input), &st) == 0) && S_ISREG(st.st_mode)) {
+        if (pos >= st.st_size) {
+            return 0;
+        }
+        text->map = dev_sys_mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(input), 0);
+        if (text->map != MAP_FAILED) {
+            text->map_len = st.st_size;
+            text->data = (const char *) text->map + pos;
+            text->len = st.st_size - pos;
+            madvise(text->map, text->map_len, MADV_SEQUENTIAL);
+            /* leave the stream at the end, as if it had been read */
+            fseeko(input, 0, SEEK_END);
+            return 0;
+        }
+        text->map = NULL;
+    }
+
+    /* pipes and the like */
+    while (!feof(input)) {
+        size_t count = 0;
+
+        if (text->len == max) {
+            char *grown = NULL;
+
+            max = max ? max * 2 : BUFSIZ;
+            grown = realloc(text->buf, max);
+            if (grown == NULL) {
+                config_text_release(text);
+                return -ENOMEM;
+            }
+            text->buf = grown;
+        }
+        count = dev_sys_fread(text->buf + text->len, 1, max - text->len, input);
+        if ((count == 0) && ferror(input)) {
+            config_text_release(text);
+            return -EIO;
+        }
+        text->len += count;
+    }
+    text->data = text->buf;
+    return 0;
+}
+
+/**
+ * Parse one entry, e.g. "pca9541-i2c-1:0.1-0x73", and link it after the tail
+ * @param token the entry, not NUL terminated
+ * @param len
+ * @param name
+ * @param lineno
+ * @param head
+ * @return negative errno on failure, else 1 if an entry was added or zero
+ * if the token isn't an entry
+ */
+static int config_parse_entry(const char *token, size_t len, const char *name, int lineno,
+        dev_config_chip_head *head)
+{
+    const char *end = token + len;
+    const char *dash1 = NULL;
+    const char *dash2 = NULL;
+    const char *dash3 = NULL;
+    dev_config_chip *chip = NULL;
+
+    /* chip prefix - bus type - bus path - address */
+    dash1 = memchr(token, '-', len);
+    if (dash1 == NULL) {
+        return 0;
+    }
+    dash2 = memchr(dash1 + 1, '-', end - (dash1 + 1));
+    if (dash2 == NULL) {
+        return 0;
+    }
+    dash3 = memchr(dash2 + 1, '-', end - (dash2 + 1));
+
+    chip = dev_config_chip_alloc();
+    if (chip == NULL) {
+        return -ENOMEM;
+    }
+
+    /* "*" matches any chip name */
+    if ((dash1 - token == 1) && (*token == '*')) {
+        chip->prefix = CHIP_NAME_PREFIX_ANY;
+    } else {
+        chip->prefix = dev_intern_n(token, dash1 - token);
+        if (chip->prefix == NULL) {
+            config_chip_free(chip);
+            return -ENOMEM;
+        }
+    }
+
+    /* without an address the bus isn't set either */
+    if (dash3 != NULL) {
+        const char *addr = dash3 + 1;
+        char *bus_id = NULL;
+
+        if ((end - addr == 1) && (*addr == '*')) {
+            chip->address = CHIP_NAME_ADDR_ANY;
+        } else if (addr < end) {
+            char number[32];
+            size_t number_len = end - addr;
+
+            if (number_len >= sizeof(number)) {
+                number_len = sizeof(number) - 1;
+            }
+            memcpy(number, addr, number_len);
+            number[number_len] = '\0';
+            chip->address = strtoul(number, NULL, 0);
+        }
+
+        /* "i2c-1:0.1" is shared by all the entries on the bus */
+        bus_id = dev_intern_n(dash1 + 1, dash3 - (dash1 + 1));
+        if (bus_id == NULL) {
+            config_chip_free(chip);
+            return -ENOMEM;
+        }
+        dev_parse_bus_id_ref(bus_id, &chip->bus);
+    }
+
+    chip->line.filename = name;
+    chip->line.lineno = lineno;
+    dev_config_append(head, chip);
+    return 1;
+}
+
+int dev_config_parse(FILE *input, const char *name, dev_config_chip_head *head)
+{
+    config_text text;
+    const char *p = NULL;
+    const char *end = NULL;
+    int lineno = 0;
+    int count = 0;
+    int ret = 0;
+
+    if (input == NULL) {
+        return -ENOENT;
+    }
+    if (head == NULL) {
+        return -EINVAL;
+    }
+    ret = config_text_get(input, &text);
+    if (ret < 0) {
+        return ret;
+    }
+
+    p = text.data;
+    end = text.data + text.len;
+    while (p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        const char *next = (eol != NULL) ? eol + 1 : end;
+        const char *token = NULL;
+
+        if (eol == NULL) {
+            eol = end;
+        }
+        if (eol - p > CONFIG_LINE_MAX - 1) {
+            eol = p + CONFIG_LINE_MAX - 1;
+        }
+        lineno++;
+
+        /* the first word of the line, up to a comment */
+        while ((p < eol) && ((*p == ' ') || (*p == '\t'))) {
+            p++;
+        }
+        token = p;
+        while ((p < eol) && (*p != '#') && (*p != ' ') && (*p != '\t') && (*p != '\0')) {
+            p++;
+        }
+        if (p > token) {
+            ret = config_parse_entry(token, p - token, name, lineno, head);
+            if (ret < 0) {
+                break;
+            }
+            count += ret;
+        }
+        p = next;
+    }
+    config_text_release(&text);
+
+    if (count > 0) {
+        dev_config_match_invalidate();
+    }
+    if (i2c_dev_verbose > 1) {
+        devi2c_debug(NULL, "parsed %d config entries from %d lines of %s",
+                count, lineno, (name != NULL) ? name : "input");
+    }
+    return (ret < 0) ? ret : count;
+}
@@ -0,0 +1,81 @@
+/**
+ * @file config-parser.h
+ * @copyright Violin Memory, Inc, 2014
+ * @brief Single pass parser for the chip configuration files
+ */
+
+#ifndef LIB_CONFIG_PARSER_H
+#define LIB_CONFIG_PARSER_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "busses.h"
+
+#ifndef OVERRIDE_ETCDIR
+#define ETCDIR "/etc"
+#else
+#ifndef ETCDIR_PATH
+#define ETCDIR_PATH		/etc
+#endif
+#define ETCDIR		__stringify(ETCDIR_PATH)
+#endif /* !OVERRIDE_ETCDIR */
+
+#define DEFAULT_CONFIG_FILE	ETCDIR"/i2cdiscov.conf"
+#define DEFAULT_CONFIG_DIR	ETCDIR"/i2cdiscov.d"
+
+/**
+ * Parse a config file and append its entries to the config list
+ * @param input file to parse, read from its current position
+ * @param name name of the file for error reporting, must persist
+ * through the life of the library
+ * @param head config list to append to
+ * @return negative errno on failure else the number of entries added
+ */
+extern int dev_config_parse(FILE *input, const char *name, dev_config_chip_head *head);
+
+/**
+ * Allocate zeroed memory that lives until dev_config_release()
+ * @param size
+ * @return the memory or NULL if out of memory
+ */
+extern void *dev_config_alloc(size_t size);
+
+/**
+ * Allocate a zeroed config entry, reusing one freed by
+ * dev_config_free_list() if there is one
+ * @return the entry or NULL if out of memory
+ */
+extern dev_config_chip *dev_config_chip_alloc(void);
+
+/**
+ * Release the prefixes of the entries of a config list and keep the
+ * entries for dev_config_chip_alloc(), leaving the list empty
+ * @param head
+ */
+extern void dev_config_free_list(dev_config_chip_head *head);
+
+/**
+ * Link an entry at the end of the config list
+ * @param head
+ * @param chip
+ */
+extern void dev_config_append(dev_config_chip_head *head, dev_config_chip *chip);
+
+/**
+ * Move the entries a filter picks from one config list to the end of another
+ * @param head
+ * @param removed
+ * @param pick
+ * @param arg passed to pick
+ * @return the number of entries moved
+ */
+extern int dev_config_move_if(dev_config_chip_head *head, dev_config_chip_head *removed,
+        bool (*pick)(const dev_config_chip *chip, void *arg), void *arg);
+
+/**
+ * Free the memory of all parsed entries, the config list must have been
+ * emptied and the entries' prefixes released before
+ */
+extern void dev_config_release(void);
+
+#endif /* !LIB_CONFIG_PARSER_H */
@@ -36,12 +36,14 @@
 #include "i2c-error.h"
 
 #include "data.h"
+#include "arena.h"
+#include "intern.h"
 
 void dev_free_bus_id(dev_bus_id *bus)
 {
     if (bus != NULL) {
         if (bus->path != NULL) {
-            free(bus->path);
+            dev_arena_free(bus->path);
         }
         bus->path = NULL;
     }
@@ -57,27 +59,27 @@ void dev_free_chip_vals(dev_chip *chip)
         chip->adapter = NULL;
 
         if (chip->name != NULL) {
-            free(chip->name);
+            dev_intern_free(chip->name);
         }
         chip->name = NULL;
 
         if (chip->driver != NULL) {
-            free(chip->driver);
+            dev_intern_free(chip->driver);
         }
         chip->driver = NULL;
 
         if (chip->subsystem != NULL) {
-            free(chip->subsystem);
+            dev_intern_free(chip->subsystem);
         }
         chip->subsystem = NULL;
 
         if (chip->module != NULL) {
-            free(chip->module);
+            dev_intern_free(chip->module);
         }
         chip->module = NULL;
 
         if (chip->devpath != NULL) {
-            free(chip->devpath);
+            dev_arena_free(chip->devpath);
         }
         chip->devpath = NULL;
     }
@@ -94,32 +96,32 @@ void dev_free_chip(dev_chip **chip)
         p_chip->adapter = NULL;
 
         if (p_chip->name != NULL) {
-            free(p_chip->name);
+            dev_intern_free(p_chip->name);
         }
         p_chip->name = NULL;
 
         if (p_chip->driver != NULL) {
-            free(p_chip->driver);
+            dev_intern_free(p_chip->driver);
         }
         p_chip->driver = NULL;
 
         if (p_chip->subsystem != NULL) {
-            free(p_chip->subsystem);
+            dev_intern_free(p_chip->subsystem);
         }
         p_chip->subsystem = NULL;
 
         if (p_chip->module != NULL) {
-            free(p_chip->module);
+            dev_intern_free(p_chip->module);
         }
         p_chip->module = NULL;
 
         if (p_chip->devpath != NULL) {
-            free(p_chip->devpath);
+            dev_arena_free(p_chip->devpath);
         }
         p_chip->devpath = NULL;
 
         if (chip != NULL && *chip != NULL) {
-            free(*chip); /* actually deallocate memory */
+            dev_arena_free(*chip); /* actually deallocate memory */
             *chip = NULL; /* null terminate */
         }
     }
@@ -146,6 +148,7 @@ int dev_parse_chip_name(const char *name, dev_chip *res)
     res->driver = NULL;
     res->subsystem = NULL;
     res->module = NULL;
+    res->attr_read = 0;
 
     res->addr = CHIP_NAME_ADDR_ANY;
     res->bus_id->nr = BUS_NR_ANY;
@@ -159,7 +162,7 @@ int dev_parse_chip_name(const char *name, dev_chip *res)
         if ((dash = strchr(name, '-')) == NULL) {
             return -EINVAL;
         }
-        res->name = strndup(name, dash - name);
+        res->name = dev_intern_n(name, dash - name);
         if (!res->name) {
             return -ENOMEM;
         }
@@ -313,6 +316,19 @@ const char *dev_sprint_bus_nr(const dev_bus_id *bus)
 }
 
 int dev_parse_bus_id(const char *name, dev_bus_id *bus)
+{
+    int ret = dev_parse_bus_id_ref(name, bus);
+
+    if ((ret == 0) && (bus->path != BUS_PATH_ANY)) {
+        bus->path = strdup(bus->path);
+        if (bus->path == NULL) {
+            return -ENOMEM;
+        }
+    }
+    return ret;
+}
+
+int dev_parse_bus_id_ref(const char *name, dev_bus_id *bus)
 {
     char *endptr = NULL;
     if (!bus) {
@@ -324,15 +340,20 @@ int dev_parse_bus_id(const char *name, dev_bus_id *bus)
     name += 4;
     bus->type = DEV_BUS_TYPE_I2C;
 
+    if (!strcmp(name, "*")) {
+        bus->nr = BUS_NR_ANY;
+        bus->path = BUS_PATH_ANY;
+        return 0;
+    }
     if ((strchr(name, ':') != NULL) || (strchr(name, '.') != NULL)) {
-        bus->path = strdup(name);
+        bus->path = (char *) name;
         bus->nr = BUS_NR_PATH;
         return 0;
     } else {
         bus->nr = strtoul(name, &endptr, 10);
         if (*name == '\0' || *endptr != '\0' || bus->nr < 0)
             return -EINVAL;
-        bus->path = strdup(name);
+        bus->path = (char *) name;
         return 0;
     }
 }
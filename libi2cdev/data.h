@@ -10,6 +10,7 @@
 #include "busses.h"
 
 extern int i2cdev_rescan_count;
+extern unsigned long i2cdev_generation;
 
 extern dev_config_chip *dev_config_chips;
 extern int dev_config_chips_count;
@@ -30,6 +31,17 @@ extern size_t adapter_global_count;
 	(el), &dev_config_files, &dev_config_files_count, \
 	&dev_config_files_max, sizeof(char *))
 
+/**
+ * @param name config file name
+ * @return the copy of the name kept for the life of the library,
+ * or NULL if out of memory
+ */
+const char *dev_config_file_name(const char *name);
+/* true if the config was read from the default file and directory */
+bool dev_config_read_from_defaults(void);
+/* record the state of the default config files again after a reload */
+int dev_config_update_sources(void);
+
 void dev_free_bus_id(dev_bus_id *bus);
 void dev_free_chip(dev_chip **chip);
 void dev_free_chip_vals(dev_chip *chip);
@@ -41,6 +53,8 @@ void free_dev_chip_list(dev_chip_head *list);
 int dev_parse_chip_name(const char *name, dev_chip *res);
 int dev_snprintf_chip_name(char *str, size_t size, const dev_chip *chip);
 int dev_parse_bus_id(const char *name, dev_bus_id *bus);
+/* like dev_parse_bus_id() but bus->path points into name instead of a copy */
+int dev_parse_bus_id_ref(const char *name, dev_bus_id *bus);
 
 const char *dev_sprint_bus_nr(const dev_bus_id *bus);
 const char *dev_sprint_bus_type(const dev_bus_id *bus);
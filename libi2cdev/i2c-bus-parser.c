@@ -34,6 +34,10 @@
 #include "common.h"
 #include "sysfs.h"
 #include "data.h"
+#include "arena.h"
+#include "intern.h"
+#include "topology.h"
+#include "syscalls.h"
 
 #include "i2c-error.h"
 #include "i2c-bus-lists.h"
@@ -87,31 +91,6 @@ static int bus_node_depth(const dev_bus_adapter *node)
     return (count);
 }
 
-/**
- *
- * @param list
- * @param channel
- * @return count of elements in list that match channel
- */
-static int count_bus_match_channel_set_bus(dev_bus_adapter_head *list,
-        int channel)
-{
-    dev_bus_adapter *entry = NULL;
-    int count = 0;
-
-    if (!list) {
-        return 0;
-    }
-
-    LIST_FOREACH(entry, list, node) {
-        if (entry->chan_id == channel) {
-            entry->bus_id = count;
-            count++;
-        }
-    }
-    return (count);
-}
-
 /* ------------------------------------------------------------------------- */
 
 /**
@@ -198,6 +177,56 @@ static int const_foreach_devbus_tree(const dev_bus_adapter_head *root,
 done:
     return ((err < 0) ? err : count);
 }
+
+/**
+ * const_foreach_devbus_tree() over the flattened topology
+ * @param dev adapter whose descendants are visited, NULL for the whole tree
+ * @param func function to run on iterator.
+ * If func returns a value less than zero its subtree is skipped
+ * else that value is added to the number of iterations
+ * @param perr pointer to previous error, stop if it is set when func fails
+ * @return number of iterations else -errno
+ */
+static int const_foreach_devbus_subtree(const dev_bus_adapter *dev,
+        int (*func)(const dev_bus_adapter *), int *perr)
+{
+    const dev_topology *topo = dev_topology_get();
+    int count = 0;
+    int begin = 0;
+    int end = 0;
+    int i = 0;
+
+    if (topo == NULL) {
+        return const_foreach_devbus_tree((dev != NULL) ? &dev->children : dev_bus_list_headp,
+                func, perr);
+    }
+    if (dev == NULL) {
+        begin = 0;
+        end = topo->adapter_count;
+    } else {
+        i = dev_topology_adapter_index(topo, dev);
+        if (i == TOPOLOGY_NONE) {
+            return const_foreach_devbus_tree(&dev->children, func, perr);
+        }
+        begin = i + 1;
+        end = topo->subtree_end[i];
+    }
+
+    for (i = begin; i < end;) {
+        int local_err = func(topo->adapter[i]);
+
+        if (local_err < 0) {
+            if ((perr != NULL) && (*perr < 0)) {
+                return *perr;
+            }
+            i = topo->subtree_end[i];
+            continue;
+        }
+        count += local_err;
+        i++;
+    }
+    return count;
+}
 /* ------------------------------------------------------------------------- */
 
 /**
@@ -254,11 +283,11 @@ void print_dev_chip(const dev_chip *chip)
             "name=%-15s\t"
             "driver=%-15s\t",
             chip->bus_id->nr, bus_type, bus_nr,
-            chip->addr, chip->name, chip->driver);
+            chip->addr, chip->name, dev_chip_get_driver(chip));
 
     if (i2c_dev_verbose) {
         printf("module=%-15s\t",
-                chip->module);
+                dev_chip_get_module(chip));
     }
 
     if (i2c_dev_verbose > 1) {
@@ -337,34 +366,15 @@ int print_config_file_data(void)
     return count;
 }
 
-/**
- * @return number of devices read
- */
-static int print_adapters_dev_chips(const dev_bus_adapter_head *list_head)
-{
-    return const_foreach_devbus_tree(list_head, print_dev_chips, NULL);
-}
-
 /**
  * @return number of devices read
  */
 int print_adapters_devices(const dev_bus_adapter *dev)
 {
-    const dev_bus_adapter_head *list_head = NULL;
     if (!dev) {
         return 0;
     }
-    list_head = &(dev->children);
-    return const_foreach_devbus_tree(list_head, print_dev_chips, NULL);
-}
-
-/**
- * @param list_head
- * @return number of devices read
- */
-static int print_devbus_list(const dev_bus_adapter_head *list_head)
-{
-    return const_foreach_devbus_tree(list_head, print_dev_bus, NULL);
+    return const_foreach_devbus_subtree(dev, print_dev_chips, NULL);
 }
 
 /**
@@ -404,7 +414,7 @@ int print_devbus(dev_bus_adapter *dev, bool print_children)
         return 0;
     }
     if (print_children == true) {
-        count += print_devbus_list(&dev->children);
+        count += const_foreach_devbus_subtree(dev, print_dev_bus, NULL);
     }
     return count;
 }
@@ -413,7 +423,7 @@ int print_devbus(dev_bus_adapter *dev, bool print_children)
  */
 int print_devbus_tree(void)
 {
-    return print_devbus_list(dev_bus_list_headp);
+    return const_foreach_devbus_subtree(NULL, print_dev_bus, NULL);
 }
 
 /**
@@ -421,7 +431,36 @@ int print_devbus_tree(void)
  */
 int print_all_adapters_dev_chips(void)
 {
-    return print_adapters_dev_chips(dev_bus_list_headp);
+    return const_foreach_devbus_subtree(NULL, print_dev_chips, NULL);
+}
+
+/**
+ * Find the mux child of an adapter sitting on a bus id and channel
+ * @param dev
+ * @param bus_id
+ * @param chan_id
+ * @return matching child adapter else NULL
+ */
+static dev_bus_adapter *bus_child_lookup_mux(const dev_bus_adapter *dev, int bus_id,
+        int chan_id)
+{
+    dev_bus_adapter *child = NULL;
+
+    if (dev->child_index != NULL) {
+        if ((bus_id < 0) || (bus_id >= dev->child_index_buses)
+                || (chan_id < 0) || (chan_id >= dev->child_index_chans)) {
+            return NULL;
+        }
+        return dev->child_index[(bus_id * dev->child_index_chans) + chan_id];
+    }
+
+    /* no index could be built */
+    LIST_FOREACH(child, &dev->children, node) {
+        if ((child->bus_id == bus_id) && (child->chan_id == chan_id)) {
+            return child;
+        }
+    }
+    return NULL;
 }
 
 /**
@@ -431,7 +470,6 @@ int print_all_adapters_dev_chips(void)
 static dev_bus_adapter *search_devbus_tree_fast_path(const char *path)
 {
     dev_bus_adapter *dev_match = NULL;
-    dev_bus_adapter_head *children = NULL;
     dev_i2c_path_disc pathdisc[MAX_BUS_DEPTH];
     dev_i2c_path_disc *p_pathdisc = NULL;
     int ret = 0;
@@ -462,49 +500,26 @@ static dev_bus_adapter *search_devbus_tree_fast_path(const char *path)
         return NULL;
     }
 
-    children = &dev_match->children;
     p_pathdisc++;
 
     // Walk the tree looking for the device specified by p_pathd
     while((count >= i) && (p_pathdisc->type != I2CDEV_END)) {
         dev_bus_adapter *match_tmp = NULL;
-        dev_bus_adapter *dev = NULL;
-        if (!children) {
-            return NULL;
-        }
         switch (p_pathdisc->type) {
         case I2CDEV_BUS:
-            if (LIST_EMPTY(children)) {
-                return NULL;
-            }
-            LIST_FOREACH(dev, children, node) {
-                if (dev->nr == p_pathdisc->id) {
-                    children = &dev->children;
-                    match_tmp = dev;
-                    break;
-                }
-            }
-            if (!match_tmp) {
+            match_tmp = lookup_dev_bus_by_nr(p_pathdisc->id);
+            if (!match_tmp || (match_tmp->parent != dev_match)) {
                 return NULL;
             }
-            children = &match_tmp->children;
             break;
         case I2CDEV_MUX:
-            if (LIST_EMPTY(children)) {
-                return NULL;
-            }
-            LIST_FOREACH(dev, children, node) {
-                if ((dev->bus_id == p_pathdisc->id) && (dev->chan_id == p_pathdisc->value)) {
-                    match_tmp = dev;
-                    break;
-                }
-            }
+            match_tmp = bus_child_lookup_mux(dev_match, p_pathdisc->id, p_pathdisc->value);
             if (!match_tmp) {
                 return NULL;
             }
-            children = &match_tmp->children;
             break;
         default:
+            match_tmp = dev_match;
             break;
         }
         p_pathdisc++ , i++;
@@ -521,6 +536,8 @@ static dev_bus_adapter *search_devbus_tree_fast_path(const char *path)
  */
 dev_bus_adapter *dev_i2c_lookup_i2c_bus(const char *i2cbus_arg)
 {
+    DEV_SYS_API(DEV_I2C_API_LOOKUP);
+
     if (!i2cbus_arg) {
         return NULL;
     }
@@ -550,9 +567,11 @@ int get_devbus_nr_from_path(const char *path)
     }
 }
 
-static int compare_dev_bus_adapter_nr(const dev_bus_adapter *dev1,
-        const dev_bus_adapter *dev2)
+static int compare_dev_bus_adapter_id(const void *p1, const void *p2)
 {
+    const dev_bus_adapter * const dev1 = *(const dev_bus_adapter * const *) p1;
+    const dev_bus_adapter * const dev2 = *(const dev_bus_adapter * const *) p2;
+
     if (!dev1) {
         return 1;
     } else if (!dev2) {
@@ -561,141 +580,88 @@ static int compare_dev_bus_adapter_nr(const dev_bus_adapter *dev1,
     return ((dev1->nr) - (dev2->nr));
 }
 
-static int compare_dev_bus_adapter_id(const void *p1, const void *p2)
+/**
+ * Order adapters by parent, channel and nr: the order bus ids are handed out in
+ */
+static int compare_dev_bus_adapter_channel(const void *p1, const void *p2)
 {
     const dev_bus_adapter * const dev1 = *(const dev_bus_adapter * const *) p1;
     const dev_bus_adapter * const dev2 = *(const dev_bus_adapter * const *) p2;
 
-    if (!dev1) {
-        return 1;
-    } else if (!dev2) {
-        return -1;
+    if (dev1->parent_id != dev2->parent_id) {
+        return (dev1->parent_id < dev2->parent_id) ? -1 : 1;
+    } else if (dev1->chan_id != dev2->chan_id) {
+        return (dev1->chan_id < dev2->chan_id) ? -1 : 1;
     }
     return ((dev1->nr) - (dev2->nr));
 }
 
 /**
- *
- * @param search
- * @param parent
+ * Link an array of adapters into a tree below root.
+ * Every adapter is bucketed below its parent, found by a binary search on
+ * the array. Walking the array backwards and inserting at the list heads
+ * leaves the roots and every child list sorted by nr.
+ * @param adapters adapter array sorted by nr
+ * @param count number of adapters in the array
+ * @param root empty root list
  * @return negative errno on failure else zero on success
  */
-static int bus_children_get(dev_bus_adapter_head *search,
-        dev_bus_adapter *parent)
+static int adapter_tree_build(dev_bus_adapter **adapters, size_t count,
+        dev_bus_adapter_head *root)
 {
-    int nr = -1;
-    int err = 0;
-    dev_bus_adapter *head = NULL;
-    dev_bus_adapter *dtmp = NULL;
-    dev_bus_adapter_head *children = NULL;
+    dev_bus_adapter **by_channel = NULL;
 
-    if (!parent) {
+    if ((adapters == NULL) || (root == NULL)) {
         return -EINVAL;
     }
+    if (!LIST_EMPTY(root)) {
+        return -EBUSY;
+    }
 
-    head = LIST_FIRST(search);
-    nr = parent->nr;
-    children = &parent->children;
-
-    while (NULL != (dtmp = bus_parent_nr_lookup(nr, head))) {
-        int channel = -1;
-        dev_bus_adapter *lookup = NULL;
-
-        bus_list_del_init(dtmp);
-
-        if (!children) {
-            return -EINVAL;
-        }
+    for (size_t i = count; i > 0; --i) {
+        dev_bus_adapter *adapter = adapters[i - 1];
 
-        dtmp->parent = parent;
-        channel = dtmp->chan_id;
+        if (adapter->parent_is_adapter) {
+            dev_bus_adapter adapter_key_val = { .nr = adapter->parent_id, };
+            dev_bus_adapter *adapter_key = &adapter_key_val;
+            dev_bus_adapter **p_parent = NULL;
 
-        if (LIST_EMPTY(children)) {
-            bus_list_insert(dtmp, children);
-        } else {
-            int cmp = 0;
-            lookup = LIST_FIRST(children);
-            cmp = compare_bus_list_insert(dtmp, lookup,
-                    compare_dev_bus_adapter_nr);
-            if (cmp == 0) {
-                return -EINVAL;
+            p_parent = bsearch(&adapter_key, adapters, count, sizeof(*adapters),
+                    compare_dev_bus_adapter_id);
+            if ((p_parent == NULL) || (*p_parent == adapter)) {
+                continue; /* parent adapter is missing, leave it unlinked */
             }
+            adapter->parent = *p_parent;
+            LIST_INSERT_HEAD(&adapter->parent->children, adapter, node);
+        } else if (adapter->parent_id == BUS_NR_ROOT) {
+            LIST_INSERT_HEAD(root, adapter, node);
         }
-
-        count_bus_match_channel_set_bus(children, channel);
-
-        if (LIST_EMPTY(search)) {
-            break;
-        } else {
-            head = LIST_FIRST(search);
-        }
-    }
-
-    children = &parent->children;
-
-    if (LIST_EMPTY(children) || LIST_EMPTY(search)) {
-        return 0;
-    } else {
-        dev_bus_adapter *tmp_child = NULL;
-        LIST_FOREACH(tmp_child, children, node) {
-            err = bus_children_get(search, tmp_child);
-        }
-    }
-    return err;
-}
-
-/**
- *
- * @param search
- * @param root
- * @return negative errno on failure else zero on success
- */
-static int adapter_tree_build(dev_bus_adapter_head *search,
-        dev_bus_adapter_head *root)
-{
-
-    dev_bus_adapter *node = NULL;
-    dev_bus_adapter *bus_tmp = NULL;
-    dev_bus_adapter *node_root = NULL;
-    dev_bus_adapter *dev = NULL;
-
-    int err = 0;
-
-    if ((search == NULL) || (root == NULL)) {
-        return -EINVAL;
     }
 
-    if (LIST_EMPTY(search)) {
-        return -ENODATA;
+    /* the bus id is the rank of an adapter among its siblings on the same channel */
+    by_channel = malloc(count * sizeof(*by_channel));
+    if (by_channel == NULL) {
+        return -ENOMEM;
     }
+    memcpy(by_channel, adapters, count * sizeof(*by_channel));
+    qsort(by_channel, count, sizeof(*by_channel), compare_dev_bus_adapter_channel);
 
-    node_root = LIST_FIRST(root);
-    node = LIST_FIRST(search);
-
-    while (NULL != (bus_tmp = bus_parent_nr_lookup(BUS_NR_ROOT, node))) {
-        int cmp = 0;
+    for (size_t i = 0; i < count; ++i) {
+        dev_bus_adapter *adapter = by_channel[i];
+        const dev_bus_adapter *prev = (i > 0) ? by_channel[i - 1] : NULL;
 
-        bus_list_del_init(bus_tmp);
-
-        if (node_root == NULL) {
-            bus_list_insert(bus_tmp, root);
-        } else {
-            cmp = compare_bus_list_insert(bus_tmp, node_root,
-                    compare_dev_bus_adapter_nr);
-            if (cmp == 0) {
-                return -EINVAL;
-            }
+        if (adapter->parent == NULL) {
+            continue;
         }
-        if (LIST_EMPTY(search)) {
-            break;
+        if ((prev != NULL) && (prev->parent == adapter->parent)
+                && (prev->chan_id == adapter->chan_id)) {
+            adapter->bus_id = prev->bus_id + 1;
         } else {
-            node = LIST_FIRST(search);
+            adapter->bus_id = 0;
         }
     }
-    LIST_FOREACH(dev, root, node) {
-        err = bus_children_get(search, dev);
-    }
-    return err;
+    free(by_channel);
+    return 0;
 }
 
 /**
@@ -718,11 +684,11 @@ static int match_set_path_test(dev_bus_adapter *dev)
     child = dev;
 
     if (bus_get_parent(child) == NULL) {
-        char *tmp_path = NULL;
-        if (asprintf(&tmp_path, "%u", dev->nr) < 0) {
+        snprintf(path, sizeof(path), "%u", dev->nr);
+        child->bus.path = dev_arena_strdup(path);
+        if (child->bus.path == NULL) {
             return -ENOMEM;
         }
-        child->bus.path = tmp_path;
         return 0;
     } else {
 
@@ -750,7 +716,7 @@ static int match_set_path_test(dev_bus_adapter *dev)
                 if (path_off >= (int)sizeof(path)) {
                     return -EINVAL;
                 }
-                child->bus.path = strdup(path);
+                child->bus.path = dev_arena_strdup(path);
                 if (child->bus.path == NULL) {
                     return -ENOMEM;
                 }
@@ -761,9 +727,64 @@ static int match_set_path_test(dev_bus_adapter *dev)
     return err;
 }
 
+int dev_bus_build_child_index(dev_bus_adapter *adapter)
+{
+    dev_bus_adapter **index = NULL;
+    dev_bus_adapter *child = NULL;
+    int buses = 0;
+    int chans = 0;
+
+    if (!adapter) {
+        return -ENODEV;
+    }
+
+    LIST_FOREACH(child, &adapter->children, node) {
+        if ((child->chan_id >= 0) && (child->bus_id >= 0)) {
+            buses = MAX(buses, child->bus_id + 1);
+            chans = MAX(chans, child->chan_id + 1);
+        }
+    }
+
+    dev_arena_free(adapter->child_index);
+    adapter->child_index = NULL;
+    adapter->child_index_buses = 0;
+    adapter->child_index_chans = 0;
+
+    if (buses == 0) {
+        return 0;
+    }
+    index = dev_arena_calloc((size_t) buses * chans, sizeof(*index));
+    if (index == NULL) {
+        return -ENOMEM;
+    }
+    LIST_FOREACH(child, &adapter->children, node) {
+        if ((child->chan_id >= 0) && (child->bus_id >= 0)) {
+            index[(child->bus_id * chans) + child->chan_id] = child;
+        }
+    }
+    adapter->child_index = index;
+    adapter->child_index_buses = buses;
+    adapter->child_index_chans = chans;
+    return 0;
+}
+
+/**
+ * Generate the path string and child index of an adapter
+ * @param dev
+ * @return negative errno on failure else zero on success
+ */
+static int bus_set_path_and_index(dev_bus_adapter *dev)
+{
+    int err = match_set_path_test(dev);
+    if (err < 0) {
+        return err;
+    }
+    return dev_bus_build_child_index(dev);
+}
+
 static int generate_bus_paths(dev_bus_adapter_head *root)
 {
-    return foreach_devbus_tree(root, match_set_path_test);
+    return foreach_devbus_tree(root, bus_set_path_and_index);
 }
 
 /**
@@ -824,6 +845,76 @@ static int sysfs_i2c_bus_selector(const struct dirent *ent)
     }
 }
 
+static int compare_int(const void *p1, const void *p2)
+{
+    const int i1 = *(const int *) p1;
+    const int i2 = *(const int *) p2;
+
+    return (i1 > i2) - (i1 < i2);
+}
+
+/**
+ * List the bus nr of every i2c adapter in /sys/bus/i2c/devices/
+ * @param[out] nrs sorted array of adapter numbers (caller frees)
+ * @return negative errno on failure else number of adapters found on success
+ */
+static int i2c_sysfs_scan_adapter_nrs(int **nrs)
+{
+    char path[PATH_MAX];
+    DIR *dir = NULL;
+    struct dirent *ent = NULL;
+    int *list = NULL;
+    int count = 0;
+    int max = 0;
+
+    if (!sysfs_mount) {
+        return -ENOENT;
+    }
+    if (snprintf(path, sizeof(path), "%s/bus/i2c/devices", sysfs_mount) >= (int) sizeof(path)) {
+        return -EINVAL;
+    }
+
+    /* unlike scandir() this costs no allocation per directory entry */
+    if ((dir = dev_sys_opendir(path)) == NULL) {
+        return -errno;
+    }
+    while (NULL != (ent = dev_sys_readdir(dir))) {
+        char *endptr = NULL;
+        long nr = -1;
+
+        if (!sysfs_i2c_bus_selector(ent)) {
+            continue;
+        }
+        nr = strtol(ent->d_name + 4, &endptr, 10);
+        if ((*endptr != '\0') || (nr < 0) || (nr > INT_MAX)) {
+            continue;
+        }
+        if (count == max) {
+            int *grown = realloc(list, (max ? max * 2 : 64) * sizeof(*list));
+
+            if (grown == NULL) {
+                dev_sys_closedir(dir);
+                free(list);
+                return -ENOMEM;
+            }
+            list = grown;
+            max = max ? max * 2 : 64;
+        }
+        list[count++] = (int) nr;
+    }
+    dev_sys_closedir(dir);
+
+    if (list == NULL) {
+        list = calloc(1, sizeof(*list));
+        if (list == NULL) {
+            return -ENOMEM;
+        }
+    }
+    qsort(list, count, sizeof(*list), compare_int);
+    *nrs = list;
+    return count;
+}
+
 dev_bus_adapter *lookup_dev_bus_by_nr(int nr)
 {
     dev_bus_adapter *match = NULL;
@@ -831,7 +922,7 @@ dev_bus_adapter *lookup_dev_bus_by_nr(int nr)
     dev_bus_adapter adapter_key_val = { .nr = nr, };
     dev_bus_adapter *adapter_key = &adapter_key_val;
 
-    if (nr < 0) {
+    if ((nr < 0) || (adapter_global_count == 0)) {
         return NULL;
     }
 
@@ -847,21 +938,18 @@ dev_bus_adapter *lookup_dev_bus_by_nr(int nr)
 
 static char *get_parent_dev_name(const char *device)
 {
-    char *bname = NULL;
-    char *slash = NULL;
+    const char *slash = NULL;
+    const char *name = NULL;
+
     if (device != NULL && *device != '\0') {
         slash = strrchr(device, '/');
         if (slash != NULL) {
-            char *name = NULL;
-            name = strndup(device, slash - device);
-            if (name != NULL) {
-                bname = basename(name);
-                if (bname) {
-                    bname = strdup(bname);
-                }
-                free(name);
-                return bname;
+            /* the path component in front of the device's own name */
+            name = slash;
+            while ((name > device) && (name[-1] != '/')) {
+                name--;
             }
+            return dev_arena_strndup(name, slash - name);
         }
     }
     return NULL;
@@ -909,8 +997,10 @@ static int dev_parse_parent_i2c_nr(const char *name, int *bus)
 static int sysfs_read_i2c_dev_bus_adapter(dev_bus_adapter *adapter,
         const char *device, const char *attr)
 {
-    char *name = NULL;
-    char *link_path = NULL;
+    char link_path[PATH_MAX];
+    char name_buf[NAME_MAX];
+    char subsystem[NAME_MAX];
+    const char *name = NULL;
     const char *attrp = NULL;
     bool dev_is_mux = false;
     char *endptr = NULL;
@@ -940,12 +1030,13 @@ static int sysfs_read_i2c_dev_bus_adapter(dev_bus_adapter *adapter,
         return -EINVAL;
     }
 
-    link_path = realpath(device, NULL);
-    if (link_path == NULL) {
+    if (dev_sys_realpath(device, link_path) == NULL) {
         err = -errno;
         goto exit_free;
     }
-    name = sysfs_read_attr(link_path, "name");
+    if (sysfs_read_attr_buf(link_path, "name", name_buf, sizeof(name_buf)) > 0) {
+        name = name_buf;
+    }
 
     // TODO: add handling of new kernel mux device topology
     ret = parse_mux_name(name, &parent_mux_bus, &channel);
@@ -960,10 +1051,16 @@ static int sysfs_read_i2c_dev_bus_adapter(dev_bus_adapter *adapter,
     adapter->nr = bus;
     adapter->chan_id = channel;
     adapter->bus_id = -1;
-    adapter->name = name;
-    adapter->devpath = link_path;
-    adapter->subsystem = sysfs_read_device_subsystem(link_path);
-    adapter->parent_name = get_parent_dev_name(link_path);
+    adapter->name = dev_intern(name);
+    adapter->devpath = dev_arena_strdup(link_path);
+    if ((adapter->name == NULL) || (adapter->devpath == NULL)) {
+        err = -ENOMEM;
+        goto exit_free;
+    }
+    if (sysfs_read_device_link_name(link_path, "subsystem", subsystem, sizeof(subsystem)) > 0) {
+        adapter->subsystem = dev_intern(subsystem);
+    }
+    adapter->parent_name = get_parent_dev_name(adapter->devpath);
 
     ret = dev_parse_parent_i2c_nr(adapter->parent_name, (&parent_bus));
     adapter->parent_is_adapter = (ret < 0) ? false : true;
@@ -981,13 +1078,13 @@ static int sysfs_read_i2c_dev_bus_adapter(dev_bus_adapter *adapter,
 
     adapter->i2c_adapt.nr = bus;
     adapter->i2c_adapt.fd = -1;
-    adapter->i2c_adapt.name = name;
+    adapter->i2c_adapt.name = adapter->name;
     adapter->i2c_adapt.prev_addr = -1;
 
     err = snprintf(char_dev_name, sizeof(char_dev_name), "/dev/i2c-%d", adapter->nr);
     if (err < 0) {
         goto init;
-    } else if (stat(char_dev_name, &st) < 0) {
+    } else if (dev_sys_stat(char_dev_name, &st) < 0) {
         goto init;
     } else {
         adapter->i2c_adapt.char_dev_uid = st.st_ino;
@@ -1001,10 +1098,10 @@ init:
     init_bus_list(&(adapter->node));
 exit_free:
     if (err < 0) {
-        free(name);
-        name = NULL;
-        free(link_path);
-        link_path = NULL;
+        dev_intern_free(adapter->name);
+        adapter->name = NULL;
+        dev_arena_free(adapter->devpath);
+        adapter->devpath = NULL;
         devi2c_warn(NULL, "failed to discover adapters: %s", strerror(-err));
     }
     return err;
@@ -1019,6 +1116,7 @@ exit_free:
 static int sysfs_read_i2c_sub_device(dev_chip *chip, const char *path)
 {
     const char *dummy_device_name = "dummy";
+    char name[NAME_MAX];
 
     if (!chip || !chip->adapter) {
         return -EINVAL;
@@ -1028,27 +1126,31 @@ static int sysfs_read_i2c_sub_device(dev_chip *chip, const char *path)
         return -EINVAL;
     }
 
-    chip->devpath = realpath(path, NULL);
-    if (chip->devpath == NULL) {
-        return -errno;
+    if (sysfs_read_attr_buf(path, "name", name, sizeof(name)) <= 0) {
+        return -ENOENT;
     }
 
-    chip->name = sysfs_read_attr(path, "name");
-    if (chip->name == NULL) {
-        free(chip->devpath);
+    /* clients are real directories below the (already resolved) adapter path */
+    chip->devpath = dev_arena_strdup(path);
+    chip->name = dev_intern(name);
+    if ((chip->devpath == NULL) || (chip->name == NULL)) {
+        dev_arena_free(chip->devpath);
         chip->devpath = NULL;
-        return -ENOENT;
+        dev_intern_free(chip->name);
+        chip->name = NULL;
+        return -ENOMEM;
     }
 
-    if (strncmp(chip->name, dummy_device_name, strlen(dummy_device_name)) != 0) {
-        chip->driver = sysfs_read_device_driver(path);
-        chip->module = sysfs_read_device_module(path);
-    } else {
-        chip->module = NULL;
-        chip->driver = NULL;
-    }
+    /* driver, module and subsystem are read on first use */
+    chip->driver = NULL;
+    chip->module = NULL;
+    chip->subsystem = NULL;
+    chip->attr_read = 0;
 
-    chip->subsystem = sysfs_read_device_subsystem(path);
+    /* driver and module are never read for dummy devices */
+    if (strncmp(chip->name, dummy_device_name, strlen(dummy_device_name)) == 0) {
+        chip->attr_read |= DEV_CHIP_ATTR_DRIVER | DEV_CHIP_ATTR_MODULE;
+    }
 
     init_dev_list(&chip->node);
 
@@ -1056,86 +1158,203 @@ static int sysfs_read_i2c_sub_device(dev_chip *chip, const char *path)
 }
 
 /**
- * Gather All i2c devices whose parent "adapter"
- * @param device
- * @param attr
- * @return negative errno on failure else number of found devices on success
+ * Read a chip attribute from sysfs the first time it is asked for
+ * @param chip
+ * @param attr the dev_chip_attr the field holds
+ * @param field the cached value
+ * @param link the device link naming the attribute value
+ * @return the attribute value or NULL
  */
-static int gather_i2c_adapters_devices(dev_bus_adapter *adapter)
+static const char *dev_chip_get_attr(dev_chip *chip, unsigned int attr,
+        char **field, const char *link)
 {
-    int err = 0;
-    int ret = 0;
-    int count = 0;
-    char path[PATH_MAX];
-    char devname[NAME_MAX];
-    int path_off = 0;
-    int devname_off = 0;
-    DIR *dir = NULL;
-    struct dirent *ent = NULL;
+    char value[NAME_MAX + 1];
 
-    if (!adapter) {
-        return -ENODEV;
+    if (!(chip->attr_read & attr)) {
+        if ((chip->devpath != NULL)
+                && (sysfs_read_device_link_name(chip->devpath, link, value, sizeof(value)) > 0)) {
+            /* a few driver and module names are shared by most chips */
+            *field = dev_intern(value);
+        }
+        chip->attr_read |= attr;
     }
+    return *field;
+}
 
-    path_off = strlen(adapter->devpath);
-    if (path_off >= (int) sizeof(path)) {
-        return -EINVAL;
+/* the accessors fill in the cached fields behind a const pointer */
+
+const char *dev_chip_get_driver(const dev_chip *chip)
+{
+    dev_chip *cache = (dev_chip *) chip;
+
+    if (chip == NULL) {
+        return NULL;
     }
-    strncpy(path, adapter->devpath, path_off);
-    path[path_off] = '\0';
+    return dev_chip_get_attr(cache, DEV_CHIP_ATTR_DRIVER, &cache->driver, "driver");
+}
 
-    devname_off = snprintf(devname, sizeof(devname), "%d-", adapter->nr);
+const char *dev_chip_get_module(const dev_chip *chip)
+{
+    dev_chip *cache = (dev_chip *) chip;
 
-    if ((dir = opendir(path)) == NULL) {
-        return -errno;
+    if (chip == NULL) {
+        return NULL;
     }
+    return dev_chip_get_attr(cache, DEV_CHIP_ATTR_MODULE, &cache->module, "driver/module");
+}
 
-    while ((!ret) && (NULL != (ent = readdir(dir)))) {
-        dev_chip *chip = NULL;
-        int address = -1;
-        char *endptr = NULL;
-        const char *p_devname = NULL;
+const char *dev_chip_get_subsystem(const dev_chip *chip)
+{
+    dev_chip *cache = (dev_chip *) chip;
+
+    if (chip == NULL) {
+        return NULL;
+    }
+    return dev_chip_get_attr(cache, DEV_CHIP_ATTR_SUBSYSTEM, &cache->subsystem, "subsystem");
+}
+
+/**
+ * Parse an i2c client device name of the form "<nr>-<addr>"
+ * @param name sysfs device name (e.g. "3-0050")
+ * @param nr the bus nr the device is expected to sit on
+ * @return negative errno on failure else the client address
+ */
+static int dev_parse_chip_dev_name(const char *name, int nr)
+{
+    char *endptr = NULL;
+    long bus = -1;
+    long address = -1;
+
+    if ((name == NULL) || !isdigit(*name)) {
+        return -EINVAL;
+    }
+    bus = strtol(name, &endptr, 10);
+    if ((*endptr != '-') || (bus != nr)) {
+        return -EINVAL;
+    }
+    name = endptr + 1;
+    if (*name == '\0') {
+        return -EINVAL;
+    }
+    address = strtol(name, &endptr, 16);
+    if ((*endptr != '\0') || (address < 0)) {
+        return -EINVAL;
+    }
+    return (int) address;
+}
+
+/**
+ * Allocate and read a chip sitting on an adapter
+ * @param[in] adapter the adapter the chip sits on
+ * @param[in] address the chip address
+ * @param[in] path the sysfs path of the chip
+ * @param[out] chipp newly allocated chip
+ * @return negative errno on failure else zero on success
+ */
+static int adapter_read_chip(dev_bus_adapter *adapter, int address,
+        const char *path, dev_chip **chipp)
+{
+    dev_chip *chip = NULL;
+    int err = 0;
+
+    chip = dev_arena_calloc(1, sizeof(*chip));
+    if (!chip) {
+        return -ENOMEM;
+    }
+    chip->addr = address;
+    chip->bus_id = &adapter->bus;
+    chip->adapter = adapter;
+
+    err = sysfs_read_i2c_sub_device(chip, path);
+    if (err < 0) {
+        dev_arena_free(chip);
+        return err;
+    }
+    *chipp = chip;
+    return 0;
+}
+
+/**
+ * Remember the sysfs directory of an adapter its chips are about to be read
+ * from. Its link count changes with each client or mux added below it.
+ * @param adapter
+ * @param dir the open directory
+ */
+static void adapter_mark_read(dev_bus_adapter *adapter, DIR *dir)
+{
+    struct stat st;
+
+    if (dev_sys_fstat(dirfd(dir), &st) == 0) {
+        adapter->sysfs_ino = st.st_ino;
+        adapter->sysfs_nlink = st.st_nlink;
+    } else {
+        adapter->sysfs_ino = 0;
+    }
+}
+
+/**
+ * Gather All i2c devices whose parent "adapter"
+ * @param device
+ * @param attr
+ * @return negative errno on failure else number of found devices on success
+ */
+static int gather_i2c_adapters_devices(dev_bus_adapter *adapter)
+{
+    int err = 0;
+    int count = 0;
+    char path[PATH_MAX];
+    int path_off = 0;
+    DIR *dir = NULL;
+    struct dirent *ent = NULL;
+
+    if (!adapter) {
+        return -ENODEV;
+    }
+
+    path_off = strlen(adapter->devpath);
+    if (path_off >= (int) sizeof(path)) {
+        return -EINVAL;
+    }
+    strncpy(path, adapter->devpath, path_off);
+    path[path_off] = '\0';
+
+    if ((dir = dev_sys_opendir(path)) == NULL) {
+        return -errno;
+    }
+    adapter_mark_read(adapter, dir);
+
+    while (NULL != (ent = dev_sys_readdir(dir))) {
+        dev_chip *chip = NULL;
+        int address = -1;
         if (ent->d_name[0] == '.') { /* skip hidden entries */
             continue;
-        } else if (strncmp(ent->d_name, devname, devname_off) != 0) { /* skip entries not based on adapter name */
-            continue;
-        }
-        p_devname = ent->d_name + devname_off;
-        if (*p_devname == '\0') {
-            continue;
         }
-        address = strtol(p_devname, &endptr, 16);
-        if (*endptr) {
+        address = dev_parse_chip_dev_name(ent->d_name, adapter->nr);
+        if (address < 0) { /* skip entries not based on adapter name */
             continue;
         }
-        chip = calloc(1, sizeof(*chip));
-        if (!chip) {
-            err = -ENOMEM;
-            goto exit_free;
-        }
-        chip->addr = address;
-        chip->bus_id = &adapter->bus;
-        chip->adapter = adapter;
-
         snprintf(path + path_off, sizeof(path) - path_off, "/%s", ent->d_name);
 
-        ret = sysfs_read_i2c_sub_device(chip, path);
-        if (ret < 0) {
-            free(chip);
+        err = adapter_read_chip(adapter, address, path, &chip);
+        if (err == -ENOMEM) {
+            goto exit_free;
+        } else if (err < 0) {
+            err = 0;
             continue;
         } else {
             count++;
             SLIST_INSERT_HEAD((&(adapter->clients)), chip, node);
+            dev_topology_invalidate();
             continue;
         }
     }
-    closedir(dir);
+    dev_sys_closedir(dir);
 
     return count;
 
 exit_free:
     if (dir) {
-        closedir(dir);
+        dev_sys_closedir(dir);
     }
     if (err < 0) {
         free_dev_chip_list(&adapter->clients);
@@ -1152,15 +1371,15 @@ static ssize_t i2c_sysfs_gather_adapters(dev_bus_adapter ***list)
 {
 
     char path[PATH_MAX];
-    struct dirent **namelist = NULL;
+    char name[20];
+    int *nrs = NULL;
     int err = 0;
     int path_off = 0;
-    int num = 0;
     size_t count = 0;
     size_t found_count = 0;
     dev_bus_adapter **adapters = NULL;
     const char *bus_type = "i2c";
-    int n = 0, i = 0;
+    int n = 0;
 
     if (!list) {
         return -EINVAL;
@@ -1175,72 +1394,52 @@ static ssize_t i2c_sysfs_gather_adapters(dev_bus_adapter ***list)
         return -EINVAL;
     }
 
-    n = scandir(path, &namelist, sysfs_i2c_bus_selector, NULL);
+    n = i2c_sysfs_scan_adapter_nrs(&nrs);
     if (n < 0) {
-        err = -errno;
-        devi2c_err(NULL, "scandir failed!- %s", strerror(-err));
+        err = n;
+        devi2c_err(NULL, "scanning adapters failed!- %s", strerror(-err));
         return err;
-    } else {
-        count = (size_t) n;
-        if (count == 0) {
-            err = 0;
-            goto exit_free;
-        }
+    }
+    count = (size_t) n;
+    if (count == 0) {
+        goto exit_free;
+    }
 
-        adapters = calloc(count, sizeof(*adapters));
-        if (!adapters) {
+    adapters = calloc(count, sizeof(*adapters));
+    if (!adapters) {
+        err = -ENOMEM;
+        goto exit_free;
+    }
+    for (size_t h = 0; h < count; ++h) {
+        dev_bus_adapter *adapter = dev_arena_calloc(1, sizeof(*adapter));
+
+        if (adapter == NULL) {
             err = -ENOMEM;
             goto exit_free;
         }
-        i = 0;
-        for (size_t h = 0; h < count; ++h) {
-            adapters[i] = calloc(1, sizeof(*adapters[i]));
-            if (adapters[i] == NULL) {
-                err = -ENOMEM;
-                num = i;
-                goto exit_free;
-            }
 
-            snprintf(path + path_off, sizeof(path) - path_off, "/%s", namelist[h]->d_name);
+        snprintf(name, sizeof(name), "i2c-%d", nrs[h]);
+        snprintf(path + path_off, sizeof(path) - path_off, "/%s", name);
 
-            err = sysfs_read_i2c_dev_bus_adapter(adapters[i], path, namelist[h]->d_name);
-            if (err < 0) {
-                if (adapters[i] != NULL) {
-                    free(adapters[i]);
-                }
-                adapters[i] = NULL;
-                devi2c_notice(NULL, "invalid adapter! - %s", strerror(-err));
-                continue;
-            } else {
-                i++;
-            }
+        err = sysfs_read_i2c_dev_bus_adapter(adapter, path, name);
+        if (err < 0) {
+            dev_arena_free(adapter);
+            devi2c_notice(NULL, "invalid adapter! - %s", strerror(-err));
+            err = 0;
+            continue;
         }
-        found_count = i;
-        qsort(adapters, found_count, sizeof(*adapters), compare_dev_bus_adapter_id);
-        *list = adapters;
-        err = 0;
+        /* the bus numbers are sorted, so is the array */
+        adapters[found_count++] = adapter;
     }
+    *list = adapters;
 
 exit_free:
-    /* Free memory allocated by scandir() */
-    for (size_t s = 0; s < count; ++s) {
-        if (namelist[s] != NULL) {
-            free(namelist[s]);
-            namelist[s] = NULL;
-        }
-    }
-    free(namelist);
+    free(nrs);
     if (err < 0) {
-        for (int r = 0; r < num; ++r) {
-            if (adapters[r] != NULL) {
-                free(adapters[r]);
-            }
-            adapters[r] = NULL;
-        }
-        if (adapters != NULL) {
-            free(adapters);
+        for (size_t r = 0; r < found_count; ++r) {
+            free_adapter_val(&adapters[r]);
         }
-        adapters = NULL;
+        free(adapters);
         return err;
     } else {
         return ((ssize_t) found_count);
@@ -1259,8 +1458,6 @@ extern int gather_i2c_dev_busses(void)
     int err = 0;
     int count = 0;
     dev_bus_adapter **adapters = NULL;
-    dev_bus_adapter_head head_temp = { .lh_first = NULL };
-    dev_bus_adapter_head *p_head_temp = &head_temp;
 
     if (!dev_bus_list_headp) {
         return -EFAULT;
@@ -1277,11 +1474,7 @@ extern int gather_i2c_dev_busses(void)
         goto done;
     }
 
-    for (int i = 0; i < count; ++i) {
-        LIST_INSERT_HEAD(p_head_temp, adapters[i], node);
-    }
-
-    err = adapter_tree_build(p_head_temp, dev_bus_list_headp);
+    err = adapter_tree_build(adapters, (size_t) count, dev_bus_list_headp);
     if (err < 0) {
         devi2c_notice(NULL, "Failed to gather adapter roots - %s", strerror(-err));
         return err;
@@ -1308,8 +1501,618 @@ extern int gather_i2c_dev_busses(void)
 done:
     adapter_global_array = adapters;
     adapter_global_count = (count >= 0) ? (size_t)count : 0 ;
+    dev_topology_invalidate();
     if (i2c_dev_verbose > 2) {
         devi2c_debug(NULL, "found %d i2c adapters", count);
     }
     return err;
 }
+
+/* ------------------------------------------------------------------------- */
+/* Incremental bus tree maintenance */
+
+/**
+ * Insert an adapter into the sorted adapter_global_array
+ * @param adapter
+ * @return negative errno on failure else zero on success
+ */
+static int adapter_global_array_insert(dev_bus_adapter *adapter)
+{
+    dev_bus_adapter **array = NULL;
+    size_t pos = 0;
+
+    while ((pos < adapter_global_count) && (adapter_global_array[pos]->nr < adapter->nr)) {
+        pos++;
+    }
+    if ((pos < adapter_global_count) && (adapter_global_array[pos]->nr == adapter->nr)) {
+        return -EEXIST;
+    }
+
+    array = realloc(adapter_global_array, (adapter_global_count + 1) * sizeof(*array));
+    if (array == NULL) {
+        return -ENOMEM;
+    }
+    memmove(&array[pos + 1], &array[pos], (adapter_global_count - pos) * sizeof(*array));
+    array[pos] = adapter;
+    adapter_global_array = array;
+    adapter_global_count++;
+    dev_topology_invalidate();
+    return 0;
+}
+
+/**
+ * Remove an adapter from the sorted adapter_global_array
+ * @param adapter
+ */
+static void adapter_global_array_remove(const dev_bus_adapter *adapter)
+{
+    dev_bus_adapter **p_match = NULL;
+    size_t pos = 0;
+
+    if (adapter_global_count == 0) {
+        return;
+    }
+    p_match = bsearch(&adapter, adapter_global_array, adapter_global_count,
+            sizeof(*adapter_global_array), compare_dev_bus_adapter_id);
+    if ((p_match == NULL) || (*p_match != adapter)) {
+        return;
+    }
+    pos = (size_t) (p_match - adapter_global_array);
+    memmove(&adapter_global_array[pos], &adapter_global_array[pos + 1],
+            (adapter_global_count - pos - 1) * sizeof(*adapter_global_array));
+    adapter_global_count--;
+    dev_topology_invalidate();
+}
+
+/**
+ * Drop the bus path of an adapter and all of its children and generate them again
+ * @param dev
+ * @return negative errno on failure else zero on success
+ */
+static int bus_subtree_reset_paths(dev_bus_adapter *dev)
+{
+    dev_bus_adapter *child = NULL;
+    int err = 0;
+
+    dev_free_bus_id(&dev->bus);
+    err = match_set_path_test(dev);
+    if (err < 0) {
+        return err;
+    }
+    LIST_FOREACH(child, &dev->children, node) {
+        err = bus_subtree_reset_paths(child);
+        if (err < 0) {
+            return err;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Renumber the bus ids of the children on a mux channel, regenerating the
+ * bus paths of each child whose bus id changed, and rebuild the parent's
+ * child index.
+ * @param parent
+ * @param channel
+ * @return negative errno on failure else zero on success
+ */
+static int bus_children_renumber(dev_bus_adapter *parent, int channel)
+{
+    dev_bus_adapter *entry = NULL;
+    int count = 0;
+    int err = 0;
+
+    LIST_FOREACH(entry, &parent->children, node) {
+        if (entry->chan_id != channel) {
+            continue;
+        }
+        if ((entry->bus_id != count) || (entry->bus.path == NULL)) {
+            entry->bus_id = count;
+            err = bus_subtree_reset_paths(entry);
+            if (err < 0) {
+                return err;
+            }
+        }
+        count++;
+    }
+    return dev_bus_build_child_index(parent);
+}
+
+/**
+ * Link an adapter into the bus tree below its parent (or as a root)
+ * @param adapter
+ * @return negative errno on failure else zero on success
+ */
+static int bus_tree_attach(dev_bus_adapter *adapter)
+{
+    dev_bus_adapter *parent = NULL;
+
+    if (adapter->parent_is_adapter) {
+        parent = lookup_dev_bus_by_nr(adapter->parent_id);
+        if (parent == NULL) {
+            return -ENODEV;
+        }
+        adapter->parent = parent;
+        sorted_bus_list_insert(&parent->children, adapter);
+        return bus_children_renumber(parent, adapter->chan_id);
+    } else if (adapter->parent_id == BUS_NR_ROOT) {
+        sorted_bus_list_insert(dev_bus_list_headp, adapter);
+        return match_set_path_test(adapter);
+    }
+    return -ENODEV;
+}
+
+/**
+ * Unlink and free an adapter along with all of its children and chips
+ * @param adapter
+ */
+static void bus_tree_free_subtree(dev_bus_adapter *adapter)
+{
+    dev_bus_adapter *child = NULL;
+    const dev_chip *chip = NULL;
+
+    while ((child = LIST_FIRST(&adapter->children)) != NULL) {
+        bus_tree_free_subtree(child);
+    }
+    SLIST_FOREACH(chip, &adapter->clients, node) {
+        device_global_count--;
+    }
+    adapter_global_array_remove(adapter);
+    bus_list_remove(adapter);
+    free_adapter_val(&adapter);
+}
+
+static dev_chip *adapter_chip_lookup(const dev_bus_adapter *adapter, int addr)
+{
+    dev_chip *chip = NULL;
+
+    SLIST_FOREACH(chip, &adapter->clients, node) {
+        if (chip->addr == addr) {
+            return chip;
+        }
+    }
+    return NULL;
+}
+
+int i2c_dev_bus_add_adapter(const char *name)
+{
+    char path[PATH_MAX];
+    dev_bus_adapter *adapter = NULL;
+    int err = 0;
+
+    if ((name == NULL) || (sysfs_mount == NULL)) {
+        return -EINVAL;
+    }
+    err = snprintf(path, sizeof(path), "%s/bus/i2c/devices/%s", sysfs_mount, name);
+    if (err >= (int) sizeof(path)) {
+        return -EINVAL;
+    }
+
+    adapter = dev_arena_calloc(1, sizeof(*adapter));
+    if (adapter == NULL) {
+        return -ENOMEM;
+    }
+    err = sysfs_read_i2c_dev_bus_adapter(adapter, path, name);
+    if (err < 0) {
+        dev_arena_free(adapter);
+        return err;
+    }
+
+    if (lookup_dev_bus_by_nr(adapter->nr) != NULL) {
+        err = -EEXIST;
+        goto exit_free;
+    }
+
+    err = adapter_global_array_insert(adapter);
+    if (err < 0) {
+        goto exit_free;
+    }
+
+    err = bus_tree_attach(adapter);
+    if (err < 0) {
+        adapter_global_array_remove(adapter);
+        bus_list_remove(adapter);
+        goto exit_free;
+    }
+
+    err = gather_i2c_adapters_devices(adapter);
+    if (err < 0) {
+        devi2c_notice(NULL, "Error reading i2c devices! - %s", strerror(-err));
+    } else {
+        device_global_count += (size_t) err;
+    }
+    devi2c_debug(NULL, "added i2c-%d at path %s", adapter->nr, adapter->bus.path);
+    return 0;
+
+exit_free:
+    free_adapter_val(&adapter);
+    return err;
+}
+
+int i2c_dev_bus_add_new_adapters(void)
+{
+    char name[NAME_MAX];
+    int *nrs = NULL;
+    int added = 0;
+    int count = 0;
+    bool progress = true;
+
+    count = i2c_sysfs_scan_adapter_nrs(&nrs);
+    if (count < 0) {
+        return count;
+    }
+    /* a child may have a lower nr than its parent, retry until nothing links */
+    while (progress) {
+        progress = false;
+        for (int i = 0; i < count; ++i) {
+            int err = 0;
+
+            if ((nrs[i] < 0) || (lookup_dev_bus_by_nr(nrs[i]) != NULL)) {
+                continue;
+            }
+            snprintf(name, sizeof(name), "i2c-%d", nrs[i]);
+            err = i2c_dev_bus_add_adapter(name);
+            if (err == 0) {
+                added++;
+                progress = true;
+            } else if (err != -ENODEV) {
+                devi2c_notice(NULL, "failed to add %s - %s", name, strerror(-err));
+                nrs[i] = -1;
+            }
+        }
+    }
+    free(nrs);
+    return added;
+}
+
+int i2c_dev_bus_remove_adapter(int nr)
+{
+    dev_bus_adapter *adapter = NULL;
+    dev_bus_adapter *parent = NULL;
+    int channel = -1;
+
+    adapter = lookup_dev_bus_by_nr(nr);
+    if (adapter == NULL) {
+        return -ENODEV;
+    }
+    parent = adapter->parent;
+    channel = adapter->chan_id;
+
+    bus_tree_free_subtree(adapter);
+    devi2c_debug(NULL, "removed i2c-%d", nr);
+
+    if (parent != NULL) {
+        return bus_children_renumber(parent, channel);
+    }
+    return 0;
+}
+
+int i2c_dev_bus_add_chip(int nr, const char *name)
+{
+    char path[PATH_MAX];
+    dev_bus_adapter *adapter = NULL;
+    dev_chip *chip = NULL;
+    int address = -1;
+    int err = 0;
+
+    adapter = lookup_dev_bus_by_nr(nr);
+    if (adapter == NULL) {
+        return -ENODEV;
+    }
+    address = dev_parse_chip_dev_name(name, nr);
+    if (address < 0) {
+        return address;
+    }
+    if (adapter_chip_lookup(adapter, address) != NULL) {
+        return -EEXIST;
+    }
+    err = snprintf(path, sizeof(path), "%s/%s", adapter->devpath, name);
+    if (err >= (int) sizeof(path)) {
+        return -EINVAL;
+    }
+    err = adapter_read_chip(adapter, address, path, &chip);
+    if (err < 0) {
+        return err;
+    }
+    SLIST_INSERT_HEAD(&adapter->clients, chip, node);
+    device_global_count++;
+    dev_topology_invalidate();
+    return 0;
+}
+
+int i2c_dev_bus_remove_chip(int nr, int addr)
+{
+    dev_bus_adapter *adapter = NULL;
+    dev_chip *chip = NULL;
+
+    adapter = lookup_dev_bus_by_nr(nr);
+    if (adapter == NULL) {
+        return -ENODEV;
+    }
+    chip = adapter_chip_lookup(adapter, addr);
+    if (chip == NULL) {
+        return -ENODEV;
+    }
+    SLIST_REMOVE(&adapter->clients, chip, dev_chip, node);
+    dev_free_chip(&chip);
+    device_global_count--;
+    dev_topology_invalidate();
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Bus tree reconciliation */
+
+/**
+ * Check whether an adapter still refers to the same kernel device.
+ * The i2c-dev character device node is re-created whenever the kernel
+ * adapter goes away, so a changed node identity means the adapter changed.
+ * Without a character device fall back to the adapter's sysfs path.
+ * @param adapter
+ * @return true if the adapter must be read again
+ */
+static bool adapter_identity_changed(const dev_bus_adapter *adapter)
+{
+    char char_dev_name[20];
+    char path[PATH_MAX];
+    char link_path[PATH_MAX];
+    struct stat st;
+
+    snprintf(char_dev_name, sizeof(char_dev_name), "/dev/i2c-%d", adapter->nr);
+    if (dev_sys_stat(char_dev_name, &st) == 0) {
+        return ((st.st_ino != adapter->i2c_adapt.char_dev_uid)
+                || (st.st_dev != adapter->i2c_adapt.char_dev));
+    } else if (adapter->i2c_adapt.char_dev_uid != 0) {
+        return true;
+    }
+
+    snprintf(path, sizeof(path), "%s/bus/i2c/devices/i2c-%d", sysfs_mount, adapter->nr);
+    return ((dev_sys_realpath(path, link_path) == NULL) || (adapter->devpath == NULL)
+            || strcmp(link_path, adapter->devpath));
+}
+
+/**
+ * Check whether the driver bound to a chip changed
+ * @param chip
+ * @param path sysfs path of the chip
+ * @return true if the chip must be read again
+ */
+static bool chip_binding_changed(const dev_chip *chip, const char *path)
+{
+    char driver[NAME_MAX + 1];
+
+    /* nothing to compare with until the driver was looked at */
+    if (!(chip->attr_read & DEV_CHIP_ATTR_DRIVER) || !strncmp(chip->name, "dummy", 5)) {
+        return false;
+    }
+    if (sysfs_read_device_link_name(path, "driver", driver, sizeof(driver)) <= 0) {
+        return (chip->driver != NULL);
+    }
+    return ((chip->driver == NULL) || (strcmp(driver, chip->driver) != 0));
+}
+
+/**
+ * Bring the chips of an unchanged adapter in line with sysfs.
+ * Chips that are still present with the same driver binding are kept as is.
+ * @param adapter
+ * @return negative errno on failure else number of chips added, removed or read again
+ */
+static int adapter_reconcile_chips(dev_bus_adapter *adapter)
+{
+    dev_chip_head present = SLIST_HEAD_INITIALIZER(present);
+    char path[PATH_MAX];
+    int path_off = 0;
+    int changes = 0;
+    int err = 0;
+    DIR *dir = NULL;
+    struct dirent *ent = NULL;
+    dev_chip *chip = NULL;
+
+    path_off = snprintf(path, sizeof(path), "%s", adapter->devpath);
+    if (path_off >= (int) sizeof(path)) {
+        return -EINVAL;
+    }
+    if ((dir = dev_sys_opendir(path)) == NULL) {
+        return -errno;
+    }
+    adapter_mark_read(adapter, dir);
+
+    while (NULL != (ent = dev_sys_readdir(dir))) {
+        int address = -1;
+
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+        address = dev_parse_chip_dev_name(ent->d_name, adapter->nr);
+        if (address < 0) {
+            continue;
+        }
+        snprintf(path + path_off, sizeof(path) - path_off, "/%s", ent->d_name);
+
+        chip = adapter_chip_lookup(adapter, address);
+        if (chip != NULL) {
+            SLIST_REMOVE(&adapter->clients, chip, dev_chip, node);
+            if (!chip_binding_changed(chip, path)) {
+                SLIST_INSERT_HEAD(&present, chip, node);
+                continue;
+            }
+            dev_free_chip(&chip);
+            device_global_count--;
+            changes++;
+        }
+
+        err = adapter_read_chip(adapter, address, path, &chip);
+        if (err == -ENOMEM) {
+            break;
+        } else if (err < 0) {
+            err = 0;
+            continue;
+        }
+        SLIST_INSERT_HEAD(&present, chip, node);
+        device_global_count++;
+        changes++;
+    }
+    dev_sys_closedir(dir);
+
+    if (err < 0) {
+        /* keep whatever was not looked at yet */
+        while ((chip = SLIST_FIRST(&present)) != NULL) {
+            SLIST_REMOVE_HEAD(&present, node);
+            SLIST_INSERT_HEAD(&adapter->clients, chip, node);
+        }
+        dev_topology_invalidate();
+        return err;
+    }
+
+    /* whatever is left over is gone from sysfs */
+    while ((chip = SLIST_FIRST(&adapter->clients)) != NULL) {
+        SLIST_REMOVE_HEAD(&adapter->clients, node);
+        dev_free_chip(&chip);
+        device_global_count--;
+        changes++;
+    }
+    adapter->clients = present;
+    if (changes > 0) {
+        dev_topology_invalidate();
+    }
+    return changes;
+}
+
+/**
+ * Check whether the bus tree is still the one last read: the same adapters,
+ * each with the same identity and an unchanged sysfs directory. This is
+ * what a topology snapshot is trusted on too; a driver bound to or unbound
+ * from a chip that stays is not seen, the uevent monitor applies those.
+ * @param sysfs_nrs adapter numbers in sysfs, sorted
+ * @param sysfs_count
+ * @return true if nothing needs to be read again
+ */
+static bool bus_tree_unchanged(const int *sysfs_nrs, int sysfs_count)
+{
+    char char_dev_name[20];
+    struct stat st;
+
+    if ((size_t) sysfs_count != adapter_global_count) {
+        return false;
+    }
+    for (size_t i = 0; i < adapter_global_count; ++i) {
+        const dev_bus_adapter *adapter = adapter_global_array[i];
+
+        /* both are sorted by nr */
+        if ((adapter->nr != sysfs_nrs[i]) || (adapter->sysfs_ino == 0)
+                || (adapter->devpath == NULL)) {
+            return false;
+        }
+        snprintf(char_dev_name, sizeof(char_dev_name), "/dev/i2c-%d", adapter->nr);
+        if (dev_sys_stat(char_dev_name, &st) == 0) {
+            if ((st.st_ino != adapter->i2c_adapt.char_dev_uid)
+                    || (st.st_dev != adapter->i2c_adapt.char_dev)) {
+                return false;
+            }
+        } else if (adapter->i2c_adapt.char_dev_uid != 0) {
+            return false;
+        }
+        /* a replaced adapter has a new directory even at the same path */
+        if ((dev_sys_stat(adapter->devpath, &st) < 0) || (st.st_ino != adapter->sysfs_ino)
+                || (st.st_nlink != adapter->sysfs_nlink)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int i2c_dev_bus_reconcile(void)
+{
+    int *sysfs_nrs = NULL;
+    int *known_nrs = NULL;
+    size_t known_count = 0;
+    int sysfs_count = 0;
+    int changes = 0;
+    int err = 0;
+    bool progress = true;
+
+    if (!dev_bus_list_headp) {
+        return -EFAULT;
+    }
+
+    sysfs_count = i2c_sysfs_scan_adapter_nrs(&sysfs_nrs);
+    if (sysfs_count < 0) {
+        devi2c_notice(NULL, "Error reading i2c adapters! - %s", strerror(-sysfs_count));
+        return sysfs_count;
+    }
+    if (bus_tree_unchanged(sysfs_nrs, sysfs_count)) {
+        free(sysfs_nrs);
+        return 0;
+    }
+
+    /* snapshot the known adapters, removing one drops its whole subtree */
+    known_count = adapter_global_count;
+    known_nrs = calloc(known_count ? known_count : 1, sizeof(*known_nrs));
+    if (known_nrs == NULL) {
+        free(sysfs_nrs);
+        return -ENOMEM;
+    }
+    for (size_t i = 0; i < known_count; ++i) {
+        known_nrs[i] = adapter_global_array[i]->nr;
+    }
+
+    /* drop adapters that went away or were replaced */
+    for (size_t i = 0; i < known_count; ++i) {
+        dev_bus_adapter *adapter = lookup_dev_bus_by_nr(known_nrs[i]);
+
+        if (adapter == NULL) {
+            continue;
+        }
+        if ((bsearch(&known_nrs[i], sysfs_nrs, sysfs_count, sizeof(*sysfs_nrs), compare_int) == NULL)
+                || adapter_identity_changed(adapter)) {
+            err = i2c_dev_bus_remove_adapter(known_nrs[i]);
+            if (err < 0) {
+                goto exit_free;
+            }
+            changes++;
+        }
+    }
+
+    /* diff the chips of the adapters that stayed */
+    for (size_t i = 0; i < adapter_global_count; ++i) {
+        err = adapter_reconcile_chips(adapter_global_array[i]);
+        if (err < 0) {
+            devi2c_notice(NULL, "Error reading i2c devices! - %s", strerror(-err));
+            continue;
+        }
+        changes += err;
+    }
+    err = 0;
+
+    /* add new adapters, a mux can only be linked once its parent is present */
+    while (progress) {
+        progress = false;
+        for (int i = 0; i < sysfs_count; ++i) {
+            char name[20];
+
+            if (lookup_dev_bus_by_nr(sysfs_nrs[i]) != NULL) {
+                continue;
+            }
+            snprintf(name, sizeof(name), "i2c-%d", sysfs_nrs[i]);
+            err = i2c_dev_bus_add_adapter(name);
+            if (err == -ENOMEM) {
+                goto exit_free;
+            } else if (err == 0) {
+                progress = true;
+                changes++;
+            }
+        }
+    }
+    err = 0;
+
+exit_free:
+    free(known_nrs);
+    free(sysfs_nrs);
+    if (err < 0) {
+        return err;
+    }
+    if (i2c_dev_verbose > 2) {
+        devi2c_debug(NULL, "reconciled i2c bus tree - %d changes", changes);
+    }
+    return changes;
+}
@@ -40,24 +40,24 @@
 #include "access.h"
 #include "data.h"
 #include "busses.h"
-
-#ifndef OVERRIDE_ETCDIR
-#define ETCDIR "/etc"
-#else
-#ifndef ETCDIR_PATH
-#define ETCDIR_PATH		/etc
-#endif
-#define ETCDIR		__stringify(ETCDIR_PATH)
-#endif /* !OVERRIDE_ETCDIR */
-
-#define DEFAULT_CONFIG_FILE	ETCDIR"/i2cdiscov.conf"
-#define DEFAULT_CONFIG_DIR	ETCDIR"/i2cdiscov.d"
+#include "snapshot.h"
+#include "arena.h"
+#include "intern.h"
+#include "topology.h"
+#include "chip-index.h"
+#include "instantiate.h"
+#include "config-parser.h"
+#include "compiled-config.h"
+#include "stats.h"
+#include "probes.h"
+#include "syscalls.h"
 
 #define BUFLEN 1024
 #define I2C_DEV_MOD_NAME "i2c_dev"
 
 int i2c_dev_verbose = 0; /* Show detailed information */
 int i2cdev_rescan_count = 0;
+unsigned long i2cdev_generation = 0;
 
 const char *stdin_config_file_name = NULL;
 
@@ -72,6 +72,10 @@ int dev_config_chips_max = 0;
 static dev_config_chip_head dev_config_list_head;
 dev_config_chip_head *p_dev_config_list_head = NULL;
 
+/* the default config files as they were read, if they were */
+static dev_config_sources config_sources;
+static bool config_from_defaults = false;
+
 static dev_bus_adapter_head dev_bus_list_head;
 dev_bus_adapter_head *dev_bus_list_headp = NULL;
 
@@ -79,8 +83,6 @@ dev_bus_adapter **adapter_global_array = NULL;
 size_t adapter_global_count = 0;
 size_t device_global_count = 0;
 
-static int parse_config_file(FILE *input, const char *name);
-
 /**
  * This is in the form of "pca9541-i2c-1:0.1-0x73"
  * See doc/libi2cdev-api and doc/i2cinit.cfg for examples
@@ -91,205 +93,65 @@ static int parse_config_file(FILE *input, const char *name);
  */
 static int parse_config(FILE *input, const char *name)
 {
-    char *name_copy = NULL;
-    int new_max_el;
+    const char *name_copy = NULL;
+    int ret = 0;
 
+    if (name == NULL) {
+        name = stdin_config_file_name;
+    }
     if (name != NULL) {
-        /* Record configuration file name for error reporting */
-        name_copy = strdup(name);
-        if (name_copy == NULL) {
-            return -ENOMEM;
-        }
-
-        if (dev_config_files_count + 1 > dev_config_files_max) {
-            new_max_el = dev_config_files_max *= 2;
-            dev_config_files = realloc(dev_config_files, (size_t) new_max_el * sizeof(char *));
-            if (!dev_config_files)
-                perror("realloc() Allocating new elements");
-            dev_config_files_max = new_max_el;
-        }
-        memcpy(((char *) dev_config_files) + dev_config_files_count * (int) sizeof(char *), name_copy, (size_t) sizeof(char *));
-        (dev_config_files_count)++;
-
-    } else if (stdin_config_file_name != NULL) {
-        /* Record configuration file name for error reporting */
-        name_copy = strdup(stdin_config_file_name);
+        name_copy = dev_config_file_name(name);
         if (name_copy == NULL) {
             return -ENOMEM;
         }
-        if (dev_config_files_count + 1 > dev_config_files_max) {
-            new_max_el = dev_config_files_max *= 2;
-            dev_config_files = realloc(dev_config_files, (size_t) new_max_el * sizeof(char *));
-            if (!dev_config_files)
-                perror("realloc() Allocating new elements");
-            dev_config_files_max = new_max_el;
-        }
-        memcpy(((char *) dev_config_files) + dev_config_files_count * (int) sizeof(char *), name_copy, (size_t) sizeof(char *));
-        (dev_config_files_count)++;
-    } else {
-        name_copy = NULL;
     }
 
-    return parse_config_file(input, name_copy);
+    ret = dev_config_parse(input, name_copy, p_dev_config_list_head);
+    return (ret < 0) ? ret : 0;
 }
 
-/* if last byte is a '\n'; chop that off
- * also chop off anything after a comment '#'
- */
-static char *clean_line(const char *line)
+const char *dev_config_file_name(const char *name)
 {
-    char buffer[BUFLEN];
-    char *begin = NULL;
-    char *end = NULL;
-
-    strncpy(buffer, line, sizeof(buffer) - 1);
-    buffer[sizeof(buffer) - 1] = '\0';
-    begin = &buffer[0];
+    char *name_copy = NULL;
 
-    /* Trim leading spaces */
-    while ((isblank(*begin)) && (*begin != '\0')) {
-        begin++;
+    for (int i = 0; i < dev_config_files_count; ++i) {
+        if (!strcmp(dev_config_files[i], name)) {
+            return dev_config_files[i];
+        }
     }
 
-    if (*begin == '\0') {
+    /* Record configuration file name for error reporting */
+    name_copy = strdup(name);
+    if (name_copy == NULL) {
         return NULL;
     }
+    if (dev_config_files_count == dev_config_files_max) {
+        int new_max_el = dev_config_files_max ? dev_config_files_max * 2 : 4;
+        char **files = realloc(dev_config_files, (size_t) new_max_el * sizeof(char *));
 
-    /* Find the end of the token.  */
-    end = strpbrk(begin, "#\t \n");
-    if (end != NULL) {
-        *end = '\0';
-    }
-    if (*begin == '\0') {
-        return NULL;
+        if (files == NULL) {
+            free(name_copy);
+            return NULL;
+        }
+        dev_config_files = files;
+        dev_config_files_max = new_max_el;
     }
-    return strdup(begin);
+    dev_config_files[dev_config_files_count++] = name_copy;
+    return name_copy;
 }
 
-static void free_config_chip(dev_config_chip *chip)
+bool dev_config_read_from_defaults(void)
 {
-    if (chip != NULL) {
-        free(chip->prefix);
-        free(chip);
-    }
+    return config_from_defaults;
 }
 
-/**
- * Read a config file
- * @param input File pointer to the configuration file
- * @param name The name of the file @note the name passed here must persist through the life of the library
- * @return If the file doesn't exist or can't be read, -errno is returned else 0
- */
-static int parse_config_file(FILE *input, const char *name)
+int dev_config_update_sources(void)
 {
-    char *line = NULL;
-    size_t len = 0;
-    ssize_t read_path;
-    int line_count = 0;
-    int ret = 0;
-    dev_config_chip *temp_chip = NULL;
-
-    if (!input)
-        return -ENOENT;
-
-    while ((read_path = getline(&line, &len, input)) != -1) {
-        char *line_entry = NULL;
-        char *linep = NULL;
-        char *dash = NULL;
-        char *bus_path = NULL;
-        char *bus_type = NULL;
-        char *chip_type_path = NULL;
-        dev_config_chip *chip = NULL;
-        bool free_chip = true;
-        line_count++;
-
-        if (line == NULL) {
-            continue;
-        }
-
-        line_entry = clean_line(line);
-
-        if (line_entry == NULL) {
-            continue;
-        }
-
-        chip = calloc(1, sizeof(*chip));
-        if (chip == NULL) {
-            goto while_free;
-        }
-
-        chip->line.filename = NULL;
-
-        linep = line_entry;
-
-        if (!(dash = strchr(linep, '-'))) {
-            goto while_free;
-        }
-
-        chip->prefix = strndup(linep, dash - linep);
-        if (chip->prefix == NULL) {
-            goto while_free;
-        }
-        linep = dash + 1;
-
-        if (!(dash = strchr(linep, '-'))) {
-            goto while_free;
-        }
-        bus_type = strndup(linep, dash - linep);
-        if (bus_type == NULL) {
-            goto while_free;
-        }
-        linep = dash + 1;
-
-        if (!(dash = strchr(linep, '-'))) {
-            goto add_bus;
-        }
-        bus_path = strndup(linep, dash - linep);
-        if (bus_path == NULL) {
-            goto while_free;
-        }
-        linep = dash + 1;
-
-        if (linep != NULL && *linep != '\0') {
-            chip->address = strtoul(linep, &dash, 0);
-        }
-
-        if (asprintf(&chip_type_path, "%s-%s", bus_type, bus_path) < 0) {
-            goto while_free;
-        }
-
-        dev_parse_bus_id(chip_type_path, &chip->bus);
-
-add_bus:
-
-        free_chip = false;
-        chip->line.filename = name;
-        chip->line.lineno = line_count;
-
-        temp_chip = SLIST_FIRST(p_dev_config_list_head);
-        if (temp_chip == NULL) {
-            SLIST_INSERT_HEAD(p_dev_config_list_head, chip, node);
-        } else {
-            dev_config_chip *chip_tmp_p = NULL;
-            while (((chip_tmp_p = SLIST_NEXT(temp_chip, node)) != NULL)
-                    && (chip_tmp_p != temp_chip)) {
-                temp_chip = chip_tmp_p;
-            }
-            SLIST_INSERT_AFTER(temp_chip, chip, node);
-        }
-while_free:
-        if (free_chip == true) {
-            free_config_chip(chip);
-        }
-        free(line_entry);
-        free(bus_type);
-        free(chip_type_path);
-        free(bus_path);
-        free(line);
-        line = NULL;
-    }
-    free(line);
-    return ret;
+    if (!config_from_defaults) {
+        return -EINVAL;
+    }
+    dev_config_sources_free(&config_sources);
+    return dev_config_sources_scan(DEFAULT_CONFIG_FILE, DEFAULT_CONFIG_DIR, &config_sources);
 }
 
 /**
@@ -341,7 +203,7 @@ int try_load_i2c_dev_mod(void)
 #else
     struct stat st;
 
-    err = stat("/sys/class/i2c-dev", &st);
+    err = dev_sys_stat("/sys/class/i2c-dev", &st);
     if (err < 0) {
         if (errno != ENOENT) {
             err = -errno;
@@ -380,7 +242,7 @@ static int add_config_from_dir(const char *dir)
     int count = 0, res = 0, i = 0;
     struct dirent **namelist;
 
-    count = scandir(dir, &namelist, config_file_filter, alphasort);
+    count = dev_sys_scandir(dir, &namelist, config_file_filter, alphasort);
     if (count < 0) {
         res = -errno;
         /* Do not return an error if directory does not exist */
@@ -403,14 +265,14 @@ static int add_config_from_dir(const char *dir)
         }
 
         /* Only accept regular files */
-        if (stat(path, &st) < 0 || !S_ISREG(st.st_mode)) {
+        if (dev_sys_stat(path, &st) < 0 || !S_ISREG(st.st_mode)) {
             continue;
         }
 
-        input = fopen(path, "r");
+        input = dev_sys_fopen(path, "r");
         if (input) {
             res = parse_config(input, path);
-            fclose(input);
+            dev_sys_fclose(input);
         } else {
             res = -errno;
         }
@@ -443,6 +305,7 @@ static void free_dev_client_list(dev_client_user_list *list)
         LIST_REMOVE(client_list, node);
         if (client_list->client) {
             client_list->client->adapter = NULL;
+            client_list->client->client_node = NULL;
         }
         free(client_list);
     }
@@ -460,36 +323,43 @@ void free_adapter_val(dev_bus_adapter **adapter)
             if ((adapter) && (*adapter)) {
 
                 if ((*adapter)->i2c_adapt.fd >= 0) {
-                    close((*adapter)->i2c_adapt.fd);
+                    I2CDEV_PROBE2(adapter__close, (*adapter)->i2c_adapt.nr,
+                            (*adapter)->i2c_adapt.fd);
+                    dev_sys_close((*adapter)->i2c_adapt.fd);
                 }
+                dev_i2c_stats_release(&(*adapter)->i2c_adapt.latency);
 
                 free_dev_chip_list(&((*adapter)->clients));
 
                 dev_free_bus_id(&(*adapter)->bus);
+                if ((*adapter)->child_index != NULL) {
+                    dev_arena_free((*adapter)->child_index);
+                }
+                (*adapter)->child_index = NULL;
                 if ((*adapter)->path != NULL) {
-                    free((*adapter)->path);
+                    dev_arena_free((*adapter)->path);
                 }
                 (*adapter)->path = NULL;
                 if ((*adapter)->name != NULL) {
-                    free((*adapter)->name);
+                    dev_intern_free((*adapter)->name);
                 }
                 (*adapter)->name = NULL;
                 if ((*adapter)->devpath != NULL) {
-                    free((*adapter)->devpath);
+                    dev_arena_free((*adapter)->devpath);
                 }
                 (*adapter)->devpath = NULL;
                 if ((*adapter)->subsystem != NULL) {
-                    free((*adapter)->subsystem);
+                    dev_intern_free((*adapter)->subsystem);
                 }
                 (*adapter)->subsystem = NULL;
                 if ((*adapter)->parent_name != NULL) {
-                    free((*adapter)->parent_name);
+                    dev_arena_free((*adapter)->parent_name);
                 }
                 (*adapter)->parent_name = NULL;
             }
 
             if (adapter != NULL && *adapter != NULL) {
-                free(*adapter); /* actually deallocate memory */
+                dev_arena_free(*adapter); /* actually deallocate memory */
                 *adapter = NULL; /* null terminate */
             }
         }
@@ -510,14 +380,14 @@ void free_adapter_list(dev_bus_adapter_head *list)
     }
 }
 
+/* the entry itself and its bus path belong to the config parser */
 static void free_dev_config_chip(dev_config_chip *chip)
 {
     if (chip != NULL) {
         if (chip->prefix != NULL) {
-            free(chip->prefix);
+            dev_intern_free(chip->prefix);
         }
         chip->prefix = NULL;
-        dev_free_bus_id(&chip->bus);
     }
 }
 
@@ -527,6 +397,7 @@ static bool init_once = false;
  separately, to make it possible to load several configuration files. */
 int i2cdev_init(FILE *input)
 {
+    DEV_SYS_API(DEV_I2C_API_INIT);
     int res = 0;
     if (get_libi2cdev_state() == LIB_SMB_READY) {
         return 0;
@@ -555,10 +426,18 @@ int i2cdev_init(FILE *input)
             const char* name = NULL;
 
             /* No configuration provided, use default */
-            input = fopen(name = DEFAULT_CONFIG_FILE, "r");
+            config_from_defaults = true;
+            if (dev_config_sources_scan(DEFAULT_CONFIG_FILE, DEFAULT_CONFIG_DIR,
+                    &config_sources) < 0) {
+                config_from_defaults = false;
+            } else if (dev_config_load_compiled(&config_sources, p_dev_config_list_head) >= 0) {
+                goto config_done;
+            }
+
+            input = dev_sys_fopen(name = DEFAULT_CONFIG_FILE, "r");
             if (input != NULL) {
                 res = parse_config(input, name);
-                fclose(input);
+                dev_sys_fclose(input);
                 if (res < 0) {
                     goto exit_cleanup;
                 }
@@ -572,12 +451,22 @@ int i2cdev_init(FILE *input)
                 goto exit_cleanup;
             }
         }
+config_done:
         init_once = true;
     }
 
-    if ((res = gather_i2c_dev_busses()) < 0) {
-        goto exit_cleanup;
+    /* a topology snapshot from this boot saves walking sysfs */
+    dev_arena_begin();
+    if (i2c_dev_snapshot_load() < 0) {
+        /* drop whatever a stale snapshot got to allocate */
+        dev_arena_begin();
+        if ((res = gather_i2c_dev_busses()) < 0) {
+            goto exit_cleanup;
+        }
+        i2c_dev_snapshot_save();
     }
+    /* incremental updates are freed one by one, they go to the heap */
+    dev_arena_end();
     set_libi2cdev_state(LIB_SMB_READY);
 
     // TODO: possibly move out of the init function (requires initialization aka libi2cdev_state = LIB_SMB_READY)
@@ -592,6 +481,7 @@ exit_cleanup:
 
 int i2cdev_rescan(void)
 {
+    DEV_SYS_API(DEV_I2C_API_RESCAN);
     int res = 0;
 
     if (get_libi2cdev_state() == LIB_SMB_UNINIIALIZED) {
@@ -600,17 +490,17 @@ int i2cdev_rescan(void)
         devi2c_debug(NULL, "Rescanning I2C bus structure - total previous rescan count = %d", i2cdev_rescan_count);
         set_libi2cdev_state(LIB_SMB_BUSY);
 
-        free_adapter_list(dev_bus_list_headp);
-
-        if (adapter_global_array != NULL) {
-            free(adapter_global_array);
-            adapter_global_count = 0;
-            adapter_global_array = NULL;
-        }
-        if ((res = gather_i2c_dev_busses()) < 0) {
+        I2CDEV_PROBE1(rescan__begin, i2cdev_rescan_count);
+        res = i2c_dev_bus_reconcile();
+        I2CDEV_PROBE2(rescan__end, res, i2cdev_rescan_count);
+        if (res < 0) {
             goto exit_cleanup;
         }
         i2cdev_rescan_count++;
+        if (res > 0) {
+            i2cdev_generation++;
+            i2c_dev_snapshot_save();
+        }
         libi2cdev_clear_invalidate_flag();
         set_libi2cdev_state(LIB_SMB_READY);
         return 0;
@@ -623,8 +513,14 @@ exit_cleanup:
     return res;
 }
 
+unsigned long i2cdev_get_generation(void)
+{
+    return i2cdev_generation;
+}
+
 int dev_remove_sysfs_i2c_device(const struct dev_i2c_board_info *info)
 {
+    DEV_SYS_API(DEV_I2C_API_INSTANTIATE);
     char path[PATH_MAX];
     char check_path[PATH_MAX];
     char buffer[NAME_MAX];
@@ -647,7 +543,7 @@ int dev_remove_sysfs_i2c_device(const struct dev_i2c_board_info *info)
 
     devi2c_debug(NULL, "Checking if device exists: %s", check_path);
 
-    if (stat(check_path, &st) < 0) {
+    if (dev_sys_stat(check_path, &st) < 0) {
         ret = -errno;
         goto exit_free;
     }
@@ -673,6 +569,7 @@ exit_free:
 
 int dev_new_sysfs_i2c_device(const struct dev_i2c_board_info *info)
 {
+    DEV_SYS_API(DEV_I2C_API_INSTANTIATE);
     char path[NAME_MAX];
     char check_path[NAME_MAX];
     char buffer[NAME_MAX];
@@ -695,7 +592,7 @@ int dev_new_sysfs_i2c_device(const struct dev_i2c_board_info *info)
 
     devi2c_debug(NULL, "Checking if device exists: %s", check_path);
 
-    ret = stat(check_path, &st);
+    ret = dev_sys_stat(check_path, &st);
     if (ret < 0) {
         if (errno != ENOENT) {
             ret = -errno;
@@ -739,13 +636,13 @@ static int remove_sysfs_i2c_device(dev_chip *chip)
         return -ENODEV;
     }
 
-    if (stat(chip->devpath, &st) < 0) {
+    if (dev_sys_stat(chip->devpath, &st) < 0) {
         return -errno;
     }
 
     snprintf(path, sizeof(path), "%s/%s", adapter->devpath, "delete_device");
 
-    if (stat(path, &st) < 0) {
+    if (dev_sys_stat(path, &st) < 0) {
         return -errno;
     } else {
         if (!(st.st_mode & S_IWUSR)) {
@@ -754,12 +651,12 @@ static int remove_sysfs_i2c_device(dev_chip *chip)
     }
 
     /* Close on Exit for kernel sysfs write calls */
-    if (NULL != (f = fopen(path, "w"))) {
-        res = fprintf(f, "0x%02hx", chip->addr);
+    if (NULL != (f = dev_sys_fopen(path, "w"))) {
+        res = dev_sys_fprintf(f, "0x%02hx", chip->addr);
         if (res < 0) {
             ret = -errno;
         }
-        res = fclose(f);
+        res = dev_sys_fclose(f);
         if (ret < 0) {
             return (ret);
         } else {
@@ -773,48 +670,14 @@ static int remove_sysfs_i2c_device(dev_chip *chip)
 
 int initialize_all_config_chips(void)
 {
-    int ret = 0;
-    dev_config_chip *comp = NULL;
-
-    dev_for_all_chips_match_config(p_dev_config_list_head);
-
-    SLIST_FOREACH(comp, p_dev_config_list_head, node) {
-
-        if ((comp->adapter_available == true) && (comp->matched == false)) {
-
-            struct dev_i2c_board_info info = {
-                .addr = comp->address,
-                .flags = 0,
-                .name = comp->prefix,
-                .path = comp->bus.path,
-            };
-
-            struct dev_i2c_board_info *p_info = &info;
+    DEV_SYS_API(DEV_I2C_API_INSTANTIATE);
 
-            if (i2c_dev_verbose) {
-                devi2c_debug(NULL, "Found chip in configuration spec not initialized:");
-                print_config_chip_data(comp);
-            }
-
-            ret = dev_new_sysfs_i2c_device(p_info);
-            if (ret < 0) {
-            	devi2c_warn(NULL, "Failed to add i2c device: \'%s\' - %s", p_info->name, strerror(-ret));
-            } else {
-                ret = i2cdev_rescan();
-                if (ret < 0) {
-                	devi2c_warn(NULL, "Failed to rescan i2c devices! - %s", strerror(-ret));
-                    return ret;
-                }
-                dev_for_all_chips_match_config(p_dev_config_list_head);
-            }
-        }
-    }
-
-    return 0;
+    return dev_instantiate_config_chips(p_dev_config_list_head);
 }
 
 int remove_adapters_config_chips(dev_bus_adapter *adapter)
 {
+    DEV_SYS_API(DEV_I2C_API_INSTANTIATE);
     int ret = 0;
     dev_chip *match = NULL;
 
@@ -844,48 +707,28 @@ int remove_adapters_config_chips(dev_bus_adapter *adapter)
 
 int remove_all_config_chips(void)
 {
-    int ret = 0;
-    dev_config_chip *comp = NULL;
-
-    dev_for_all_chips_match_config(p_dev_config_list_head);
-
-    SLIST_FOREACH(comp, p_dev_config_list_head, node) {
-
-        if ((comp->adapter_available == true) && (comp->matched == true)) {
+    DEV_SYS_API(DEV_I2C_API_INSTANTIATE);
 
-            struct dev_i2c_board_info info = {
-                .addr = comp->address,
-                .flags = 0,
-                .name = comp->prefix,
-                .path = comp->bus.path,
-            };
-
-            struct dev_i2c_board_info *p_info = &info;
-
-            if (i2c_dev_verbose) {
-                devi2c_debug(NULL, "Found chip in configuration spec initialized:");
-                print_config_chip_data(comp);
-            }
+    return dev_remove_config_chips(p_dev_config_list_head);
+}
 
-            ret = dev_remove_sysfs_i2c_device(p_info);
+int i2cdev_compile_config(const char *path)
+{
+    DEV_SYS_API(DEV_I2C_API_COMPILE_CONFIG);
 
-            if (ret < 0) {
-            	devi2c_warn(NULL, "Failed to remove i2c device: \'%s\' - %s", p_info->name, strerror(-ret));
-            } else {
-                ret = i2cdev_rescan();
-                if (ret < 0) {
-                	devi2c_warn(NULL, "Failed to rescan i2c devices! - %s", strerror(-ret));
-                    return ret;
-                }
-                dev_for_all_chips_match_config(p_dev_config_list_head);
-            }
-        }
+    if (!check_libi2cdev_ready()) {
+        return -ENODEV;
     }
-    return ret;
+    /* the sources recorded must be the ones the entries came from */
+    if (!config_from_defaults) {
+        return -EINVAL;
+    }
+    return dev_config_compile(path, &config_sources, p_dev_config_list_head);
 }
 
 void i2cdev_cleanup(void)
 {
+    DEV_SYS_API(DEV_I2C_API_CLEANUP);
     int i = 0;
     dev_config_chip *chipptr = NULL;
 
@@ -894,15 +737,21 @@ void i2cdev_cleanup(void)
     }
     set_libi2cdev_state(LIB_SMB_NOT_READY);
 
+    i2cdev_uevent_monitor_close();
+    i2cdev_config_monitor_close();
+    dev_instantiate_release();
+
+    dev_config_match_invalidate();
     if (p_dev_config_list_head) {
         while (NULL != (chipptr = SLIST_FIRST(p_dev_config_list_head))) {
             SLIST_REMOVE_HEAD(p_dev_config_list_head, node);
             free_dev_config_chip(chipptr);
-            if (chipptr != NULL) {
-                free(chipptr);
-            }
         }
     }
+    dev_config_release();
+    dev_compiled_config_release();
+    dev_config_sources_free(&config_sources);
+    config_from_defaults = false;
 
     for (i = 0; i < dev_config_files_count; i++) {
         if (dev_config_files[i] != NULL) {
@@ -918,7 +767,12 @@ void i2cdev_cleanup(void)
 	dev_config_files_max = 0;
     stdin_config_file_name = NULL;
 
+    /* closes the adapters and frees what was allocated after discovery */
+    dev_chip_index_release();
+    dev_topology_release();
     free_adapter_list(dev_bus_list_headp);
+    dev_arena_release();
+    dev_intern_release();
 
     if (adapter_global_array != NULL) {
         free(adapter_global_array);
@@ -0,0 +1,745 @@
+/**
+ * @file instantiate.c
+ * @copyright Violin Memory, Inc, 2014
+ *
+ * @brief Batched creation and removal of the chips listed in the config.
+ *
+ * Writing new_device makes the kernel probe the chip's driver, which for
+ * a mux creates its channel adapters, and chips behind a mux can only be
+ * created once those exist. So chips are created a level at a time: every
+ * unmatched config entry whose adapter exists is written, then the bus tree
+ * picks up just the written chips and the adapters that appeared, and the
+ * config is matched again to find the entries of the next level.
+ * The new_device and delete_device files stay open per adapter for the
+ * whole batch.
+ *
+ * A write returns only after the driver probed, and probing can do slow
+ * i2c traffic of its own. Chips on different root buses don't share any
+ * bus, so with i2cdev_set_instantiate_threads() the writes of a batch are
+ * split per root bus over a few threads, while those of one root bus stay
+ * in order on a single thread. The threads are started by the first batch
+ * that needs them and wait for the next one until i2cdev_cleanup().
+ */
+
+#define _GNU_SOURCE 1
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include <sys/stat.h>
+
+#include "common.h"
+#include "data.h"
+#include "access.h"
+#include "topology.h"
+#include "snapshot.h"
+#include "instantiate.h"
+#include "syscalls.h"
+
+#include "i2c-error.h"
+#include "i2c-dev-parser.h"
+#include "i2cdiscov.h"
+
+extern dev_bus_adapter *lookup_dev_bus_by_nr(int nr);
+
+#define BATCH_NEW_DEVICE        0
+#define BATCH_DELETE_DEVICE     1
+
+static const char * const batch_file_name[] = {
+    [BATCH_NEW_DEVICE] = "new_device",
+    [BATCH_DELETE_DEVICE] = "delete_device",
+};
+
+typedef struct batch_op {
+    dev_config_chip *config;
+    int nr; /* adapter the chip sits on */
+    int addr;
+    int depth; /* depth of the adapter in the bus tree */
+    int root; /* root bus of the adapter */
+    int fd; /* new_device or delete_device file of the adapter */
+    int err;
+} batch_op;
+
+typedef struct batch_fds {
+    int nr;
+    int fd[2]; /* new_device and delete_device, or -1 if not open yet */
+} batch_fds;
+
+typedef struct batch {
+    batch_op *op;
+    int count;
+    int max;
+
+    batch_fds *fds; /* sorted by adapter nr */
+    int fds_count;
+    int fds_max;
+} batch;
+
+/* work shared by the threads writing a batch, a group is one root bus */
+typedef struct batch_dispatch {
+    batch *b;
+    int which;
+    const int *group; /* first op of each group, groups + 1 entries */
+    int groups;
+    int next; /* next group to be taken */
+    int api; /* public call of the calling thread, for syscall counting */
+} batch_dispatch;
+
+/* 1: write in the calling thread, 0: one thread per root bus */
+static int instantiate_threads = 1;
+
+#define POOL_THREADS_MAX        32
+
+/* threads writing batches along with the calling thread, kept between batches */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work; /* a batch was posted or the threads must stop */
+    pthread_cond_t done; /* the last thread on the batch finished */
+    pthread_mutex_t dispatch; /* one batch at a time */
+    pthread_t thread[POOL_THREADS_MAX];
+    int count;
+    batch_dispatch *d;
+    unsigned long seq; /* batches posted */
+    int slots; /* threads the batch still wants */
+    int busy; /* threads on the batch */
+    bool stop;
+} pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+    .dispatch = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+int i2cdev_set_instantiate_threads(int threads)
+{
+    if (threads < 0) {
+        return -EINVAL;
+    }
+    instantiate_threads = threads;
+    return 0;
+}
+
+static void batch_release(batch *b)
+{
+    for (int i = 0; i < b->fds_count; ++i) {
+        for (int f = 0; f < 2; ++f) {
+            if (b->fds[i].fd[f] >= 0) {
+                dev_sys_close(b->fds[i].fd[f]);
+            }
+        }
+    }
+    free(b->fds);
+    free(b->op);
+    memset(b, 0, sizeof(*b));
+}
+
+static int batch_add_op(batch *b, dev_config_chip *config, int depth)
+{
+    const dev_bus_adapter *root = config->adapter;
+
+    if (b->count == b->max) {
+        int max = b->max ? b->max * 2 : 32;
+        batch_op *grown = realloc(b->op, max * sizeof(*grown));
+
+        if (grown == NULL) {
+            return -ENOMEM;
+        }
+        b->op = grown;
+        b->max = max;
+    }
+    b->op[b->count].config = config;
+    b->op[b->count].nr = config->adapter->nr;
+    b->op[b->count].addr = config->address;
+    b->op[b->count].depth = depth;
+    while (root->parent != NULL) {
+        root = root->parent;
+    }
+    b->op[b->count].root = root->nr;
+    b->op[b->count].fd = -1;
+    b->op[b->count].err = 0;
+    b->count++;
+    return 0;
+}
+
+/**
+ * Get the open new_device or delete_device file of an adapter
+ * @param b
+ * @param adapter
+ * @param which BATCH_NEW_DEVICE or BATCH_DELETE_DEVICE
+ * @return negative errno on failure else the file descriptor
+ */
+static int batch_fd(batch *b, const dev_bus_adapter *adapter, int which)
+{
+    char path[PATH_MAX];
+    batch_fds *entry = NULL;
+    int lo = 0;
+    int hi = b->fds_count;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+
+        if (b->fds[mid].nr < adapter->nr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if ((lo == b->fds_count) || (b->fds[lo].nr != adapter->nr)) {
+        if (b->fds_count == b->fds_max) {
+            int max = b->fds_max ? b->fds_max * 2 : 16;
+            batch_fds *grown = realloc(b->fds, max * sizeof(*grown));
+
+            if (grown == NULL) {
+                return -ENOMEM;
+            }
+            b->fds = grown;
+            b->fds_max = max;
+        }
+        memmove(&b->fds[lo + 1], &b->fds[lo], (b->fds_count - lo) * sizeof(*b->fds));
+        b->fds[lo].nr = adapter->nr;
+        b->fds[lo].fd[0] = -1;
+        b->fds[lo].fd[1] = -1;
+        b->fds_count++;
+    }
+    entry = &b->fds[lo];
+
+    if (entry->fd[which] < 0) {
+        if (snprintf(path, sizeof(path), "%s/%s", adapter->devpath,
+                batch_file_name[which]) >= (int) sizeof(path)) {
+            return -ENAMETOOLONG;
+        }
+        entry->fd[which] = dev_sys_open(path, O_WRONLY | O_CLOEXEC);
+        if (entry->fd[which] < 0) {
+            return -errno;
+        }
+    }
+    return entry->fd[which];
+}
+
+/**
+ * Write one operation to its adapter's new_device or delete_device file
+ * @param op
+ * @param which BATCH_NEW_DEVICE or BATCH_DELETE_DEVICE
+ * @return negative errno on failure else zero on success
+ */
+static int batch_write(const batch_op *op, int which)
+{
+    char buffer[NAME_MAX];
+    int count = 0;
+
+    if (which == BATCH_NEW_DEVICE) {
+        count = snprintf(buffer, sizeof(buffer), "%s 0x%02hx", op->config->prefix, op->addr);
+    } else {
+        count = snprintf(buffer, sizeof(buffer), "0x%02hx", op->addr);
+    }
+    if ((count < 0) || (count >= (int) sizeof(buffer))) {
+        return -EINVAL;
+    }
+    /* every write to a sysfs attribute is a separate store, rewind anyway */
+    if (TEMP_FAILURE_RETRY(dev_sys_pwrite(op->fd, buffer, count, 0)) < 0) {
+        return -errno;
+    }
+    return 0;
+}
+
+static int batch_compare_nr(const void *p1, const void *p2)
+{
+    const batch_op *op1 = p1;
+    const batch_op *op2 = p2;
+
+    if (op1->root != op2->root) {
+        return (op1->root > op2->root) - (op1->root < op2->root);
+    }
+    if (op1->nr != op2->nr) {
+        return (op1->nr > op2->nr) - (op1->nr < op2->nr);
+    }
+    return (op1->addr > op2->addr) - (op1->addr < op2->addr);
+}
+
+/* deepest adapters first, so chips behind a mux go before the mux */
+static int batch_compare_depth(const void *p1, const void *p2)
+{
+    const batch_op *op1 = p1;
+    const batch_op *op2 = p2;
+
+    if (op1->root != op2->root) {
+        return (op1->root > op2->root) - (op1->root < op2->root);
+    }
+    if (op1->depth != op2->depth) {
+        return (op1->depth < op2->depth) - (op1->depth > op2->depth);
+    }
+    return batch_compare_nr(p1, p2);
+}
+
+static void *batch_worker(void *arg)
+{
+    batch_dispatch *d = arg;
+    int g = 0;
+
+    dev_sys_api = d->api;
+    while ((g = __sync_fetch_and_add(&d->next, 1)) < d->groups) {
+        for (int i = d->group[g]; i < d->group[g + 1]; ++i) {
+            batch_op *op = &d->b->op[i];
+
+            if (op->err < 0) {
+                continue;
+            }
+            op->err = batch_write(op, d->which);
+            if (op->err < 0) {
+                devi2c_warn(NULL, "Failed to %s i2c device: \'%s\' - %s",
+                        (d->which == BATCH_NEW_DEVICE) ? "add" : "remove",
+                        op->config->prefix, strerror(-op->err));
+            }
+        }
+    }
+    return NULL;
+}
+
+static void *pool_worker(void *arg)
+{
+    unsigned long seen = (unsigned long) (uintptr_t) arg;
+
+    pthread_mutex_lock(&pool.lock);
+    for (;;) {
+        batch_dispatch *d = NULL;
+
+        while (!pool.stop && (pool.seq == seen)) {
+            pthread_cond_wait(&pool.work, &pool.lock);
+        }
+        if (pool.stop) {
+            break;
+        }
+        seen = pool.seq;
+        if (pool.slots == 0) {
+            continue;
+        }
+        pool.slots--;
+        pool.busy++;
+        d = pool.d;
+        pthread_mutex_unlock(&pool.lock);
+
+        batch_worker(d);
+
+        pthread_mutex_lock(&pool.lock);
+        if ((--pool.busy == 0) && (pool.slots == 0)) {
+            pthread_cond_signal(&pool.done);
+        }
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return NULL;
+}
+
+/* the threads aren't copied into a forked child */
+static void pool_atfork_child(void)
+{
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_mutex_init(&pool.dispatch, NULL);
+    pthread_cond_init(&pool.work, NULL);
+    pthread_cond_init(&pool.done, NULL);
+    pool.count = 0;
+    pool.slots = 0;
+    pool.busy = 0;
+    pool.stop = false;
+}
+
+static void pool_register_atfork(void)
+{
+    pthread_atfork(NULL, NULL, pool_atfork_child);
+}
+
+/**
+ * Write a batch with the calling thread and up to extra pool threads,
+ * starting the threads the pool is short of
+ * @param d
+ * @param extra
+ */
+static void pool_run(batch_dispatch *d, int extra)
+{
+    pthread_mutex_lock(&pool.dispatch);
+    pthread_mutex_lock(&pool.lock);
+    if (extra > 0) {
+        pthread_once(&pool_once, pool_register_atfork);
+    }
+    while (pool.count < extra) {
+        /* it waits for the batch posted below */
+        if (pthread_create(&pool.thread[pool.count], NULL, pool_worker,
+                (void *) (uintptr_t) pool.seq) != 0) {
+            break;
+        }
+        pool.count++;
+    }
+    pool.d = d;
+    pool.slots = (extra < pool.count) ? extra : pool.count;
+    pool.seq++;
+    pthread_cond_broadcast(&pool.work);
+    pthread_mutex_unlock(&pool.lock);
+
+    /* the calling thread takes groups as well, so threads that are late are harmless */
+    batch_worker(d);
+
+    pthread_mutex_lock(&pool.lock);
+    pool.slots = 0;
+    while (pool.busy > 0) {
+        pthread_cond_wait(&pool.done, &pool.lock);
+    }
+    pool.d = NULL;
+    pthread_mutex_unlock(&pool.lock);
+    pthread_mutex_unlock(&pool.dispatch);
+}
+
+void dev_instantiate_release(void)
+{
+    pthread_mutex_lock(&pool.dispatch);
+    pthread_mutex_lock(&pool.lock);
+    pool.stop = true;
+    pthread_cond_broadcast(&pool.work);
+    pthread_mutex_unlock(&pool.lock);
+    for (int t = 0; t < pool.count; ++t) {
+        pthread_join(pool.thread[t], NULL);
+    }
+    pthread_mutex_lock(&pool.lock);
+    pool.count = 0;
+    pool.stop = false;
+    pthread_mutex_unlock(&pool.lock);
+    pthread_mutex_unlock(&pool.dispatch);
+}
+
+/**
+ * Write all operations of a batch, sorted by root bus, the root buses
+ * in parallel when more than one thread is allowed
+ * @param b
+ * @param which BATCH_NEW_DEVICE or BATCH_DELETE_DEVICE
+ * @return negative errno if the batch couldn't be started else zero,
+ * the result of each write is left in its operation
+ */
+static int batch_write_all(batch *b, int which)
+{
+    batch_dispatch d;
+    int *group = NULL;
+    int threads = 0;
+
+    memset(&d, 0, sizeof(d));
+    group = malloc((b->count + 1) * sizeof(*group));
+    if (group == NULL) {
+        return -ENOMEM;
+    }
+    /* files are opened here, the threads only write */
+    for (int i = 0; i < b->count; ++i) {
+        b->op[i].fd = batch_fd(b, b->op[i].config->adapter, which);
+        b->op[i].err = (b->op[i].fd < 0) ? b->op[i].fd : 0;
+        if (b->op[i].err < 0) {
+            devi2c_warn(NULL, "Failed to open %s of i2c-%d - %s", batch_file_name[which],
+                    b->op[i].nr, strerror(-b->op[i].err));
+        }
+        if ((i == 0) || (b->op[i].root != b->op[i - 1].root)) {
+            group[d.groups++] = i;
+        }
+    }
+    group[d.groups] = b->count;
+    d.b = b;
+    d.which = which;
+    d.group = group;
+    d.api = dev_sys_api;
+
+    threads = instantiate_threads ? instantiate_threads : d.groups;
+    if (threads > d.groups) {
+        threads = d.groups;
+    }
+    if (threads > POOL_THREADS_MAX + 1) {
+        threads = POOL_THREADS_MAX + 1;
+    }
+    if (i2c_dev_verbose > 1) {
+        devi2c_debug(NULL, "Writing %d i2c devices on %d root buses with %d threads",
+                b->count, d.groups, (threads > 0) ? threads : 1);
+    }
+
+    if (threads > 1) {
+        pool_run(&d, threads - 1);
+    } else {
+        batch_worker(&d);
+    }
+
+    free(group);
+    return 0;
+}
+
+static bool adapter_has_chip_at(const dev_bus_adapter *adapter, int addr)
+{
+    const dev_chip *chip = NULL;
+
+    SLIST_FOREACH(chip, &adapter->clients, node) {
+        if (chip->addr == addr) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Remove the children of an adapter whose sysfs directory went away
+ * @param nr
+ * @return number of adapters removed
+ */
+static int batch_prune_adapters(int nr)
+{
+    dev_bus_adapter *adapter = NULL;
+    dev_bus_adapter *child = NULL;
+    int gone[64];
+    int count = 0;
+    int removed = 0;
+
+    do {
+        adapter = lookup_dev_bus_by_nr(nr);
+        if (adapter == NULL) {
+            return removed;
+        }
+        count = 0;
+        LIST_FOREACH(child, &adapter->children, node) {
+            struct stat st;
+
+            if ((dev_sys_stat(child->devpath, &st) < 0) && (errno == ENOENT)
+                    && (count < (int) ARRAY_SIZE(gone))) {
+                gone[count++] = child->nr;
+            }
+        }
+        for (int i = 0; i < count; ++i) {
+            if (i2c_dev_bus_remove_adapter(gone[i]) == 0) {
+                removed++;
+            }
+        }
+    } while (count == (int) ARRAY_SIZE(gone));
+    return removed;
+}
+
+/**
+ * Bring the bus tree up to date after a batch of new_device writes,
+ * without a full rescan
+ * @param b
+ * @return negative errno on failure else the number of changes
+ */
+static int batch_update_created(const batch *b)
+{
+    char name[NAME_MAX];
+    int changes = 0;
+    int err = 0;
+
+    for (int i = 0; i < b->count; ++i) {
+        if (b->op[i].err < 0) {
+            continue;
+        }
+        snprintf(name, sizeof(name), "%d-%04x", b->op[i].nr, b->op[i].addr);
+        err = i2c_dev_bus_add_chip(b->op[i].nr, name);
+        if (err == 0) {
+            changes++;
+        } else if (err != -EEXIST) {
+            devi2c_info(NULL, "created i2c device %s not found - %s", name, strerror(-err));
+        }
+    }
+    /* the channels of newly created muxes */
+    err = i2c_dev_bus_add_new_adapters();
+    if (err < 0) {
+        return err;
+    }
+    return changes + err;
+}
+
+/**
+ * Bring the bus tree up to date after a batch of delete_device writes,
+ * without a full rescan
+ * @param b
+ * @return the number of changes
+ */
+static int batch_update_removed(const batch *b)
+{
+    int changes = 0;
+
+    for (int i = 0; i < b->count; ++i) {
+        if (b->op[i].err < 0) {
+            continue;
+        }
+        if (i2c_dev_bus_remove_chip(b->op[i].nr, b->op[i].addr) == 0) {
+            changes++;
+        }
+        /* the channels of a removed mux */
+        changes += batch_prune_adapters(b->op[i].nr);
+    }
+    return changes;
+}
+
+/**
+ * Apply a batch update to the bus tree like i2cdev_rescan() does,
+ * falling back to a full rescan if it fails
+ * @param b
+ * @param update
+ * @return negative errno on failure else the number of changes
+ */
+static int batch_apply(const batch *b, int (*update)(const batch *))
+{
+    int changes = 0;
+
+    if (get_libi2cdev_state() != LIB_SMB_READY) {
+        return -EBUSY;
+    }
+    set_libi2cdev_state(LIB_SMB_BUSY);
+    changes = update(b);
+    set_libi2cdev_state(LIB_SMB_READY);
+
+    if (changes < 0) {
+        devi2c_notice(NULL, "Failed to update i2c bus tree - %s, rescanning", strerror(-changes));
+        changes = i2cdev_rescan();
+        if (changes < 0) {
+            devi2c_warn(NULL, "Failed to rescan i2c devices! - %s", strerror(-changes));
+        }
+        return changes;
+    }
+    if (changes > 0) {
+        i2cdev_generation++;
+    }
+    return changes;
+}
+
+int dev_instantiate_config_chips(dev_config_chip_head *head)
+{
+    dev_config_chip *comp = NULL;
+    bool *tried = NULL;
+    batch b;
+    int entries = 0;
+    int levels = 0;
+    int changes = 0;
+    int ret = 0;
+
+    memset(&b, 0, sizeof(b));
+    if ((head == NULL) || SLIST_EMPTY(head)) {
+        return 0;
+    }
+    SLIST_FOREACH(comp, head, node) {
+        entries++;
+    }
+    /* every entry is written at most once, even if its chip doesn't show up */
+    tried = calloc(entries, sizeof(*tried));
+    if (tried == NULL) {
+        return -ENOMEM;
+    }
+
+    while (1) {
+        int k = 0;
+
+        dev_for_all_chips_match_config(head);
+
+        b.count = 0;
+        SLIST_FOREACH(comp, head, node) {
+            if (!tried[k] && (comp->adapter_available == true) && (comp->matched == false)
+                    && !dev_config_chip_has_wildcards(comp)) {
+                tried[k] = true;
+
+                if (i2c_dev_verbose) {
+                    devi2c_debug(NULL, "Found chip in configuration spec not initialized:");
+                    print_config_chip_data(comp);
+                }
+                /* a different chip already sits at the address */
+                if (adapter_has_chip_at(comp->adapter, comp->address)) {
+                    k++;
+                    continue;
+                }
+                ret = batch_add_op(&b, comp, 0);
+                if (ret < 0) {
+                    goto exit_free;
+                }
+            }
+            k++;
+        }
+        if (b.count == 0) {
+            break;
+        }
+
+        qsort(b.op, b.count, sizeof(*b.op), batch_compare_nr);
+        ret = batch_write_all(&b, BATCH_NEW_DEVICE);
+        if (ret < 0) {
+            goto exit_free;
+        }
+
+        ret = batch_apply(&b, batch_update_created);
+        if (ret < 0) {
+            goto exit_free;
+        }
+        changes += ret;
+        levels++;
+    }
+    ret = 0;
+
+    if (i2c_dev_verbose) {
+        devi2c_debug(NULL, "Initialized config chips in %d levels, %d changes", levels, changes);
+    }
+
+exit_free:
+    if (changes > 0) {
+        i2c_dev_snapshot_save();
+    }
+    batch_release(&b);
+    free(tried);
+    return ret;
+}
+
+int dev_remove_config_chips(dev_config_chip_head *head)
+{
+    const dev_topology *topo = NULL;
+    dev_config_chip *comp = NULL;
+    batch b;
+    int ret = 0;
+
+    memset(&b, 0, sizeof(b));
+    if ((head == NULL) || SLIST_EMPTY(head)) {
+        return 0;
+    }
+
+    dev_for_all_chips_match_config(head);
+    topo = dev_topology_get();
+
+    SLIST_FOREACH(comp, head, node) {
+        if ((comp->adapter_available == true) && (comp->matched == true)
+                && !dev_config_chip_has_wildcards(comp)) {
+            int i = dev_topology_adapter_index(topo, comp->adapter);
+
+            if (i2c_dev_verbose) {
+                devi2c_debug(NULL, "Found chip in configuration spec initialized:");
+                print_config_chip_data(comp);
+            }
+            ret = batch_add_op(&b, comp, (i != TOPOLOGY_NONE) ? topo->depth[i] : 0);
+            if (ret < 0) {
+                goto exit_free;
+            }
+        }
+    }
+    if (b.count == 0) {
+        goto exit_free;
+    }
+
+    qsort(b.op, b.count, sizeof(*b.op), batch_compare_depth);
+    ret = batch_write_all(&b, BATCH_DELETE_DEVICE);
+    if (ret < 0) {
+        goto exit_free;
+    }
+
+    ret = batch_apply(&b, batch_update_removed);
+    if (ret < 0) {
+        goto exit_free;
+    }
+    if (ret > 0) {
+        i2c_dev_snapshot_save();
+    }
+    ret = 0;
+    dev_for_all_chips_match_config(head);
+
+exit_free:
+    batch_release(&b);
+    return ret;
+}
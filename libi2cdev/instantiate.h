@@ -0,0 +1,33 @@
+/**
+ * @file instantiate.h
+ * @copyright Violin Memory, Inc, 2014
+ * @brief Batched creation and removal of the chips listed in the config
+ */
+
+#ifndef LIB_INSTANTIATE_H
+#define LIB_INSTANTIATE_H
+
+#include "busses.h"
+
+/**
+ * Create every config chip which doesn't exist yet, one bus tree level
+ * at a time, updating the bus tree once per level
+ * @param head config list
+ * @return negative errno on failure else zero on success
+ */
+extern int dev_instantiate_config_chips(dev_config_chip_head *head);
+
+/**
+ * Remove every config chip which exists, chips behind a mux before the mux,
+ * updating the bus tree once
+ * @param head config list
+ * @return negative errno on failure else zero on success
+ */
+extern int dev_remove_config_chips(dev_config_chip_head *head);
+
+/**
+ * Stop the threads kept for writing batches
+ */
+extern void dev_instantiate_release(void);
+
+#endif /* !LIB_INSTANTIATE_H */
@@ -0,0 +1,280 @@
+/**
+ * @file intern.c
+ * @copyright Violin Memory, Inc, 2014
+ *
+ * @brief Interned strings shared by the chips and adapters of the bus tree.
+ *
+ * A handful of driver, module and subsystem names are repeated by hundreds
+ * of chips, so every such string is stored once. Each interned string also
+ * points at the first string interned with the same case folded spelling,
+ * which turns the case insensitive name matching of chips and config
+ * entries into a pointer compare.
+ */
+
+#define _GNU_SOURCE 1
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include <sys/param.h>	/* for MAX() */
+
+#include "common.h"
+#include "arena.h"
+#include "intern.h"
+
+#define INTERN_TABLE_MIN    64
+#define INTERN_CHUNK_MIN    4096
+#define INTERN_CHUNK_MAX    32
+
+typedef struct intern_str {
+    const struct intern_str *fold; /* first string with the same case folded spelling */
+    uint32_t hash;
+    char str[];
+} intern_str;
+
+typedef struct intern_table {
+    intern_str **slots;
+    size_t size; /* power of two */
+    size_t count;
+} intern_table;
+
+typedef struct intern_chunk {
+    char *base;
+    size_t size;
+    size_t used;
+} intern_chunk;
+
+/* exact spelling -> string, and case folded spelling -> first such string */
+static intern_table intern_exact;
+static intern_table intern_folded;
+
+/* string storage, each chunk is twice the size of the previous one */
+static intern_chunk intern_chunks[INTERN_CHUNK_MAX];
+static int intern_chunk_count = 0;
+
+static uint32_t intern_hash(const char *str, size_t len, bool fold)
+{
+    uint32_t hash = 2166136261u; /* FNV-1a */
+
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = (unsigned char) str[i];
+
+        hash ^= fold ? (unsigned char) tolower(c) : c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Find the slot a string lives in or should be added at
+ * @param table
+ * @param str
+ * @param len
+ * @param hash
+ * @param fold compare case insensitively
+ * @return the slot
+ */
+static intern_str **intern_table_slot(const intern_table *table, const char *str,
+        size_t len, uint32_t hash, bool fold)
+{
+    size_t mask = table->size - 1;
+    size_t pos = hash & mask;
+
+    while (table->slots[pos] != NULL) {
+        const intern_str *entry = table->slots[pos];
+
+        if ((entry->hash == hash) || fold) {
+            int cmp = fold ? strncasecmp(entry->str, str, len) : strncmp(entry->str, str, len);
+
+            if ((cmp == 0) && (entry->str[len] == '\0')) {
+                break;
+            }
+        }
+        pos = (pos + 1) & mask;
+    }
+    return &table->slots[pos];
+}
+
+/**
+ * Make room for one more entry, keeping the table at most half full
+ * @param table
+ * @param fold
+ * @return negative errno on failure else zero on success
+ */
+static int intern_table_reserve(intern_table *table, bool fold)
+{
+    intern_table grown = { NULL, 0, 0 };
+
+    if ((table->count + 1) * 2 <= table->size) {
+        return 0;
+    }
+    grown.size = table->size ? table->size * 2 : INTERN_TABLE_MIN;
+    grown.slots = calloc(grown.size, sizeof(*grown.slots));
+    if (grown.slots == NULL) {
+        return -ENOMEM;
+    }
+    for (size_t i = 0; i < table->size; ++i) {
+        intern_str *entry = table->slots[i];
+
+        if (entry != NULL) {
+            size_t len = strlen(entry->str);
+            uint32_t hash = fold ? intern_hash(entry->str, len, true) : entry->hash;
+
+            *intern_table_slot(&grown, entry->str, len, hash, fold) = entry;
+        }
+    }
+    grown.count = table->count;
+    free(table->slots);
+    *table = grown;
+    return 0;
+}
+
+/**
+ * Carve an interned string out of the chunk storage
+ * @param size
+ * @return the memory or NULL if out of memory
+ */
+static intern_str *intern_chunk_alloc(size_t size)
+{
+    intern_chunk *chunk = NULL;
+
+    size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+    if (intern_chunk_count > 0) {
+        chunk = &intern_chunks[intern_chunk_count - 1];
+    }
+    if ((chunk == NULL) || (size > chunk->size - chunk->used)) {
+        size_t chunk_size = chunk ? chunk->size * 2 : INTERN_CHUNK_MIN;
+
+        if (intern_chunk_count == INTERN_CHUNK_MAX) {
+            return NULL;
+        }
+        chunk_size = MAX(chunk_size, size);
+        chunk = &intern_chunks[intern_chunk_count];
+        chunk->base = malloc(chunk_size);
+        if (chunk->base == NULL) {
+            return NULL;
+        }
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        intern_chunk_count++;
+    }
+    chunk->used += size;
+    return (intern_str *) (chunk->base + chunk->used - size);
+}
+
+/**
+ * @param str
+ * @return the table entry of an interned string else NULL
+ */
+static const intern_str *intern_entry(const char *str)
+{
+    if (str == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < intern_chunk_count; ++i) {
+        const intern_chunk *chunk = &intern_chunks[i];
+
+        if ((str > chunk->base) && (str < chunk->base + chunk->used)) {
+            return (const intern_str *) (str - offsetof(intern_str, str));
+        }
+    }
+    return NULL;
+}
+
+char *dev_intern_n(const char *str, size_t len)
+{
+    intern_str **slot = NULL;
+    intern_str **fold_slot = NULL;
+    intern_str *entry = NULL;
+    uint32_t hash = 0;
+    uint32_t fold_hash = 0;
+
+    if (str == NULL) {
+        return NULL;
+    }
+    len = strnlen(str, len);
+    hash = intern_hash(str, len, false);
+
+    if ((intern_table_reserve(&intern_exact, false) < 0)
+            || (intern_table_reserve(&intern_folded, true) < 0)) {
+        return NULL;
+    }
+    slot = intern_table_slot(&intern_exact, str, len, hash, false);
+    if (*slot != NULL) {
+        return (*slot)->str;
+    }
+
+    entry = intern_chunk_alloc(sizeof(*entry) + len + 1);
+    if (entry == NULL) {
+        return NULL;
+    }
+    entry->hash = hash;
+    memcpy(entry->str, str, len);
+    entry->str[len] = '\0';
+
+    fold_hash = intern_hash(str, len, true);
+    fold_slot = intern_table_slot(&intern_folded, str, len, fold_hash, true);
+    if (*fold_slot == NULL) {
+        *fold_slot = entry;
+        intern_folded.count++;
+    }
+    entry->fold = *fold_slot;
+
+    *slot = entry;
+    intern_exact.count++;
+    return entry->str;
+}
+
+char *dev_intern(const char *str)
+{
+    return dev_intern_n(str, SIZE_MAX);
+}
+
+bool dev_intern_owns(const char *str)
+{
+    return (intern_entry(str) != NULL);
+}
+
+void dev_intern_free(char *str)
+{
+    if (!dev_intern_owns(str)) {
+        dev_arena_free(str);
+    }
+}
+
+bool dev_intern_caseeq(const char *s1, const char *s2)
+{
+    const intern_str *e1 = NULL;
+    const intern_str *e2 = NULL;
+
+    if (s1 == s2) {
+        return true;
+    } else if ((s1 == NULL) || (s2 == NULL)) {
+        return false;
+    }
+    e1 = intern_entry(s1);
+    e2 = intern_entry(s2);
+    if ((e1 != NULL) && (e2 != NULL)) {
+        return (e1->fold == e2->fold);
+    }
+    return (strcasecmp(s1, s2) == 0);
+}
+
+void dev_intern_release(void)
+{
+    for (int i = 0; i < intern_chunk_count; ++i) {
+        free(intern_chunks[i].base);
+        intern_chunks[i].base = NULL;
+    }
+    intern_chunk_count = 0;
+
+    free(intern_exact.slots);
+    memset(&intern_exact, 0, sizeof(intern_exact));
+    free(intern_folded.slots);
+    memset(&intern_folded, 0, sizeof(intern_folded));
+}
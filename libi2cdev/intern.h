@@ -0,0 +1,56 @@
+/**
+ * @file intern.h
+ * @copyright Violin Memory, Inc, 2014
+ * @brief Interned strings shared by the chips and adapters of the bus tree
+ */
+
+#ifndef LIB_INTERN_H
+#define LIB_INTERN_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * Look up or add a string in the intern table.
+ * Equal strings share one copy which lives until dev_intern_release(),
+ * it must not be modified or passed to free().
+ * @param str
+ * @return the shared copy or NULL if out of memory
+ */
+extern char *dev_intern(const char *str);
+
+/**
+ * dev_intern() for the first len bytes of a string
+ * @param str
+ * @param len
+ * @return the shared copy or NULL if out of memory
+ */
+extern char *dev_intern_n(const char *str, size_t len);
+
+/**
+ * @param str
+ * @return true if str is a string returned by dev_intern()
+ */
+extern bool dev_intern_owns(const char *str);
+
+/**
+ * Free a string which may or may not be interned
+ * @param str
+ */
+extern void dev_intern_free(char *str);
+
+/**
+ * Case insensitive string equality. Two interned strings are compared by
+ * their case folded identity without looking at the characters.
+ * @param s1
+ * @param s2
+ * @return true if the strings only differ in case
+ */
+extern bool dev_intern_caseeq(const char *s1, const char *s2);
+
+/**
+ * Drop the intern table and every string in it
+ */
+extern void dev_intern_release(void);
+
+#endif /* !LIB_INTERN_H */
@@ -0,0 +1,48 @@
+/**
+ * @file probes.h
+ * @copyright Violin Memory, Inc, 2014
+ * @brief USDT probes for perf and bpftrace, built with ./configure --enable-usdt
+ *
+ * Each probe is a nop in the code and a note in the ELF file of the
+ * program linking libi2cdev.a, which a tracer turns into a breakpoint
+ * only while it is attached, e.g.
+ *   bpftrace -e 'usdt:/usr/bin/lsi2c:libi2cdev:rescan__end { printf("%d\n", arg0); }'
+ *   perf buildid-cache --add /usr/bin/lsi2c; perf probe sdt_libi2cdev:transaction__end
+ * Without sys/sdt.h the probes compile to nothing.
+ *
+ * transaction__begin   adapter nr, address, op, command, length
+ * transaction__end     adapter nr, address, op, result, latency ns
+ * transaction__slow    adapter nr, address, op, latency ns, threshold ns
+ * adapter__open        adapter nr, fd or negative errno
+ * adapter__close       adapter nr, fd
+ * set__slave__addr     adapter nr, address, force, result
+ * rescan__begin        rescans done before
+ * rescan__end          changes to the bus tree or negative errno, rescans done before
+ * config__match        chip prefix, adapter nr or -1, address, matched
+ */
+
+#ifndef LIB_PROBES_H
+#define LIB_PROBES_H
+
+#ifdef ENABLE_USDT
+#include <sys/sdt.h>
+
+#define I2CDEV_PROBE1(name, a1) \
+    DTRACE_PROBE1(libi2cdev, name, a1)
+#define I2CDEV_PROBE2(name, a1, a2) \
+    DTRACE_PROBE2(libi2cdev, name, a1, a2)
+#define I2CDEV_PROBE4(name, a1, a2, a3, a4) \
+    DTRACE_PROBE4(libi2cdev, name, a1, a2, a3, a4)
+#define I2CDEV_PROBE5(name, a1, a2, a3, a4, a5) \
+    DTRACE_PROBE5(libi2cdev, name, a1, a2, a3, a4, a5)
+
+#else
+
+#define I2CDEV_PROBE1(name, a1)                 do { } while (0)
+#define I2CDEV_PROBE2(name, a1, a2)             do { } while (0)
+#define I2CDEV_PROBE4(name, a1, a2, a3, a4)     do { } while (0)
+#define I2CDEV_PROBE5(name, a1, a2, a3, a4, a5) do { } while (0)
+
+#endif /* ENABLE_USDT */
+
+#endif /* !LIB_PROBES_H */
@@ -0,0 +1,115 @@
+/**
+ * @file slow.c
+ * @copyright Violin Memory, Inc, 2014
+ *
+ * @brief Detection of transactions slower than a threshold.
+ *
+ * A client, an adapter and the library as a whole may each have a latency
+ * threshold; a transaction is held to the first of the three that is set.
+ * Checking it costs a few relaxed loads and a compare. A transaction over
+ * its threshold is copied, with the name and adapter path of its client,
+ * to a ring of the latest ones, which the application drains when it
+ * likes: nothing is logged or written out from the thread that made it.
+ * The ring takes a lock, which only slow transactions ever touch. When it
+ * is full the oldest event is overwritten, which leaves a gap in the
+ * sequence numbers the reader can see.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <busses.h>
+#include <libi2cdev.h>
+
+#include "common.h"
+#include "stats.h"
+#include "i2cdiscov.h"
+
+#define SLOW_RING_SIZE  256
+
+uint64_t dev_i2c_slow_default_ns = 0;
+
+static struct {
+    pthread_mutex_t lock;
+    uint64_t head;              /* events written, the next sequence number */
+    uint64_t tail;              /* sequence number of the oldest event kept */
+    struct dev_i2c_slow_event event[SLOW_RING_SIZE];
+} slow_ring = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+void dev_i2c_slow_record(const dev_i2c_xfer *xfer, uint64_t latency, uint64_t threshold)
+{
+    const SMBusDevice *client = xfer->client;
+    struct dev_i2c_slow_event *ev = NULL;
+
+    I2CDEV_PROBE5(transaction__slow, xfer->event.adapter_nr, xfer->event.addr,
+            xfer->event.op, latency, threshold);
+
+    pthread_mutex_lock(&slow_ring.lock);
+    if (slow_ring.head - slow_ring.tail == SLOW_RING_SIZE) {
+        slow_ring.tail++;
+    }
+    ev = &slow_ring.event[slow_ring.head % SLOW_RING_SIZE];
+    ev->seq = slow_ring.head++;
+    memcpy(ev->name, client->name, sizeof(ev->name));
+    ev->name[sizeof(ev->name) - 1] = '\0';
+    memcpy(ev->path, client->path, sizeof(ev->path));
+    ev->path[sizeof(ev->path) - 1] = '\0';
+    ev->adapter_nr = xfer->event.adapter_nr;
+    ev->addr = xfer->event.addr;
+    ev->op = xfer->event.op;
+    ev->read_write = xfer->event.read_write;
+    ev->command = xfer->event.command;
+    ev->result = xfer->event.result;
+    ev->start_ns = xfer->event.start_ns;
+    ev->latency_ns = latency;
+    ev->threshold_ns = threshold;
+    pthread_mutex_unlock(&slow_ring.lock);
+}
+
+int dev_i2c_set_slow_threshold(SMBusDevice *client, uint64_t threshold_ns)
+{
+    if (!client) {
+        return -EINVAL;
+    }
+    __atomic_store_n(&client->slow_ns, threshold_ns, __ATOMIC_RELAXED);
+    return 0;
+}
+
+int dev_i2c_set_adapter_slow_threshold(const char *path, uint64_t threshold_ns)
+{
+    dev_bus_adapter *adapter = NULL;
+
+    if (!path) {
+        return -EINVAL;
+    }
+    adapter = dev_i2c_lookup_i2c_bus(path);
+    if (adapter == NULL) {
+        return -ENODEV;
+    }
+    __atomic_store_n(&adapter->i2c_adapt.slow_ns, threshold_ns, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void dev_i2c_set_default_slow_threshold(uint64_t threshold_ns)
+{
+    __atomic_store_n(&dev_i2c_slow_default_ns, threshold_ns, __ATOMIC_RELAXED);
+}
+
+int dev_i2c_get_slow_events(struct dev_i2c_slow_event *events, int count)
+{
+    int n = 0;
+
+    if ((count < 0) || ((count > 0) && !events)) {
+        return -EINVAL;
+    }
+    pthread_mutex_lock(&slow_ring.lock);
+    for (; (n < count) && (slow_ring.tail != slow_ring.head); ++n) {
+        events[n] = slow_ring.event[slow_ring.tail++ % SLOW_RING_SIZE];
+    }
+    pthread_mutex_unlock(&slow_ring.lock);
+    return n;
+}
@@ -39,6 +39,9 @@
 #include "data.h"
 #include "i2cdiscov.h"
 #include "i2c-dev-parser.h"
+#include "stats.h"
+#include "probes.h"
+#include "syscalls.h"
 #include "../version.h"
 
 /* As of now the build system does not define O_CLOEXEC so it was necessary to define it here. */
@@ -64,6 +67,7 @@ static int i2c_check_client_addr_validity(SMBusDevice *client);
  */
 SMBusDevice *dev_i2c_new_device(struct dev_i2c_board_info const *info)
 {
+    DEV_SYS_API(DEV_I2C_API_NEW_DEVICE);
     SMBusDevice *client = NULL;
     int err = 0;
 
@@ -191,7 +195,7 @@ int dev_i2c_open_i2c_dev(SMBusAdapter *adapter)
         return -errno;
     }
 
-    if (stat(filename, &st) < 0) {
+    if (dev_sys_stat(filename, &st) < 0) {
         return -errno;
     } else {
         if ((st.st_dev != adapter->char_dev) || (st.st_ino != adapter->char_dev_uid)) {
@@ -209,12 +213,13 @@ int dev_i2c_open_i2c_dev(SMBusAdapter *adapter)
     /* open is called here with the nonblocking flag to allow multiple
      * processes access to the same i2c-dev. This is needed because of
      * how the kernel i2c ioctl interfaces with the open file descriptor. */
-    adapter->fd = open(filename, (O_RDWR | O_NONBLOCK | O_CLOEXEC));
+    adapter->fd = dev_sys_open(filename, (O_RDWR | O_NONBLOCK | O_CLOEXEC));
     if (adapter->fd < 0) {
         err = -errno;
     } else {
         err = 0;
     }
+    I2CDEV_PROBE2(adapter__open, adapter->nr, (adapter->fd < 0) ? err : adapter->fd);
     return err;
 }
 
@@ -223,7 +228,7 @@ int dev_i2c_get_functionality(SMBusAdapter *adapter)
     int ret = 0;
     if (!adapter)
         return -EINVAL;
-    if (ioctl(adapter->fd, I2C_FUNCS, &adapter->funcs) < 0)
+    if (dev_sys_ioctl(adapter->fd, I2C_FUNCS, &adapter->funcs) < 0)
         ret = -errno;
 
     return ret;
@@ -236,8 +241,9 @@ int dev_i2c_set_slave_addr(SMBusAdapter *adapter, int address, int force)
         return -EINVAL;
     /* With force, let the user read from/write to the registers
      even when a driver is also running */
-    if (ioctl(adapter->fd, force ? I2C_SLAVE_FORCE : I2C_SLAVE, address) < 0)
+    if (dev_sys_ioctl(adapter->fd, force ? I2C_SLAVE_FORCE : I2C_SLAVE, address) < 0)
         ret = -errno;
+    I2CDEV_PROBE4(set__slave__addr, adapter->nr, address, force, ret);
 
     return ret;
 }
@@ -252,7 +258,7 @@ int dev_i2c_set_adapter_timeout(SMBusAdapter *adapter, int timeout_ms)
         return -EINVAL;
     if (!adapter)
         return -ENODEV;
-    if (ioctl(adapter->fd, I2C_TIMEOUT, timeout) < 0)
+    if (dev_sys_ioctl(adapter->fd, I2C_TIMEOUT, timeout) < 0)
         ret = -errno;
 
     return ret;
@@ -265,7 +271,7 @@ int dev_i2c_set_adapter_retries(SMBusAdapter *adapter, unsigned long retries)
 
     if (!adapter)
         return -ENODEV;
-    if (ioctl(adapter->fd, I2C_RETRIES, retries) < 0)
+    if (dev_sys_ioctl(adapter->fd, I2C_RETRIES, retries) < 0)
         ret = -errno;
 
     return ret;
@@ -282,7 +288,8 @@ int dev_i2c_adapter_close(SMBusAdapter *adapter)
         return -EINVAL;
     }
     if (adapter->fd >= 0) {
-        close(adapter->fd);
+        I2CDEV_PROBE2(adapter__close, adapter->nr, adapter->fd);
+        dev_sys_close(adapter->fd);
         adapter->fd = -1;
     }
     return 0;
@@ -300,6 +307,7 @@ static int register_client_node(dev_client_user_list *list, SMBusDevice *client)
             return -ENOMEM;
         }
         client_node->client = client;
+        client->client_node = client_node;
         // Add the client to the adapter's list of registered clients
         LIST_INSERT_HEAD(list, client_node, node);
     }
@@ -380,6 +388,7 @@ error_exit:
  */
 int dev_i2c_close(SMBusDevice *client)
 {
+    DEV_SYS_API(DEV_I2C_API_CLOSE);
     SMBusAdapter *adap = NULL;
 
     if (!client)
@@ -390,7 +399,8 @@ int dev_i2c_close(SMBusDevice *client)
 
     if (adap != NULL) {
         if (adap->fd >= 0) {
-            close(adap->fd);
+            I2CDEV_PROBE2(adapter__close, adap->nr, adap->fd);
+            dev_sys_close(adap->fd);
             adap->fd = -1;
         }
     }
@@ -403,6 +413,8 @@ int dev_i2c_close(SMBusDevice *client)
  */
 void dev_i2c_delete(SMBusDevice *client)
 {
+    DEV_SYS_API(DEV_I2C_API_DELETE);
+
     if (!client)
         return;
 
@@ -413,6 +425,7 @@ void dev_i2c_delete(SMBusDevice *client)
         remove_client_node(client);
         client->adapter = NULL;
     }
+    dev_i2c_stats_release(&client->latency);
     free(client);
     return;
 }
@@ -424,6 +437,7 @@ void dev_i2c_delete(SMBusDevice *client)
  */
 int dev_i2c_open(SMBusDevice *client)
 {
+    DEV_SYS_API(DEV_I2C_API_OPEN);
     int ret = 0;
     int scan_ret = -ENODATA;
     dev_bus_adapter *adapt = NULL;
@@ -520,9 +534,11 @@ SMBusAdapter *dev_i2c_open_adapter(SMBusDevice *client)
  */
 int32_t dev_i2c_smbus_probe(uint8_t addr, const char *path, int mode)
 {
+    DEV_SYS_API(DEV_I2C_API_PROBE);
     int err = 0;
     __s32 ret = 0;
     int cmd = 0;
+    dev_i2c_xfer xfer;
     dev_bus_adapter *adapter = NULL;
     SMBusDevice dummy_client = {
         .addr = 0,
@@ -580,16 +596,22 @@ int32_t dev_i2c_smbus_probe(uint8_t addr, const char *path, int mode)
     switch (cmd) {
     case MODE_READ:
         /* This is known to lock SMBus on various write-only chips */
+        dev_i2c_op_begin(&xfer, client, DEV_I2C_OP_BYTE, I2C_SMBUS_READ, -1, 1);
         ret = i2c_smbus_read_byte(client->adapter->fd);
+        dev_i2c_op_read_value(&xfer, ret, 1);
+        dev_i2c_op_end(&xfer, ret, 1, 0);
         break;
     case MODE_QUICK:
     default:
         /* This is known to corrupt some EEPROMs */
+        dev_i2c_op_begin(&xfer, client, DEV_I2C_OP_QUICK, I2C_SMBUS_WRITE, -1, 0);
         ret = i2c_smbus_write_quick(client->adapter->fd, I2C_SMBUS_WRITE);
+        dev_i2c_op_end(&xfer, ret, 0, 0);
         break;
     }
 
     dev_i2c_close(client);
+    dev_i2c_stats_release(&client->latency);
     return ret;
 
 error_exit:
@@ -606,9 +628,11 @@ error_exit:
  */
 int32_t dev_i2c_smbus_write_quick(SMBusDevice *client, uint8_t value)
 {
+    DEV_SYS_API(DEV_I2C_API_SMBUS);
     int err = 0;
     __s32 ret = 0;
     SMBusAdapter *adap = NULL;
+    dev_i2c_xfer xfer;
 
     err = dev_i2c_open(client);
     if (err < 0) {
@@ -621,7 +645,9 @@ int32_t dev_i2c_smbus_write_quick(SMBusDevice *client, uint8_t value)
         goto error_exit;
     }
 
+    dev_i2c_op_begin(&xfer, client, DEV_I2C_OP_QUICK, value, -1, 0);
     ret = i2c_smbus_write_quick(adap->fd, value);
+    dev_i2c_op_end(&xfer, ret, 0, 0);
 
     err = dev_i2c_close(client);
 
@@ -641,9 +667,11 @@ error_exit:
  */
 int32_t dev_i2c_smbus_read_byte(SMBusDevice *client)
 {
+    DEV_SYS_API(DEV_I2C_API_SMBUS);
     int err = 0;
     __s32 ret = 0;
     SMBusAdapter *adap = NULL;
+    dev_i2c_xfer xfer;
 
     err = dev_i2c_open(client);
     if (err < 0) {
@@ -656,7 +684,10 @@ int32_t dev_i2c_smbus_read_byte(SMBusDevice *client)
         goto error_exit;
     }
 
+    dev_i2c_op_begin(&xfer, client, DEV_I2C_OP_BYTE, I2C_SMBUS_READ, -1, 1);
     ret = i2c_smbus_read_byte(adap->fd);
+    dev_i2c_op_read_value(&xfer, ret, 1);
+    dev_i2c_op_end(&xfer, ret, 1, 0);
 
     err = dev_i2c_close(client);
 
@@ -677,9 +708,11 @@ error_exit:
  */
 int32_t dev_i2c_smbus_write_byte(SMBusDevice *client, uint8_t value)
 {
+    DEV_SYS_API(DEV_I2C_API_SMBUS);
     int err = 0;
     __s32 ret = 0;
     SMBusAdapter *adap = NULL;
+    dev_i2c_xfer xfer;
 
     err = dev_i2c_open(client);
     if (err < 0) {
@@ -692,7 +725,10 @@ int32_t dev_i2c_smbus_write_byte(SMBusDevice *client, uint8_t value)
         goto error_exit;
     }
 
+    dev_i2c_op_begin(&xfer, client, DEV_I2C_OP_BYTE, I2C_SMBUS_WRITE, -1, 1);
+    dev_i2c_op_write_value(&xfer, value, 1);
     ret = i2c_smbus_write_byte(adap->fd, value);
+    dev_i2c_op_end(&xfer, ret, 0, 1);
 
     err = dev_i2c_close(client);
 
@@ -713,9 +749,11 @@ error_exit:
  */
 int32_t dev_i2c_smbus_read_byte_data(SMBusDevice *client, uint8_t command)
 {
+    DEV_SYS_API(DEV_I2C_API_SMBUS);
     int err = 0;
     __s32 ret = 0;
     SMBusAdapter *adap = NULL;
+    dev_i2c_xfer xfer;
 
     err = dev_i2c_open(client);
     if (err < 0) {
@@ -728,7 +766,10 @@ int32_t dev_i2c_smbus_read_byte_data(SMBusDevice *client, uint8_t command)
         goto error_exit;
     }
 
+    dev_i2c_op_begin(&xfer, client, DEV_I2C_OP_BYTE_DATA, I2C_SMBUS_READ, command, 1);
     ret = i2c_smbus_read_byte_data(adap->fd, command);
+    dev_i2c_op_read_value(&xfer, ret, 1);
+    dev_i2c_op_end(&xfer, ret, 1, 1);
 
     err = dev_i2c_close(client);
 
@@ -752,9 +793,11 @@ error_exit:
 int32_t dev_i2c_smbus_write_byte_data(SMBusDevice *client, uint8_t command,
         uint8_t value)
 {
+    DEV_SYS_API(DEV_I2C_API_SMBUS);
     int err = 0;
     __s32 ret = 0;
     SMBusAdapter *adap = NULL;
+    dev_i2c_xfer xfer;
 
     err = dev_i2c_open(client);
     if (err < 0) {
@@ -767,7 +810,10 @@ int32_t dev_i2c_smbus_write_byte_data(SMBusDevice *client, uint8_t command,
         goto error_exit;
     }
 
+    dev_i2c_op_begin(&xfer, client, DEV_I2C_OP_BYTE_DATA, I2C_SMBUS_WRITE, command, 1);
+    dev_i2c_op_write_value(&xfer, value, 1);
     ret = i2c_smbus_write_byte_data(adap->fd, command, value);
+    dev_i2c_op_end(&xfer, ret, 0, 2);
 
     err = dev_i2c_close(client);
 
@@ -788,10 +834,12 @@ error_exit:
  */
 int32_t dev_i2c_smbus_read_word_data(SMBusDevice *client, uint8_t command)
 {
+    DEV_SYS_API(DEV_I2C_API_SMBUS);
     int err = 0;
     __s32 ret = 0;
 
     SMBusAdapter *adap = NULL;
+    dev_i2c_xfer xfer;
 
     err = dev_i2c_open(client);
     if (err < 0) {
@@ -804,7 +852,10 @@ int32_t dev_i2c_smbus_read_word_data(SMBusDevice *client, uint8_t command)
         goto error_exit;
     }
 
+    dev_i2c_op_begin(&xfer, client, DEV_I2C_OP_WORD_DATA, I2C_SMBUS_READ, command, 2);
     ret = i2c_smbus_read_word_data(adap->fd, command);
+    dev_i2c_op_read_value(&xfer, ret, 2);
+    dev_i2c_op_end(&xfer, ret, 2, 1);
 
     err = dev_i2c_close(client);
 
@@ -827,9 +878,11 @@ error_exit:
 int32_t dev_i2c_smbus_write_word_data(SMBusDevice *client, uint8_t command,
         uint16_t value)
 {
+    DEV_SYS_API(DEV_I2C_API_SMBUS);
     int err = 0;
     __s32 ret = 0;
     SMBusAdapter *adap = NULL;
+    dev_i2c_xfer xfer;
 
     err = dev_i2c_open(client);
     if (err < 0) {
@@ -842,7 +895,10 @@ int32_t dev_i2c_smbus_write_word_data(SMBusDevice *client, uint8_t command,
         goto error_exit;
     }
 
+    dev_i2c_op_begin(&xfer, client, DEV_I2C_OP_WORD_DATA, I2C_SMBUS_WRITE, command, 2);
+    dev_i2c_op_write_value(&xfer, value, 2);
     ret = i2c_smbus_write_word_data(adap->fd, command, value);
+    dev_i2c_op_end(&xfer, ret, 0, 3);
 
     err = dev_i2c_close(client);
 
@@ -856,9 +912,11 @@ error_exit:
 int32_t dev_i2c_smbus_process_call(SMBusDevice *client, uint8_t command,
         uint16_t value)
 {
+    DEV_SYS_API(DEV_I2C_API_SMBUS);
     int err = 0;
     __s32 ret = 0;
     SMBusAdapter *adap = NULL;
+    dev_i2c_xfer xfer;
 
     err = dev_i2c_open(client);
     if (err < 0) {
@@ -871,7 +929,11 @@ int32_t dev_i2c_smbus_process_call(SMBusDevice *client, uint8_t command,
         goto error_exit;
     }
 
+    dev_i2c_op_begin(&xfer, client, DEV_I2C_OP_PROC_CALL, I2C_SMBUS_WRITE, command, 2);
+    dev_i2c_op_write_value(&xfer, value, 2);
     ret = i2c_smbus_process_call(adap->fd, command, value);
+    dev_i2c_op_read_value(&xfer, ret, 2);
+    dev_i2c_op_end(&xfer, ret, 2, 3);
     if (ret < 0) {
         err = ret;
         goto error_exit;
@@ -905,9 +967,11 @@ error_exit:
 int32_t dev_i2c_smbus_read_block_data(SMBusDevice *client, uint8_t command,
         uint8_t *values)
 {
+    DEV_SYS_API(DEV_I2C_API_SMBUS);
     int err = 0;
     __s32 ret = 0;
     SMBusAdapter *adap = NULL;
+    dev_i2c_xfer xfer;
 
     err = dev_i2c_open(client);
     if (err < 0) {
@@ -920,7 +984,12 @@ int32_t dev_i2c_smbus_read_block_data(SMBusDevice *client, uint8_t command,
         goto error_exit;
     }
 
+    dev_i2c_op_begin(&xfer, client, DEV_I2C_OP_BLOCK_DATA, I2C_SMBUS_READ, command, I2C_SMBUS_BLOCK_MAX);
     ret = i2c_smbus_read_block_data(adap->fd, command, values);
+    if (ret >= 0) {
+        dev_i2c_op_read(&xfer, values, ret);
+    }
+    dev_i2c_op_end(&xfer, ret, ret + 1, 1);
     if (ret < 0) {
         err = ret;
         goto error_exit;
@@ -949,9 +1018,11 @@ error_exit:
 int32_t dev_i2c_smbus_write_block_data(SMBusDevice *client, uint8_t command,
         uint8_t length, const uint8_t *values)
 {
+    DEV_SYS_API(DEV_I2C_API_SMBUS);
     int err = 0;
     __s32 ret = 0;
     SMBusAdapter *adap = NULL;
+    dev_i2c_xfer xfer;
 
     err = dev_i2c_open(client);
     if (err < 0) {
@@ -964,7 +1035,10 @@ int32_t dev_i2c_smbus_write_block_data(SMBusDevice *client, uint8_t command,
         goto error_exit;
     }
 
+    dev_i2c_op_begin(&xfer, client, DEV_I2C_OP_BLOCK_DATA, I2C_SMBUS_WRITE, command, length);
+    dev_i2c_op_write(&xfer, values, length);
     ret = i2c_smbus_write_block_data(adap->fd, command, length, values);
+    dev_i2c_op_end(&xfer, ret, 0, length + 2);
     if (ret < 0) {
         err = ret;
         goto error_exit;
@@ -984,9 +1058,11 @@ error_exit:
 int32_t dev_i2c_smbus_read_i2c_block_data(SMBusDevice *client, uint8_t command,
         uint8_t length, uint8_t *values)
 {
+    DEV_SYS_API(DEV_I2C_API_SMBUS);
     int err = 0;
     __s32 ret = 0;
     SMBusAdapter *adap = NULL;
+    dev_i2c_xfer xfer;
 
     err = dev_i2c_open(client);
     if (err < 0) {
@@ -999,7 +1075,12 @@ int32_t dev_i2c_smbus_read_i2c_block_data(SMBusDevice *client, uint8_t command,
         goto error_exit;
     }
 
+    dev_i2c_op_begin(&xfer, client, DEV_I2C_OP_I2C_BLOCK_DATA, I2C_SMBUS_READ, command, length);
     ret = i2c_smbus_read_i2c_block_data(adap->fd, command, length, values);
+    if (ret >= 0) {
+        dev_i2c_op_read(&xfer, values, ret);
+    }
+    dev_i2c_op_end(&xfer, ret, ret, 1);
     if (ret < 0) {
         err = ret;
         goto error_exit;
@@ -1018,9 +1099,11 @@ error_exit:
 int32_t dev_i2c_smbus_write_i2c_block_data(SMBusDevice *client, uint8_t command,
         uint8_t length, const uint8_t *values)
 {
+    DEV_SYS_API(DEV_I2C_API_SMBUS);
     int err = 0;
     __s32 ret = 0;
     SMBusAdapter *adap = NULL;
+    dev_i2c_xfer xfer;
 
     err = dev_i2c_open(client);
     if (err < 0) {
@@ -1033,7 +1116,10 @@ int32_t dev_i2c_smbus_write_i2c_block_data(SMBusDevice *client, uint8_t command,
         goto error_exit;
     }
 
+    dev_i2c_op_begin(&xfer, client, DEV_I2C_OP_I2C_BLOCK_DATA, I2C_SMBUS_WRITE, command, length);
+    dev_i2c_op_write(&xfer, values, length);
     ret = i2c_smbus_write_i2c_block_data(adap->fd, command, length, values);
+    dev_i2c_op_end(&xfer, ret, 0, length + 1);
     if (ret < 0) {
         err = ret;
         goto error_exit;
@@ -1053,9 +1139,11 @@ error_exit:
 int32_t dev_i2c_smbus_block_process_call(SMBusDevice *client, uint8_t command,
         uint8_t length, uint8_t *values)
 {
+    DEV_SYS_API(DEV_I2C_API_SMBUS);
     int err = 0;
     __s32 ret = 0;
     SMBusAdapter *adap = NULL;
+    dev_i2c_xfer xfer;
 
     err = dev_i2c_open(client);
     if (err < 0) {
@@ -1068,7 +1156,17 @@ int32_t dev_i2c_smbus_block_process_call(SMBusDevice *client, uint8_t command,
         goto error_exit;
     }
 
+    dev_i2c_op_begin(&xfer, client, DEV_I2C_OP_BLOCK_PROC_CALL, I2C_SMBUS_WRITE, command, length);
+    /* the reply overwrites values */
+    if (length <= sizeof(xfer.wbuf)) {
+        memcpy(xfer.wbuf, values, length);
+        dev_i2c_op_write(&xfer, xfer.wbuf, length);
+    }
     ret = i2c_smbus_block_process_call(adap->fd, command, length, values);
+    if (ret >= 0) {
+        dev_i2c_op_read(&xfer, values, ret);
+    }
+    dev_i2c_op_end(&xfer, ret, ret + 1, length + 2);
     if (ret < 0) {
         err = ret;
         goto error_exit;
@@ -1084,11 +1182,14 @@ error_exit:
 }
 
 
-static int i2c_transfer(SMBusAdapter *adap, struct i2c_msg *msgs, unsigned int num)
+static int i2c_transfer(SMBusDevice *client, struct i2c_msg *msgs, unsigned int num)
 {
     int err = 0;
+    uint32_t read = 0;
+    uint32_t written = 0;
+    dev_i2c_xfer xfer;
 
-    if (!adap || !msgs || !num)
+    if (!client || !client->adapter || !msgs || !num)
     	return -EINVAL;
 
     struct i2c_rdwr_ioctl_data msgset = {
@@ -1096,10 +1197,33 @@ static int i2c_transfer(SMBusAdapter *adap, struct i2c_msg *msgs, unsigned int n
         .nmsgs = num,
     };
 
-    err = ioctl(adap->fd, I2C_RDWR, &msgset);
+    for (unsigned int i = 0; i < num; ++i) {
+        if (msgs[i].flags & I2C_M_RD) {
+            read += msgs[i].len;
+        } else {
+            written += msgs[i].len;
+        }
+    }
+
+    dev_i2c_op_begin(&xfer, client, DEV_I2C_OP_TRANSFER,
+            read ? I2C_SMBUS_READ : I2C_SMBUS_WRITE, -1, read + written);
+    /* the first message each way is what a trace keeps */
+    for (unsigned int i = 0; i < num; ++i) {
+        if (!(msgs[i].flags & I2C_M_RD) && !xfer.event.write_data) {
+            dev_i2c_op_write(&xfer, msgs[i].buf, msgs[i].len);
+        }
+    }
+    err = dev_sys_ioctl(client->adapter->fd, I2C_RDWR, &msgset);
     if (err < 0) {
         err = -errno;
+    } else {
+        for (unsigned int i = 0; i < num; ++i) {
+            if ((msgs[i].flags & I2C_M_RD) && !xfer.event.read_data) {
+                dev_i2c_op_read(&xfer, msgs[i].buf, msgs[i].len);
+            }
+        }
     }
+    dev_i2c_op_end(&xfer, err, read, written);
 
     return err;
 }
@@ -1108,6 +1232,7 @@ int dev_i2c_transfer_data(SMBusDevice *client,
         uint8_t write_length, uint8_t *write_data, uint8_t read_length,
         uint8_t *read_data)
 {
+    DEV_SYS_API(DEV_I2C_API_TRANSFER);
     int err = 0;
 
     err = dev_i2c_open(client);
@@ -1130,7 +1255,7 @@ int dev_i2c_transfer_data(SMBusDevice *client,
         },
     };
 
-    err = i2c_transfer(client->adapter, msgs, 2);
+    err = i2c_transfer(client, msgs, 2);
 
     dev_i2c_close(client);
     return err;
@@ -1139,6 +1264,7 @@ int dev_i2c_transfer_data(SMBusDevice *client,
 int dev_i2c_write_data(SMBusDevice *client, uint8_t length,
         uint8_t *data)
 {
+    DEV_SYS_API(DEV_I2C_API_TRANSFER);
     int err = 0;
 
     err = dev_i2c_open(client);
@@ -1153,7 +1279,7 @@ int dev_i2c_write_data(SMBusDevice *client, uint8_t length,
         .buf = data,
     };
 
-    err = i2c_transfer(client->adapter, &msgs, 1);
+    err = i2c_transfer(client, &msgs, 1);
 
     dev_i2c_close(client);
     return err;
@@ -1162,6 +1288,7 @@ int dev_i2c_write_data(SMBusDevice *client, uint8_t length,
 int dev_i2c_read_data(SMBusDevice *client, uint8_t length,
         uint8_t *data)
 {
+    DEV_SYS_API(DEV_I2C_API_TRANSFER);
     int err = 0;
 
     err = dev_i2c_open(client);
@@ -1176,7 +1303,7 @@ int dev_i2c_read_data(SMBusDevice *client, uint8_t length,
         .buf = data,
     };
 
-    err = i2c_transfer(client->adapter, &msgs, 1);
+    err = i2c_transfer(client, &msgs, 1);
 
     dev_i2c_close(client);
     return err;
@@ -30,6 +30,8 @@
 #include <linux/i2c.h>
 #include <linux/i2c-dev.h>
 
+#include "syscalls.h"
+
 /* Compatibility defines */
 #ifndef I2C_SMBUS_I2C_BLOCK_BROKEN
 #define I2C_SMBUS_I2C_BLOCK_BROKEN I2C_SMBUS_I2C_BLOCK_DATA
@@ -49,7 +51,7 @@ __s32 i2c_smbus_access(int file, char read_write, __u8 command,
     };
     __s32 err;
 
-    err = ioctl(file, I2C_SMBUS, &args);
+    err = dev_sys_ioctl(file, I2C_SMBUS, &args);
     if (err == -1)
         err = -errno;
     return err;
@@ -0,0 +1,818 @@
+/**
+ * @file snapshot.c
+ * @copyright Violin Memory, Inc, 2014
+ *
+ * @brief Persistent bus topology snapshot.
+ * The adapter tree, bus paths, chips and cached adapter functionality are
+ * written to a flat binary file which is mapped and validated at start-up
+ * instead of walking sysfs again.
+ */
+
+#define _GNU_SOURCE 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <linux/limits.h> /* for PATH_MAX */
+
+#include "common.h"
+#include "sysfs.h"
+#include "data.h"
+#include "snapshot.h"
+#include "arena.h"
+#include "intern.h"
+#include "topology.h"
+#include "syscalls.h"
+
+#include "i2c-error.h"
+#include "i2c-bus-lists.h"
+#include "i2c-dev-parser.h"
+#include "i2cdiscov.h"
+
+#ifndef OVERRIDE_RUNDIR
+#define RUNDIR "/run"
+#else
+#ifndef RUNDIR_PATH
+#define RUNDIR_PATH		/run
+#endif
+#define RUNDIR		__stringify(RUNDIR_PATH)
+#endif /* !OVERRIDE_RUNDIR */
+
+#define DEFAULT_SNAPSHOT_FILE	RUNDIR"/i2cdiscov-topology.cache"
+
+#define SNAPSHOT_MAGIC      0x54433249 /* "I2CT" */
+#define SNAPSHOT_VERSION    2
+
+#define BOOT_ID_PATH        "/proc/sys/kernel/random/boot_id"
+#define BOOT_ID_LEN         40
+
+/*
+ * File layout:
+ *  snapshot_header
+ *  snapshot_adapter[adapter_count]   sorted by nr
+ *  snapshot_chip[chip_count]         grouped by adapter
+ *  string table[strings_size]        string offsets of zero stand for NULL
+ */
+typedef struct snapshot_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size;
+    char boot_id[BOOT_ID_LEN];
+    uint32_t sysfs_mount;
+    uint32_t adapter_count;
+    uint32_t chip_count;
+    uint32_t strings_size;
+} snapshot_header;
+
+typedef struct snapshot_adapter {
+    int32_t nr;
+    int32_t parent_nr; /* nr of the adapter it is linked below or -1 */
+    int32_t parent_id;
+    int32_t chan_id;
+    int32_t bus_id;
+    int32_t bus_type;
+    uint32_t parent_is_adapter;
+    uint32_t name;
+    uint32_t devpath;
+    uint32_t subsystem;
+    uint32_t parent_name;
+    uint32_t bus_path;
+    uint32_t first_chip;
+    uint32_t chip_count;
+    /* identity fingerprint */
+    uint64_t char_dev;
+    uint64_t char_dev_uid;
+    uint64_t sysfs_ino;
+    uint64_t sysfs_nlink;
+    uint64_t funcs;
+} snapshot_adapter;
+
+typedef struct snapshot_chip {
+    int32_t addr;
+    uint32_t name;
+    uint32_t devpath;
+    uint32_t driver;
+    uint32_t module;
+    uint32_t subsystem;
+    uint32_t attr_read; /* dev_chip_attr values the record holds */
+} snapshot_chip;
+
+typedef struct snapshot_strings {
+    char *buf;
+    size_t len;
+    size_t max;
+    bool failed;
+} snapshot_strings;
+
+static char *snapshot_file = NULL;
+static bool snapshot_disabled = false;
+
+/* state of the tree the snapshot on disk was taken from */
+static unsigned long snapshot_generation = 0;
+static unsigned long snapshot_funcs = 0;
+static bool snapshot_current = false;
+
+int i2cdev_set_snapshot_file(const char *path)
+{
+    char *file = NULL;
+
+    if (path != NULL) {
+        file = strdup(path);
+        if (file == NULL) {
+            return -ENOMEM;
+        }
+    }
+    free(snapshot_file);
+    snapshot_file = file;
+    snapshot_disabled = (path == NULL);
+    snapshot_current = false;
+    return 0;
+}
+
+static const char *snapshot_file_name(void)
+{
+    if (snapshot_disabled) {
+        return NULL;
+    }
+    return (snapshot_file != NULL) ? snapshot_file : DEFAULT_SNAPSHOT_FILE;
+}
+
+/**
+ * Read the kernel boot id
+ * @param[out] boot_id
+ * @return negative errno on failure else zero on success
+ */
+static int read_boot_id(char boot_id[BOOT_ID_LEN])
+{
+    ssize_t len = 0;
+    int fd = -1;
+
+    memset(boot_id, 0, BOOT_ID_LEN);
+    fd = dev_sys_open(BOOT_ID_PATH, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+    len = TEMP_FAILURE_RETRY(dev_sys_read(fd, boot_id, BOOT_ID_LEN - 1));
+    dev_sys_close(fd);
+    if (len <= 0) {
+        return -EIO;
+    }
+    boot_id[strcspn(boot_id, "\n")] = '\0';
+    return 0;
+}
+
+/**
+ * Fill in the identity of the sysfs node of an adapter
+ * @param devpath
+ * @param[out] rec
+ */
+static void adapter_fingerprint(const char *devpath, snapshot_adapter *rec)
+{
+    struct stat st;
+
+    rec->sysfs_ino = 0;
+    rec->sysfs_nlink = 0;
+    /* a sysfs directory link count changes with each client or mux added below it */
+    if ((devpath != NULL) && (dev_sys_stat(devpath, &st) == 0)) {
+        rec->sysfs_ino = st.st_ino;
+        rec->sysfs_nlink = st.st_nlink;
+    }
+}
+
+/**
+ * Check the recorded identity of an adapter against the running system
+ * @param rec
+ * @param strings
+ * @return true if the adapter is unchanged
+ */
+static bool adapter_fingerprint_valid(const snapshot_adapter *rec, const char *strings)
+{
+    char char_dev_name[20];
+    snapshot_adapter live;
+    struct stat st;
+
+    snprintf(char_dev_name, sizeof(char_dev_name), "/dev/i2c-%d", rec->nr);
+    if (dev_sys_stat(char_dev_name, &st) == 0) {
+        if ((st.st_dev != rec->char_dev) || (st.st_ino != rec->char_dev_uid)) {
+            return false;
+        }
+    } else if (rec->char_dev_uid != 0) {
+        return false;
+    }
+
+    adapter_fingerprint(rec->devpath ? strings + rec->devpath : NULL, &live);
+    return ((live.sysfs_ino == rec->sysfs_ino) && (live.sysfs_nlink == rec->sysfs_nlink)
+            && (live.sysfs_ino != 0));
+}
+
+static unsigned long adapter_funcs_hash(void)
+{
+    unsigned long hash = 0;
+
+    for (size_t i = 0; i < adapter_global_count; ++i) {
+        hash = (hash * 31) + adapter_global_array[i]->i2c_adapt.funcs;
+    }
+    return hash;
+}
+
+static void snapshot_mark_current(void)
+{
+    snapshot_generation = i2cdev_generation;
+    snapshot_funcs = adapter_funcs_hash();
+    snapshot_current = true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static uint32_t snapshot_add_string(snapshot_strings *strings, const char *str)
+{
+    size_t len = 0;
+    uint32_t offset = 0;
+
+    if (str == NULL) {
+        return 0;
+    }
+    len = strlen(str) + 1;
+    if (strings->len + len > strings->max) {
+        size_t max = (strings->max != 0) ? strings->max * 2 : 4096;
+        char *buf = NULL;
+
+        while (strings->len + len > max) {
+            max *= 2;
+        }
+        buf = (max <= UINT32_MAX) ? realloc(strings->buf, max) : NULL;
+        if (buf == NULL) {
+            strings->failed = true;
+            return 0;
+        }
+        strings->buf = buf;
+        strings->max = max;
+    }
+    offset = (uint32_t) strings->len;
+    memcpy(strings->buf + strings->len, str, len);
+    strings->len += len;
+    return offset;
+}
+
+int i2c_dev_snapshot_save(void)
+{
+    const char *file = snapshot_file_name();
+    char tmp_name[PATH_MAX];
+    snapshot_header header;
+    snapshot_strings strings = { NULL, 0, 0, false };
+    snapshot_adapter *adapters = NULL;
+    snapshot_chip *chips = NULL;
+    size_t chip_count = 0;
+    size_t c = 0;
+    int fd = -1;
+    int err = 0;
+
+    if (file == NULL) {
+        return 0;
+    }
+
+    memset(&header, 0, sizeof(header));
+    err = read_boot_id(header.boot_id);
+    if (err < 0) {
+        return err;
+    }
+
+    for (size_t i = 0; i < adapter_global_count; ++i) {
+        const dev_chip *chip = NULL;
+        SLIST_FOREACH(chip, &adapter_global_array[i]->clients, node) {
+            chip_count++;
+        }
+    }
+
+    adapters = calloc(adapter_global_count ? adapter_global_count : 1, sizeof(*adapters));
+    chips = calloc(chip_count ? chip_count : 1, sizeof(*chips));
+    if ((adapters == NULL) || (chips == NULL)) {
+        err = -ENOMEM;
+        goto exit_free;
+    }
+
+    /* offset zero is reserved for NULL */
+    snapshot_add_string(&strings, "");
+    header.sysfs_mount = snapshot_add_string(&strings, sysfs_mount);
+
+    for (size_t i = 0; i < adapter_global_count; ++i) {
+        const dev_bus_adapter *adapter = adapter_global_array[i];
+        snapshot_adapter *rec = &adapters[i];
+        const dev_chip *chip = NULL;
+
+        rec->nr = adapter->nr;
+        rec->parent_nr = (adapter->parent != NULL) ? adapter->parent->nr : -1;
+        rec->parent_id = adapter->parent_id;
+        rec->chan_id = adapter->chan_id;
+        rec->bus_id = adapter->bus_id;
+        rec->bus_type = adapter->bus.type;
+        rec->parent_is_adapter = adapter->parent_is_adapter;
+        rec->name = snapshot_add_string(&strings, adapter->name);
+        rec->devpath = snapshot_add_string(&strings, adapter->devpath);
+        rec->subsystem = snapshot_add_string(&strings, adapter->subsystem);
+        rec->parent_name = snapshot_add_string(&strings, adapter->parent_name);
+        rec->bus_path = snapshot_add_string(&strings, adapter->bus.path);
+        rec->char_dev = adapter->i2c_adapt.char_dev;
+        rec->char_dev_uid = adapter->i2c_adapt.char_dev_uid;
+        rec->funcs = adapter->i2c_adapt.funcs;
+        adapter_fingerprint(adapter->devpath, rec);
+
+        rec->first_chip = (uint32_t) c;
+        SLIST_FOREACH(chip, &adapter->clients, node) {
+            snapshot_chip *crec = &chips[c++];
+            crec->addr = chip->addr;
+            crec->name = snapshot_add_string(&strings, chip->name);
+            crec->devpath = snapshot_add_string(&strings, chip->devpath);
+            crec->driver = snapshot_add_string(&strings, chip->driver);
+            crec->module = snapshot_add_string(&strings, chip->module);
+            crec->subsystem = snapshot_add_string(&strings, chip->subsystem);
+            crec->attr_read = chip->attr_read;
+        }
+        rec->chip_count = (uint32_t) c - rec->first_chip;
+    }
+
+    if ((strings.buf == NULL) || strings.failed) {
+        err = -ENOMEM;
+        goto exit_free;
+    }
+
+    header.magic = SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    header.adapter_count = (uint32_t) adapter_global_count;
+    header.chip_count = (uint32_t) chip_count;
+    header.strings_size = (uint32_t) strings.len;
+    header.size = sizeof(header) + (adapter_global_count * sizeof(*adapters))
+            + (chip_count * sizeof(*chips)) + strings.len;
+
+    /* write a new file and rename it over the old one so readers never see a partial snapshot */
+    if (snprintf(tmp_name, sizeof(tmp_name), "%s.XXXXXX", file) >= (int) sizeof(tmp_name)) {
+        err = -ENAMETOOLONG;
+        goto exit_free;
+    }
+    fd = dev_sys_mkostemp(tmp_name, O_CLOEXEC);
+    if (fd < 0) {
+        err = -errno;
+        goto exit_free;
+    }
+    dev_sys_fchmod(fd, 0644);
+
+    if (((err = dev_sys_write_all(fd, &header, sizeof(header))) < 0)
+            || ((err = dev_sys_write_all(fd, adapters, adapter_global_count * sizeof(*adapters))) < 0)
+            || ((err = dev_sys_write_all(fd, chips, chip_count * sizeof(*chips))) < 0)
+            || ((err = dev_sys_write_all(fd, strings.buf, strings.len)) < 0)) {
+        dev_sys_close(fd);
+        dev_sys_unlink(tmp_name);
+        goto exit_free;
+    }
+    dev_sys_close(fd);
+    if (dev_sys_rename(tmp_name, file) < 0) {
+        err = -errno;
+        dev_sys_unlink(tmp_name);
+        goto exit_free;
+    }
+    snapshot_mark_current();
+    err = 0;
+
+exit_free:
+    if (err < 0) {
+        devi2c_debug(NULL, "failed to write topology snapshot %s - %s", file, strerror(-err));
+    }
+    free(strings.buf);
+    free(chips);
+    free(adapters);
+    return err;
+}
+
+int i2cdev_save_snapshot(void)
+{
+    if (get_libi2cdev_state() != LIB_SMB_READY) {
+        return -EBUSY;
+    }
+    if (snapshot_current && (snapshot_generation == i2cdev_generation)
+            && (snapshot_funcs == adapter_funcs_hash())) {
+        return 0;
+    }
+    return i2c_dev_snapshot_save();
+}
+
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Count the i2c adapters currently registered in sysfs
+ * @return negative errno on failure else the adapter count
+ */
+static int sysfs_count_adapters(void)
+{
+    char path[PATH_MAX];
+    struct dirent *ent = NULL;
+    DIR *dir = NULL;
+    int count = 0;
+
+    snprintf(path, sizeof(path), "%s/bus/i2c/devices", sysfs_mount);
+    if ((dir = dev_sys_opendir(path)) == NULL) {
+        return -errno;
+    }
+    while (NULL != (ent = dev_sys_readdir(dir))) {
+        if (!strncmp(ent->d_name, "i2c-", 4)) {
+            count++;
+        }
+    }
+    dev_sys_closedir(dir);
+    return count;
+}
+
+static int snapshot_strdup(const char *strings, uint32_t offset, char **str)
+{
+    *str = NULL;
+    if (offset == 0) {
+        return 0;
+    }
+    *str = dev_arena_strdup(strings + offset);
+    return (*str != NULL) ? 0 : -ENOMEM;
+}
+
+static int snapshot_intern(const char *strings, uint32_t offset, char **str)
+{
+    *str = NULL;
+    if (offset == 0) {
+        return 0;
+    }
+    *str = dev_intern(strings + offset);
+    return (*str != NULL) ? 0 : -ENOMEM;
+}
+
+static const snapshot_adapter *snapshot_find_rec(const snapshot_adapter *adapters,
+        uint32_t count, int32_t nr)
+{
+    uint32_t lo = 0;
+    uint32_t hi = count;
+
+    while (lo < hi) {
+        uint32_t mid = lo + ((hi - lo) / 2);
+        if (adapters[mid].nr == nr) {
+            return &adapters[mid];
+        } else if (adapters[mid].nr < nr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Check that every adapter hangs below a root through adapters of the
+ * snapshot, so that linking them can't make a loop
+ * @param adapters sorted by nr
+ * @param count
+ * @return negative errno if the links are broken else zero
+ */
+static int snapshot_validate_tree(const snapshot_adapter *adapters, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i) {
+        const snapshot_adapter *rec = &adapters[i];
+        uint32_t steps = 0;
+
+        if (rec->parent_nr < 0) {
+            /* the tree would leave it out */
+            if (rec->parent_id != BUS_NR_ROOT) {
+                return -EINVAL;
+            }
+            continue;
+        }
+        if (!rec->parent_is_adapter || (rec->parent_id != rec->parent_nr)) {
+            return -EINVAL;
+        }
+        /* a chain longer than the adapters are many goes round in a loop */
+        while (rec->parent_nr >= 0) {
+            rec = snapshot_find_rec(adapters, count, rec->parent_nr);
+            if ((rec == NULL) || (++steps > count)) {
+                return -EINVAL;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * Check that a mapped snapshot is intact and still describes this system
+ * @param map
+ * @param size
+ * @return negative errno if it can't be used else zero
+ */
+static int snapshot_validate(const void *map, size_t size)
+{
+    const snapshot_header *header = map;
+    const snapshot_adapter *adapters = NULL;
+    const snapshot_chip *chips = NULL;
+    const char *strings = NULL;
+    char boot_id[BOOT_ID_LEN];
+    uint64_t expected = 0;
+    int err = 0;
+
+    if ((header->magic != SNAPSHOT_MAGIC) || (header->version != SNAPSHOT_VERSION)
+            || (header->size != size)) {
+        return -EINVAL;
+    }
+    expected = sizeof(*header) + ((uint64_t) header->adapter_count * sizeof(*adapters))
+            + ((uint64_t) header->chip_count * sizeof(*chips)) + header->strings_size;
+    if ((expected != size) || (header->strings_size == 0)) {
+        return -EINVAL;
+    }
+    adapters = (const snapshot_adapter *) (header + 1);
+    chips = (const snapshot_chip *) (adapters + header->adapter_count);
+    strings = (const char *) (chips + header->chip_count);
+    if (strings[header->strings_size - 1] != '\0') {
+        return -EINVAL;
+    }
+
+    /* inode numbers are only meaningful within the boot they were taken in */
+    err = read_boot_id(boot_id);
+    if (err < 0) {
+        return err;
+    }
+    if (strncmp(boot_id, header->boot_id, BOOT_ID_LEN) != 0) {
+        return -ESTALE;
+    }
+    if ((header->sysfs_mount == 0) || (header->sysfs_mount >= header->strings_size)
+            || strcmp(strings + header->sysfs_mount, sysfs_mount)) {
+        return -ESTALE;
+    }
+
+    if (sysfs_count_adapters() != (int) header->adapter_count) {
+        return -ESTALE;
+    }
+
+    for (uint32_t i = 0; i < header->adapter_count; ++i) {
+        const snapshot_adapter *rec = &adapters[i];
+
+        if ((i > 0) && (rec->nr <= adapters[i - 1].nr)) {
+            return -EINVAL;
+        }
+        if ((rec->name >= header->strings_size) || (rec->devpath >= header->strings_size)
+                || (rec->subsystem >= header->strings_size)
+                || (rec->parent_name >= header->strings_size)
+                || (rec->bus_path >= header->strings_size)
+                || (rec->first_chip > header->chip_count)
+                || (rec->chip_count > header->chip_count - rec->first_chip)) {
+            return -EINVAL;
+        }
+        if (!adapter_fingerprint_valid(rec, strings)) {
+            return -ESTALE;
+        }
+    }
+    err = snapshot_validate_tree(adapters, header->adapter_count);
+    if (err < 0) {
+        return err;
+    }
+    for (uint32_t i = 0; i < header->chip_count; ++i) {
+        const snapshot_chip *crec = &chips[i];
+
+        if ((crec->name >= header->strings_size) || (crec->devpath >= header->strings_size)
+                || (crec->driver >= header->strings_size)
+                || (crec->module >= header->strings_size)
+                || (crec->subsystem >= header->strings_size)) {
+            return -EINVAL;
+        }
+    }
+    return 0;
+}
+
+static dev_bus_adapter *snapshot_lookup_nr(dev_bus_adapter **adapters, size_t count, int nr)
+{
+    size_t lo = 0;
+    size_t hi = count;
+
+    while (lo < hi) {
+        size_t mid = lo + ((hi - lo) / 2);
+        if (adapters[mid]->nr == nr) {
+            return adapters[mid];
+        } else if (adapters[mid]->nr < nr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Allocate a chip from its snapshot record
+ * @param adapter
+ * @param crec
+ * @param strings
+ * @param[out] chipp
+ * @return negative errno on failure else zero on success
+ */
+static int snapshot_read_chip(dev_bus_adapter *adapter, const snapshot_chip *crec,
+        const char *strings, dev_chip **chipp)
+{
+    dev_chip *chip = NULL;
+
+    chip = dev_arena_calloc(1, sizeof(*chip));
+    if (chip == NULL) {
+        return -ENOMEM;
+    }
+    chip->addr = crec->addr;
+    chip->bus_id = &adapter->bus;
+    chip->adapter = adapter;
+    chip->attr_read = crec->attr_read;
+    init_dev_list(&chip->node);
+
+    if ((snapshot_intern(strings, crec->name, &chip->name) < 0)
+            || (snapshot_strdup(strings, crec->devpath, &chip->devpath) < 0)
+            || (snapshot_intern(strings, crec->driver, &chip->driver) < 0)
+            || (snapshot_intern(strings, crec->module, &chip->module) < 0)
+            || (snapshot_intern(strings, crec->subsystem, &chip->subsystem) < 0)) {
+        dev_free_chip(&chip);
+        return -ENOMEM;
+    }
+    *chipp = chip;
+    return 0;
+}
+
+/**
+ * Allocate an adapter and its chips from a snapshot record
+ * @param rec
+ * @param chips
+ * @param strings
+ * @param[out] adapterp
+ * @return negative errno on failure else zero on success
+ */
+static int snapshot_read_adapter(const snapshot_adapter *rec, const snapshot_chip *chips,
+        const char *strings, dev_bus_adapter **adapterp)
+{
+    dev_bus_adapter *adapter = NULL;
+    int err = 0;
+
+    adapter = dev_arena_calloc(1, sizeof(*adapter));
+    if (adapter == NULL) {
+        return -ENOMEM;
+    }
+    LIST_INIT(&adapter->children);
+    LIST_INIT(&adapter->user_clients);
+    SLIST_INIT(&adapter->clients);
+    init_bus_list(&adapter->node);
+
+    adapter->nr = rec->nr;
+    adapter->chan_id = rec->chan_id;
+    adapter->bus_id = rec->bus_id;
+    adapter->parent_id = rec->parent_id;
+    adapter->parent_is_adapter = rec->parent_is_adapter ? true : false;
+    adapter->path = BUS_PATH_ANY;
+    adapter->bus.type = (devbus_type) rec->bus_type;
+    adapter->bus.nr = rec->nr;
+
+    adapter->i2c_adapt.nr = rec->nr;
+    adapter->i2c_adapt.fd = -1;
+    adapter->i2c_adapt.prev_addr = -1;
+    adapter->i2c_adapt.char_dev = (dev_t) rec->char_dev;
+    adapter->i2c_adapt.char_dev_uid = (ino_t) rec->char_dev_uid;
+    adapter->i2c_adapt.funcs = (unsigned long) rec->funcs;
+    adapter->sysfs_ino = (ino_t) rec->sysfs_ino;
+    adapter->sysfs_nlink = (nlink_t) rec->sysfs_nlink;
+
+    if ((snapshot_intern(strings, rec->name, &adapter->name) < 0)
+            || (snapshot_strdup(strings, rec->devpath, &adapter->devpath) < 0)
+            || (snapshot_intern(strings, rec->subsystem, &adapter->subsystem) < 0)
+            || (snapshot_strdup(strings, rec->parent_name, &adapter->parent_name) < 0)
+            || (snapshot_strdup(strings, rec->bus_path, &adapter->bus.path) < 0)) {
+        err = -ENOMEM;
+        goto exit_free;
+    }
+    adapter->i2c_adapt.name = adapter->name;
+
+    /* keep the order the chips were recorded in */
+    for (uint32_t j = rec->chip_count; j > 0; --j) {
+        dev_chip *chip = NULL;
+
+        err = snapshot_read_chip(adapter, &chips[rec->first_chip + j - 1], strings, &chip);
+        if (err < 0) {
+            goto exit_free;
+        }
+        SLIST_INSERT_HEAD(&adapter->clients, chip, node);
+    }
+    *adapterp = adapter;
+    return 0;
+
+exit_free:
+    free_adapter_val(&adapter);
+    return err;
+}
+
+int i2c_dev_snapshot_load(void)
+{
+    const char *file = snapshot_file_name();
+    const snapshot_header *header = NULL;
+    const snapshot_adapter *recs = NULL;
+    const snapshot_chip *chips = NULL;
+    const char *strings = NULL;
+    dev_bus_adapter **adapters = NULL;
+    void *map = MAP_FAILED;
+    size_t size = 0;
+    struct stat st;
+    int fd = -1;
+    int err = 0;
+
+    if (file == NULL) {
+        return -ENOENT;
+    }
+    if (!dev_bus_list_headp || !LIST_EMPTY(dev_bus_list_headp) || (adapter_global_array != NULL)) {
+        return -EBUSY;
+    }
+
+    fd = dev_sys_open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+    if (dev_sys_fstat(fd, &st) < 0) {
+        err = -errno;
+        dev_sys_close(fd);
+        return err;
+    }
+    size = (size_t) st.st_size;
+    if (size < sizeof(*header)) {
+        dev_sys_close(fd);
+        return -EINVAL;
+    }
+    map = dev_sys_mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    dev_sys_close(fd);
+    if (map == MAP_FAILED) {
+        return -errno;
+    }
+
+    err = snapshot_validate(map, size);
+    if (err < 0) {
+        goto exit_unmap;
+    }
+
+    header = map;
+    recs = (const snapshot_adapter *) (header + 1);
+    chips = (const snapshot_chip *) (recs + header->adapter_count);
+    strings = (const char *) (chips + header->chip_count);
+
+    adapters = calloc(header->adapter_count ? header->adapter_count : 1, sizeof(*adapters));
+    if (adapters == NULL) {
+        err = -ENOMEM;
+        goto exit_unmap;
+    }
+    for (uint32_t i = 0; i < header->adapter_count; ++i) {
+        err = snapshot_read_adapter(&recs[i], chips, strings, &adapters[i]);
+        if (err < 0) {
+            goto exit_free;
+        }
+    }
+    /* the links were checked, nothing can fail from here on, link the tree */
+    for (uint32_t i = 0; i < header->adapter_count; ++i) {
+        dev_bus_adapter *adapter = adapters[i];
+
+        if (recs[i].parent_nr >= 0) {
+            adapter->parent = snapshot_lookup_nr(adapters, header->adapter_count,
+                    recs[i].parent_nr);
+            sorted_bus_list_insert(&adapter->parent->children, adapter);
+        } else {
+            sorted_bus_list_insert(dev_bus_list_headp, adapter);
+        }
+    }
+    for (uint32_t i = 0; i < header->adapter_count; ++i) {
+        /* without an index path lookups fall back to walking the children */
+        dev_bus_build_child_index(adapters[i]);
+    }
+    adapter_global_array = adapters;
+    adapter_global_count = header->adapter_count;
+    device_global_count = header->chip_count;
+    dev_topology_invalidate();
+    snapshot_mark_current();
+
+    if (i2c_dev_verbose > 2) {
+        devi2c_debug(NULL, "loaded %u i2c adapters from topology snapshot %s",
+                header->adapter_count, file);
+    }
+    dev_sys_munmap(map, size);
+    return 0;
+
+exit_free:
+    for (uint32_t i = 0; i < header->adapter_count; ++i) {
+        if (adapters[i] != NULL) {
+            free_adapter_val(&adapters[i]);
+        }
+    }
+    free(adapters);
+exit_unmap:
+    dev_sys_munmap(map, size);
+    if (i2c_dev_verbose > 2) {
+        devi2c_debug(NULL, "not using topology snapshot %s - %s", file, strerror(-err));
+    }
+    return err;
+}
@@ -0,0 +1,25 @@
+/**
+ * @file snapshot.h
+ * @copyright Violin Memory, Inc, 2014
+ * @brief Persistent bus topology snapshot used to skip sysfs discovery
+ */
+
+#ifndef LIB_SNAPSHOT_H
+#define LIB_SNAPSHOT_H
+
+/**
+ * Load the bus tree from the topology snapshot file.
+ * The snapshot is only used when it was written during the current boot
+ * and every adapter still matches its recorded identity.
+ * @return negative errno if the snapshot is missing or stale
+ * (the tree is left untouched) else zero on success
+ */
+extern int i2c_dev_snapshot_load(void);
+
+/**
+ * Write the current bus tree to the topology snapshot file
+ * @return negative errno on failure else zero on success
+ */
+extern int i2c_dev_snapshot_save(void);
+
+#endif /* !LIB_SNAPSHOT_H */
@@ -0,0 +1,616 @@
+/**
+ * @file stats.c
+ * @copyright Violin Memory, Inc, 2014
+ *
+ * @brief Per-client and per-adapter transaction counters.
+ *
+ * Every transaction adds to the counters of its client and of the adapter
+ * it went through. The counters are plain 64 bit integers updated with
+ * relaxed atomic operations: threads using different clients never wait
+ * for each other, and those sharing an adapter are serialised by the
+ * kernel's bus lock long before the counters matter.
+ *
+ * Every transaction also adds the bit times it takes on the wire, from
+ * its byte counts and the start, ack, repeated start and stop bits of the
+ * protocol, which dev_i2c_get_bus_utilisation() turns into time at the
+ * clock frequency of the bus, and compares with the time spent.
+ *
+ * Latencies also go to a log-linear histogram, in the manner of HDR
+ * histograms: 8 linear buckets per power of two, so every bucket is
+ * within 12.5% of the values it holds. Each histogram has a few stripes
+ * of buckets and a thread always adds to the same stripe, so threads
+ * hardly ever touch the same cache line; the stripes are summed when the
+ * percentiles are read.
+ *
+ * Tracing hooks are published through a single pointer: a transaction
+ * reads it once and pays for one untaken branch when no hooks are set.
+ * The application and the library's own tracers, like the recorder,
+ * each have a slot in it.
+ *
+ * Transactions over their latency threshold are handed to slow.c.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <endian.h>
+#include <pthread.h>
+
+#include <busses.h>
+#include <libi2cdev.h>
+#include <i2c-error.h>
+
+#include "common.h"
+#include "stats.h"
+#include "sysfs.h"
+#include "topology.h"
+#include "i2cdiscov.h"
+
+#define stats_add(field, val)   __atomic_fetch_add(&(field), (val), __ATOMIC_RELAXED)
+
+#define LATENCY_UNIT_SHIFT  7   /* 128 ns is the finest resolution */
+#define LATENCY_SUB_BITS    3   /* 8 buckets per power of two */
+#define LATENCY_SUB_COUNT   (1 << LATENCY_SUB_BITS)
+#define LATENCY_OCTAVES     32  /* up to 128 ns << 35, about 73 minutes */
+#define LATENCY_BUCKETS     ((LATENCY_OCTAVES + 1) * LATENCY_SUB_COUNT)
+#define LATENCY_STRIPES     4
+
+#define BUS_FREQ_DEFAULT    100000  /* standard mode */
+
+struct dev_i2c_latency_hist {
+    uint64_t bucket[LATENCY_STRIPES][LATENCY_BUCKETS];
+};
+
+const dev_i2c_tracer *dev_i2c_trace_hooks = NULL;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int latency_stripe_next = 0;
+static __thread int latency_stripe = -1;
+
+static const char *const dev_i2c_op_names[DEV_I2C_OP_MAX] = {
+    [DEV_I2C_OP_QUICK] = "quick",
+    [DEV_I2C_OP_BYTE] = "byte",
+    [DEV_I2C_OP_BYTE_DATA] = "byte_data",
+    [DEV_I2C_OP_WORD_DATA] = "word_data",
+    [DEV_I2C_OP_PROC_CALL] = "proc_call",
+    [DEV_I2C_OP_BLOCK_DATA] = "block_data",
+    [DEV_I2C_OP_I2C_BLOCK_DATA] = "i2c_block_data",
+    [DEV_I2C_OP_BLOCK_PROC_CALL] = "block_proc_call",
+    [DEV_I2C_OP_TRANSFER] = "transfer",
+};
+
+static const char *const dev_i2c_error_class_names[DEV_I2C_ERR_MAX] = {
+    [DEV_I2C_ERR_NOACK] = "noack",
+    [DEV_I2C_ERR_TIMEOUT] = "timeout",
+    [DEV_I2C_ERR_BUS] = "bus",
+    [DEV_I2C_ERR_PROTOCOL] = "protocol",
+    [DEV_I2C_ERR_UNSUPPORTED] = "unsupported",
+    [DEV_I2C_ERR_OTHER] = "other",
+};
+
+const char *dev_i2c_op_name(int op)
+{
+    return ((op >= 0) && (op < DEV_I2C_OP_MAX)) ? dev_i2c_op_names[op] : "unknown";
+}
+
+const char *dev_i2c_error_class_name(int err)
+{
+    return ((err >= 0) && (err < DEV_I2C_ERR_MAX)) ? dev_i2c_error_class_names[err] : "unknown";
+}
+
+/* see Documentation/i2c/fault-codes in the kernel */
+static enum dev_i2c_error_class stats_error_class(int32_t err)
+{
+    switch (-err) {
+    case ENXIO:
+    case EREMOTEIO:
+        return DEV_I2C_ERR_NOACK;
+    case ETIMEDOUT:
+        return DEV_I2C_ERR_TIMEOUT;
+    case EAGAIN:
+    case EBUSY:
+    case EIO:
+        return DEV_I2C_ERR_BUS;
+    case EBADMSG:
+    case EPROTO:
+    case EOVERFLOW:
+    case EMSGSIZE:
+        return DEV_I2C_ERR_PROTOCOL;
+    case EOPNOTSUPP:
+    case EINVAL:
+        return DEV_I2C_ERR_UNSUPPORTED;
+    default:
+        return DEV_I2C_ERR_OTHER;
+    }
+}
+
+static void stats_max(uint64_t *max, uint64_t val)
+{
+    uint64_t cur = __atomic_load_n(max, __ATOMIC_RELAXED);
+
+    while ((val > cur) && !__atomic_compare_exchange_n(max, &cur, val, true,
+            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        /* cur was reloaded */
+    }
+}
+
+/**
+ * Bit times a transaction takes on the wire: a start, the address byte,
+ * every byte written and read, each with its ack bit, and a stop, plus a
+ * repeated start and the address again when it turns from writing the
+ * command to reading. A failure is counted as a nack of the address.
+ */
+static uint64_t stats_wire_bits(int32_t ret, uint32_t read, uint32_t written)
+{
+    uint64_t bits = 1 + 9 + 1;
+
+    if (ret < 0) {
+        return bits;
+    }
+    bits += 9 * ((uint64_t) read + written);
+    if ((read > 0) && (written > 0)) {
+        bits += 1 + 9;
+    }
+    return bits;
+}
+
+static void stats_update(struct dev_i2c_stats *stats, enum dev_i2c_op op, uint64_t start,
+        uint64_t latency, int32_t ret, uint32_t read, uint32_t written, uint64_t wire_bits)
+{
+    if (__atomic_load_n(&stats->first_ns, __ATOMIC_RELAXED) == 0) {
+        uint64_t none = 0;
+
+        __atomic_compare_exchange_n(&stats->first_ns, &none, start, false,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+    stats_add(stats->ops[op], 1);
+    if (ret < 0) {
+        stats_add(stats->errors[stats_error_class(ret)], 1);
+    } else {
+        if (read) {
+            stats_add(stats->bytes_read, read);
+        }
+        if (written) {
+            stats_add(stats->bytes_written, written);
+        }
+    }
+    stats_add(stats->latency_ns, latency);
+    stats_add(stats->wire_bits, wire_bits);
+    stats_max(&stats->latency_max_ns, latency);
+}
+
+static int latency_bucket(uint64_t ns)
+{
+    uint64_t units = ns >> LATENCY_UNIT_SHIFT;
+    int msb = 0;
+    int bucket = 0;
+
+    if (units < LATENCY_SUB_COUNT) {
+        return (int) units;
+    }
+    msb = 63 - __builtin_clzll(units);
+    bucket = (msb - LATENCY_SUB_BITS + 1) * LATENCY_SUB_COUNT
+            + (int) ((units >> (msb - LATENCY_SUB_BITS)) & (LATENCY_SUB_COUNT - 1));
+    return (bucket < LATENCY_BUCKETS) ? bucket : LATENCY_BUCKETS - 1;
+}
+
+/* the largest latency that falls into a bucket */
+static uint64_t latency_bucket_max(int bucket)
+{
+    int octave = bucket / LATENCY_SUB_COUNT;
+    int sub = bucket % LATENCY_SUB_COUNT;
+    int shift = 0;
+
+    if (octave == 0) {
+        return ((uint64_t) (sub + 1) << LATENCY_UNIT_SHIFT) - 1;
+    }
+    shift = octave - 1;
+    return ((uint64_t) (LATENCY_SUB_COUNT + sub + 1) << (shift + LATENCY_UNIT_SHIFT)) - 1;
+}
+
+static void latency_record(struct dev_i2c_latency_hist **slot, uint64_t latency)
+{
+    struct dev_i2c_latency_hist *hist = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+
+    if (hist == NULL) {
+        struct dev_i2c_latency_hist *fresh = calloc(1, sizeof(*fresh));
+
+        if (fresh == NULL) {
+            return;
+        }
+        /* another thread may have installed one meanwhile */
+        if (__atomic_compare_exchange_n(slot, &hist, fresh, false,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            hist = fresh;
+        } else {
+            free(fresh);
+        }
+    }
+    if (latency_stripe < 0) {
+        latency_stripe = __atomic_fetch_add(&latency_stripe_next, 1, __ATOMIC_RELAXED)
+                % LATENCY_STRIPES;
+    }
+    stats_add(hist->bucket[latency_stripe][latency_bucket(latency)], 1);
+}
+
+static void latency_zero(struct dev_i2c_latency_hist *hist)
+{
+    if (hist == NULL) {
+        return;
+    }
+    for (int i = 0; i < LATENCY_STRIPES; ++i) {
+        for (int b = 0; b < LATENCY_BUCKETS; ++b) {
+            __atomic_store_n(&hist->bucket[i][b], 0, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void latency_percentiles(const struct dev_i2c_latency_hist *hist, uint64_t max,
+        const double *percentiles, uint64_t *values_ns, int count)
+{
+    uint64_t merged[LATENCY_BUCKETS];
+    uint64_t total = 0;
+
+    memset(merged, 0, sizeof(merged));
+    if (hist != NULL) {
+        for (int i = 0; i < LATENCY_STRIPES; ++i) {
+            for (int b = 0; b < LATENCY_BUCKETS; ++b) {
+                merged[b] += __atomic_load_n(&hist->bucket[i][b], __ATOMIC_RELAXED);
+            }
+        }
+    }
+    for (int b = 0; b < LATENCY_BUCKETS; ++b) {
+        total += merged[b];
+    }
+
+    for (int i = 0; i < count; ++i) {
+        double p = percentiles[i];
+        uint64_t rank = 0;
+        uint64_t seen = 0;
+        int b = 0;
+
+        values_ns[i] = 0;
+        if (total == 0) {
+            continue;
+        }
+        p = (p < 0.0) ? 0.0 : (p > 100.0) ? 100.0 : p;
+        rank = (uint64_t) (p / 100.0 * (double) total);
+        if ((double) rank < p / 100.0 * (double) total) {
+            rank++; /* round up */
+        }
+        if (rank == 0) {
+            rank = 1;
+        }
+        for (b = 0; b < LATENCY_BUCKETS - 1; ++b) {
+            seen += merged[b];
+            if (seen >= rank) {
+                break;
+            }
+        }
+        values_ns[i] = latency_bucket_max(b);
+        if ((max > 0) && (values_ns[i] > max)) {
+            values_ns[i] = max;
+        }
+    }
+}
+
+void dev_i2c_stats_release(struct dev_i2c_latency_hist **latency)
+{
+    if (latency != NULL) {
+        free(*latency);
+        *latency = NULL;
+    }
+}
+
+void dev_i2c_trace_pre(const dev_i2c_xfer *xfer)
+{
+    for (int i = 0; i < DEV_I2C_TRACE_SLOTS; ++i) {
+        if (xfer->tracer->slot[i].pre != NULL) {
+            xfer->tracer->slot[i].pre(&xfer->event, xfer->tracer->slot[i].arg);
+        }
+    }
+}
+
+static void trace_post(const dev_i2c_xfer *xfer)
+{
+    for (int i = 0; i < DEV_I2C_TRACE_SLOTS; ++i) {
+        if (xfer->tracer->slot[i].post != NULL) {
+            xfer->tracer->slot[i].post(&xfer->event, xfer->tracer->slot[i].arg);
+        }
+    }
+}
+
+void dev_i2c_op_end(dev_i2c_xfer *xfer, int32_t ret, uint32_t read, uint32_t written)
+{
+    SMBusDevice *client = xfer->client;
+    enum dev_i2c_op op = xfer->event.op;
+    uint64_t latency = 0;
+    uint64_t wire_bits = stats_wire_bits(ret, read, written);
+    uint64_t threshold = 0;
+
+    xfer->event.end_ns = dev_i2c_stats_clock();
+    xfer->event.result = ret;
+    latency = xfer->event.end_ns - xfer->event.start_ns;
+    I2CDEV_PROBE5(transaction__end, xfer->event.adapter_nr, xfer->event.addr,
+            op, ret, latency);
+
+    stats_update(&client->stats, op, xfer->event.start_ns, latency, ret, read, written,
+            wire_bits);
+    latency_record(&client->latency, latency);
+    if (client->adapter != NULL) {
+        stats_update(&client->adapter->stats, op, xfer->event.start_ns, latency, ret, read,
+                written, wire_bits);
+        latency_record(&client->adapter->latency, latency);
+    }
+
+    /* the client's own threshold, else its adapter's, else the default */
+    threshold = __atomic_load_n(&client->slow_ns, __ATOMIC_RELAXED);
+    if ((threshold == 0) && (client->adapter != NULL)) {
+        threshold = __atomic_load_n(&client->adapter->slow_ns, __ATOMIC_RELAXED);
+    }
+    if (threshold == 0) {
+        threshold = __atomic_load_n(&dev_i2c_slow_default_ns, __ATOMIC_RELAXED);
+    }
+    if (__builtin_expect((threshold != 0) && (latency > threshold), 0)) {
+        dev_i2c_slow_record(xfer, latency, threshold);
+    }
+
+    if (__builtin_expect(xfer->tracer != NULL, 0)) {
+        trace_post(xfer);
+    }
+}
+
+int dev_i2c_trace_attach(int slot, dev_i2c_trace_func pre, dev_i2c_trace_func post,
+        void *arg)
+{
+    const dev_i2c_tracer *old = NULL;
+    dev_i2c_tracer *tracer = NULL;
+    int used = 0;
+
+    if ((slot < 0) || (slot >= DEV_I2C_TRACE_SLOTS)) {
+        return -EINVAL;
+    }
+
+    tracer = malloc(sizeof(*tracer));
+    if (tracer == NULL) {
+        return -ENOMEM;
+    }
+
+    pthread_mutex_lock(&trace_lock);
+    old = dev_i2c_trace_hooks;
+    if (old != NULL) {
+        *tracer = *old;
+    } else {
+        memset(tracer, 0, sizeof(*tracer));
+    }
+    tracer->slot[slot].pre = pre;
+    tracer->slot[slot].post = post;
+    tracer->slot[slot].arg = arg;
+    for (int i = 0; i < DEV_I2C_TRACE_SLOTS; ++i) {
+        used |= (tracer->slot[i].pre != NULL) || (tracer->slot[i].post != NULL);
+    }
+    if (!used) {
+        free(tracer);
+        tracer = NULL;
+    }
+    /*
+     * a transaction under way may still hold the old hooks and nothing
+     * tells when it is done with them, so they are never freed: hooks
+     * are set a handful of times in the life of a process
+     */
+    __atomic_store_n(&dev_i2c_trace_hooks, tracer, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&trace_lock);
+    return 0;
+}
+
+int dev_i2c_set_trace_hooks(dev_i2c_trace_func pre, dev_i2c_trace_func post, void *arg)
+{
+    return dev_i2c_trace_attach(DEV_I2C_TRACE_APP, pre, post, arg);
+}
+
+static void stats_copy(struct dev_i2c_stats *dst, const struct dev_i2c_stats *src)
+{
+    for (int i = 0; i < DEV_I2C_OP_MAX; ++i) {
+        dst->ops[i] = __atomic_load_n(&src->ops[i], __ATOMIC_RELAXED);
+    }
+    for (int i = 0; i < DEV_I2C_ERR_MAX; ++i) {
+        dst->errors[i] = __atomic_load_n(&src->errors[i], __ATOMIC_RELAXED);
+    }
+    dst->bytes_read = __atomic_load_n(&src->bytes_read, __ATOMIC_RELAXED);
+    dst->bytes_written = __atomic_load_n(&src->bytes_written, __ATOMIC_RELAXED);
+    dst->latency_ns = __atomic_load_n(&src->latency_ns, __ATOMIC_RELAXED);
+    dst->latency_max_ns = __atomic_load_n(&src->latency_max_ns, __ATOMIC_RELAXED);
+    dst->wire_bits = __atomic_load_n(&src->wire_bits, __ATOMIC_RELAXED);
+    dst->first_ns = __atomic_load_n(&src->first_ns, __ATOMIC_RELAXED);
+}
+
+static void stats_zero(struct dev_i2c_stats *stats)
+{
+    for (int i = 0; i < DEV_I2C_OP_MAX; ++i) {
+        __atomic_store_n(&stats->ops[i], 0, __ATOMIC_RELAXED);
+    }
+    for (int i = 0; i < DEV_I2C_ERR_MAX; ++i) {
+        __atomic_store_n(&stats->errors[i], 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&stats->bytes_read, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->bytes_written, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->latency_ns, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->latency_max_ns, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->wire_bits, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->first_ns, 0, __ATOMIC_RELAXED);
+}
+
+int dev_i2c_get_stats(const SMBusDevice *client, struct dev_i2c_stats *stats)
+{
+    if (!client || !stats) {
+        return -EINVAL;
+    }
+    stats_copy(stats, &client->stats);
+    return 0;
+}
+
+int dev_i2c_reset_stats(SMBusDevice *client)
+{
+    if (!client) {
+        return -EINVAL;
+    }
+    stats_zero(&client->stats);
+    latency_zero(client->latency);
+    return 0;
+}
+
+int dev_i2c_get_adapter_stats(const char *path, struct dev_i2c_stats *stats)
+{
+    dev_bus_adapter *adapter = NULL;
+
+    if (!path || !stats) {
+        return -EINVAL;
+    }
+    adapter = dev_i2c_lookup_i2c_bus(path);
+    if (adapter == NULL) {
+        return -ENODEV;
+    }
+    stats_copy(stats, &adapter->i2c_adapt.stats);
+    return 0;
+}
+
+int dev_i2c_reset_adapter_stats(const char *path)
+{
+    dev_bus_adapter *adapter = NULL;
+
+    if (!path) {
+        return -EINVAL;
+    }
+    adapter = dev_i2c_lookup_i2c_bus(path);
+    if (adapter == NULL) {
+        return -ENODEV;
+    }
+    stats_zero(&adapter->i2c_adapt.stats);
+    latency_zero(adapter->i2c_adapt.latency);
+    return 0;
+}
+
+int dev_i2c_get_latency_percentiles(const SMBusDevice *client,
+        const double *percentiles, uint64_t *values_ns, int count)
+{
+    if (!client || (count < 0) || ((count > 0) && (!percentiles || !values_ns))) {
+        return -EINVAL;
+    }
+    latency_percentiles(__atomic_load_n(&client->latency, __ATOMIC_ACQUIRE),
+            __atomic_load_n(&client->stats.latency_max_ns, __ATOMIC_RELAXED),
+            percentiles, values_ns, count);
+    return 0;
+}
+
+int dev_i2c_get_adapter_latency_percentiles(const char *path,
+        const double *percentiles, uint64_t *values_ns, int count)
+{
+    dev_bus_adapter *adapter = NULL;
+
+    if (!path || (count < 0) || ((count > 0) && (!percentiles || !values_ns))) {
+        return -EINVAL;
+    }
+    adapter = dev_i2c_lookup_i2c_bus(path);
+    if (adapter == NULL) {
+        return -ENODEV;
+    }
+    latency_percentiles(__atomic_load_n(&adapter->i2c_adapt.latency, __ATOMIC_ACQUIRE),
+            __atomic_load_n(&adapter->i2c_adapt.stats.latency_max_ns, __ATOMIC_RELAXED),
+            percentiles, values_ns, count);
+    return 0;
+}
+
+/**
+ * Read the clock frequency of a physical bus from the firmware node of the
+ * adapter or, as most device trees have it, of its controller
+ * @param adapter
+ * @return the frequency in Hz or zero if not found
+ */
+static uint32_t bus_freq_read(const dev_bus_adapter *adapter)
+{
+    static const char *const attrs[] = {
+        "of_node/clock-frequency",
+        "../of_node/clock-frequency",
+    };
+    uint8_t buf[16];
+
+    if (adapter->devpath == NULL) {
+        return 0;
+    }
+    for (size_t i = 0; i < sizeof(attrs) / sizeof(attrs[0]); ++i) {
+        ssize_t len = sysfs_read_attr_raw(adapter->devpath, attrs[i], buf, sizeof(buf) - 1);
+        uint32_t be = 0;
+
+        /* a device tree property is one big endian cell */
+        if (len == sizeof(be)) {
+            memcpy(&be, buf, sizeof(be));
+            return be32toh(be);
+        } else if (len > 0) {
+            buf[len] = '\0';
+            return (uint32_t) strtoul((const char *) buf, NULL, 0);
+        }
+    }
+    return 0;
+}
+
+int dev_i2c_get_bus_utilisation(const char *path, struct dev_i2c_bus_utilisation *util)
+{
+    const dev_topology *topo = NULL;
+    dev_bus_adapter *adapter = NULL;
+    const dev_bus_adapter *root = NULL;
+    uint64_t first = 0;
+    uint64_t bits = 0;
+    int i = 0;
+
+    if (!path || !util) {
+        return -EINVAL;
+    }
+    adapter = dev_i2c_lookup_i2c_bus(path);
+    if (adapter == NULL) {
+        return -ENODEV;
+    }
+    topo = dev_topology_get();
+    i = dev_topology_adapter_index(topo, adapter);
+    if (i == TOPOLOGY_NONE) {
+        return -ENODEV;
+    }
+
+    memset(util, 0, sizeof(*util));
+    for (int j = i; j < topo->subtree_end[i]; ++j) {
+        struct dev_i2c_stats stats;
+
+        stats_copy(&stats, &topo->adapter[j]->i2c_adapt.stats);
+        for (int op = 0; op < DEV_I2C_OP_MAX; ++op) {
+            util->transactions += stats.ops[op];
+        }
+        util->wall_ns += stats.latency_ns;
+        bits += stats.wire_bits;
+        if ((stats.first_ns != 0) && ((first == 0) || (stats.first_ns < first))) {
+            first = stats.first_ns;
+        }
+    }
+
+    for (root = adapter; root->parent != NULL; root = root->parent) {
+    }
+    util->bus_freq_hz = bus_freq_read(root);
+    util->bus_freq_known = (util->bus_freq_hz != 0);
+    if (!util->bus_freq_known) {
+        util->bus_freq_hz = BUS_FREQ_DEFAULT;
+    }
+
+    /* bits * 10^9 overflows after about 18 Gbit, divide first */
+    util->wire_ns = (bits / util->bus_freq_hz) * 1000000000ULL
+            + (bits % util->bus_freq_hz) * 1000000000ULL / util->bus_freq_hz;
+    if (first != 0) {
+        util->window_ns = dev_i2c_stats_clock() - first;
+    }
+    if (util->window_ns > 0) {
+        util->utilisation = 100.0 * (double) util->wire_ns / (double) util->window_ns;
+        util->busy = 100.0 * (double) util->wall_ns / (double) util->window_ns;
+    }
+    if (util->wire_ns > 0) {
+        util->wall_to_wire = (double) util->wall_ns / (double) util->wire_ns;
+    }
+    return 0;
+}
@@ -0,0 +1,183 @@
+/**
+ * @file stats.h
+ * @copyright Violin Memory, Inc, 2014
+ * @brief Per-client and per-adapter transaction counters and tracing hooks
+ */
+
+#ifndef LIB_STATS_H
+#define LIB_STATS_H
+
+#include <stdint.h>
+#include <time.h>
+#include <linux/i2c.h>
+#include "busses.h"
+#include "probes.h"
+
+/* users of the tracing hooks, each has its own pair */
+enum dev_i2c_trace_slot {
+    DEV_I2C_TRACE_APP = 0,      /* dev_i2c_set_trace_hooks() */
+    DEV_I2C_TRACE_RECORDER,     /* dev_i2c_trace_record_start() */
+    DEV_I2C_TRACE_EXPORTER,     /* dev_i2c_trace_export_start() */
+    DEV_I2C_TRACE_SLOTS,
+};
+
+/* the hooks installed, never changed once published */
+typedef struct dev_i2c_tracer {
+    struct {
+        dev_i2c_trace_func pre;
+        dev_i2c_trace_func post;
+        void *arg;
+    } slot[DEV_I2C_TRACE_SLOTS];
+} dev_i2c_tracer;
+
+extern const dev_i2c_tracer *dev_i2c_trace_hooks;
+
+/**
+ * Install or, with both hooks NULL, remove the hooks of one user
+ * @param slot enum dev_i2c_trace_slot
+ * @param pre
+ * @param post
+ * @param arg
+ * @return negative errno on failure else zero on success
+ */
+extern int dev_i2c_trace_attach(int slot, dev_i2c_trace_func pre, dev_i2c_trace_func post,
+        void *arg);
+
+/* a transaction under way, between dev_i2c_op_begin() and dev_i2c_op_end() */
+typedef struct dev_i2c_xfer {
+    SMBusDevice *client;
+    const dev_i2c_tracer *tracer;
+    struct dev_i2c_trace_event event;
+    uint8_t wbuf[I2C_SMBUS_BLOCK_MAX]; /* data written, when the caller's buffer won't do */
+    uint8_t rbuf[2];
+} dev_i2c_xfer;
+
+/**
+ * @return the monotonic clock in nanoseconds, to time a transaction
+ */
+static inline uint64_t dev_i2c_stats_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+extern void dev_i2c_trace_pre(const dev_i2c_xfer *xfer);
+
+/**
+ * Start timing a transaction and call the pre hooks if there are any
+ * @param xfer
+ * @param client
+ * @param op enum dev_i2c_op
+ * @param read_write I2C_SMBUS_READ or I2C_SMBUS_WRITE
+ * @param command command byte or -1 if the protocol has none
+ * @param length data bytes requested, the command byte excluded
+ */
+static inline void dev_i2c_op_begin(dev_i2c_xfer *xfer, SMBusDevice *client,
+        enum dev_i2c_op op, int read_write, int command, uint32_t length)
+{
+    xfer->client = client;
+    xfer->tracer = __atomic_load_n(&dev_i2c_trace_hooks, __ATOMIC_ACQUIRE);
+    xfer->event.adapter_nr = (client->adapter != NULL) ? client->adapter->nr : -1;
+    xfer->event.addr = client->addr;
+    xfer->event.op = op;
+    xfer->event.read_write = read_write;
+    xfer->event.command = command;
+    xfer->event.length = length;
+    xfer->event.path = client->path;
+    xfer->event.write_data = NULL;
+    xfer->event.write_len = 0;
+    xfer->event.read_data = NULL;
+    xfer->event.read_len = 0;
+    xfer->event.result = 0;
+    xfer->event.end_ns = 0;
+    xfer->event.start_ns = dev_i2c_stats_clock();
+    I2CDEV_PROBE5(transaction__begin, xfer->event.adapter_nr, xfer->event.addr,
+            op, command, length);
+    if (__builtin_expect(xfer->tracer != NULL, 0)) {
+        dev_i2c_trace_pre(xfer);
+    }
+}
+
+/**
+ * Set the data a transaction writes after its command byte, between
+ * dev_i2c_op_begin() and dev_i2c_op_end(), for the post hooks to see
+ * @param xfer
+ * @param data must stay unchanged until dev_i2c_op_end()
+ * @param len
+ */
+static inline void dev_i2c_op_write(dev_i2c_xfer *xfer, const uint8_t *data, uint32_t len)
+{
+    xfer->event.write_data = data;
+    xfer->event.write_len = len;
+}
+
+/**
+ * Set a word or byte a transaction writes, least significant byte first
+ * @param xfer
+ * @param value
+ * @param len 1 or 2
+ */
+static inline void dev_i2c_op_write_value(dev_i2c_xfer *xfer, uint16_t value, uint32_t len)
+{
+    xfer->wbuf[0] = value & 0xff;
+    xfer->wbuf[1] = value >> 8;
+    dev_i2c_op_write(xfer, xfer->wbuf, len);
+}
+
+/**
+ * Set the data a transaction read, before dev_i2c_op_end(), for the post
+ * hooks to see
+ * @param xfer
+ * @param data
+ * @param len
+ */
+static inline void dev_i2c_op_read(dev_i2c_xfer *xfer, const uint8_t *data, uint32_t len)
+{
+    xfer->event.read_data = data;
+    xfer->event.read_len = len;
+}
+
+/**
+ * Set the word or byte a transaction returned, if it succeeded
+ * @param xfer
+ * @param ret result of the transaction
+ * @param len 1 or 2
+ */
+static inline void dev_i2c_op_read_value(dev_i2c_xfer *xfer, int32_t ret, uint32_t len)
+{
+    if (ret >= 0) {
+        xfer->rbuf[0] = ret & 0xff;
+        xfer->rbuf[1] = (ret >> 8) & 0xff;
+        dev_i2c_op_read(xfer, xfer->rbuf, len);
+    }
+}
+
+/**
+ * Count a finished transaction for its client and adapter and call the
+ * post hooks if there are any
+ * @param xfer
+ * @param ret result of the transaction, negative errno on failure
+ * @param read bytes read if it succeeded
+ * @param written bytes written if it succeeded
+ */
+extern void dev_i2c_op_end(dev_i2c_xfer *xfer, int32_t ret, uint32_t read, uint32_t written);
+
+extern uint64_t dev_i2c_slow_default_ns;
+
+/**
+ * Copy a transaction over its latency threshold to the ring of slow ones
+ * @param xfer
+ * @param latency
+ * @param threshold
+ */
+extern void dev_i2c_slow_record(const dev_i2c_xfer *xfer, uint64_t latency, uint64_t threshold);
+
+/**
+ * Free a client's or adapter's latency histogram
+ * @param latency
+ */
+extern void dev_i2c_stats_release(struct dev_i2c_latency_hist **latency);
+
+#endif /* !LIB_STATS_H */
@@ -0,0 +1,134 @@
+/**
+ * @file syscalls.c
+ * @copyright Violin Memory, Inc, 2014
+ *
+ * @brief Counting of the syscalls the library makes, per public call.
+ *
+ * Meant to catch regressions in how many syscalls a dev_i2c_open() or a
+ * rescan costs. While counting is off a syscall pays for one untaken
+ * branch; while it's on, for a relaxed atomic add to a global table.
+ */
+
+#define _GNU_SOURCE 1
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <libi2cdev.h>
+
+#include "syscalls.h"
+
+int dev_sys_counting = 0;
+__thread int dev_sys_api = DEV_I2C_API_OTHER;
+
+static struct dev_i2c_syscall_stats dev_sys_stats;
+
+static const char *const dev_i2c_api_names[DEV_I2C_API_MAX] = {
+    [DEV_I2C_API_OTHER] = "other",
+    [DEV_I2C_API_INIT] = "init",
+    [DEV_I2C_API_RESCAN] = "rescan",
+    [DEV_I2C_API_CLEANUP] = "cleanup",
+    [DEV_I2C_API_COMPILE_CONFIG] = "compile_config",
+    [DEV_I2C_API_INSTANTIATE] = "instantiate",
+    [DEV_I2C_API_UEVENT] = "uevent_monitor",
+    [DEV_I2C_API_CONFIG_MONITOR] = "config_monitor",
+    [DEV_I2C_API_LOOKUP] = "lookup",
+    [DEV_I2C_API_NEW_DEVICE] = "new_device",
+    [DEV_I2C_API_DELETE] = "delete",
+    [DEV_I2C_API_OPEN] = "open",
+    [DEV_I2C_API_CLOSE] = "close",
+    [DEV_I2C_API_PROBE] = "probe",
+    [DEV_I2C_API_SMBUS] = "smbus",
+    [DEV_I2C_API_TRANSFER] = "transfer",
+};
+
+static const char *const dev_i2c_syscall_names[DEV_I2C_SYS_MAX] = {
+    [DEV_I2C_SYS_OPEN] = "open",
+    [DEV_I2C_SYS_CLOSE] = "close",
+    [DEV_I2C_SYS_STAT] = "stat",
+    [DEV_I2C_SYS_READ] = "read",
+    [DEV_I2C_SYS_WRITE] = "write",
+    [DEV_I2C_SYS_READLINK] = "readlink",
+    [DEV_I2C_SYS_REALPATH] = "realpath",
+    [DEV_I2C_SYS_OPENDIR] = "opendir",
+    [DEV_I2C_SYS_READDIR] = "readdir",
+    [DEV_I2C_SYS_MMAP] = "mmap",
+    [DEV_I2C_SYS_RENAME] = "rename",
+    [DEV_I2C_SYS_UNLINK] = "unlink",
+    [DEV_I2C_SYS_SOCKET] = "socket",
+    [DEV_I2C_SYS_INOTIFY] = "inotify",
+    [DEV_I2C_SYS_IOCTL_SMBUS] = "ioctl_smbus",
+    [DEV_I2C_SYS_IOCTL_RDWR] = "ioctl_rdwr",
+    [DEV_I2C_SYS_IOCTL_SLAVE] = "ioctl_slave",
+    [DEV_I2C_SYS_IOCTL_FUNCS] = "ioctl_funcs",
+    [DEV_I2C_SYS_IOCTL_OTHER] = "ioctl_other",
+    [DEV_I2C_SYS_CHMOD] = "chmod",
+    [DEV_I2C_SYS_CLOCK] = "clock",
+};
+
+const char *dev_i2c_api_name(int api)
+{
+    return ((api >= 0) && (api < DEV_I2C_API_MAX)) ? dev_i2c_api_names[api] : "unknown";
+}
+
+const char *dev_i2c_syscall_name(int sys)
+{
+    return ((sys >= 0) && (sys < DEV_I2C_SYS_MAX)) ? dev_i2c_syscall_names[sys] : "unknown";
+}
+
+void dev_sys_count_api(int api)
+{
+    __atomic_fetch_add(&dev_sys_stats.calls[api], 1, __ATOMIC_RELAXED);
+}
+
+void dev_sys_count_syscall(int sys)
+{
+    __atomic_fetch_add(&dev_sys_stats.syscalls[dev_sys_api][sys], 1, __ATOMIC_RELAXED);
+}
+
+void dev_i2c_set_syscall_counting(int enable)
+{
+    __atomic_store_n(&dev_sys_counting, !!enable, __ATOMIC_RELAXED);
+}
+
+int dev_i2c_get_syscall_stats(struct dev_i2c_syscall_stats *stats)
+{
+    if (!stats) {
+        return -EINVAL;
+    }
+    for (int api = 0; api < DEV_I2C_API_MAX; ++api) {
+        stats->calls[api] = __atomic_load_n(&dev_sys_stats.calls[api], __ATOMIC_RELAXED);
+        for (int sys = 0; sys < DEV_I2C_SYS_MAX; ++sys) {
+            stats->syscalls[api][sys] = __atomic_load_n(&dev_sys_stats.syscalls[api][sys],
+                    __ATOMIC_RELAXED);
+        }
+    }
+    return 0;
+}
+
+void dev_i2c_reset_syscall_stats(void)
+{
+    for (int api = 0; api < DEV_I2C_API_MAX; ++api) {
+        __atomic_store_n(&dev_sys_stats.calls[api], 0, __ATOMIC_RELAXED);
+        for (int sys = 0; sys < DEV_I2C_SYS_MAX; ++sys) {
+            __atomic_store_n(&dev_sys_stats.syscalls[api][sys], 0, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+int dev_sys_write_all(int fd, const void *buf, size_t len)
+{
+    const char *pos = buf;
+
+    while (len > 0) {
+        ssize_t ret = TEMP_FAILURE_RETRY(dev_sys_write(fd, pos, len));
+        if (ret < 0) {
+            return -errno;
+        }
+        pos += ret;
+        len -= (size_t) ret;
+    }
+    return 0;
+}
@@ -0,0 +1,117 @@
+/**
+ * @file syscalls.h
+ * @copyright Violin Memory, Inc, 2014
+ * @brief Counting of the syscalls the library makes, per public call
+ *
+ * Every syscall of the library goes through one of the dev_sys_*()
+ * wrappers below, which count it against the public call the thread is
+ * in when counting is on; the headers of the wrapped functions are left
+ * to the file using them. Public calls mark themselves with DEV_SYS_API(),
+ * and only the outermost one a thread enters counts.
+ */
+
+#ifndef LIB_SYSCALLS_H
+#define LIB_SYSCALLS_H
+
+#include <linux/i2c-dev.h>
+#include <libi2cdev.h>
+
+extern int dev_sys_counting;
+extern __thread int dev_sys_api; /* DEV_I2C_API_OTHER outside the library */
+
+extern void dev_sys_count_api(int api);
+extern void dev_sys_count_syscall(int sys);
+
+static inline void dev_sys_count(enum dev_i2c_syscall sys)
+{
+    if (__builtin_expect(__atomic_load_n(&dev_sys_counting, __ATOMIC_RELAXED), 0)) {
+        dev_sys_count_syscall(sys);
+    }
+}
+
+static inline int dev_sys_api_enter(enum dev_i2c_api api)
+{
+    int saved = dev_sys_api;
+
+    if (saved == DEV_I2C_API_OTHER) {
+        dev_sys_api = api;
+        if (__builtin_expect(__atomic_load_n(&dev_sys_counting, __ATOMIC_RELAXED), 0)) {
+            dev_sys_count_api(api);
+        }
+    }
+    return saved;
+}
+
+static inline void dev_sys_api_leave(int *saved)
+{
+    dev_sys_api = *saved;
+}
+
+/*
+ * Count the syscalls made until the function returns against api, unless
+ * the thread is in a public call already. Goes first in the function body.
+ */
+#define DEV_SYS_API(api) \
+    int dev_sys_api_saved __attribute__((cleanup(dev_sys_api_leave))) = dev_sys_api_enter(api)
+
+static inline enum dev_i2c_syscall dev_sys_ioctl_kind(unsigned long request)
+{
+    switch (request) {
+    case I2C_SMBUS:
+        return DEV_I2C_SYS_IOCTL_SMBUS;
+    case I2C_RDWR:
+        return DEV_I2C_SYS_IOCTL_RDWR;
+    case I2C_SLAVE:
+    case I2C_SLAVE_FORCE:
+        return DEV_I2C_SYS_IOCTL_SLAVE;
+    case I2C_FUNCS:
+        return DEV_I2C_SYS_IOCTL_FUNCS;
+    default:
+        return DEV_I2C_SYS_IOCTL_OTHER;
+    }
+}
+
+#define dev_sys_open(...)           (dev_sys_count(DEV_I2C_SYS_OPEN), open(__VA_ARGS__))
+#define dev_sys_fopen(path, mode)   (dev_sys_count(DEV_I2C_SYS_OPEN), fopen(path, mode))
+#define dev_sys_mkostemp(tmpl, flags) (dev_sys_count(DEV_I2C_SYS_OPEN), mkostemp(tmpl, flags))
+#define dev_sys_close(fd)           (dev_sys_count(DEV_I2C_SYS_CLOSE), close(fd))
+#define dev_sys_fclose(file)        (dev_sys_count(DEV_I2C_SYS_CLOSE), fclose(file))
+#define dev_sys_closedir(dir)       (dev_sys_count(DEV_I2C_SYS_CLOSE), closedir(dir))
+#define dev_sys_stat(path, st)      (dev_sys_count(DEV_I2C_SYS_STAT), stat(path, st))
+#define dev_sys_fstat(fd, st)       (dev_sys_count(DEV_I2C_SYS_STAT), fstat(fd, st))
+#define dev_sys_read(fd, buf, len)  (dev_sys_count(DEV_I2C_SYS_READ), read(fd, buf, len))
+#define dev_sys_getline(line, len, file) (dev_sys_count(DEV_I2C_SYS_READ), getline(line, len, file))
+#define dev_sys_fread(buf, size, n, file) (dev_sys_count(DEV_I2C_SYS_READ), fread(buf, size, n, file))
+#define dev_sys_recvmsg(fd, msg, flags) (dev_sys_count(DEV_I2C_SYS_READ), recvmsg(fd, msg, flags))
+#define dev_sys_write(fd, buf, len) (dev_sys_count(DEV_I2C_SYS_WRITE), write(fd, buf, len))
+#define dev_sys_pwrite(fd, buf, len, off) (dev_sys_count(DEV_I2C_SYS_WRITE), pwrite(fd, buf, len, off))
+#define dev_sys_fprintf(file, ...)  (dev_sys_count(DEV_I2C_SYS_WRITE), fprintf(file, __VA_ARGS__))
+#define dev_sys_readlink(path, buf, len) (dev_sys_count(DEV_I2C_SYS_READLINK), readlink(path, buf, len))
+#define dev_sys_realpath(path, buf) (dev_sys_count(DEV_I2C_SYS_REALPATH), realpath(path, buf))
+#define dev_sys_opendir(path)       (dev_sys_count(DEV_I2C_SYS_OPENDIR), opendir(path))
+#define dev_sys_scandir(...)        (dev_sys_count(DEV_I2C_SYS_OPENDIR), scandir(__VA_ARGS__))
+#define dev_sys_readdir(dir)        (dev_sys_count(DEV_I2C_SYS_READDIR), readdir(dir))
+#define dev_sys_mmap(...)           (dev_sys_count(DEV_I2C_SYS_MMAP), mmap(__VA_ARGS__))
+#define dev_sys_munmap(addr, len)   (dev_sys_count(DEV_I2C_SYS_MMAP), munmap(addr, len))
+#define dev_sys_rename(from, to)    (dev_sys_count(DEV_I2C_SYS_RENAME), rename(from, to))
+#define dev_sys_unlink(path)        (dev_sys_count(DEV_I2C_SYS_UNLINK), unlink(path))
+#define dev_sys_fchmod(fd, mode)    (dev_sys_count(DEV_I2C_SYS_CHMOD), fchmod(fd, mode))
+#define dev_sys_socket(...)         (dev_sys_count(DEV_I2C_SYS_SOCKET), socket(__VA_ARGS__))
+#define dev_sys_bind(...)           (dev_sys_count(DEV_I2C_SYS_SOCKET), bind(__VA_ARGS__))
+#define dev_sys_setsockopt(...)     (dev_sys_count(DEV_I2C_SYS_SOCKET), setsockopt(__VA_ARGS__))
+#define dev_sys_inotify_init1(flags) (dev_sys_count(DEV_I2C_SYS_INOTIFY), inotify_init1(flags))
+#define dev_sys_inotify_add_watch(...) (dev_sys_count(DEV_I2C_SYS_INOTIFY), inotify_add_watch(__VA_ARGS__))
+#define dev_sys_clock_gettime(clock, ts) (dev_sys_count(DEV_I2C_SYS_CLOCK), clock_gettime(clock, ts))
+/**
+ * Write a whole buffer, counting every write() it takes
+ * @param fd
+ * @param buf
+ * @param len
+ * @return negative errno on failure else zero
+ */
+extern int dev_sys_write_all(int fd, const void *buf, size_t len);
+
+#define dev_sys_ioctl(fd, request, ...) \
+    (dev_sys_count(dev_sys_ioctl_kind(request)), ioctl(fd, request, __VA_ARGS__))
+
+#endif /* !LIB_SYSCALLS_H */
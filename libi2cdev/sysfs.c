@@ -31,6 +31,7 @@
 #include "common.h"
 #include "sysfs.h"
 #include "data.h"
+#include "syscalls.h"
 
 #ifndef SYSFS_MAGIC
 #define SYSFS_MAGIC 0x62656572
@@ -69,7 +70,7 @@ int init_sysfs(void)
         if (sysfs_path_debugging == true) {
             fprintf(stderr,
                     "WARNING: This build has been compiled with sysfs path override enabled!\n");
-            if (stat(sysfs_mount_path, &statbuf) < 0) {
+            if (dev_sys_stat(sysfs_mount_path, &statbuf) < 0) {
                 fprintf(stderr,
                         "ERROR: could not find valid sysfs path \"%s\" - %s\n",
                         sysfs_mount_path, strerror(errno));
@@ -98,6 +99,61 @@ int init_sysfs(void)
     return 1;
 }
 
+ssize_t sysfs_read_attr_buf(const char *syspath, const char *attr, char *buf, size_t size)
+{
+    char path[PATH_MAX];
+    ssize_t len = 0;
+    int fd = -1;
+    int err = 0;
+
+    if (size == 0) {
+        return -EINVAL;
+    }
+    len = snprintf(path, sizeof(path), "%s/%s", syspath, attr);
+    if (len <= 0 || len >= (ssize_t) sizeof(path)) {
+        return -ENAMETOOLONG;
+    }
+
+    /* a plain read(), stdio would allocate a FILE and its buffer per attribute */
+    fd = dev_sys_open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+    len = TEMP_FAILURE_RETRY(dev_sys_read(fd, buf, size - 1));
+    err = errno;
+    dev_sys_close(fd);
+    if (len < 0) {
+        return -err;
+    }
+    buf[len] = '\0';
+
+    /* Last byte is a '\n'; chop that off */
+    *strchrnul(buf, '\n') = '\0';
+    return (ssize_t) strlen(buf);
+}
+
+ssize_t sysfs_read_attr_raw(const char *syspath, const char *attr, void *buf, size_t size)
+{
+    char path[PATH_MAX];
+    ssize_t len = 0;
+    int fd = -1;
+    int err = 0;
+
+    len = snprintf(path, sizeof(path), "%s/%s", syspath, attr);
+    if (len <= 0 || len >= (ssize_t) sizeof(path)) {
+        return -ENAMETOOLONG;
+    }
+
+    fd = dev_sys_open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+    len = TEMP_FAILURE_RETRY(dev_sys_read(fd, buf, size));
+    err = errno;
+    dev_sys_close(fd);
+    return (len < 0) ? -err : len;
+}
+
 /*
  * Read an attribute from sysfs
  * reads out the first (usually only) one line up to '\n' or '\0'
@@ -106,34 +162,12 @@ int init_sysfs(void)
  */
 char *sysfs_read_attr(const char *syspath, const char *attr)
 {
-    char path[PATH_MAX];
     char buf[NAME_MAX];
-    char *buf_end = NULL;
-    char *line = NULL;
-    FILE *fp = NULL;
-    ssize_t slen = 0;
 
-    slen = snprintf(path, sizeof(path), "%s/%s", syspath, attr);
-    if (slen <= 0 || slen == (ssize_t) sizeof(path)) {
-        return NULL;
-    } else {
-        path[slen] = '\0';
-    }
-
-    if ((fp = fopen(path, "r")) != NULL) {
-        line = fgets(buf, sizeof(buf), fp);
-        fclose(fp);
-    }
-    if (line == NULL){
-        return NULL;
-    }
-    /* Last byte is a '\n'; chop that off */
-    buf_end = strchrnul(line, '\n');
-    *buf_end = '\0';
-    if (*line == '\0') {
+    if (sysfs_read_attr_buf(syspath, attr, buf, sizeof(buf)) <= 0) {
         return NULL;
     }
-    return strdup(line);
+    return strdup(buf);
 }
 
 #define MAX_SYSFS_WRITE_SIZE 4096
@@ -147,15 +181,15 @@ ssize_t sysfs_write_file(const char *filename, const char *buffer, size_t size)
     if (size > MAX_SYSFS_WRITE_SIZE) {
         return -EFBIG;
     }
-    fd = open(filename, O_WRONLY);
+    fd = dev_sys_open(filename, O_WRONLY);
     if (fd < 0) {
         ret = -errno;
     } else {
-        nbytes = TEMP_FAILURE_RETRY(write(fd, buffer, size));
+        nbytes = TEMP_FAILURE_RETRY(dev_sys_write(fd, buffer, size));
         if (nbytes < 0) {
             ret = -errno;
         }
-        ret1 = TEMP_FAILURE_RETRY(close(fd));
+        ret1 = TEMP_FAILURE_RETRY(dev_sys_close(fd));
     }
     return ((ret < 0) ? ret : ((ret1 < 0) ? ret1 : nbytes));
 }
@@ -180,12 +214,12 @@ static int sysfs_read_uevents(char ***uevents, int *count, int *max,
         path[len] = '\0';
     }
 
-    if ((fp = fopen(path, "r")) == NULL) {
+    if ((fp = dev_sys_fopen(path, "r")) == NULL) {
         return -errno;
     }
 
     len = 0;
-    while ((len = getline(&line, &line_len, fp)) != EOF) {
+    while ((len = dev_sys_getline(&line, &line_len, fp)) != EOF) {
         char *uevent_val = NULL;
         char *p_line = NULL;
         if (line == NULL) {
@@ -209,7 +243,7 @@ static int sysfs_read_uevents(char ***uevents, int *count, int *max,
         free(uevent_val);
     }
     free(line);
-    fclose(fp);
+    dev_sys_fclose(fp);
     return (0);
 }
 
@@ -265,7 +299,7 @@ struct stat *sysfs_read_stats(const char *syspath, const char *attr)
     }
     path[len] = '\0';
 
-    if (stat(path, &statbuf) < 0) {
+    if (dev_sys_stat(path, &statbuf) < 0) {
         return NULL;
     } else {
         sp = malloc(sizeof(struct stat));
@@ -283,7 +317,7 @@ static char *readlink_internal(const char *filename)
     char *p_link = NULL;
     ssize_t len = 0;
 
-    len = readlink(filename, buffer, sizeof(buffer));
+    len = dev_sys_readlink(filename, buffer, sizeof(buffer));
     if (len <= 0 || len == (ssize_t) sizeof(buffer)) {
         return NULL;
     }
@@ -323,115 +357,68 @@ char *sysfs_read_link(const char *syspath, const char *attr)
     return readlink_internal(path);
 }
 
-/* From a sysfs device path, return the module name, or NULL */
-char *sysfs_read_device_module(const char *syspath)
+ssize_t sysfs_read_device_link_name(const char *syspath, const char *link,
+        char *buf, size_t size)
 {
     char path[PATH_MAX];
     char path_target[PATH_MAX];
-    char *module = NULL;
-    char *pbname = NULL;
+    const char *pbname = NULL;
     ssize_t len = 0;
-    struct stat st;
 
-    if (snprintf(path, sizeof(path), "%s/driver/module", syspath) < 0)
-        return NULL;
-    if (lstat(path, &st) < 0) {
-        return NULL;
+    len = snprintf(path, sizeof(path), "%s/%s", syspath, link);
+    if (len <= 0 || len >= (ssize_t) sizeof(path)) {
+        return -ENAMETOOLONG;
     }
-    len = readlink(path, path_target, sizeof(path_target));
-    if (len <= 0 || len == (ssize_t) sizeof(path_target)) {
-        return NULL;
+    len = dev_sys_readlink(path, path_target, sizeof(path_target));
+    if (len < 0) {
+        return -errno;
+    } else if (len == 0 || len == (ssize_t) sizeof(path_target)) {
+        return -EINVAL;
     }
     path_target[len] = '\0';
 
-    if (*path_target == '\0') {
-        return NULL;
-    }
-    pbname = basename(path_target);
-    if (pbname != NULL && *pbname != '\0') {
-        module = strdup(pbname);
-        if (module == NULL) {
-            return NULL;
-        } else {
-            return module;
-        }
-    } else {
-        return NULL;
+    pbname = strrchr(path_target, '/');
+    pbname = (pbname != NULL) ? pbname + 1 : path_target;
+    len = (ssize_t) strlen(pbname);
+    if (len == 0) {
+        return -EINVAL;
+    } else if (len >= (ssize_t) size) {
+        return -ENAMETOOLONG;
     }
+    memcpy(buf, pbname, len + 1);
+    return len;
 }
 
-/* From a sysfs device path, return the driver name, or NULL */
-char *sysfs_read_device_driver(const char *syspath)
+/**
+ * Read the name a device link points to into a freshly allocated string
+ * @param syspath
+ * @param link
+ * @return the name or NULL
+ */
+static char *sysfs_read_device_link_dup(const char *syspath, const char *link)
 {
-    char path[PATH_MAX];
-    char path_target[PATH_MAX];
-    char *driver = NULL;
-    char *pbname = NULL;
-    ssize_t len = 0;
-    struct stat st;
+    char name[NAME_MAX + 1];
 
-    if (snprintf(path, sizeof(path), "%s/driver", syspath) < 0) {
-        return NULL;
-    }
-    if (lstat(path, &st) < 0) {
-        return NULL;
-    }
-    len = readlink(path, path_target, sizeof(path_target));
-    if (len <= 0 || len == (ssize_t) sizeof(path_target)) {
+    if (sysfs_read_device_link_name(syspath, link, name, sizeof(name)) <= 0) {
         return NULL;
     }
-    path_target[len] = '\0';
+    return strdup(name);
+}
 
-    if (*path_target == '\0') {
-        return NULL;
-    }
-    pbname = basename(path_target);
-    if (pbname != NULL && *pbname != '\0') {
-        driver = strdup(pbname);
-        if (driver == NULL) {
-            return NULL;
-        } else {
-            return driver;
-        }
-    } else {
-        return NULL;
-    }
+/* From a sysfs device path, return the module name, or NULL */
+char *sysfs_read_device_module(const char *syspath)
+{
+    return sysfs_read_device_link_dup(syspath, "driver/module");
+}
+
+/* From a sysfs device path, return the driver name, or NULL */
+char *sysfs_read_device_driver(const char *syspath)
+{
+    return sysfs_read_device_link_dup(syspath, "driver");
 }
 
 /* From a sysfs device path, return the subsystem name, or NULL */
 char *sysfs_read_device_subsystem(const char *syspath)
 {
-    char path[PATH_MAX];
-    char path_target[PATH_MAX];
-    char *subsystem = NULL;
-    char *pbname = NULL;
-    ssize_t len = 0;
-    struct stat st;
-
-    if (snprintf(path, sizeof(path), "%s/subsystem", syspath) < 0) {
-        return NULL;
-    }
-    if (lstat(path, &st) < 0) {
-        return NULL;
-    }
-    len = readlink(path, path_target, sizeof(path_target));
-    if (len <= 0 || len == (ssize_t) sizeof(path_target)) {
-        return NULL;
-    }
-    path_target[len] = '\0';
-    if (*path_target == '\0') {
-        return NULL;
-    }
-    pbname = basename(path_target);
-    if (pbname != NULL && *pbname != '\0') {
-        subsystem = strdup(pbname);
-        if (subsystem == NULL) {
-            return NULL;
-        } else {
-            return subsystem;
-        }
-    } else {
-        return NULL;
-    }
+    return sysfs_read_device_link_dup(syspath, "subsystem");
 }
-
@@ -29,6 +29,29 @@ extern int init_sysfs(void);
  */
 extern char *sysfs_read_attr(const char *syspath, const char *attr);
 
+/**
+ * Read an attribute from sysfs into a caller supplied buffer
+ * This function will read out the first line up to '\n' or '\0'
+ * @param syspath path to read from.
+ * @param attr attribute name to read from within 'syspath' path.
+ * @param buf buffer receiving the NUL terminated value
+ * @param size size of buf
+ * @return negative errno on failure else the length of the value.
+ */
+extern ssize_t sysfs_read_attr_buf(const char *syspath, const char *attr,
+        char *buf, size_t size);
+
+/**
+ * Read a binary attribute from sysfs, such as a firmware property
+ * @param syspath path to read from.
+ * @param attr attribute name to read from within 'syspath' path.
+ * @param buf buffer receiving the value as it is
+ * @param size size of buf
+ * @return negative errno on failure else the number of bytes read.
+ */
+extern ssize_t sysfs_read_attr_raw(const char *syspath, const char *attr,
+        void *buf, size_t size);
+
 /**
  * write up to size bytes from buffer to the file named filename.
  * The data in buffer is not necessarily a character string,
@@ -68,6 +91,17 @@ extern struct stat *sysfs_read_stats(const char *syspath, const char *attr);
  */
 extern char *sysfs_read_link(const char *syspath, const char *attr);
 
+/**
+ * Read the last path component a device link (e.g. "driver") points to
+ * @param syspath device path to read from.
+ * @param link link name within 'syspath' path.
+ * @param buf buffer receiving the NUL terminated name
+ * @param size size of buf
+ * @return negative errno on failure else the length of the name.
+ */
+extern ssize_t sysfs_read_device_link_name(const char *syspath, const char *link,
+        char *buf, size_t size);
+
 /**
  * Read a device's module from sysfs
  * @param device path to read from.
@@ -0,0 +1,231 @@
+/**
+ * @file topology.c
+ * @copyright Violin Memory, Inc, 2014
+ *
+ * @brief Flattened read-only copy of the bus tree.
+ *
+ * The linked adapter and chip lists are scattered over the heap and every
+ * traversal chases their pointers. After each change the tree is copied into
+ * a handful of contiguous arrays in depth first order, so a subtree is an
+ * index range and the chips of an adapter are a slice of the chip arrays.
+ * The linked tree stays the master copy, this one is rebuilt lazily.
+ */
+
+#define _GNU_SOURCE 1
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include <sys/queue.h>
+
+#include "common.h"
+#include "data.h"
+#include "topology.h"
+
+#include "i2c-error.h"
+#include "i2cdiscov.h"
+
+static dev_topology topology;
+static void *topology_block = NULL;
+static bool topology_valid = false;
+static unsigned long topology_serial = 0;
+
+void dev_topology_invalidate(void)
+{
+    topology_valid = false;
+}
+
+void dev_topology_release(void)
+{
+    free(topology_block);
+    topology_block = NULL;
+    memset(&topology, 0, sizeof(topology));
+    topology_valid = false;
+}
+
+static int topology_compare_nr(const void *p1, const void *p2)
+{
+    const dev_bus_adapter * const dev1 = *(const dev_bus_adapter * const *) p1;
+    const dev_bus_adapter * const dev2 = *(const dev_bus_adapter * const *) p2;
+
+    return (dev1->nr > dev2->nr) - (dev1->nr < dev2->nr);
+}
+
+/**
+ * Count the adapters and chips reachable from a list of roots
+ * @param head
+ * @param adapters
+ * @param chips
+ */
+static void topology_count(const dev_bus_adapter_head *head, int *adapters, int *chips)
+{
+    const dev_bus_adapter *dev = NULL;
+    const dev_chip *chip = NULL;
+
+    LIST_FOREACH(dev, head, node) {
+        (*adapters)++;
+        SLIST_FOREACH(chip, &dev->clients, node) {
+            (*chips)++;
+        }
+        topology_count(&dev->children, adapters, chips);
+    }
+}
+
+/**
+ * Copy a list of siblings and their subtrees into the topology
+ * @param topo
+ * @param head
+ * @param parent index of the parent adapter or TOPOLOGY_NONE
+ * @param depth
+ * @param next next free adapter index
+ * @param next_chip next free chip index
+ */
+static void topology_fill(dev_topology *topo, const dev_bus_adapter_head *head,
+        int parent, int depth, int *next, int *next_chip)
+{
+    dev_bus_adapter *dev = NULL;
+    dev_chip *chip = NULL;
+    int prev = TOPOLOGY_NONE;
+
+    LIST_FOREACH(dev, head, node) {
+        int i = (*next)++;
+
+        topo->adapter[i] = dev;
+        topo->nr[i] = dev->nr;
+        topo->parent[i] = parent;
+        topo->first_child[i] = TOPOLOGY_NONE;
+        topo->next_sibling[i] = TOPOLOGY_NONE;
+        topo->depth[i] = depth;
+        if (prev != TOPOLOGY_NONE) {
+            topo->next_sibling[prev] = i;
+        } else if (parent != TOPOLOGY_NONE) {
+            topo->first_child[parent] = i;
+        }
+        prev = i;
+
+        topo->first_chip[i] = *next_chip;
+        SLIST_FOREACH(chip, &dev->clients, node) {
+            int c = (*next_chip)++;
+
+            topo->chip[c] = chip;
+            topo->chip_addr[c] = chip->addr;
+            topo->chip_adapter[c] = i;
+        }
+        topology_fill(topo, &dev->children, i, depth + 1, next, next_chip);
+        topo->subtree_end[i] = *next;
+    }
+}
+
+/**
+ * Hand out an array from the topology block
+ * @param pos offset into the block, advanced past the array
+ * @param size
+ * @return the array
+ */
+static void *topology_carve(size_t *pos, size_t size)
+{
+    void *array = (char *) topology_block + *pos;
+
+    *pos += (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    return array;
+}
+
+static int topology_build(void)
+{
+    dev_topology topo;
+    size_t ints = 0;
+    size_t size = 0;
+    size_t pos = 0;
+    int next = 0;
+    int next_chip = 0;
+
+    memset(&topo, 0, sizeof(topo));
+    if (dev_bus_list_headp == NULL) {
+        return -ENODEV;
+    }
+    topology_count(dev_bus_list_headp, &topo.adapter_count, &topo.chip_count);
+    topo.global_count = adapter_global_count;
+
+    /* all arrays live in one block */
+    ints = (size_t) topo.adapter_count * 7 + 1 + (size_t) topo.chip_count * 2
+            + topo.global_count;
+    size = ((size_t) topo.adapter_count + topo.chip_count) * sizeof(void *)
+            + ints * sizeof(int) + 16 * sizeof(void *);
+
+    free(topology_block);
+    topology_block = calloc(1, size);
+    if (topology_block == NULL) {
+        memset(&topology, 0, sizeof(topology));
+        return -ENOMEM;
+    }
+    topo.adapter = topology_carve(&pos, topo.adapter_count * sizeof(*topo.adapter));
+    topo.chip = topology_carve(&pos, topo.chip_count * sizeof(*topo.chip));
+    topo.nr = topology_carve(&pos, topo.adapter_count * sizeof(int));
+    topo.parent = topology_carve(&pos, topo.adapter_count * sizeof(int));
+    topo.first_child = topology_carve(&pos, topo.adapter_count * sizeof(int));
+    topo.next_sibling = topology_carve(&pos, topo.adapter_count * sizeof(int));
+    topo.subtree_end = topology_carve(&pos, topo.adapter_count * sizeof(int));
+    topo.depth = topology_carve(&pos, topo.adapter_count * sizeof(int));
+    topo.first_chip = topology_carve(&pos, (topo.adapter_count + 1) * sizeof(int));
+    topo.chip_addr = topology_carve(&pos, topo.chip_count * sizeof(int));
+    topo.chip_adapter = topology_carve(&pos, topo.chip_count * sizeof(int));
+    topo.by_global = topology_carve(&pos, topo.global_count * sizeof(int));
+
+    topology_fill(&topo, dev_bus_list_headp, TOPOLOGY_NONE, 0, &next, &next_chip);
+    topo.first_chip[topo.adapter_count] = next_chip;
+
+    /* adapter_global_array is sorted by nr, so are the nrs looked up in it */
+    for (size_t g = 0; g < topo.global_count; ++g) {
+        topo.by_global[g] = TOPOLOGY_NONE;
+    }
+    for (int i = 0; i < topo.adapter_count; ++i) {
+        dev_bus_adapter **p_match = NULL;
+
+        p_match = bsearch(&topo.adapter[i], adapter_global_array, topo.global_count,
+                sizeof(*adapter_global_array), topology_compare_nr);
+        if (p_match != NULL) {
+            topo.by_global[p_match - adapter_global_array] = i;
+        }
+    }
+
+    topo.serial = ++topology_serial;
+    topology = topo;
+    if (i2c_dev_verbose > 2) {
+        devi2c_debug(NULL, "flattened bus tree: %d adapters, %d chips",
+                topo.adapter_count, topo.chip_count);
+    }
+    return 0;
+}
+
+const dev_topology *dev_topology_get(void)
+{
+    if (!topology_valid) {
+        if (topology_build() < 0) {
+            return NULL;
+        }
+        topology_valid = true;
+    }
+    return &topology;
+}
+
+unsigned long dev_topology_serial(void)
+{
+    return topology_valid ? topology.serial : 0;
+}
+
+int dev_topology_adapter_index(const dev_topology *topo, const dev_bus_adapter *adapter)
+{
+    dev_bus_adapter **p_match = NULL;
+
+    if ((topo == NULL) || (adapter == NULL) || (topo->global_count == 0)) {
+        return TOPOLOGY_NONE;
+    }
+    p_match = bsearch(&adapter, adapter_global_array, topo->global_count,
+            sizeof(*adapter_global_array), topology_compare_nr);
+    if ((p_match == NULL) || (*p_match != adapter)) {
+        return TOPOLOGY_NONE;
+    }
+    return topo->by_global[p_match - adapter_global_array];
+}
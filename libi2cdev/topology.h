@@ -0,0 +1,78 @@
+/**
+ * @file topology.h
+ * @copyright Violin Memory, Inc, 2014
+ * @brief Flattened read-only copy of the bus tree for traversals and lookups
+ */
+
+#ifndef LIB_TOPOLOGY_H
+#define LIB_TOPOLOGY_H
+
+#include <stddef.h>
+#include "busses.h"
+
+#define TOPOLOGY_NONE   (-1)
+
+/*
+ * The adapters of the bus tree in depth first order with index based links,
+ * followed by their chips grouped per adapter in the order of the clients
+ * list. The subtree of adapter i is the index range [i, subtree_end[i]),
+ * its chips are [first_chip[i], first_chip[i + 1]).
+ * Adapters which could not be linked below their parent are left out,
+ * just like in a walk of the linked tree.
+ */
+typedef struct dev_topology {
+    unsigned long serial; /* changes every time the topology is built */
+    int adapter_count;
+    int chip_count;
+
+    /* per adapter, in depth first order */
+    dev_bus_adapter **adapter;
+    int *nr;
+    int *parent;
+    int *first_child;
+    int *next_sibling;
+    int *subtree_end;
+    int *depth;
+    int *first_chip; /* adapter_count + 1 entries */
+
+    /* per chip */
+    dev_chip **chip;
+    int *chip_addr;
+    int *chip_adapter;
+
+    /* depth first index of adapter_global_array[i], or TOPOLOGY_NONE */
+    int *by_global;
+    size_t global_count;
+} dev_topology;
+
+/**
+ * Get the flattened topology of the current bus tree,
+ * it is built again after the tree changed.
+ * @return the topology or NULL if it couldn't be built
+ */
+extern const dev_topology *dev_topology_get(void);
+
+/**
+ * @return the serial of the current topology, or zero if it is stale
+ * and will be built again by the next dev_topology_get()
+ */
+extern unsigned long dev_topology_serial(void);
+
+/**
+ * Mark the topology stale, call whenever adapters or chips are added or removed
+ */
+extern void dev_topology_invalidate(void);
+
+/**
+ * Free the topology
+ */
+extern void dev_topology_release(void);
+
+/**
+ * @param topo
+ * @param adapter
+ * @return the depth first index of an adapter or TOPOLOGY_NONE
+ */
+extern int dev_topology_adapter_index(const dev_topology *topo, const dev_bus_adapter *adapter);
+
+#endif /* !LIB_TOPOLOGY_H */
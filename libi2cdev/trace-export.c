@@ -0,0 +1,322 @@
+/**
+ * @file trace-export.c
+ * @copyright Violin Memory, Inc, 2014
+ *
+ * @brief Export of transactions in the Chrome trace event format.
+ *
+ * A post hook in its own tracer slot turns each transaction into a
+ * complete ("X") event and appends it to a buffer under a lock, written
+ * out whenever it fills up. The process of an event is the physical bus,
+ * the first element of the adapter path, and its thread the adapter, so
+ * chrome://tracing and Perfetto draw one track per bus and mux channel
+ * and show where a bus sits idle, and where transactions on channels of
+ * the same bus wait for each other. Tracks are named by metadata events
+ * the first time they are used.
+ */
+
+#define _GNU_SOURCE 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <linux/i2c.h>
+
+#include <busses.h>
+#include <libi2cdev.h>
+
+#include "common.h"
+#include "stats.h"
+#include "syscalls.h"
+
+#define EXPORT_BUFFER_SIZE  (64 * 1024)
+#define EXPORT_EVENT_MAX    512     /* room kept for one event */
+#define EXPORT_TRACK_NONE   100000  /* tracks of paths without a bus or adapter number */
+
+/* a path seen, with its track */
+typedef struct export_track {
+    char *path;
+    int pid;
+    int tid;
+} export_track;
+
+/* the export under way */
+static struct {
+    pthread_mutex_t lock;
+    int fd;                     /* -1 when not exporting */
+    int err;                    /* first write error */
+    char *buf;
+    size_t len;
+    uint64_t start_ns;
+    uint64_t count;
+    bool empty;                 /* no event written yet */
+    export_track *tracks;
+    uint32_t track_count;
+    uint32_t track_max;
+    uint32_t last_track;
+} exporter = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .fd = -1,
+};
+
+static void export_flush(void)
+{
+    int err = 0;
+
+    if (exporter.len == 0) {
+        return;
+    }
+    err = dev_sys_write_all(exporter.fd, exporter.buf, exporter.len);
+    if ((err < 0) && (exporter.err == 0)) {
+        exporter.err = err;
+    }
+    exporter.len = 0;
+}
+
+static void export_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/* events are short, anything longer than EXPORT_EVENT_MAX is cut */
+static void export_printf(const char *fmt, ...)
+{
+    va_list ap;
+    int len = 0;
+
+    if (exporter.len + EXPORT_EVENT_MAX > EXPORT_BUFFER_SIZE) {
+        export_flush();
+    }
+    va_start(ap, fmt);
+    len = vsnprintf(exporter.buf + exporter.len, EXPORT_EVENT_MAX, fmt, ap);
+    va_end(ap);
+    if (len > 0) {
+        exporter.len += (len < EXPORT_EVENT_MAX) ? (size_t) len : EXPORT_EVENT_MAX - 1;
+    }
+}
+
+/* separator to put before an event, the array has no trailing comma */
+static const char *export_sep(void)
+{
+    if (exporter.empty) {
+        exporter.empty = false;
+        return "";
+    }
+    return ",";
+}
+
+/* adapter paths are digits, dots and colons, anything else is dropped */
+static void export_path_name(char *name, size_t size, const char *path)
+{
+    size_t len = 0;
+
+    for (; (*path != '\0') && (len + 1 < size); ++path) {
+        if ((*path != '"') && (*path != '\\') && ((unsigned char) *path >= ' ')) {
+            name[len++] = *path;
+        }
+    }
+    name[len] = '\0';
+}
+
+/**
+ * @param path
+ * @param adapter_nr
+ * @return the track of the path, named in the export the first time, or
+ * NULL if out of memory
+ */
+static const export_track *export_track_get(const char *path, int adapter_nr)
+{
+    char name[I2C_ADAPT_PATH_SIZE];
+    export_track *track = NULL;
+    uint32_t i = exporter.last_track;
+    bool new_pid = true;
+    char *end = NULL;
+    long root = 0;
+
+    if ((i < exporter.track_count) && !strcmp(exporter.tracks[i].path, path)) {
+        return &exporter.tracks[i];
+    }
+    for (i = 0; i < exporter.track_count; ++i) {
+        if (!strcmp(exporter.tracks[i].path, path)) {
+            exporter.last_track = i;
+            return &exporter.tracks[i];
+        }
+    }
+
+    if (i == exporter.track_max) {
+        uint32_t max = exporter.track_max ? 2 * exporter.track_max : 16;
+        export_track *tracks = realloc(exporter.tracks, max * sizeof(*tracks));
+
+        if (tracks == NULL) {
+            return NULL;
+        }
+        exporter.tracks = tracks;
+        exporter.track_max = max;
+    }
+    track = &exporter.tracks[i];
+    track->path = strdup(path);
+    if (track->path == NULL) {
+        return NULL;
+    }
+    /* the physical bus is the root of the path, "0" of "0:0.2" */
+    root = strtol(path, &end, 10);
+    track->pid = ((end != path) && ((*end == ':') || (*end == '\0')) && (root >= 0)
+            && (root < EXPORT_TRACK_NONE)) ? (int) root : EXPORT_TRACK_NONE + (int) i;
+    track->tid = (adapter_nr >= 0) ? adapter_nr : EXPORT_TRACK_NONE + (int) i;
+    for (uint32_t j = 0; j < i; ++j) {
+        new_pid &= (exporter.tracks[j].pid != track->pid);
+    }
+    exporter.track_count++;
+    exporter.last_track = i;
+
+    export_path_name(name, sizeof(name), path);
+    if (new_pid && (track->pid < EXPORT_TRACK_NONE)) {
+        export_printf("%s\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+                "\"args\":{\"name\":\"i2c bus %d\"}}", export_sep(), track->pid, track->pid);
+    } else if (new_pid) {
+        export_printf("%s\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+                "\"args\":{\"name\":\"i2c bus %s\"}}", export_sep(), track->pid, name);
+    }
+    if (adapter_nr >= 0) {
+        export_printf("%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                "\"args\":{\"name\":\"%s (i2c-%d)\"}}", export_sep(), track->pid, track->tid,
+                name, adapter_nr);
+    } else {
+        export_printf("%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                "\"args\":{\"name\":\"%s\"}}", export_sep(), track->pid, track->tid, name);
+    }
+    return track;
+}
+
+static void export_post(const struct dev_i2c_trace_event *event, void *arg)
+{
+    const export_track *track = NULL;
+    uint64_t start = 0;
+    uint64_t duration = event->end_ns - event->start_ns;
+
+    (void) arg;
+
+    pthread_mutex_lock(&exporter.lock);
+    if (exporter.fd < 0) { /* stopped since the transaction began */
+        goto exit_unlock;
+    }
+    track = export_track_get((event->path != NULL) ? event->path : "", event->adapter_nr);
+    if (track == NULL) {
+        if (exporter.err == 0) {
+            exporter.err = -ENOMEM;
+        }
+        goto exit_unlock;
+    }
+
+    start = (event->start_ns > exporter.start_ns) ? event->start_ns - exporter.start_ns : 0;
+    export_printf("%s\n{\"name\":\"%s\",\"cat\":\"i2c\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+            "\"ts\":%llu.%03u,\"dur\":%llu.%03u,%s\"args\":{\"addr\":\"0x%02x\","
+            "\"dir\":\"%s\",\"command\":%d,\"length\":%u,\"result\":%d}}",
+            export_sep(), dev_i2c_op_name(event->op), track->pid, track->tid,
+            (unsigned long long) (start / 1000), (unsigned) (start % 1000),
+            (unsigned long long) (duration / 1000), (unsigned) (duration % 1000),
+            (event->result < 0) ? "\"cname\":\"terrible\"," : "",
+            event->addr, (event->read_write == I2C_SMBUS_READ) ? "read" : "write",
+            event->command, event->length, event->result);
+    exporter.count++;
+
+exit_unlock:
+    pthread_mutex_unlock(&exporter.lock);
+}
+
+static void export_release(void)
+{
+    for (uint32_t i = 0; i < exporter.track_count; ++i) {
+        free(exporter.tracks[i].path);
+    }
+    free(exporter.tracks);
+    exporter.tracks = NULL;
+    exporter.track_count = 0;
+    exporter.track_max = 0;
+    free(exporter.buf);
+    exporter.buf = NULL;
+    exporter.len = 0;
+    if (exporter.fd >= 0) {
+        dev_sys_close(exporter.fd);
+    }
+    exporter.fd = -1;
+}
+
+int dev_i2c_trace_export_start(const char *file)
+{
+    int err = 0;
+
+    if (file == NULL) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&exporter.lock);
+    if (exporter.fd >= 0) {
+        pthread_mutex_unlock(&exporter.lock);
+        return -EBUSY;
+    }
+
+    exporter.err = 0;
+    exporter.count = 0;
+    exporter.last_track = 0;
+    exporter.buf = malloc(EXPORT_BUFFER_SIZE);
+    if (exporter.buf == NULL) {
+        err = -ENOMEM;
+        goto exit_release;
+    }
+    exporter.fd = dev_sys_open(file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (exporter.fd < 0) {
+        err = -errno;
+        goto exit_release;
+    }
+
+    exporter.start_ns = dev_i2c_stats_clock();
+    exporter.empty = true;
+    export_printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    err = dev_i2c_trace_attach(DEV_I2C_TRACE_EXPORTER, NULL, export_post, NULL);
+    if (err < 0) {
+        goto exit_release;
+    }
+    pthread_mutex_unlock(&exporter.lock);
+
+    devi2c_debug(NULL, "exporting transactions to %s", file);
+    return 0;
+
+exit_release:
+    export_release();
+    pthread_mutex_unlock(&exporter.lock);
+    return err;
+}
+
+int dev_i2c_trace_export_stop(void)
+{
+    int err = 0;
+
+    dev_i2c_trace_attach(DEV_I2C_TRACE_EXPORTER, NULL, NULL, NULL);
+
+    pthread_mutex_lock(&exporter.lock);
+    if (exporter.fd < 0) {
+        pthread_mutex_unlock(&exporter.lock);
+        return -EINVAL;
+    }
+    export_printf("\n]}\n");
+    export_flush();
+    if ((dev_sys_close(exporter.fd) < 0) && (exporter.err == 0)) {
+        exporter.err = -errno;
+    }
+    exporter.fd = -1;
+    err = exporter.err;
+    if (err == 0) {
+        err = (exporter.count > INT32_MAX) ? INT32_MAX : (int) exporter.count;
+    } else {
+        devi2c_debug(NULL, "lost events of the export - %s", strerror(-err));
+    }
+    export_release();
+    pthread_mutex_unlock(&exporter.lock);
+    return err;
+}
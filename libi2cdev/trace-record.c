@@ -0,0 +1,646 @@
+/**
+ * @file trace-record.c
+ * @copyright Violin Memory, Inc, 2014
+ *
+ * @brief Recording of transactions to a binary trace file, and their replay.
+ *
+ * The recorder is a post hook in its own tracer slot: each transaction,
+ * with the bytes it wrote and read, is appended to a buffer under a lock
+ * and the buffer is written out whenever it fills up. Adapter paths are
+ * written once, the first time one is seen, and referred to by number.
+ *
+ * The replay walks a trace and passes each transaction through the same
+ * accounting as a real one, on stand-in adapters and clients which open
+ * no device, while a backend answers in place of the kernel: by default
+ * a mock giving back what was recorded, optionally at the recorded pace.
+ */
+
+#define _GNU_SOURCE 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <linux/i2c.h>
+
+#include <busses.h>
+#include <libi2cdev.h>
+
+#include "common.h"
+#include "stats.h"
+#include "syscalls.h"
+
+#define TRACE_MAGIC         0x54433249 /* "I2CT" */
+#define TRACE_VERSION       1
+
+#define TRACE_OP_PATH       0xff    /* record naming an adapter path */
+#define TRACE_DATA_MAX      4096    /* longer data is cut short */
+#define TRACE_BUFFER_SIZE   (64 * 1024)
+
+#define REPLAY_ADDR_MAX     0x400   /* 10 bit addresses included */
+
+#define TRACE_ALIGN(len)    (((len) + 7) & ~(size_t) 7)
+
+/*
+ * File layout:
+ *  trace_header
+ *  trace_record, followed by its write then read data, padded to 8 bytes,
+ *  repeated until the end of the file
+ *
+ * A record with op TRACE_OP_PATH comes before the first use of a path: it
+ * gives the number of the path in path, the adapter number in result and
+ * the path, nul included, as its write data.
+ */
+typedef struct trace_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t start_ns;          /* CLOCK_MONOTONIC when recording started */
+    int64_t start_realtime_sec; /* and CLOCK_REALTIME */
+    int64_t start_realtime_nsec;
+    uint64_t record_count;      /* transactions, zero if recording never stopped */
+    uint32_t path_count;
+    uint32_t reserved;
+} trace_header;
+
+typedef struct trace_record {
+    uint64_t start_ns;          /* since the start of the recording */
+    uint32_t duration_ns;
+    int32_t result;
+    uint16_t path;
+    uint16_t addr;
+    int16_t command;
+    uint8_t op;
+    uint8_t read_write;
+    uint16_t length;
+    uint16_t write_len;
+    uint16_t read_len;
+    uint16_t reserved;
+} trace_record;
+
+/* the recording under way */
+static struct {
+    pthread_mutex_t lock;
+    int fd;                     /* -1 when not recording */
+    int err;                    /* first write error */
+    uint8_t *buf;
+    size_t len;
+    trace_header header;
+    char **paths;
+    uint32_t paths_max;
+    uint32_t last_path;
+} recorder = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .fd = -1,
+};
+
+static void record_flush(void)
+{
+    int err = 0;
+
+    if (recorder.len == 0) {
+        return;
+    }
+    err = dev_sys_write_all(recorder.fd, recorder.buf, recorder.len);
+    if ((err < 0) && (recorder.err == 0)) {
+        recorder.err = err;
+    }
+    recorder.len = 0;
+}
+
+static void record_append(const trace_record *rec, const uint8_t *write_data,
+        const uint8_t *read_data)
+{
+    size_t size = sizeof(*rec) + TRACE_ALIGN((size_t) rec->write_len + rec->read_len);
+    uint8_t *pos = NULL;
+
+    if (recorder.len + size > TRACE_BUFFER_SIZE) {
+        record_flush();
+    }
+    pos = recorder.buf + recorder.len;
+    memcpy(pos, rec, sizeof(*rec));
+    pos += sizeof(*rec);
+    if (rec->write_len > 0) {
+        memcpy(pos, write_data, rec->write_len);
+        pos += rec->write_len;
+    }
+    if (rec->read_len > 0) {
+        memcpy(pos, read_data, rec->read_len);
+        pos += rec->read_len;
+    }
+    memset(pos, 0, recorder.buf + recorder.len + size - pos);
+    recorder.len += size;
+}
+
+/**
+ * @param path
+ * @param adapter_nr
+ * @return number of the path, written to the trace the first time, or
+ * negative errno
+ */
+static int record_path(const char *path, int adapter_nr)
+{
+    trace_record rec;
+    uint32_t i = recorder.last_path;
+
+    if ((i < recorder.header.path_count) && !strcmp(recorder.paths[i], path)) {
+        return (int) i;
+    }
+    for (i = 0; i < recorder.header.path_count; ++i) {
+        if (!strcmp(recorder.paths[i], path)) {
+            recorder.last_path = i;
+            return (int) i;
+        }
+    }
+
+    if (i > UINT16_MAX) {
+        return -ENOSPC;
+    }
+    if (i == recorder.paths_max) {
+        uint32_t max = recorder.paths_max ? 2 * recorder.paths_max : 16;
+        char **paths = realloc(recorder.paths, max * sizeof(*paths));
+
+        if (paths == NULL) {
+            return -ENOMEM;
+        }
+        recorder.paths = paths;
+        recorder.paths_max = max;
+    }
+    recorder.paths[i] = strdup(path);
+    if (recorder.paths[i] == NULL) {
+        return -ENOMEM;
+    }
+    recorder.header.path_count++;
+    recorder.last_path = i;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.op = TRACE_OP_PATH;
+    rec.path = (uint16_t) i;
+    rec.result = adapter_nr;
+    rec.write_len = (uint16_t) (strlen(path) + 1);
+    record_append(&rec, (const uint8_t *) path, NULL);
+    return (int) i;
+}
+
+static void record_post(const struct dev_i2c_trace_event *event, void *arg)
+{
+    trace_record rec;
+    uint64_t duration = event->end_ns - event->start_ns;
+    int path = 0;
+
+    (void) arg;
+
+    pthread_mutex_lock(&recorder.lock);
+    /* a transaction begun before recording stopped may still end here */
+    if (recorder.fd < 0) {
+        goto exit_unlock;
+    }
+    path = record_path((event->path != NULL) ? event->path : "", event->adapter_nr);
+    if (path < 0) {
+        if (recorder.err == 0) {
+            recorder.err = path;
+        }
+        goto exit_unlock;
+    }
+
+    memset(&rec, 0, sizeof(rec));
+    rec.start_ns = (event->start_ns > recorder.header.start_ns)
+            ? event->start_ns - recorder.header.start_ns : 0;
+    rec.duration_ns = (duration > UINT32_MAX) ? UINT32_MAX : (uint32_t) duration;
+    rec.result = event->result;
+    rec.path = (uint16_t) path;
+    rec.addr = event->addr;
+    rec.command = (int16_t) event->command;
+    rec.op = (uint8_t) event->op;
+    rec.read_write = (uint8_t) event->read_write;
+    rec.length = (event->length > UINT16_MAX) ? UINT16_MAX : (uint16_t) event->length;
+    if (event->write_data != NULL) {
+        rec.write_len = (event->write_len > TRACE_DATA_MAX) ? TRACE_DATA_MAX : event->write_len;
+    }
+    if (event->read_data != NULL) {
+        rec.read_len = (event->read_len > TRACE_DATA_MAX) ? TRACE_DATA_MAX : event->read_len;
+    }
+    record_append(&rec, event->write_data, event->read_data);
+    recorder.header.record_count++;
+
+exit_unlock:
+    pthread_mutex_unlock(&recorder.lock);
+}
+
+static void record_release(void)
+{
+    for (uint32_t i = 0; i < recorder.header.path_count; ++i) {
+        free(recorder.paths[i]);
+    }
+    free(recorder.paths);
+    recorder.paths = NULL;
+    recorder.paths_max = 0;
+    free(recorder.buf);
+    recorder.buf = NULL;
+    recorder.len = 0;
+    if (recorder.fd >= 0) {
+        dev_sys_close(recorder.fd);
+    }
+    recorder.fd = -1;
+}
+
+int dev_i2c_trace_record_start(const char *file)
+{
+    struct timespec now;
+    int err = 0;
+
+    if (file == NULL) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&recorder.lock);
+    if (recorder.fd >= 0) {
+        pthread_mutex_unlock(&recorder.lock);
+        return -EBUSY;
+    }
+
+    memset(&recorder.header, 0, sizeof(recorder.header));
+    recorder.err = 0;
+    recorder.last_path = 0;
+    recorder.buf = malloc(TRACE_BUFFER_SIZE);
+    if (recorder.buf == NULL) {
+        err = -ENOMEM;
+        goto exit_release;
+    }
+    recorder.fd = dev_sys_open(file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (recorder.fd < 0) {
+        err = -errno;
+        goto exit_release;
+    }
+
+    recorder.header.magic = TRACE_MAGIC;
+    recorder.header.version = TRACE_VERSION;
+    recorder.header.start_ns = dev_i2c_stats_clock();
+    dev_sys_clock_gettime(CLOCK_REALTIME, &now);
+    recorder.header.start_realtime_sec = now.tv_sec;
+    recorder.header.start_realtime_nsec = now.tv_nsec;
+    memcpy(recorder.buf, &recorder.header, sizeof(recorder.header));
+    recorder.len = sizeof(recorder.header);
+
+    err = dev_i2c_trace_attach(DEV_I2C_TRACE_RECORDER, NULL, record_post, NULL);
+    if (err < 0) {
+        goto exit_release;
+    }
+    pthread_mutex_unlock(&recorder.lock);
+
+    devi2c_debug(NULL, "recording transactions to %s", file);
+    return 0;
+
+exit_release:
+    record_release();
+    pthread_mutex_unlock(&recorder.lock);
+    return err;
+}
+
+int dev_i2c_trace_record_stop(void)
+{
+    int err = 0;
+
+    dev_i2c_trace_attach(DEV_I2C_TRACE_RECORDER, NULL, NULL, NULL);
+
+    pthread_mutex_lock(&recorder.lock);
+    if (recorder.fd < 0) {
+        pthread_mutex_unlock(&recorder.lock);
+        return -EINVAL;
+    }
+    record_flush();
+    if ((recorder.err == 0)
+            && (dev_sys_pwrite(recorder.fd, &recorder.header, sizeof(recorder.header), 0)
+                    != sizeof(recorder.header))) {
+        recorder.err = -errno;
+    }
+    if ((dev_sys_close(recorder.fd) < 0) && (recorder.err == 0)) {
+        recorder.err = -errno;
+    }
+    recorder.fd = -1;
+    err = recorder.err;
+    if (err == 0) {
+        err = (recorder.header.record_count > INT32_MAX)
+                ? INT32_MAX : (int) recorder.header.record_count;
+    } else {
+        devi2c_debug(NULL, "lost records of the trace - %s", strerror(-err));
+    }
+    record_release();
+    pthread_mutex_unlock(&recorder.lock);
+    return err;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* an adapter path of the trace being replayed, with its stand-in clients */
+typedef struct replay_path {
+    SMBusAdapter adapter;
+    char path[I2C_ADAPT_PATH_SIZE];
+    SMBusDevice **clients; /* by address, allocated on first use */
+} replay_path;
+
+typedef struct replay {
+    replay_path **paths;
+    uint32_t path_count;
+} replay;
+
+static int replay_add_path(replay *r, uint16_t nr, int adapter_nr, const char *path,
+        size_t len)
+{
+    replay_path *rp = NULL;
+
+    if ((len == 0) || (path[len - 1] != '\0')) {
+        return -EINVAL;
+    }
+    if (nr >= r->path_count) {
+        replay_path **paths = realloc(r->paths, (nr + 1) * sizeof(*paths));
+
+        if (paths == NULL) {
+            return -ENOMEM;
+        }
+        memset(paths + r->path_count, 0, (nr + 1 - r->path_count) * sizeof(*paths));
+        r->paths = paths;
+        r->path_count = nr + 1;
+    }
+    if (r->paths[nr] != NULL) {
+        return -EINVAL;
+    }
+
+    rp = calloc(1, sizeof(*rp));
+    if (rp == NULL) {
+        return -ENOMEM;
+    }
+    rp->clients = calloc(REPLAY_ADDR_MAX, sizeof(*rp->clients));
+    if (rp->clients == NULL) {
+        free(rp);
+        return -ENOMEM;
+    }
+    strncpy(rp->path, path, sizeof(rp->path) - 1);
+    rp->adapter.nr = adapter_nr;
+    rp->adapter.name = rp->path;
+    rp->adapter.fd = -1;
+    rp->adapter.prev_addr = -1;
+    r->paths[nr] = rp;
+    return 0;
+}
+
+static SMBusDevice *replay_client(replay *r, const trace_record *rec)
+{
+    replay_path *rp = NULL;
+    SMBusDevice *client = NULL;
+
+    if ((rec->path >= r->path_count) || (r->paths[rec->path] == NULL)
+            || (rec->addr >= REPLAY_ADDR_MAX)) {
+        return NULL;
+    }
+    rp = r->paths[rec->path];
+    client = rp->clients[rec->addr];
+    if (client == NULL) {
+        client = calloc(1, sizeof(*client));
+        if (client == NULL) {
+            return NULL;
+        }
+        client->addr = rec->addr;
+        snprintf(client->name, sizeof(client->name), "replay");
+        memcpy(client->path, rp->path, sizeof(client->path));
+        client->adapter = &rp->adapter;
+        rp->clients[rec->addr] = client;
+    }
+    return client;
+}
+
+static void replay_release(replay *r)
+{
+    for (uint32_t i = 0; i < r->path_count; ++i) {
+        replay_path *rp = r->paths[i];
+
+        if (rp == NULL) {
+            continue;
+        }
+        for (int addr = 0; addr < REPLAY_ADDR_MAX; ++addr) {
+            if (rp->clients[addr] != NULL) {
+                dev_i2c_stats_release(&rp->clients[addr]->latency);
+                free(rp->clients[addr]);
+            }
+        }
+        dev_i2c_stats_release(&rp->adapter.latency);
+        free(rp->clients);
+        free(rp);
+    }
+    free(r->paths);
+}
+
+/* waits shorter than this spin, a sleep would overshoot most of them */
+#define REPLAY_SPIN_NS      100000
+
+static void replay_sleep_until(uint64_t ns)
+{
+    uint64_t now = dev_i2c_stats_clock();
+
+    if (now + REPLAY_SPIN_NS < ns) {
+        struct timespec ts = {
+            .tv_sec = (ns - REPLAY_SPIN_NS) / 1000000000ULL,
+            .tv_nsec = (ns - REPLAY_SPIN_NS) % 1000000000ULL,
+        };
+
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+        }
+    }
+    while (dev_i2c_stats_clock() < ns) {
+    }
+}
+
+/* the default backend, answering what was recorded */
+static int32_t replay_mock(const struct dev_i2c_trace_event *event, uint8_t *read_data,
+        int flags)
+{
+    if (flags & DEV_I2C_REPLAY_REALTIME) {
+        replay_sleep_until(dev_i2c_stats_clock() + (event->end_ns - event->start_ns));
+    }
+    if (event->read_len > 0) {
+        memcpy(read_data, event->read_data, event->read_len);
+    }
+    return event->result;
+}
+
+/**
+ * Bytes read and written by a transaction, counted as smbus-dev.c does:
+ * with the command byte, and the count byte of block transfers
+ */
+static void replay_bytes(const trace_record *rec, uint32_t *read, uint32_t *written)
+{
+    bool block = (rec->op == DEV_I2C_OP_BLOCK_DATA) || (rec->op == DEV_I2C_OP_BLOCK_PROC_CALL);
+
+    *written = rec->write_len + (rec->command >= 0);
+    *read = rec->read_len;
+    if (block && (rec->read_write == I2C_SMBUS_WRITE)) {
+        *written += 1;
+    }
+    if (block && ((rec->read_write == I2C_SMBUS_READ) || (rec->op == DEV_I2C_OP_BLOCK_PROC_CALL))) {
+        *read += 1;
+    }
+}
+
+int dev_i2c_trace_replay(const char *file, const struct dev_i2c_replay_backend *backend,
+        int flags, struct dev_i2c_replay_stats *stats)
+{
+    struct dev_i2c_replay_stats total;
+    struct dev_i2c_trace_event event;
+    uint8_t read_data[TRACE_DATA_MAX];
+    const trace_header *header = NULL;
+    const uint8_t *map = NULL;
+    replay r = { NULL, 0 };
+    uint64_t recorded_first = 0;
+    uint64_t recorded_last = 0;
+    uint64_t replay_start = 0;
+    uint64_t replay_last = 0;
+    size_t size = 0;
+    size_t pos = 0;
+    struct stat st;
+    int fd = -1;
+    int err = 0;
+
+    if (file == NULL) {
+        return -EINVAL;
+    }
+
+    fd = dev_sys_open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+    if (dev_sys_fstat(fd, &st) < 0) {
+        err = -errno;
+        dev_sys_close(fd);
+        return err;
+    }
+    size = (size_t) st.st_size;
+    if (size < sizeof(*header)) {
+        dev_sys_close(fd);
+        return -EINVAL;
+    }
+    map = dev_sys_mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    dev_sys_close(fd);
+    if (map == MAP_FAILED) {
+        return -errno;
+    }
+    header = (const trace_header *) map;
+    if ((header->magic != TRACE_MAGIC) || (header->version != TRACE_VERSION)) {
+        err = -EINVAL;
+        goto exit_unmap;
+    }
+
+    memset(&total, 0, sizeof(total));
+    /* a trace cut short by a crash ends at its last whole record */
+    for (pos = sizeof(*header); pos + sizeof(trace_record) <= size; ) {
+        const trace_record *rec = (const trace_record *) (map + pos);
+        const uint8_t *write_data = (const uint8_t *) (rec + 1);
+        const uint8_t *recorded_read = write_data + rec->write_len;
+        size_t data_len = TRACE_ALIGN((size_t) rec->write_len + rec->read_len);
+        SMBusDevice *client = NULL;
+        dev_i2c_xfer xfer;
+        uint32_t read = 0;
+        uint32_t written = 0;
+        int32_t ret = 0;
+
+        if (pos + sizeof(*rec) + data_len > size) {
+            break;
+        }
+        pos += sizeof(*rec) + data_len;
+
+        if (rec->op == TRACE_OP_PATH) {
+            err = replay_add_path(&r, rec->path, rec->result, (const char *) write_data,
+                    rec->write_len);
+            if (err < 0) {
+                goto exit_release;
+            }
+            continue;
+        }
+        if ((rec->op >= DEV_I2C_OP_MAX) || (rec->read_len > TRACE_DATA_MAX)) {
+            err = -EINVAL;
+            goto exit_release;
+        }
+        client = replay_client(&r, rec);
+        if (client == NULL) {
+            err = ((rec->path < r.path_count) && (r.paths[rec->path] != NULL)
+                    && (rec->addr < REPLAY_ADDR_MAX)) ? -ENOMEM : -EINVAL;
+            goto exit_release;
+        }
+
+        if (total.transactions == 0) {
+            recorded_first = rec->start_ns;
+            replay_start = dev_i2c_stats_clock();
+        } else if (flags & DEV_I2C_REPLAY_REALTIME) {
+            replay_sleep_until(replay_start + (rec->start_ns - recorded_first));
+        }
+
+        event.adapter_nr = client->adapter->nr;
+        event.addr = rec->addr;
+        event.op = rec->op;
+        event.read_write = rec->read_write;
+        event.command = rec->command;
+        event.length = rec->length;
+        event.path = client->path;
+        event.write_data = write_data;
+        event.write_len = rec->write_len;
+        event.read_data = recorded_read;
+        event.read_len = rec->read_len;
+        event.result = rec->result;
+        event.start_ns = rec->start_ns;
+        event.end_ns = rec->start_ns + rec->duration_ns;
+
+        dev_i2c_op_begin(&xfer, client, event.op, event.read_write, event.command,
+                event.length);
+        dev_i2c_op_write(&xfer, write_data, rec->write_len);
+        if (backend != NULL) {
+            ret = backend->xfer(&event, read_data, backend->arg);
+        } else {
+            ret = replay_mock(&event, read_data, flags);
+        }
+        if (ret >= 0) {
+            dev_i2c_op_read(&xfer, read_data, rec->read_len);
+        }
+        replay_bytes(rec, &read, &written);
+        dev_i2c_op_end(&xfer, ret, read, written);
+
+        total.transactions++;
+        if (ret < 0) {
+            total.errors++;
+        }
+        if ((ret != rec->result)
+                || ((ret >= 0) && memcmp(read_data, recorded_read, rec->read_len))) {
+            total.mismatches++;
+        }
+        total.recorded_latency_ns += rec->duration_ns;
+        total.latency_ns += xfer.event.end_ns - xfer.event.start_ns;
+        if (event.end_ns > recorded_last) {
+            recorded_last = event.end_ns;
+        }
+        replay_last = xfer.event.end_ns;
+    }
+
+    if (total.transactions > 0) {
+        total.recorded_ns = recorded_last - recorded_first;
+        total.elapsed_ns = replay_last - replay_start;
+    }
+    if (stats != NULL) {
+        *stats = total;
+    }
+    devi2c_debug(NULL, "replayed %llu transactions from %s",
+            (unsigned long long) total.transactions, file);
+
+exit_release:
+    replay_release(&r);
+exit_unmap:
+    dev_sys_munmap((void *) map, size);
+    return err;
+}
@@ -0,0 +1,261 @@
+/**
+ * @file uevent.c
+ * @copyright Violin Memory, Inc, 2014
+ *
+ * @brief Kernel uevent monitor used to apply i2c adapter and client
+ * hot-plug events to the bus tree without a full rescan.
+ */
+
+#define _GNU_SOURCE 1
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <linux/netlink.h>
+
+#include "common.h"
+#include "data.h"
+#include "syscalls.h"
+
+#include "i2c-error.h"
+#include "i2c-dev-parser.h"
+
+/* The kernel emits uevents on the first multicast group */
+#define UEVENT_KERNEL_GROUP     1
+#define UEVENT_BUFFER_SIZE      8192
+#define UEVENT_RCVBUF_SIZE      (1024 * 1024)
+
+static int uevent_fd = -1;
+
+typedef struct i2c_uevent {
+    const char *action;
+    const char *devpath;
+    const char *subsystem;
+    const char *devtype;
+} i2c_uevent;
+
+/**
+ * Split a raw uevent message into the keys libi2cdev cares about
+ * @param[in] buf message buffer ("action@devpath\0KEY=value\0...")
+ * @param[in] len message length
+ * @param[out] event parsed event
+ * @return negative errno on failure else zero on success
+ */
+static int uevent_parse(const char *buf, size_t len, i2c_uevent *event)
+{
+    const char *pos = buf;
+    const char *end = buf + len;
+
+    memset(event, 0, sizeof(*event));
+
+    /* skip the "action@devpath" header */
+    if (memchr(buf, '@', strnlen(buf, len)) == NULL) {
+        return -EINVAL;
+    }
+    pos += strnlen(pos, end - pos) + 1;
+
+    while (pos < end) {
+        size_t keylen = strnlen(pos, end - pos);
+
+        if (!strncmp(pos, "ACTION=", 7)) {
+            event->action = pos + 7;
+        } else if (!strncmp(pos, "DEVPATH=", 8)) {
+            event->devpath = pos + 8;
+        } else if (!strncmp(pos, "SUBSYSTEM=", 10)) {
+            event->subsystem = pos + 10;
+        } else if (!strncmp(pos, "DEVTYPE=", 8)) {
+            event->devtype = pos + 8;
+        }
+        pos += keylen + 1;
+    }
+
+    if ((event->action == NULL) || (event->devpath == NULL)
+            || (event->subsystem == NULL)) {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+/**
+ * Apply a parsed uevent to the bus tree
+ * @param event
+ * @return negative errno on failure, zero if the event was ignored,
+ * else one if the bus tree was modified.
+ */
+static int uevent_apply(const i2c_uevent *event)
+{
+    const char *name = NULL;
+    char *endptr = NULL;
+    int nr = -1;
+    int addr = -1;
+    int err = 0;
+
+    if (strcmp(event->subsystem, "i2c") || (event->devtype == NULL)) {
+        return 0;
+    }
+
+    name = strrchr(event->devpath, '/');
+    name = (name != NULL) ? name + 1 : event->devpath;
+
+    if (!strcmp(event->devtype, "i2c_adapter")) {
+        if (strncmp(name, "i2c-", 4)) {
+            return -EINVAL;
+        }
+        nr = strtol(name + 4, &endptr, 10);
+        if (*endptr != '\0') {
+            return -EINVAL;
+        }
+        if (!strcmp(event->action, "add")) {
+            err = i2c_dev_bus_add_adapter(name);
+        } else if (!strcmp(event->action, "remove")) {
+            err = i2c_dev_bus_remove_adapter(nr);
+        } else {
+            return 0;
+        }
+    } else if (!strcmp(event->devtype, "i2c_client")) {
+        nr = strtol(name, &endptr, 10);
+        if (*endptr != '-') {
+            return -EINVAL;
+        }
+        addr = strtol(endptr + 1, &endptr, 16);
+        if (*endptr != '\0') {
+            return -EINVAL;
+        }
+        if (!strcmp(event->action, "add")) {
+            err = i2c_dev_bus_add_chip(nr, name);
+        } else if (!strcmp(event->action, "remove")) {
+            err = i2c_dev_bus_remove_chip(nr, addr);
+        } else if (!strcmp(event->action, "bind") || !strcmp(event->action, "unbind")) {
+            /* driver and module changed, read the chip again */
+            i2c_dev_bus_remove_chip(nr, addr);
+            err = i2c_dev_bus_add_chip(nr, name);
+        } else {
+            return 0;
+        }
+    } else {
+        return 0;
+    }
+
+    if (err < 0) {
+        devi2c_info(NULL, "failed to apply uevent %s %s - %s",
+                event->action, event->devpath, strerror(-err));
+        return err;
+    }
+    i2cdev_generation++;
+    return 1;
+}
+
+int i2cdev_uevent_monitor_open(void)
+{
+    DEV_SYS_API(DEV_I2C_API_UEVENT);
+    struct sockaddr_nl addr = {
+        .nl_family = AF_NETLINK,
+        .nl_pid = 0,
+        .nl_groups = UEVENT_KERNEL_GROUP,
+    };
+    int rcvbuf = UEVENT_RCVBUF_SIZE;
+    int fd = -1;
+
+    if (uevent_fd >= 0) {
+        return uevent_fd;
+    }
+    if (!check_libi2cdev_ready()) {
+        return -ENODEV;
+    }
+
+    fd = dev_sys_socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+            NETLINK_KOBJECT_UEVENT);
+    if (fd < 0) {
+        return -errno;
+    }
+    /* a hot-plugged line card can emit a burst of events, don't drop them */
+    if (dev_sys_setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) < 0) {
+        dev_sys_setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+    if (dev_sys_bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        int err = -errno;
+        dev_sys_close(fd);
+        return err;
+    }
+    uevent_fd = fd;
+    return uevent_fd;
+}
+
+int i2cdev_uevent_monitor_process(void)
+{
+    DEV_SYS_API(DEV_I2C_API_UEVENT);
+    char buf[UEVENT_BUFFER_SIZE];
+    int count = 0;
+
+    if (uevent_fd < 0) {
+        return -EBADF;
+    }
+    if (get_libi2cdev_state() != LIB_SMB_READY) {
+        return -EBUSY;
+    }
+
+    while (1) {
+        struct sockaddr_nl sender;
+        struct iovec iov = {
+            .iov_base = buf,
+            .iov_len = sizeof(buf) - 1,
+        };
+        struct msghdr msg = {
+            .msg_name = &sender,
+            .msg_namelen = sizeof(sender),
+            .msg_iov = &iov,
+            .msg_iovlen = 1,
+        };
+        i2c_uevent event;
+        ssize_t len = 0;
+        int ret = 0;
+
+        len = TEMP_FAILURE_RETRY(dev_sys_recvmsg(uevent_fd, &msg, 0));
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            } else if (errno == ENOBUFS) {
+                /* events were lost, the tree can only be trusted after a full rescan */
+                devi2c_notice(NULL, "uevent buffer overrun, rescanning i2c bus tree");
+                ret = i2cdev_rescan();
+                if (ret < 0) {
+                    return ret;
+                }
+                count++;
+                continue;
+            }
+            return -errno;
+        }
+        /* only trust messages sent by the kernel */
+        if ((msg.msg_namelen != sizeof(sender)) || (sender.nl_pid != 0)) {
+            continue;
+        }
+        buf[len] = '\0';
+
+        if (uevent_parse(buf, (size_t) len, &event) < 0) {
+            continue;
+        }
+        ret = uevent_apply(&event);
+        if (ret > 0) {
+            count += ret;
+        }
+    }
+    return count;
+}
+
+void i2cdev_uevent_monitor_close(void)
+{
+    DEV_SYS_API(DEV_I2C_API_UEVENT);
+
+    if (uevent_fd >= 0) {
+        dev_sys_close(uevent_fd);
+    }
+    uevent_fd = -1;
+}
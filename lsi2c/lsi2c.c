@@ -42,6 +42,8 @@
 #include <getopt.h>
 #include <stdbool.h>
 
+#include <linux/i2c.h>
+
 #include "busses.h"
 #include "i2c-dev-parser.h"
 #include "smbus-dev.h"
@@ -66,6 +68,8 @@ static void print_long_help(void)
     puts(
             "  -c, --config-file     Specify a config file\n"
             "  -C, --print-config    Display i2c devices in configuration file\n"
+            "  -b, --compile-config[=FILE]\n"
+            "                        Compile the default configuration files\n"
             "  -a, --all             Print all i2c-devs in bus tree\n"
             "  -d, --print-devices   Display sysfs i2c devices\n"
             "  -t, --tree            Print i2c bus and children\n"
@@ -79,7 +83,19 @@ static void print_long_help(void)
             "  -v, --verbose         Be verbose\n"
             "  -i, --initialize      Initialize devices in configuration file\n"
             "  -r, --remove          Remove devices in configuration file\n"
+            "  -j, --jobs=N          Initialize or remove devices on up to N root\n"
+            "                        buses at once, 0 for all of them\n"
             "  -k, --kmod            Try to initialize i2c_dev kernel module\n"
+            "  -s, --syscalls        Count the syscalls of the library and print\n"
+            "                        them per library call at exit\n"
+            "  -o, --record=FILE     Record the transactions made to a trace file\n"
+            "  -y, --replay=FILE     Replay a trace file against a mock of the\n"
+            "                        devices and print a summary\n"
+            "  -e, --chrome-trace=FILE\n"
+            "                        Write the transactions made, or replayed at\n"
+            "                        the recorded pace, in Chrome trace format\n"
+            "  -w, --slow=USEC       Print the transactions made, or replayed at\n"
+            "                        the recorded pace, that took over USEC\n"
             "\n"
             "Use `-' after `-c' to read the config file from stdin.\n");
 }
@@ -175,6 +191,100 @@ static int set_adapter_retries(dev_bus_adapter *adapter, unsigned long retries)
     return err;
 }
 
+static void print_syscall_stats(void)
+{
+    struct dev_i2c_syscall_stats stats;
+    int api = 0;
+    int sys = 0;
+
+    if (dev_i2c_get_syscall_stats(&stats) < 0) {
+        return;
+    }
+    printf("Syscalls by library call:\n");
+    for (api = 0; api < DEV_I2C_API_MAX; ++api) {
+        unsigned long long total = 0;
+
+        for (sys = 0; sys < DEV_I2C_SYS_MAX; ++sys) {
+            total += stats.syscalls[api][sys];
+        }
+        if ((stats.calls[api] == 0) && (total == 0)) {
+            continue;
+        }
+        printf("  %-15s %6llu calls %8llu syscalls", dev_i2c_api_name(api),
+                (unsigned long long) stats.calls[api], total);
+        if (stats.calls[api] > 0) {
+            printf(" (%.1f per call)", (double) total / stats.calls[api]);
+        }
+        printf(":");
+        for (sys = 0; sys < DEV_I2C_SYS_MAX; ++sys) {
+            if (stats.syscalls[api][sys] > 0) {
+                printf(" %s=%llu", dev_i2c_syscall_name(sys),
+                        (unsigned long long) stats.syscalls[api][sys]);
+            }
+        }
+        printf("\n");
+    }
+}
+
+static int replay_trace(const char *file, int flags)
+{
+    struct dev_i2c_replay_stats stats;
+    int err = 0;
+
+    err = dev_i2c_trace_replay(file, NULL, flags, &stats);
+    if (err < 0) {
+        fprintf(stderr, "Failed to replay %s: %s\n", file, strerror(-err));
+        return EXIT_FAILURE;
+    }
+    printf("Replayed %llu transactions, %llu failed, %llu mismatched\n",
+            (unsigned long long) stats.transactions, (unsigned long long) stats.errors,
+            (unsigned long long) stats.mismatches);
+    printf("Recorded: %llu us, %llu us in transactions\n",
+            (unsigned long long) stats.recorded_ns / 1000,
+            (unsigned long long) stats.recorded_latency_ns / 1000);
+    printf("Replay:   %llu us, %llu us in transactions\n",
+            (unsigned long long) stats.elapsed_ns / 1000,
+            (unsigned long long) stats.latency_ns / 1000);
+    return EXIT_SUCCESS;
+}
+
+static void stop_chrome_trace(const char *file)
+{
+    int exported = dev_i2c_trace_export_stop();
+
+    if (exported < 0) {
+        fprintf(stderr, "Failed to write %s: %s\n", file, strerror(-exported));
+    } else if (i2c_dev_verbose) {
+        printf("Wrote %d transactions to %s\n", exported, file);
+    }
+}
+
+static void print_slow_events(void)
+{
+    struct dev_i2c_slow_event events[32];
+    int count = 0;
+
+    printf("Slow transactions:\n");
+    while ((count = dev_i2c_get_slow_events(events, 32)) > 0) {
+        for (int i = 0; i < count; ++i) {
+            const struct dev_i2c_slow_event *ev = &events[i];
+
+            printf("  #%llu %s 0x%02x (%s) %s %s", (unsigned long long) ev->seq, ev->path,
+                    ev->addr, ev->name[0] ? ev->name : "?", dev_i2c_op_name(ev->op),
+                    (ev->read_write == I2C_SMBUS_READ) ? "read" : "write");
+            if (ev->command >= 0) {
+                printf(" cmd 0x%02x", ev->command);
+            }
+            printf(": %llu us, over %llu us", (unsigned long long) ev->latency_ns / 1000,
+                    (unsigned long long) ev->threshold_ns / 1000);
+            if (ev->result < 0) {
+                printf(", %s", strerror(-ev->result));
+            }
+            printf("\n");
+        }
+    }
+}
+
 /* Return 0 on success, and an exit error code otherwise */
 static int read_config_file(const char *config_file_name)
 {
@@ -230,6 +340,12 @@ int main(int argc, char **argv)
     const char *rescan_arg = NULL;
     const char *retry_count_arg = NULL;
     const char *timeout_arg = NULL;
+    const char *jobs_arg = NULL;
+    const char *compile_config_name = NULL;
+    const char *record_file = NULL;
+    const char *replay_file = NULL;
+    const char *chrome_trace_file = NULL;
+    const char *slow_arg = NULL;
 
     bool do_bus_list_all = false;
     bool do_initialize_all_devs = false;
@@ -237,11 +353,13 @@ int main(int argc, char **argv)
     bool do_remove_all_devs = false;
     bool do_print_all_devs = false;
     bool do_print_all_config = false;
+    bool do_compile_config = false;
     bool do_print_funcs = false;
     bool do_probe_address = false;
     bool do_bus_rescan = false;
     bool do_set_retry_count = false;
     bool do_set_timeout = false;
+    bool do_count_syscalls = false;
 
     int dev_count = 0;
     int adapter_count = 0;
@@ -260,8 +378,10 @@ int main(int argc, char **argv)
         { "all", no_argument, NULL, 'a'},
         { "print-devices", no_argument, NULL, 'd'},
         { "print-config", no_argument, NULL, 'C'},
+        { "compile-config", optional_argument, NULL, 'b'},
         { "initialize", no_argument, NULL, 'i'},
         { "remove", no_argument, NULL, 'r'},
+        { "jobs", required_argument, NULL, 'j'},
         { "kmod", no_argument, NULL, 'k'},
         { "config-file", required_argument, NULL, 'c' },
         { "timeout", required_argument, NULL, 'T' },
@@ -270,11 +390,16 @@ int main(int argc, char **argv)
         { "path", required_argument, NULL, 'p' },
         { "probe", required_argument, NULL, 'P' },
         { "rescan", optional_argument, NULL, 'R' },
+        { "syscalls", no_argument, NULL, 's' },
+        { "record", required_argument, NULL, 'o' },
+        { "replay", required_argument, NULL, 'y' },
+        { "chrome-trace", required_argument, NULL, 'e' },
+        { "slow", required_argument, NULL, 'w' },
         { NULL, 0, NULL, 0 }
     };
 
     while (1) {
-        c = getopt_long(argc, argv, "adhCVvtrikFc:p:P:R:S:T:", long_opts, &index_cnt);
+        c = getopt_long(argc, argv, "adhCVvtriksFb::c:e:j:o:p:P:R:S:T:w:y:", long_opts, &index_cnt);
         if (c == EOF) {
             break;
         }
@@ -332,6 +457,10 @@ int main(int argc, char **argv)
         case 'C':
             do_print_all_config = true;
             break;
+        case 'b':
+            compile_config_name = optarg;
+            do_compile_config = true;
+            break;
         case 'd':
             do_print_all_devs = true;
             break;
@@ -344,12 +473,33 @@ int main(int argc, char **argv)
         case 'k':
             do_initialize_i2c_dev_kmod = true;
             break;
+        case 's':
+            do_count_syscalls = true;
+            dev_i2c_set_syscall_counting(1);
+            break;
+        case 'o':
+            record_file = optarg;
+            break;
+        case 'y':
+            replay_file = optarg;
+            break;
+        case 'e':
+            chrome_trace_file = optarg;
+            break;
+        case 'w':
+            slow_arg = optarg;
+            dev_i2c_set_default_slow_threshold(strtoull(slow_arg, NULL, 0) * 1000);
+            break;
         case 't':
             opt_tree = 1;
             break;
         case 'i':
             do_initialize_all_devs = true;
             break;
+        case 'j':
+            jobs_arg = optarg;
+            i2cdev_set_instantiate_threads(strtol(jobs_arg, NULL, 0));
+            break;
         default:
             fprintf(stderr,
                 "Internal error while parsing options!\n");
@@ -367,11 +517,50 @@ int main(int argc, char **argv)
         printf("Searching for i2c devices\n");
     }
 
+    if (chrome_trace_file != NULL) {
+        err = dev_i2c_trace_export_start(chrome_trace_file);
+        if (err < 0) {
+            fprintf(stderr, "Failed to write %s: %s\n", chrome_trace_file, strerror(-err));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* a trace replays without the devices, or even the buses */
+    if (replay_file != NULL) {
+        err = replay_trace(replay_file,
+                ((chrome_trace_file != NULL) || (slow_arg != NULL)) ? DEV_I2C_REPLAY_REALTIME : 0);
+        if (chrome_trace_file != NULL) {
+            stop_chrome_trace(chrome_trace_file);
+        }
+        if (slow_arg != NULL) {
+            print_slow_events();
+        }
+        if (do_count_syscalls) {
+            print_syscall_stats();
+        }
+        exit(err);
+    }
+
     err = read_config_file(config_file_name);
     if (err) {
+        if (chrome_trace_file != NULL) {
+            stop_chrome_trace(chrome_trace_file);
+        }
         exit(err);
     }
 
+    if (record_file != NULL) {
+        err = dev_i2c_trace_record_start(record_file);
+        if (err < 0) {
+            fprintf(stderr, "Failed to record to %s: %s\n", record_file, strerror(-err));
+            if (chrome_trace_file != NULL) {
+                stop_chrome_trace(chrome_trace_file);
+            }
+            i2cdev_cleanup();
+            exit(EXIT_FAILURE);
+        }
+    }
+
     if (do_initialize_i2c_dev_kmod) {
         err = try_load_i2c_dev_mod();
         if (err == 0) {
@@ -386,6 +575,14 @@ int main(int argc, char **argv)
         goto done;
     }
 
+    if (do_compile_config) {
+        err = i2cdev_compile_config(compile_config_name);
+        if (err < 0) {
+            fprintf(stderr, "Failed to compile config: %s\n", strerror(-err));
+        }
+        goto done;
+    }
+
     if (do_remove_all_devs) {
         err = remove_all_config_chips();
         goto done;
@@ -479,8 +676,30 @@ done:
         }
     }
 
+    if (record_file != NULL) {
+        int recorded = dev_i2c_trace_record_stop();
+
+        if (recorded < 0) {
+            fprintf(stderr, "Failed to record to %s: %s\n", record_file, strerror(-recorded));
+        } else if (i2c_dev_verbose) {
+            printf("Recorded %d transactions to %s\n", recorded, record_file);
+        }
+    }
+
+    if (chrome_trace_file != NULL) {
+        stop_chrome_trace(chrome_trace_file);
+    }
+
     i2cdev_cleanup();
 
+    if (slow_arg != NULL) {
+        print_slow_events();
+    }
+
+    if (do_count_syscalls) {
+        print_syscall_stats();
+    }
+
     if (err < 0) {
         fprintf(stderr, "lsi2c exited with error: %s", strerror(-err));
         exit(EXIT_FAILURE);
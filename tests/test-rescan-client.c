@@ -0,0 +1,101 @@
+/**
+ * @file test-rescan-client.c
+ * @copyright Violin Memory, Inc, 2014
+ *
+ * @brief A client registered on an adapter that a rescan removes must be
+ * registered again when it is opened after the adapter comes back, and
+ * dev_i2c_delete() must not touch the node freed with the old adapter.
+ *
+ * There is no /dev/i2c-N for the synthetic tree, so opening the client
+ * fails after its adapter was looked up and the client registered on it,
+ * which is all this needs.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include <libi2cdev.h>
+
+#include "fakesys.h"
+
+#define TEST_ROOTS  2
+
+static int test_remove_adapter(int nr)
+{
+    char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/bus/i2c/devices/i2c-%d", BENCH_SYSFS, nr);
+    if (unlink(path) < 0) {
+        return -1;
+    }
+    snprintf(path, sizeof(path), "%s/devices/platform/ctrl%d", BENCH_SYSFS, nr);
+    bench_fakesys_remove(path);
+    return 0;
+}
+
+int main(void)
+{
+    struct dev_i2c_board_info info = { DEV_I2C_BOARD_INFO_PATH("at24", 0x50, "1") };
+    SMBusDevice *client = NULL;
+    int adapters = 0;
+    int err = 0;
+
+    adapters = bench_fakesys_create(BENCH_SYSFS, TEST_ROOTS, 0, 1, 2);
+    if (adapters != TEST_ROOTS) {
+        fprintf(stderr, "Failed to build %s\n", BENCH_SYSFS);
+        return EXIT_FAILURE;
+    }
+    i2cdev_set_snapshot_file(NULL);
+    if (i2cdev_init(NULL) != 0) {
+        fprintf(stderr, "i2cdev_init() failed\n");
+        goto exit_fail;
+    }
+    client = dev_i2c_new_device(&info);
+    if (client == NULL) {
+        fprintf(stderr, "dev_i2c_new_device() failed\n");
+        goto exit_fail;
+    }
+    dev_i2c_open(client);
+    if (client->adapter == NULL) {
+        fprintf(stderr, "client not registered on i2c-1\n");
+        goto exit_fail;
+    }
+
+    /* the rescan frees the adapter and the client's node on it */
+    if ((test_remove_adapter(1) < 0) || (i2cdev_rescan() < 0)) {
+        fprintf(stderr, "Failed to remove i2c-1\n");
+        goto exit_fail;
+    }
+    if (client->adapter != NULL) {
+        fprintf(stderr, "client still on the removed adapter\n");
+        goto exit_fail;
+    }
+
+    /* put it back and open the client on the new adapter */
+    if ((bench_fakesys_create(BENCH_SYSFS, TEST_ROOTS, 0, 1, 2) != TEST_ROOTS)
+            || (i2cdev_rescan() < 0)) {
+        fprintf(stderr, "Failed to add i2c-1 back\n");
+        goto exit_fail;
+    }
+    dev_i2c_open(client);
+    if (client->adapter == NULL) {
+        fprintf(stderr, "client not registered on the new i2c-1\n");
+        goto exit_fail;
+    }
+    dev_i2c_delete(client);
+    client = NULL;
+
+    i2cdev_cleanup();
+    bench_fakesys_remove(BENCH_SYSFS);
+    return EXIT_SUCCESS;
+
+exit_fail:
+    err = EXIT_FAILURE;
+    dev_i2c_delete(client);
+    i2cdev_cleanup();
+    bench_fakesys_remove(BENCH_SYSFS);
+    return err;
+}